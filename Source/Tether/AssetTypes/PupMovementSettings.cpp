@@ -0,0 +1,76 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupMovementSettings.h"
+
+
+UPupMovementSettings::UPupMovementSettings()
+{
+	MovementLODTiers = MakeDefaultMovementLODTiers();
+}
+
+
+TArray<FPupMovementLODTier> UPupMovementSettings::MakeDefaultMovementLODTiers()
+{
+	TArray<FPupMovementLODTier> Tiers;
+	Tiers.AddDefaulted();
+
+	FPupMovementLODTier& Reduced = Tiers.AddDefaulted_GetRef();
+	Reduced.MinDistance = 2500.0f;
+	Reduced.bWhenOffScreen = true;
+	Reduced.StepInterval = 2;
+	Reduced.bProbeLedges = false;
+	Reduced.bLineTraceFloor = true;
+
+	FPupMovementLODTier& Distant = Tiers.AddDefaulted_GetRef();
+	Distant.MinDistance = 6000.0f;
+	Distant.StepInterval = 4;
+	Distant.bProbeLedges = false;
+	Distant.bLineTraceFloor = true;
+	return Tiers;
+}
+
+
+void UPupMovementSettings::PostInitProperties()
+{
+	Super::PostInitProperties();
+	UpdateDerivedValues();
+}
+
+
+void UPupMovementSettings::PostLoad()
+{
+	Super::PostLoad();
+	UpdateDerivedValues();
+}
+
+
+#if WITH_EDITOR
+void UPupMovementSettings::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+{
+	Super::PostEditChangeProperty(PropertyChangedEvent);
+	UpdateDerivedValues();
+}
+#endif
+
+
+void UPupMovementSettings::UpdateDerivedValues()
+{
+	MaxInclineZComponent = FMath::Cos(FMath::DegreesToRadians(MaxIncline));
+	HoldJumpAcceleration = MaxJumpTime <= 0.0f ? 0.0f : (ApexVelocity - JumpInitialVelocity) / MaxJumpTime;
+
+	KernelParams.MaxSpeed = MaxSpeed;
+	KernelParams.MaxAcceleration = MaxAcceleration;
+	KernelParams.BreakingFriction = BreakingFriction;
+	KernelParams.DashSpeed = DashSpeed;
+	KernelParams.AirControlFactor = AirControlFactor;
+	KernelParams.TerminalVelocity = TerminalVelocity;
+	KernelParams.HoldJumpAcceleration = HoldJumpAcceleration;
+	KernelParams.ApexVelocity = ApexVelocity;
+	KernelParams.DeflectionFriction = DeflectionFriction;
+	KernelParams.DeflectionControlInfluence = DeflectionControlInfluence;
+	KernelParams.DragSpeed = DragSpeed;
+	KernelParams.RotationSpeed = RotationSpeed;
+	KernelParams.SnapRotationVelocity = SnapRotationVelocity;
+	KernelParams.SlipFactor = SlipFactor;
+	KernelParams.bSlip = bSlip;
+}
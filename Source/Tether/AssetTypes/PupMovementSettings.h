@@ -0,0 +1,311 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "Engine/DataAsset.h"
+#include "Tether/Character/MovementComponent/PupMovementKernel.h"
+
+#include "PupMovementSettings.generated.h"
+
+
+/** How much of the movement simulation a pup runs, for pups nobody is looking at closely **/
+USTRUCT(BlueprintType)
+struct TETHER_API FPupMovementLODTier
+{
+	GENERATED_BODY()
+
+	/** Pups at least this far from every viewer can use this tier **/
+	UPROPERTY(EditAnywhere, Category = "LOD", meta = (ClampMin = 0.0f))
+	float MinDistance = 0.0f;
+
+	/** Can pups that haven't been rendered recently use this tier, however close they are? **/
+	UPROPERTY(EditAnywhere, Category = "LOD")
+	bool bWhenOffScreen = false;
+
+	/** Simulate one long step in place of this many fixed steps **/
+	UPROPERTY(EditAnywhere, Category = "LOD", meta = (ClampMin = 1))
+	int32 StepInterval = 1;
+
+	/** Look for ledges to mantle and slide along? **/
+	UPROPERTY(EditAnywhere, Category = "LOD")
+	bool bProbeLedges = true;
+
+	/** Find the floor with a single line trace down the middle of the capsule, instead of capsule sweeps **/
+	UPROPERTY(EditAnywhere, Category = "LOD")
+	bool bLineTraceFloor = false;
+};
+
+
+/**
+ * Movement tuning for pups, shared by every pup movement component that points at the same asset.
+ * Read only at runtime, so editing an asset retunes every pup using it at once.
+ **/
+UCLASS(BlueprintType, HideCategories = "Object")
+class TETHER_API UPupMovementSettings : public UDataAsset
+{
+	GENERATED_BODY()
+
+public:
+	UPupMovementSettings();
+
+	virtual void PostInitProperties() override;
+
+	virtual void PostLoad() override;
+
+#if WITH_EDITOR
+	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
+#endif
+
+	/** The movement kernel's tuning values, without gravity, which comes from the world. **/
+	const FPupMovementKernelParams& GetKernelParams() const { return KernelParams; }
+
+	/** Full detail up close, then fewer steps and cheaper queries for pups that are far away or out of sight **/
+	static TArray<FPupMovementLODTier> MakeDefaultMovementLODTiers();
+
+	/** Recalculate every derived value from the edited ones. Needed after changing tuning outside of the editor. **/
+	void UpdateDerivedValues();
+
+
+	/* ========================== SPEED PROPERTIES ========================== */
+	/**
+	 * The maximum running velocity the player can achieve by running.
+	 * External forces can accelerate the player further, but they will be unable
+	 * to maintain that speed.
+	 * To control the absolute maximum velocity, see: 'TerminalVelocity'
+	 **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Speed", meta = (ClampMin = 0.0f))
+	float MaxSpeed = 250.0f;
+
+	/** How quickly the player gains speed (in units/s2) when the control stick is pushed all the way. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Speed", meta = (ClampMin = 0.0f))
+	float MaxAcceleration = 1500.0f;
+
+	/** How quickly the player stops (in units/s2) when the control stick is released. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Speed|Friction", meta = (ClampMin = 0.0f))
+	float BreakingFriction = 3000.0f;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Speed|Dash")
+	float DashSpeed = 800.0f;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Speed|Dash")
+	float DashTime = 0.2f;
+
+	/** How long a dash pressed while the player can't dash is held on to, and done as soon as they can. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Speed|Dash", meta = (ClampMin = 0.0f))
+	float DashBufferTime = 0.1f;
+
+
+
+	/* ========================== ROTATION PROPERTIES ========================== */
+	/** The absolute maximum velocity the player can go in any movement state. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f))
+	float TerminalVelocity = 1000.0f;
+
+	/** How fast (in degrees/s) the player turns to face the direction of the input. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Rotation", meta = (ClampMin = 0.0f))
+	float RotationSpeed = 1000.0f;
+
+	/** Will the player rotate slower as they move faster? Simulates decreased static friction when running. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Rotation|Slip")
+	bool bSlip = true;
+
+	/**
+	 * How much the player's rotation speed should be multiplied by when moving fast.
+	 * Scales linearly with velocity - if this value is 0 and the player is moving at
+	 * their maximum speed, they will be unable to turn.
+	 * If at 1, the player will turn at the same speed regardless of how fast they
+	 * are moving across the floor.
+	 **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Rotation|Slip", meta = (ClampMin = 0.0f, ClampMax = 1.0f, EditCondition = "bSlip"))
+	float SlipFactor = 0.5f;
+
+
+
+	/* ========================== JUMPING PROPERTIES ========================== */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Jumping|Floor", meta = (ClampMin = 0.0f))
+	float FloorSnapDistance = 5.0f;
+
+	/** The initial velocity (in units/s) applied as an impulse, when jumping **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f))
+	float JumpInitialVelocity = 200.0f;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f))
+	float ApexVelocity = 500.0f;
+
+	/**
+	 * How much the player accelerates (in units/s2) when the jump is held, after the initial velocity is applied.
+	 * Derived from the ApexVelocity, JumpInitialVelocity and MaxJumpTime values.
+	 **/
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Jumping")
+	float HoldJumpAcceleration = 0.0f;
+
+	/** The maximum time the Jump can be held for, in seconds. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f))
+	float MaxJumpTime = 0.4f;
+
+	/**
+	 * How long after falling (in seconds) can the player still jump? Setting this value to 0
+	 * will prevent the player from jumping at all immediately after leaving the floor.
+	 * Recommended to set this value to compensate for player reaction time and other
+	 * sources of latency.
+	 **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f))
+	float CoyoteTime = 0.25f;
+
+	/**
+	 * How long a jump pressed while the player can't jump is held on to, and done as soon as they can, e.g.
+	 * pressing jump just before landing. If the button is let go first, the jump is only a hop.
+	 **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f))
+	float JumpBufferTime = 0.1f;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f, ClampMax = 1.0f))
+	float AirControlFactor = 0.8f;
+
+	/**
+	 * Does the character move forward along the direction is facing?
+	 * If true, the character accelerates only forwards and rotates to accomodate the direction of input.
+	 * If false, the acceleration will be applied regardless of the player's rotation, and they will
+	 * begin to rotate in that direction.
+	 **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Jumping")
+	bool bTurnFirst = false;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Jumping|Double Jump")
+	bool bDoubleJump = true;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Jumping|Double Jump", meta = (ClampMin = 0.0f, ClampMax = 1.0f, EditCondition = "bDoubleJump"))
+	float DoubleJumpAccelerationFactor = 0.25f;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Jumping|Wall Jump")
+	float WallJumpDisableTime = 0.2f;
+
+
+
+	/* ========================== ANCHORING PROPERTIES ========================== */
+	/** How close a wall must be to the player before they can grab on to it. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Anchored|Mantling", meta = (ClampMin = 0.0f))
+	float GrabRangeForward = 20.0f;
+
+	/** How far above the eye location the player can grab onto a ledge. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Anchored|Mantling", meta = (ClampMin = 0.0f))
+	float GrabRangeTop = 10.0f;
+
+	/** How far below the eye location the player can grab onto a ledge. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Anchored|Mantling", meta = (ClampMin = 0.0f))
+	float GrabRangeBottom = 10.0f;
+
+	/**
+	 * How fast the player must be falling before they can grab onto the ledge.
+	 * The apex of the height is 0.0 (unit/s).
+	 * A negative value will allow the player to grab onto a ledge, even
+	 * if they are still moving upward.
+	 **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Anchored|Mantling")
+	float MaximumGrabVelocity = -100.0f;
+
+	/**
+	 * How far the ledge can deviate from a perfectly 'level' floor.
+	 * At 1.0f, the ledge must be completely level, and at 0.0f
+	 * the ledge could be vertical.
+	 * This value is recommended to be somewhere between 0.5f and 0.95f
+	 * to account for errors in floating point arithmetic.
+	 **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Anchored|Mantling", meta = (ClampMin = 0.0f, ClampMax = 1.0f))
+	float LedgeDeviation = 0.9f;
+
+	/** How quickly the player should move to their anchor, in units/s **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Anchored", meta = (ClampMin = 0.0f))
+	float SnapVelocity = 150.0f;
+
+	/** How quickly the player should rotate to face their anchor, in degrees/s **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Anchored", meta = (ClampMin = 0.0f))
+	float SnapRotationVelocity = 360.0f;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Anchored|Wall Slide|Scramble")
+	float WallScrambleTime = 0.4f;
+
+
+
+	/* ========================== PLANAR PROPERTIES ========================== */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Planar", meta = (ClampMin = 0.0f, ClampMax = 90.0f))
+	float MaxIncline = 60.0f;
+
+	/**
+	 * The smallest value the Z component of a pup's FloorNormal can be,
+	 * before it will no longer be considered a valid floor and the
+	 * player will instead begin to slide down it.
+	 * Derived from MaxIncline.
+	 **/
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Planar")
+	float MaxInclineZComponent = 0.5f;
+
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "Planar", Meta = (ClampMin = 0.0f, ClampMax = 1.0f))
+	float MaxWallDeviation = 0.2f;
+
+
+
+	/* ========================== DEFLECTION PROPERTIES ========================== */
+	/** The deceleration of the player when being set to the Deflected state by another object **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Deflections", meta = (ClampMin = 0.0f))
+	float DeflectionFriction = 800.0f;
+
+	/** Factor representing how much the player can still be controlled when Deflected **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Deflections", meta = (ClampMin = 0.0f, ClampMax = 1.0f))
+	float DeflectionControlInfluence = 0.2f;
+
+	/** If the player can regain control of the character early, by cancelling the velocity in the direction **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Deflections")
+	bool bCanRegainControl = true;
+
+	/** Can the player jump, even if they are being Deflected? Player must still be on a valid floor. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Deflections")
+	bool bCanJumpWhileDeflected = true;
+
+
+
+	/* ========================== RECOVERY PROPERTIES ========================== */
+	/** How long it takes the player to return to the stage after falling. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Recovery", meta = (ClampMin = 0.0f))
+	float RecoveryTime = 1.0f;
+
+	/** Should the player be able to pass through any/all objects when recovering? **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Recovery")
+	bool bIgnoreObstaclesWhenRecovering = true;
+
+	/** The height offset added to a pup's LastValidLocation when recovering. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Recovery")
+	float RecoveryLevitationHeight = 100.0f;
+
+	/** How far away from the edge we should be to consider a location 'safe' **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Recovery", meta = (ClampMin = 0.0f))
+	float MinimumSafeRadius = 100.0f;
+
+
+
+	/* ========================== DRAGGING PROPERTIES ========================== */
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Dragging")
+	bool bDragOnlyWhenGrounded = true;
+
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Dragging")
+	float DragSpeed = 100.0f;
+
+
+
+	/* ========================== LOD PROPERTIES ========================== */
+	/**
+	 * Movement detail for pups no player controls, from full detail to the cheapest.
+	 * The last tier a pup qualifies for is used.
+	 **/
+	UPROPERTY(EditAnywhere, Category = "LOD")
+	TArray<FPupMovementLODTier> MovementLODTiers;
+
+	/** How long a pup stays at full detail after being hit, pushed or deflected **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "LOD", meta = (ClampMin = 0.0f))
+	float MovementLODPromotionTime = 2.0f;
+
+private:
+	FPupMovementKernelParams KernelParams;
+};
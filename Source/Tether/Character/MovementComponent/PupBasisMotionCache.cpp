@@ -0,0 +1,55 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupBasisMotionCache.h"
+
+#include "Tether/Core/SurfaceVelocity.h"
+
+
+static FVector ReadSurfaceVelocity(const UObject* SurfaceVelocitySource)
+{
+	return SurfaceVelocitySource ? ISurfaceVelocity::Execute_GetSurfaceVelocity(SurfaceVelocitySource) : FVector::ZeroVector;
+}
+
+
+FPupBasisMotion::FPupBasisMotion(const UPrimitiveComponent* Basis, const UObject* SurfaceVelocitySource)
+{
+	const FTransform& Transform = Basis->GetComponentTransform();
+	Location = Transform.GetLocation();
+	Quat = Transform.GetRotation();
+	Rotation = Basis->GetComponentRotation();
+	SurfaceVelocity = ReadSurfaceVelocity(SurfaceVelocitySource);
+	Frame = GFrameCounter;
+}
+
+
+const FPupBasisMotion& FPupBasisMotionCache::Get(const UPrimitiveComponent* Basis, const UObject* SurfaceVelocitySource)
+{
+	check(Basis);
+	FPupBasisMotion& Motion = Entries.FindOrAdd(Basis);
+
+	// A basis can move at any point in the frame, e.g. a platform that ticks after some of the pups on it, so
+	// compare against its transform instead of trusting the frame. Reading the transform is cheap, the rotator isn't.
+	const FTransform& Transform = Basis->GetComponentTransform();
+	if (Motion.Frame == 0 || Motion.Location != Transform.GetLocation() || !(Motion.Quat == Transform.GetRotation()))
+	{
+		Motion = FPupBasisMotion(Basis, SurfaceVelocitySource);
+	}
+	else if (Motion.Frame != GFrameCounter)
+	{
+		Motion.SurfaceVelocity = ReadSurfaceVelocity(SurfaceVelocitySource);
+		Motion.Frame = GFrameCounter;
+	}
+	return Motion;
+}
+
+
+void FPupBasisMotionCache::Prune(const uint64 MaxIdleFrames)
+{
+	for (auto Iterator = Entries.CreateIterator(); Iterator; ++Iterator)
+	{
+		if (!Iterator.Key().IsValid() || GFrameCounter - Iterator.Value().Frame > MaxIdleFrames)
+		{
+			Iterator.RemoveCurrent();
+		}
+	}
+}
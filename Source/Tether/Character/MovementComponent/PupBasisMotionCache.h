@@ -0,0 +1,61 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/** Where a movable basis is, read once each time it moves and shared by every pup standing on it **/
+struct FPupBasisMotion
+{
+	FPupBasisMotion() = default;
+	FPupBasisMotion(const UPrimitiveComponent* Basis, const UObject* SurfaceVelocitySource);
+
+	FVector Location = FVector::ZeroVector;
+	FQuat Quat = FQuat::Identity;
+	FRotator Rotation = FRotator::ZeroRotator;
+
+	/** Extra velocity the basis gives anything standing on it, like a conveyor belt. See ISurfaceVelocity. **/
+	FVector SurfaceVelocity = FVector::ZeroVector;
+
+	/** The last frame a pup asked about the basis, which is also when the surface velocity was last read **/
+	uint64 Frame = 0;
+
+	/** Turn a position relative to the basis, ignoring scale, into world space **/
+	FVector TransformPosition(const FVector& LocalPosition) const { return Location + Quat.RotateVector(LocalPosition); }
+
+	/** Turn a world space position into one relative to the basis, ignoring scale **/
+	FVector InverseTransformPosition(const FVector& WorldPosition) const { return Quat.UnrotateVector(WorldPosition - Location); }
+
+	/** Is the basis still exactly where it was when a pup last recorded its position relative to it? **/
+	bool IsAt(const FVector& RecordedLocation, const FRotator& RecordedRotation) const
+	{
+		return Location == RecordedLocation && Rotation == RecordedRotation;
+	}
+};
+
+
+/**
+ * The motion of every movable basis pups are standing on, read again only when the basis has moved.
+ * Holds weak pointers, so bases that are destroyed are simply forgotten the next time the cache is pruned.
+ **/
+class TETHER_API FPupBasisMotionCache
+{
+public:
+	/**
+	 * The motion of Basis right now. Read from the component when its transform no longer matches the cached one,
+	 * so a basis that moves after some of its pups have stepped this frame is still seen where it is.
+	 * @param SurfaceVelocitySource		What gives Basis its surface velocity, if anything. Read once per frame.
+	 **/
+	const FPupBasisMotion& Get(const UPrimitiveComponent* Basis, const UObject* SurfaceVelocitySource);
+
+	/** Forget bases that no pup has asked about for a while, or that no longer exist **/
+	void Prune(const uint64 MaxIdleFrames);
+
+	void Reset() { Entries.Reset(); }
+
+	int32 Num() const { return Entries.Num(); }
+
+private:
+	TMap<TWeakObjectPtr<const UPrimitiveComponent>, FPupBasisMotion> Entries;
+};
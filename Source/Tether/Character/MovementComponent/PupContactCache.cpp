@@ -0,0 +1,211 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupContactCache.h"
+
+#include "PupMovementStats.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Components/ShapeComponent.h"
+#include "PhysicsEngine/BodySetup.h"
+
+
+FPupContactQuery FPupContactQuery::Line(const FVector& Start, const FVector& End)
+{
+	FPupContactQuery Query;
+	Query.Start = Start;
+	Query.End = End;
+	return Query;
+}
+
+
+FPupContactQuery FPupContactQuery::Capsule(const FVector& Start, const FVector& End, const FCollisionShape& Shape)
+{
+	FPupContactQuery Query;
+	Query.Start = Start;
+	Query.End = End;
+	Query.Radius = Shape.GetCapsuleRadius();
+	Query.HalfHeight = Shape.GetCapsuleHalfHeight();
+	return Query;
+}
+
+
+FBox FPupContactQuery::GetBounds() const
+{
+	const FVector Extent(Radius, Radius, FMath::Max(Radius, HalfHeight));
+	return FBox(Start.ComponentMin(End) - Extent, Start.ComponentMax(End) + Extent);
+}
+
+
+float FPupContactQuery::GetSupport(const FVector& Normal) const
+{
+	// Capsules are always upright, so only the vertical part of the normal reaches along the capsule's segment
+	return Radius + FMath::Max(HalfHeight - Radius, 0.0f) * FMath::Abs(Normal.Z);
+}
+
+
+void FPupContactCache::Gather(const UWorld* World, const UPrimitiveComponent* Capsule, const float Inflation,
+	const FCollisionQueryParams& QueryParams)
+{
+	Reset();
+	if (!World || !Capsule)
+	{
+		return;
+	}
+
+	const FCollisionShape CapsuleShape = Capsule->GetCollisionShape();
+	const FVector Extent = FVector(CapsuleShape.GetCapsuleRadius(), CapsuleShape.GetCapsuleRadius(), CapsuleShape.GetCapsuleHalfHeight()) +
+		FVector(Inflation);
+	Origin = Capsule->GetComponentLocation();
+	Region = FBox(Origin - Extent, Origin + Extent);
+
+	if (FrameStats)
+	{
+		FrameStats->AddQuery(EPupMovementQuery::Overlap);
+	}
+	World->OverlapMultiByChannel(OverlapResults, Origin, FQuat::Identity, ECC_Pawn, FCollisionShape::MakeBox(Extent), QueryParams);
+	for (const FOverlapResult& Overlap : OverlapResults)
+	{
+		UPrimitiveComponent* Component = Overlap.GetComponent();
+		if (!Overlap.bBlockingHit || !Component || FindContact(Component))
+		{
+			continue;
+		}
+
+		FPupContact& Contact = Contacts.AddDefaulted_GetRef();
+		Contact.Component = Component;
+		Contact.Bounds = Component->Bounds.GetBox();
+	}
+	OverlapResults.Reset();
+	bGathered = true;
+}
+
+
+void FPupContactCache::Reset()
+{
+	Contacts.Reset();
+	bGathered = false;
+}
+
+
+bool FPupContactCache::MayHit(const FPupContactQuery& Query, const TArray<AActor*>& IgnoredActors,
+	const UPrimitiveComponent* OnlyComponent) const
+{
+	if (!bGathered)
+	{
+		return CountResult(true);
+	}
+
+	const FBox QueryBounds = Query.GetBounds();
+	if (OnlyComponent)
+	{
+		// Component queries ignore channels, so the component has to be one we know about
+		const FPupContact* Contact = FindContact(OnlyComponent);
+		return CountResult(!Contact || (Contact->Bounds.Intersect(QueryBounds) && !IsSeparated(*Contact, Query)));
+	}
+
+	if (!Region.IsInside(QueryBounds))
+	{
+		return CountResult(true);
+	}
+
+	for (const FPupContact& Contact : Contacts)
+	{
+		if (!Contact.Bounds.Intersect(QueryBounds) || IgnoredActors.Contains(Contact.Component->GetOwner()))
+		{
+			continue;
+		}
+
+		if (!IsSeparated(Contact, Query))
+		{
+			return CountResult(true);
+		}
+	}
+	return CountResult(false);
+}
+
+
+bool FPupContactCache::FindClosestPoint(const UPrimitiveComponent* Component, const FVector& Location,
+	FVector& OutClosestPoint, FVector* OutNormal) const
+{
+	const FPupContact* Contact = FindContact(Component);
+	if (!Contact || !Location.Equals(Origin))
+	{
+		return false;
+	}
+
+	UpdateClosestPoint(*Contact);
+	if (!Contact->bHasClosestPoint)
+	{
+		return false;
+	}
+
+	OutClosestPoint = Contact->ClosestPoint;
+	if (OutNormal)
+	{
+		*OutNormal = Contact->ClosestNormal;
+	}
+	return true;
+}
+
+
+const FPupContact* FPupContactCache::FindContact(const UPrimitiveComponent* Component) const
+{
+	return Contacts.FindByPredicate([Component](const FPupContact& Contact)
+	{
+		return Contact.Component == Component;
+	});
+}
+
+
+void FPupContactCache::UpdateClosestPoint(const FPupContact& Contact) const
+{
+	if (Contact.bHasClosestPoint)
+	{
+		return;
+	}
+
+	if (FrameStats)
+	{
+		FrameStats->AddQuery(EPupMovementQuery::ClosestPoint);
+	}
+	const float Distance = Contact.Component->GetClosestPointOnCollision(Origin, Contact.ClosestPoint);
+	if (Distance <= KINDA_SMALL_NUMBER)
+	{
+		// Either the query failed, or the origin is inside the component
+		return;
+	}
+
+	Contact.ClosestNormal = (Origin - Contact.ClosestPoint) / Distance;
+	Contact.bHasClosestPoint = true;
+
+	// The closest point only gives a separating plane when the whole component is one convex shape
+	const UBodySetup* BodySetup = Contact.Component->GetBodySetup();
+	const bool bSingleBody = Contact.Component->IsA<UShapeComponent>() ||
+		(Contact.Component->IsA<UStaticMeshComponent>() && !Contact.Component->IsA<UInstancedStaticMeshComponent>());
+	Contact.bHasSeparatingPlane = bSingleBody && BodySetup && BodySetup->AggGeom.GetElementCount() == 1 &&
+		BodySetup->CollisionTraceFlag != CTF_UseComplexAsSimple;
+}
+
+
+bool FPupContactCache::IsSeparated(const FPupContact& Contact, const FPupContactQuery& Query) const
+{
+	UpdateClosestPoint(Contact);
+	if (!Contact.bHasSeparatingPlane)
+	{
+		return false;
+	}
+
+	// The swept shape misses if every point of it stays in front of the plane
+	const float StartDistance = FVector::DotProduct(Query.Start - Contact.ClosestPoint, Contact.ClosestNormal);
+	const float EndDistance = FVector::DotProduct(Query.End - Contact.ClosestPoint, Contact.ClosestNormal);
+	return FMath::Min(StartDistance, EndDistance) - Query.GetSupport(Contact.ClosestNormal) > KINDA_SMALL_NUMBER;
+}
+
+
+bool FPupContactCache::CountResult(const bool bMayHit) const
+{
+	if (FrameStats)
+	{
+		FrameStats->AddContactCacheResult(bMayHit);
+	}
+	return bMayHit;
+}
@@ -0,0 +1,97 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WorldCollision.h"
+
+struct FPupMovementFrameStats;
+
+
+/** A line or upright capsule moving from Start to End, described well enough to test against cached contacts **/
+struct FPupContactQuery
+{
+	FVector Start = FVector::ZeroVector;
+	FVector End = FVector::ZeroVector;
+	float Radius = 0.0f;
+	float HalfHeight = 0.0f;
+
+	static FPupContactQuery Line(const FVector& Start, const FVector& End);
+	static FPupContactQuery Capsule(const FVector& Start, const FVector& End, const FCollisionShape& Shape);
+
+	FBox GetBounds() const;
+
+	/** How far the swept shape reaches from its path in the direction opposite to Normal **/
+	float GetSupport(const FVector& Normal) const;
+};
+
+
+/** A blocking primitive near the player at the start of a movement step **/
+struct FPupContact
+{
+	UPrimitiveComponent* Component = nullptr;
+	FBox Bounds = FBox(ForceInit);
+
+	/** Closest point on the component to the cache origin, found the first time it is needed **/
+	mutable FVector ClosestPoint = FVector::ZeroVector;
+	mutable FVector ClosestNormal = FVector::ZeroVector;
+	mutable bool bHasClosestPoint = false;
+
+	/** Does the plane through ClosestPoint separate the whole component from the origin? Only true for single convex shapes. **/
+	mutable bool bHasSeparatingPlane = false;
+};
+
+
+/**
+ * Every blocking primitive around the player, gathered with a single overlap at the start of a movement step.
+ * Lets movement routines skip physics queries that can't possibly hit anything.
+ * Holds raw component pointers, so it must be reset before the step ends.
+ **/
+class TETHER_API FPupContactCache
+{
+public:
+	/** Gather every primitive that blocks pawns within Inflation of the capsule **/
+	void Gather(const UWorld* World, const UPrimitiveComponent* Capsule, const float Inflation, const FCollisionQueryParams& QueryParams);
+
+	void Reset();
+
+	bool IsGathered() const { return bGathered; }
+
+	/**
+	 * Could a query hit anything? Returns true whenever the cache can't rule it out, including queries that leave the gathered region.
+	 * @param OnlyComponent		If set, only consider hits against this component, as with LineTraceComponent
+	 **/
+	bool MayHit(const FPupContactQuery& Query, const TArray<AActor*>& IgnoredActors, const UPrimitiveComponent* OnlyComponent = nullptr) const;
+
+	/** Find the closest point on a component to a location, if it was already known for that location **/
+	bool FindClosestPoint(const UPrimitiveComponent* Component, const FVector& Location, FVector& OutClosestPoint, FVector* OutNormal = nullptr) const;
+
+	int32 GetNumContacts() const { return Contacts.Num(); }
+
+	/** The box contacts were gathered from. Queries that leave it are never ruled out. **/
+	const FBox& GetRegion() const { return Region; }
+
+	/** Where the overlap and closest point queries the cache runs, and its hits and misses, are counted, if anywhere **/
+	void SetFrameStats(FPupMovementFrameStats* InFrameStats) { FrameStats = InFrameStats; }
+
+private:
+	const FPupContact* FindContact(const UPrimitiveComponent* Component) const;
+
+	void UpdateClosestPoint(const FPupContact& Contact) const;
+
+	/** Can the query be proven to miss this contact? **/
+	bool IsSeparated(const FPupContact& Contact, const FPupContactQuery& Query) const;
+
+	bool CountResult(const bool bMayHit) const;
+
+	TArray<FPupContact, TInlineAllocator<16>> Contacts;
+
+	/** Scratch space for the overlap, kept around so gathering doesn't allocate every step **/
+	TArray<FOverlapResult> OverlapResults;
+
+	FBox Region = FBox(ForceInit);
+	FVector Origin = FVector::ZeroVector;
+	bool bGathered = false;
+
+	FPupMovementFrameStats* FrameStats = nullptr;
+};
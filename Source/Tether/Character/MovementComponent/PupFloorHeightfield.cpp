@@ -0,0 +1,888 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupFloorHeightfield.h"
+
+#include "EngineUtils.h"
+#include "GameFramework/Pawn.h"
+#include "Tether/Tether.h"
+
+
+namespace PupFloorHeightfieldConstants
+{
+	/** Cells must be at least this flat before the heightfield will answer floor queries on them **/
+	static constexpr float FlatNormalZ = 0.999f;
+
+	/** Largest height difference between cells under a capsule that still counts as the same flat floor **/
+	static constexpr float HeightTolerance = 0.5f;
+
+	/** How far the sweep used to check a cell's whole top surface is shrunk from the cell's edges **/
+	static constexpr float CellInset = 0.5f;
+
+	/** Neighbouring cells further apart in height than this are treated as a ledge when computing edge distances **/
+	static constexpr float EdgeHeightStep = 10.0f;
+
+	/** Distance between diagonal cells, in cells **/
+	static constexpr float DiagonalWeight = 1.41421356f;
+
+	/** Smallest drop from a floor to the one beside it that is treated as a grabbable ledge **/
+	static constexpr float MinLedgeDrop = 20.0f;
+
+	/** How far below the top of a ledge its wall face is probed **/
+	static constexpr float LedgeProbeDepth = 5.0f;
+
+	/** Smallest dot product between the wall normals of neighbouring ledge pieces that still lets them merge **/
+	static constexpr float LedgeNormalAgreement = 0.999f;
+
+	/** Largest distance between neighbouring ledge pieces that still lets them merge into one segment **/
+	static constexpr float LedgeMergeTolerance = 1.0f;
+
+	/** Refuse to bake grids larger than this, to keep the level package a sensible size **/
+	static constexpr int32 MaxCells = 4096 * 4096;
+}
+
+static_assert(sizeof(FPupFloorCell) == 12, "FPupFloorCell is serialized as raw bytes; bump CellLayoutVersion if its layout changes");
+
+
+void UPupFloorHeightfield::Serialize(FArchive& Ar)
+{
+	Super::Serialize(Ar);
+
+	BulkData.Serialize(Ar, this);
+
+	if (Ar.IsLoading())
+	{
+		LoadCellsFromBulkData();
+	}
+}
+
+
+#if WITH_EDITOR
+void UPupFloorHeightfield::Bake(UWorld* World, const float InCellSize, const float WalkableNormalZ, const float LayerSeparation)
+{
+	Cells.Reset();
+	Components.Reset();
+	MovableComponents.Reset();
+	Ledges.Reset();
+	LedgeBucketStarts.Reset();
+	LedgeBucketEntries.Reset();
+	SizeX = 0;
+	SizeY = 0;
+	CellSize = FMath::Max(InCellSize, 1.0f);
+	BakedLayoutVersion = CellLayoutVersion;
+
+	if (!World)
+	{
+		return;
+	}
+
+	// Gather the extent of everything a pup could stand on, and everything that could move underneath one
+	FBox StaticBounds(ForceInit);
+	TArray<FBox> MovableBounds;
+	FCollisionQueryParams QueryParams(SCENE_QUERY_STAT(PupFloorHeightfieldBake), false);
+
+	for (TActorIterator<AActor> ActorIterator(World); ActorIterator; ++ActorIterator)
+	{
+		const bool bIsPawn = ActorIterator->IsA<APawn>();
+		TInlineComponentArray<UPrimitiveComponent*> Primitives(*ActorIterator);
+
+		for (UPrimitiveComponent* Primitive : Primitives)
+		{
+			if (!Primitive->IsCollisionEnabled() || Primitive->GetCollisionResponseToChannel(ECC_Pawn) != ECR_Block)
+			{
+				continue;
+			}
+
+			if (bIsPawn || Primitive->Mobility == EComponentMobility::Movable)
+			{
+				// Pawns can be anywhere at runtime, so only other movable components are tracked afterwards
+				MovableBounds.Add(Primitive->Bounds.GetBox().ExpandBy(CellSize));
+				QueryParams.AddIgnoredComponent(Primitive);
+				if (!bIsPawn)
+				{
+					MovableComponents.Add(Primitive);
+				}
+			}
+			else
+			{
+				StaticBounds += Primitive->Bounds.GetBox();
+			}
+		}
+	}
+
+	if (!StaticBounds.IsValid)
+	{
+		UE_LOG(LogTetherGame, Warning, TEXT("Floor heightfield bake found no static geometry in %s"), *World->GetName());
+		return;
+	}
+
+	const FVector BoundsSize = StaticBounds.GetSize();
+	SizeX = FMath::Max(FMath::CeilToInt(BoundsSize.X / CellSize), 1);
+	SizeY = FMath::Max(FMath::CeilToInt(BoundsSize.Y / CellSize), 1);
+
+	if (static_cast<int64>(SizeX) * SizeY > PupFloorHeightfieldConstants::MaxCells)
+	{
+		UE_LOG(LogTetherGame, Error, TEXT("Floor heightfield for %s would need %i x %i cells; increase the cell size"),
+			*World->GetName(), SizeX, SizeY);
+		SizeX = 0;
+		SizeY = 0;
+		return;
+	}
+
+	Origin = FVector2D(StaticBounds.Min.X, StaticBounds.Min.Y);
+	Cells.SetNum(SizeX * SizeY);
+
+	TMap<UPrimitiveComponent*, uint16> ComponentIndices;
+	const float TraceTop = StaticBounds.Max.Z + 10.0f;
+	const float TraceBottom = StaticBounds.Min.Z - 10.0f;
+
+	for (int32 Y = 0; Y < SizeY; Y++)
+	{
+		for (int32 X = 0; X < SizeX; X++)
+		{
+			FPupFloorCell& Cell = Cells[Y * SizeX + X];
+			const FVector2D CellCenter = Origin + FVector2D(X + 0.5f, Y + 0.5f) * CellSize;
+			const FVector TraceEnd(CellCenter, TraceBottom);
+
+			// Sweep the whole cell as well as tracing its center, to catch anything thin that falls between samples
+			FHitResult TopHit;
+			FHitResult CellHit;
+			const bool bHitTop = World->LineTraceSingleByChannel(TopHit, FVector(CellCenter, TraceTop), TraceEnd, ECC_Pawn, QueryParams) &&
+				TopHit.GetComponent();
+			const bool bHitCell = World->SweepSingleByChannel(CellHit, FVector(CellCenter, TraceTop), TraceEnd, FQuat::Identity, ECC_Pawn,
+				FCollisionShape::MakeBox(FVector(CellSize * 0.5f - PupFloorHeightfieldConstants::CellInset,
+					CellSize * 0.5f - PupFloorHeightfieldConstants::CellInset, PupFloorHeightfieldConstants::CellInset)), QueryParams);
+
+			if (!bHitTop)
+			{
+				// Nothing to stand on anywhere in this column
+				Cell.Flags = static_cast<uint8>(bHitCell ? FPupFloorCell::StaticOnly : FPupFloorCell::StaticOnly | FPupFloorCell::Uniform);
+				continue;
+			}
+
+			Cell.Flags = FPupFloorCell::HasFloor;
+			if (bHitCell && CellHit.GetComponent() == TopHit.GetComponent() &&
+				FMath::Abs(CellHit.Location.Z - PupFloorHeightfieldConstants::CellInset - TopHit.ImpactPoint.Z) <= PupFloorHeightfieldConstants::HeightTolerance)
+			{
+				Cell.Flags |= FPupFloorCell::Uniform;
+			}
+			Cell.Height = TopHit.ImpactPoint.Z;
+			Cell.SetNormalZ(TopHit.ImpactNormal.Z);
+
+			if (TopHit.ImpactNormal.Z >= WalkableNormalZ)
+			{
+				Cell.Flags |= FPupFloorCell::Walkable;
+			}
+
+			uint16* ExistingIndex = ComponentIndices.Find(TopHit.GetComponent());
+			if (ExistingIndex)
+			{
+				Cell.ComponentIndex = *ExistingIndex;
+			}
+			else if (Components.Num() < MAX_uint16)
+			{
+				Cell.ComponentIndex = static_cast<uint16>(Components.Add(TopHit.GetComponent()));
+				ComponentIndices.Add(TopHit.GetComponent(), Cell.ComponentIndex);
+			}
+
+			// Look for a second floor beneath the first one. Starting inside solid geometry is fine, since nothing can stand there,
+			// but any other hit means a pup could be underneath the top surface and the column can't be answered from the grid.
+			FHitResult LowerHit;
+			const FVector LowerStart(CellCenter, Cell.Height - LayerSeparation);
+			const bool bLayered = LowerStart.Z > TraceBottom &&
+				World->LineTraceSingleByChannel(LowerHit, LowerStart, TraceEnd, ECC_Pawn, QueryParams) &&
+				!LowerHit.bStartPenetrating && LowerHit.Distance > KINDA_SMALL_NUMBER;
+
+			if (!bLayered)
+			{
+				Cell.Flags |= FPupFloorCell::StaticOnly;
+			}
+		}
+	}
+
+	// Anything that can move can end up underneath a pup, so those columns always need real sweeps
+	for (const FBox& Bounds : MovableBounds)
+	{
+		int32 MinX, MinY, MaxX, MaxY;
+		GetCellCoordinates(Bounds.Min, MinX, MinY);
+		GetCellCoordinates(Bounds.Max, MaxX, MaxY);
+
+		for (int32 Y = FMath::Max(MinY, 0); Y <= FMath::Min(MaxY, SizeY - 1); Y++)
+		{
+			for (int32 X = FMath::Max(MinX, 0); X <= FMath::Min(MaxX, SizeX - 1); X++)
+			{
+				Cells[Y * SizeX + X].Flags &= ~FPupFloorCell::StaticOnly;
+			}
+		}
+	}
+
+	ComputeEdgeDistances();
+
+	TBitArray<> DescribedCells(false, Cells.Num());
+	BakeLedges(World, QueryParams, TraceBottom, DescribedCells);
+	BuildLedgeBuckets();
+
+	// Columns with something in them the grid and ledges can't describe always need real queries
+	for (int32 Index = 0; Index < Cells.Num(); Index++)
+	{
+		if (!Cells[Index].HasFlag(FPupFloorCell::Uniform) && !DescribedCells[Index])
+		{
+			Cells[Index].Flags &= ~FPupFloorCell::StaticOnly;
+		}
+	}
+
+	BulkData.SetBulkDataFlags(BULKDATA_ForceInlinePayload);
+	BulkData.Lock(LOCK_READ_WRITE);
+	void* BulkDataPtr = BulkData.Realloc(Cells.Num() * sizeof(FPupFloorCell));
+	FMemory::Memcpy(BulkDataPtr, Cells.GetData(), Cells.Num() * sizeof(FPupFloorCell));
+	BulkData.Unlock();
+
+	UE_LOG(LogTetherGame, Display, TEXT("Baked %i x %i floor heightfield for %s with %i ledges referencing %i components"),
+		SizeX, SizeY, *World->GetName(), Ledges.Num(), Components.Num());
+}
+
+
+void UPupFloorHeightfield::ComputeEdgeDistances()
+{
+	const auto IsEdgeCell = [this](const int32 X, const int32 Y)
+	{
+		const FPupFloorCell& Cell = Cells[Y * SizeX + X];
+		if (!Cell.HasFlag(FPupFloorCell::HasFloor) || !Cell.HasFlag(FPupFloorCell::Walkable) || !Cell.HasFlag(FPupFloorCell::Uniform))
+		{
+			return true;
+		}
+
+		static const FIntPoint Neighbours[] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1} };
+		for (const FIntPoint& Offset : Neighbours)
+		{
+			const int32 NeighbourX = X + Offset.X;
+			const int32 NeighbourY = Y + Offset.Y;
+			if (NeighbourX < 0 || NeighbourY < 0 || NeighbourX >= SizeX || NeighbourY >= SizeY)
+			{
+				return true;
+			}
+
+			const FPupFloorCell& Neighbour = Cells[NeighbourY * SizeX + NeighbourX];
+			if (!Neighbour.HasFlag(FPupFloorCell::HasFloor) ||
+				FMath::Abs(Neighbour.Height - Cell.Height) > PupFloorHeightfieldConstants::EdgeHeightStep)
+			{
+				return true;
+			}
+		}
+		return false;
+	};
+
+	// Distances are in cells until the very end
+	TArray<float> Distances;
+	Distances.SetNumUninitialized(Cells.Num());
+	for (int32 Y = 0; Y < SizeY; Y++)
+	{
+		for (int32 X = 0; X < SizeX; X++)
+		{
+			Distances[Y * SizeX + X] = IsEdgeCell(X, Y) ? 0.0f : MAX_flt;
+		}
+	}
+
+	const auto Relax = [this, &Distances](const int32 X, const int32 Y, const int32 NeighbourX, const int32 NeighbourY, const float Weight)
+	{
+		if (NeighbourX >= 0 && NeighbourY >= 0 && NeighbourX < SizeX && NeighbourY < SizeY)
+		{
+			float& Distance = Distances[Y * SizeX + X];
+			Distance = FMath::Min(Distance, Distances[NeighbourY * SizeX + NeighbourX] + Weight);
+		}
+	};
+
+	// Forward pass looks at neighbours that were already visited above and to the left, backward pass the opposite
+	for (int32 Y = 0; Y < SizeY; Y++)
+	{
+		for (int32 X = 0; X < SizeX; X++)
+		{
+			Relax(X, Y, X - 1, Y, 1.0f);
+			Relax(X, Y, X, Y - 1, 1.0f);
+			Relax(X, Y, X - 1, Y - 1, PupFloorHeightfieldConstants::DiagonalWeight);
+			Relax(X, Y, X + 1, Y - 1, PupFloorHeightfieldConstants::DiagonalWeight);
+		}
+	}
+	for (int32 Y = SizeY - 1; Y >= 0; Y--)
+	{
+		for (int32 X = SizeX - 1; X >= 0; X--)
+		{
+			Relax(X, Y, X + 1, Y, 1.0f);
+			Relax(X, Y, X, Y + 1, 1.0f);
+			Relax(X, Y, X + 1, Y + 1, PupFloorHeightfieldConstants::DiagonalWeight);
+			Relax(X, Y, X - 1, Y + 1, PupFloorHeightfieldConstants::DiagonalWeight);
+		}
+	}
+
+	for (int32 Index = 0; Index < Cells.Num(); Index++)
+	{
+		Cells[Index].EdgeDistance = static_cast<uint16>(FMath::Clamp(Distances[Index] * CellSize, 0.0f, static_cast<float>(MAX_uint16)));
+	}
+}
+
+
+void UPupFloorHeightfield::BakeLedges(UWorld* World, const FCollisionQueryParams& QueryParams, const float BottomHeight,
+	TBitArray<>& OutDescribedCells)
+{
+	using namespace PupFloorHeightfieldConstants;
+
+	// Is there a wall face belonging to the component at this point, just below the top of the ledge?
+	const auto HasWallAt = [&](const FVector& Point, const FVector& WallNormal, const uint16 ComponentIndex, FHitResult& OutHit)
+	{
+		const FVector Start = Point + WallNormal * CellSize * 0.5f;
+		const FVector End = Point - WallNormal * CellSize * 0.5f;
+		return World->LineTraceSingleByChannel(OutHit, Start, End, ECC_Pawn, QueryParams) && !OutHit.bStartPenetrating &&
+			OutHit.GetComponent() == Components[ComponentIndex].Get();
+	};
+
+	// Pieces are only cell sized, so find where the wall actually stops near each end of a segment
+	const auto RefineEnd = [&](const FPupLedgeSegment& Ledge, const FVector& End, const FVector& Outwards)
+	{
+		const FVector WallNormal = Ledge.WallNormal.GetSafeNormal2D();
+		const FVector ProbeOffset = FVector::DownVector * LedgeProbeDepth;
+		FHitResult DiscardHit;
+
+		float Inside = -CellSize * 0.5f;
+		float Outside = CellSize * 0.5f;
+		if (HasWallAt(End + Outwards * Outside + ProbeOffset, WallNormal, Ledge.ComponentIndex, DiscardHit))
+		{
+			return End + Outwards * Outside;
+		}
+		for (int32 Iteration = 0; Iteration < 6; Iteration++)
+		{
+			const float Middle = (Inside + Outside) * 0.5f;
+			if (HasWallAt(End + Outwards * Middle + ProbeOffset, WallNormal, Ledge.ComponentIndex, DiscardHit))
+			{
+				Inside = Middle;
+			}
+			else
+			{
+				Outside = Middle;
+			}
+		}
+		return End + Outwards * Inside;
+	};
+
+	const auto FinishLedge = [&](const int32 LedgeIndex)
+	{
+		FPupLedgeSegment& Ledge = Ledges[LedgeIndex];
+		const FVector Direction = Ledge.GetDirection();
+		Ledge.Start = RefineEnd(Ledge, Ledge.Start, -Direction);
+		Ledge.End = RefineEnd(Ledge, Ledge.End, Direction);
+	};
+
+	static const FIntPoint Directions[] = { {1, 0}, {-1, 0}, {0, 1}, {0, -1} };
+	for (const FIntPoint& Direction : Directions)
+	{
+		// Walk along each row of cell edges in the direction the wall runs, so neighbouring pieces can be merged
+		const bool bWallRunsAlongY = Direction.X != 0;
+		const int32 NumRows = bWallRunsAlongY ? SizeX : SizeY;
+		const int32 RowLength = bWallRunsAlongY ? SizeY : SizeX;
+		const FVector Normal(Direction.X, Direction.Y, 0.0f);
+		const FVector Tangent = bWallRunsAlongY ? FVector::RightVector : FVector::ForwardVector;
+
+		for (int32 Row = 0; Row < NumRows; Row++)
+		{
+			int32 OpenLedge = INDEX_NONE;
+			for (int32 Column = 0; Column < RowLength; Column++)
+			{
+				const int32 X = bWallRunsAlongY ? Row : Column;
+				const int32 Y = bWallRunsAlongY ? Column : Row;
+				const FPupFloorCell& Top = Cells[Y * SizeX + X];
+				const int32 PreviousLedge = OpenLedge;
+				OpenLedge = INDEX_NONE;
+
+				if (!Top.HasFlag(FPupFloorCell::HasFloor) || !Components.IsValidIndex(Top.ComponentIndex))
+				{
+					continue;
+				}
+
+				const int32 NeighbourX = X + Direction.X;
+				const int32 NeighbourY = Y + Direction.Y;
+				const bool bNeighbourInBounds = NeighbourX >= 0 && NeighbourY >= 0 && NeighbourX < SizeX && NeighbourY < SizeY;
+				const FPupFloorCell* Neighbour = bNeighbourInBounds ? &Cells[NeighbourY * SizeX + NeighbourX] : nullptr;
+				const float NeighbourHeight = Neighbour && Neighbour->HasFlag(FPupFloorCell::HasFloor) ? Neighbour->Height : BottomHeight;
+				const float Drop = Top.Height - NeighbourHeight;
+
+				const auto MarkDescribed = [&]()
+				{
+					OutDescribedCells[Y * SizeX + X] = true;
+					if (bNeighbourInBounds)
+					{
+						OutDescribedCells[NeighbourY * SizeX + NeighbourX] = true;
+					}
+				};
+
+				if (Drop < MinLedgeDrop)
+				{
+					// Steps this short can't be seen from a pup's eye line, so they don't need a ledge
+					if (Drop > 0.0f)
+					{
+						MarkDescribed();
+					}
+					continue;
+				}
+
+				// Trace back into the top cell from in front of it to find exactly where the wall face is
+				const FVector CellCenter(Origin + FVector2D(X + 0.5f, Y + 0.5f) * CellSize, Top.Height - LedgeProbeDepth);
+				FHitResult WallHit;
+				if (!HasWallAt(CellCenter + Normal * CellSize * 0.5f, Normal, Top.ComponentIndex, WallHit))
+				{
+					continue;
+				}
+
+				// Then find the surface on top, just behind the wall face
+				const FVector TopProbe = WallHit.ImpactPoint - WallHit.ImpactNormal.GetSafeNormal2D();
+				FHitResult TopHit;
+				if (!World->LineTraceSingleByChannel(TopHit, FVector(TopProbe.X, TopProbe.Y, Top.Height + LedgeProbeDepth * 2.0f),
+					FVector(TopProbe.X, TopProbe.Y, Top.Height - LedgeProbeDepth * 2.0f), ECC_Pawn, QueryParams) || TopHit.bStartPenetrating)
+				{
+					continue;
+				}
+
+				MarkDescribed();
+				const bool bGrabbable = Top.HasFlag(FPupFloorCell::Walkable);
+				const FVector PieceCenter(WallHit.ImpactPoint.X, WallHit.ImpactPoint.Y, TopHit.ImpactPoint.Z);
+				const FVector PieceStart = PieceCenter - Tangent * CellSize * 0.5f;
+				const FVector PieceEnd = PieceCenter + Tangent * CellSize * 0.5f;
+
+				if (PreviousLedge != INDEX_NONE)
+				{
+					FPupLedgeSegment& Ledge = Ledges[PreviousLedge];
+					const float OffsetFromWall = FMath::Abs(FVector::DotProduct(PieceCenter - Ledge.Start, Ledge.WallNormal.GetSafeNormal2D()));
+					if (Ledge.ComponentIndex == Top.ComponentIndex && Ledge.bGrabbable == bGrabbable &&
+						FVector::DotProduct(Ledge.WallNormal, WallHit.ImpactNormal) >= LedgeNormalAgreement &&
+						FMath::Abs(Ledge.End.Z - PieceCenter.Z) <= LedgeMergeTolerance &&
+						OffsetFromWall <= LedgeMergeTolerance)
+					{
+						Ledge.End = PieceEnd;
+						Ledge.BottomHeight = FMath::Max(Ledge.BottomHeight, NeighbourHeight);
+						OpenLedge = PreviousLedge;
+						continue;
+					}
+					FinishLedge(PreviousLedge);
+				}
+
+				FPupLedgeSegment& Ledge = Ledges.AddDefaulted_GetRef();
+				Ledge.Start = PieceStart;
+				Ledge.End = PieceEnd;
+				Ledge.WallNormal = WallHit.ImpactNormal;
+				Ledge.TopNormal = TopHit.ImpactNormal;
+				Ledge.BottomHeight = NeighbourHeight;
+				Ledge.ComponentIndex = Top.ComponentIndex;
+				Ledge.bGrabbable = bGrabbable;
+				OpenLedge = Ledges.Num() - 1;
+			}
+
+			if (OpenLedge != INDEX_NONE)
+			{
+				FinishLedge(OpenLedge);
+			}
+		}
+	}
+
+	// Ledges that were refined down to nothing can't be grabbed anyway
+	Ledges.RemoveAll([](const FPupLedgeSegment& Ledge)
+	{
+		return Ledge.GetLength() < 1.0f;
+	});
+}
+
+
+void UPupFloorHeightfield::BuildLedgeBuckets()
+{
+	LedgeBucketsX = FMath::DivideAndRoundUp(SizeX, LedgeBucketCells);
+	LedgeBucketsY = FMath::DivideAndRoundUp(SizeY, LedgeBucketCells);
+	const int32 NumBuckets = LedgeBucketsX * LedgeBucketsY;
+
+	// Counting sort, so each bucket's ledges end up next to each other
+	TArray<int32> BucketCounts;
+	BucketCounts.SetNumZeroed(NumBuckets);
+
+	const auto ForEachBucket = [this](const FPupLedgeSegment& Ledge, TFunctionRef<void(int32)> Visitor)
+	{
+		int32 MinX, MinY, MaxX, MaxY;
+		GetCellCoordinates(Ledge.Start.ComponentMin(Ledge.End), MinX, MinY);
+		GetCellCoordinates(Ledge.Start.ComponentMax(Ledge.End), MaxX, MaxY);
+		for (int32 Y = FMath::Max(MinY / LedgeBucketCells, 0); Y <= FMath::Min(MaxY / LedgeBucketCells, LedgeBucketsY - 1); Y++)
+		{
+			for (int32 X = FMath::Max(MinX / LedgeBucketCells, 0); X <= FMath::Min(MaxX / LedgeBucketCells, LedgeBucketsX - 1); X++)
+			{
+				Visitor(Y * LedgeBucketsX + X);
+			}
+		}
+	};
+
+	for (const FPupLedgeSegment& Ledge : Ledges)
+	{
+		ForEachBucket(Ledge, [&BucketCounts](const int32 Bucket) { BucketCounts[Bucket]++; });
+	}
+
+	LedgeBucketStarts.SetNumUninitialized(NumBuckets + 1);
+	LedgeBucketStarts[0] = 0;
+	for (int32 Bucket = 0; Bucket < NumBuckets; Bucket++)
+	{
+		LedgeBucketStarts[Bucket + 1] = LedgeBucketStarts[Bucket] + BucketCounts[Bucket];
+	}
+
+	LedgeBucketEntries.SetNumUninitialized(LedgeBucketStarts[NumBuckets]);
+	TArray<int32> BucketFill(LedgeBucketStarts);
+	for (int32 LedgeIndex = 0; LedgeIndex < Ledges.Num(); LedgeIndex++)
+	{
+		ForEachBucket(Ledges[LedgeIndex], [this, &BucketFill, LedgeIndex](const int32 Bucket)
+		{
+			LedgeBucketEntries[BucketFill[Bucket]++] = LedgeIndex;
+		});
+	}
+}
+#endif
+
+
+const FPupFloorCell* UPupFloorHeightfield::FindCell(const FVector& Location) const
+{
+	int32 X, Y;
+	if (!GetCellCoordinates(Location, X, Y) || X < 0 || Y < 0 || X >= SizeX || Y >= SizeY)
+	{
+		return nullptr;
+	}
+
+	return &Cells[Y * SizeX + X];
+}
+
+
+EPupHeightfieldFloorResult UPupFloorHeightfield::QueryFloor(const FVector& CapsuleLocation, const float Radius,
+	const float HalfHeight, const float SweepUp, const float SweepDown, const TArray<AActor*>& IgnoredActors,
+	float& OutFloorHeight, UPrimitiveComponent*& OutComponent) const
+{
+	int32 MinX, MinY, MaxX, MaxY;
+	if (!GetCellCoordinates(CapsuleLocation - FVector(Radius, Radius, 0.0f), MinX, MinY) ||
+		!GetCellCoordinates(CapsuleLocation + FVector(Radius, Radius, 0.0f), MaxX, MaxY) ||
+		MinX < 0 || MinY < 0 || MaxX >= SizeX || MaxY >= SizeY)
+	{
+		return EPupHeightfieldFloorResult::Unknown;
+	}
+
+	const float CapsuleBottom = CapsuleLocation.Z - HalfHeight;
+	const FPupFloorCell* FloorCell = nullptr;
+	int32 NumCells = 0;
+	int32 NumFloorCells = 0;
+	float FloorHeight = -BIG_NUMBER;
+
+	for (int32 Y = MinY; Y <= MaxY; Y++)
+	{
+		for (int32 X = MinX; X <= MaxX; X++)
+		{
+			const FPupFloorCell& Cell = Cells[Y * SizeX + X];
+			NumCells++;
+
+			if (!Cell.HasFlag(FPupFloorCell::StaticOnly) || !Cell.HasFlag(FPupFloorCell::Uniform))
+			{
+				return EPupHeightfieldFloorResult::Unknown;
+			}
+
+			if (!Cell.HasFlag(FPupFloorCell::HasFloor) || Cell.Height < CapsuleBottom - SweepDown)
+			{
+				continue;
+			}
+
+			if (Cell.Height > CapsuleBottom + SweepUp)
+			{
+				// Something is above our feet inside the footprint, which is a wall or a penetration - let a sweep handle it
+				return EPupHeightfieldFloorResult::Unknown;
+			}
+
+			if (!Cell.HasFlag(FPupFloorCell::Walkable) || Cell.GetNormalZ() < PupFloorHeightfieldConstants::FlatNormalZ)
+			{
+				return EPupHeightfieldFloorResult::Unknown;
+			}
+
+			if (FloorCell && (FloorCell->ComponentIndex != Cell.ComponentIndex ||
+				FMath::Abs(FloorCell->Height - Cell.Height) > PupFloorHeightfieldConstants::HeightTolerance))
+			{
+				return EPupHeightfieldFloorResult::Unknown;
+			}
+
+			FloorCell = &Cell;
+			FloorHeight = FMath::Max(FloorHeight, Cell.Height);
+			NumFloorCells++;
+		}
+	}
+
+	if (NumFloorCells != 0 && NumFloorCells != NumCells)
+	{
+		// Part of the footprint is over an edge, and the exact contact point matters there
+		return EPupHeightfieldFloorResult::Unknown;
+	}
+
+	// Something movable may have been carried over static cells since the bake
+	const FBox SweepBounds(CapsuleLocation - FVector(Radius, Radius, HalfHeight + SweepDown),
+		CapsuleLocation + FVector(Radius, Radius, HalfHeight + SweepUp));
+	if (!IsClearOfMovables(SweepBounds, IgnoredActors))
+	{
+		return EPupHeightfieldFloorResult::Unknown;
+	}
+
+	if (NumFloorCells == 0)
+	{
+		return EPupHeightfieldFloorResult::NoFloor;
+	}
+
+	OutComponent = GetCellComponent(*FloorCell);
+	if (!OutComponent)
+	{
+		return EPupHeightfieldFloorResult::Unknown;
+	}
+
+	OutFloorHeight = FloorHeight;
+	return EPupHeightfieldFloorResult::Floor;
+}
+
+
+bool UPupFloorHeightfield::IsSafeFloorLocation(const FVector& FloorLocation, const UPrimitiveComponent* FloorComponent,
+	const float SafeRadius, bool& bOutSafe) const
+{
+	const FPupFloorCell* Cell = FindCell(FloorLocation);
+	if (!Cell || !Cell->HasFlag(FPupFloorCell::HasFloor) || !Cell->HasFlag(FPupFloorCell::StaticOnly) ||
+		FMath::Abs(Cell->Height - FloorLocation.Z) > PupFloorHeightfieldConstants::EdgeHeightStep)
+	{
+		return false;
+	}
+
+	// A pup standing on something else at the same height, like a platform parked over the cell, needs a real check
+	if (!FloorComponent || GetCellComponent(*Cell) != FloorComponent)
+	{
+		return false;
+	}
+
+	bOutSafe = Cell->EdgeDistance >= SafeRadius;
+	return true;
+}
+
+
+bool UPupFloorHeightfield::FindNearestSafeFloorLocation(const FVector& FloorLocation, const float SafeRadius,
+	const float MaxSearchDistance, FVector& OutSafeFloorLocation) const
+{
+	int32 CenterX, CenterY;
+	if (!HasData() || !GetCellCoordinates(FloorLocation, CenterX, CenterY))
+	{
+		return false;
+	}
+
+	// Search outwards in square rings, stopping once no ring could contain anything closer than the best cell so far
+	const int32 MaxRing = FMath::CeilToInt(MaxSearchDistance / CellSize);
+	float BestDistanceSquared = FMath::Square(MaxSearchDistance);
+	bool bFound = false;
+
+	for (int32 Ring = 0; Ring <= MaxRing; Ring++)
+	{
+		if (bFound && FMath::Square((Ring - 1) * CellSize) > BestDistanceSquared)
+		{
+			break;
+		}
+
+		for (int32 Y = CenterY - Ring; Y <= CenterY + Ring; Y++)
+		{
+			// Only the first and last rows are fully inside the ring, every other row only has its two end cells
+			const int32 XStep = (Y == CenterY - Ring || Y == CenterY + Ring) ? 1 : FMath::Max(Ring * 2, 1);
+			for (int32 X = CenterX - Ring; X <= CenterX + Ring; X += XStep)
+			{
+				if (X < 0 || Y < 0 || X >= SizeX || Y >= SizeY)
+				{
+					continue;
+				}
+
+				// Movable floors may have gone by the time the pup gets there, and layered cells only know their top floor
+				const FPupFloorCell& Cell = Cells[Y * SizeX + X];
+				if (!Cell.HasFlag(FPupFloorCell::HasFloor) || !Cell.HasFlag(FPupFloorCell::StaticOnly) ||
+					Cell.EdgeDistance < SafeRadius || !GetCellComponent(Cell))
+				{
+					continue;
+				}
+
+				const FVector CellLocation(Origin + FVector2D(X + 0.5f, Y + 0.5f) * CellSize, Cell.Height);
+				const float DistanceSquared = FVector::DistSquared(CellLocation, FloorLocation);
+				if (DistanceSquared < BestDistanceSquared)
+				{
+					BestDistanceSquared = DistanceSquared;
+					OutSafeFloorLocation = CellLocation;
+					bFound = true;
+				}
+			}
+		}
+	}
+
+	return bFound;
+}
+
+
+bool UPupFloorHeightfield::IsRegionStatic(const FBox& Region, const TArray<AActor*>& IgnoredActors) const
+{
+	int32 MinX, MinY, MaxX, MaxY;
+	if (!GetCellCoordinates(Region.Min, MinX, MinY) || !GetCellCoordinates(Region.Max, MaxX, MaxY) ||
+		MinX < 0 || MinY < 0 || MaxX >= SizeX || MaxY >= SizeY)
+	{
+		return false;
+	}
+
+	for (int32 Y = MinY; Y <= MaxY; Y++)
+	{
+		for (int32 X = MinX; X <= MaxX; X++)
+		{
+			if (!Cells[Y * SizeX + X].HasFlag(FPupFloorCell::StaticOnly))
+			{
+				return false;
+			}
+		}
+	}
+
+	return IsClearOfMovables(Region, IgnoredActors);
+}
+
+
+void UPupFloorHeightfield::ForEachLedge(const FBox& Region, TFunctionRef<void(const FPupLedgeSegment&)> Visitor) const
+{
+	int32 MinX, MinY, MaxX, MaxY;
+	if (Ledges.Num() == 0 || !GetCellCoordinates(Region.Min, MinX, MinY) || !GetCellCoordinates(Region.Max, MaxX, MaxY))
+	{
+		return;
+	}
+
+	for (int32 Y = FMath::Max(MinY / LedgeBucketCells, 0); Y <= FMath::Min(MaxY / LedgeBucketCells, LedgeBucketsY - 1); Y++)
+	{
+		for (int32 X = FMath::Max(MinX / LedgeBucketCells, 0); X <= FMath::Min(MaxX / LedgeBucketCells, LedgeBucketsX - 1); X++)
+		{
+			const int32 Bucket = Y * LedgeBucketsX + X;
+			for (int32 Entry = LedgeBucketStarts[Bucket]; Entry < LedgeBucketStarts[Bucket + 1]; Entry++)
+			{
+				const FPupLedgeSegment& Ledge = Ledges[LedgeBucketEntries[Entry]];
+				const FBox LedgeBounds(Ledge.Start.ComponentMin(Ledge.End) - FVector(0.0f, 0.0f, Ledge.Start.Z - Ledge.BottomHeight),
+					Ledge.Start.ComponentMax(Ledge.End));
+				if (LedgeBounds.Intersect(Region))
+				{
+					Visitor(Ledge);
+				}
+			}
+		}
+	}
+}
+
+
+const FPupLedgeSegment* UPupFloorHeightfield::RaycastLedgeWalls(const FVector& Start, const FVector& Direction,
+	const float Distance, float& OutHitDistance) const
+{
+	const FPupLedgeSegment* ClosestLedge = nullptr;
+	OutHitDistance = Distance;
+
+	FBox RayBounds(ForceInit);
+	RayBounds += Start;
+	RayBounds += Start + Direction * Distance;
+
+	ForEachLedge(RayBounds.ExpandBy(1.0f), [&](const FPupLedgeSegment& Ledge)
+	{
+		// Walls are treated as vertical planes hanging from the ledge
+		const FVector WallNormal = Ledge.WallNormal.GetSafeNormal2D();
+		const float Facing = -FVector::DotProduct(Direction, WallNormal);
+		const float DistanceFromWall = FVector::DotProduct(Start - Ledge.Start, WallNormal);
+		if (Facing <= KINDA_SMALL_NUMBER || DistanceFromWall < 0.0f)
+		{
+			return;
+		}
+
+		const float HitDistance = DistanceFromWall / Facing;
+		if (HitDistance > OutHitDistance || (ClosestLedge && HitDistance == OutHitDistance))
+		{
+			return;
+		}
+
+		const FVector HitPoint = Start + Direction * HitDistance;
+		const float Length = Ledge.GetLength();
+		const float Along = FVector::DotProduct(HitPoint - Ledge.Start, Ledge.GetDirection());
+		if (Along < 0.0f || Along > Length)
+		{
+			return;
+		}
+
+		const float TopHeight = FMath::Lerp(Ledge.Start.Z, Ledge.End.Z, Along / Length);
+		if (HitPoint.Z <= Ledge.BottomHeight || HitPoint.Z >= TopHeight)
+		{
+			return;
+		}
+
+		ClosestLedge = &Ledge;
+		OutHitDistance = HitDistance;
+	});
+
+	return ClosestLedge;
+}
+
+
+UPrimitiveComponent* UPupFloorHeightfield::GetCellComponent(const FPupFloorCell& Cell) const
+{
+	if (!Components.IsValidIndex(Cell.ComponentIndex))
+	{
+		return nullptr;
+	}
+
+	return Components[Cell.ComponentIndex].Get();
+}
+
+
+UPrimitiveComponent* UPupFloorHeightfield::GetLedgeComponent(const FPupLedgeSegment& Ledge) const
+{
+	if (!Components.IsValidIndex(Ledge.ComponentIndex))
+	{
+		return nullptr;
+	}
+
+	return Components[Ledge.ComponentIndex].Get();
+}
+
+
+bool UPupFloorHeightfield::IsClearOfMovables(const FBox& Region, const TArray<AActor*>& IgnoredActors) const
+{
+	for (const TSoftObjectPtr<UPrimitiveComponent>& MovableComponent : MovableComponents)
+	{
+		const UPrimitiveComponent* Component = MovableComponent.Get();
+		if (Component && Component->IsCollisionEnabled() && !IgnoredActors.Contains(Component->GetOwner()) &&
+			Component->Bounds.GetBox().Intersect(Region))
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+
+void UPupFloorHeightfield::LoadCellsFromBulkData()
+{
+	Cells.Reset();
+
+	const int64 BulkDataSize = BulkData.GetBulkDataSize();
+	if (BakedLayoutVersion != CellLayoutVersion || BulkDataSize == 0)
+	{
+		return;
+	}
+
+	if (BulkDataSize != static_cast<int64>(SizeX) * SizeY * sizeof(FPupFloorCell))
+	{
+		UE_LOG(LogTetherGame, Warning, TEXT("Floor heightfield %s has mismatched bulk data and will be ignored; rebake it"), *GetPathName());
+		return;
+	}
+
+	Cells.SetNumUninitialized(SizeX * SizeY);
+	const void* BulkDataPtr = BulkData.LockReadOnly();
+	FMemory::Memcpy(Cells.GetData(), BulkDataPtr, BulkDataSize);
+	BulkData.Unlock();
+}
+
+
+bool UPupFloorHeightfield::GetCellCoordinates(const FVector& Location, int32& OutX, int32& OutY) const
+{
+	if (SizeX <= 0 || SizeY <= 0)
+	{
+		return false;
+	}
+
+	OutX = FMath::FloorToInt((Location.X - Origin.X) / CellSize);
+	OutY = FMath::FloorToInt((Location.Y - Origin.Y) / CellSize);
+	return true;
+}
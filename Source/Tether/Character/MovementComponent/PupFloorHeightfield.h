@@ -0,0 +1,234 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "Serialization/BulkData.h"
+#include "PupFloorHeightfield.generated.h"
+
+/**
+ * A single column of the floor heightfield, describing the highest static floor surface in that column.
+ * Stored as raw bytes in the heightfield's bulk data, so the layout must stay plain old data.
+ **/
+struct FPupFloorCell
+{
+	enum EFlags : uint8
+	{
+		/** There is a static floor surface somewhere in this column **/
+		HasFloor	= 1 << 0,
+		/** The floor surface is shallow enough to walk on with the default MaxIncline **/
+		Walkable	= 1 << 1,
+		/** Nothing movable overlaps this column, there is only one layer of floor, and any walls in it are in the ledge index **/
+		StaticOnly	= 1 << 2,
+		/** The top surface is at the same height across the whole cell, not just at its center **/
+		Uniform		= 1 << 3
+	};
+
+	float Height = 0.0f;
+	uint16 QuantizedNormalZ = 0;
+	uint16 ComponentIndex = MAX_uint16;
+	/** Distance to the nearest cell where a pup could fall or slide off the floor, in units **/
+	uint16 EdgeDistance = 0;
+	uint8 Flags = 0;
+
+	bool HasFlag(const EFlags Flag) const { return (Flags & Flag) != 0; }
+	float GetNormalZ() const { return QuantizedNormalZ / static_cast<float>(MAX_uint16); }
+	void SetNormalZ(const float NormalZ) { QuantizedNormalZ = static_cast<uint16>(FMath::Clamp(NormalZ, 0.0f, 1.0f) * MAX_uint16); }
+};
+
+
+/** A straight, grabbable ledge on static geometry, running along the top of a wall face **/
+USTRUCT()
+struct FPupLedgeSegment
+{
+	GENERATED_BODY()
+
+	/** Start of the ledge, on the wall face at the height of the top surface **/
+	UPROPERTY()
+	FVector Start = FVector::ZeroVector;
+
+	UPROPERTY()
+	FVector End = FVector::ZeroVector;
+
+	/** Normal of the wall face below the ledge, pointing away from the wall **/
+	UPROPERTY()
+	FVector WallNormal = FVector::ForwardVector;
+
+	/** Normal of the surface on top of the ledge **/
+	UPROPERTY()
+	FVector TopNormal = FVector::UpVector;
+
+	/** Height of the floor at the bottom of the wall, or the bottom of the level if there is none **/
+	UPROPERTY()
+	float BottomHeight = 0.0f;
+
+	/** Can this ledge be mantled? Walls beneath unwalkable tops are kept so they can still be hit. **/
+	UPROPERTY()
+	bool bGrabbable = true;
+
+	UPROPERTY()
+	uint16 ComponentIndex = MAX_uint16;
+
+	float GetLength() const { return FVector::Dist(Start, End); }
+	FVector GetDirection() const { return (End - Start).GetSafeNormal(); }
+};
+
+
+/** The result of asking the heightfield about the floor beneath a capsule **/
+enum class EPupHeightfieldFloorResult : uint8
+{
+	/** The heightfield can't answer this query, and a real sweep should be used instead **/
+	Unknown,
+	/** There is definitely no floor within range **/
+	NoFloor,
+	/** There is a flat, walkable, static floor within range **/
+	Floor
+};
+
+
+/**
+ * A per-level grid of the static floor surfaces in a level, baked in the editor from World Settings.
+ * Lets pups answer most floor queries without sweeping the physics scene.
+ **/
+UCLASS()
+class TETHER_API UPupFloorHeightfield : public UObject
+{
+	GENERATED_BODY()
+
+public:
+	virtual void Serialize(FArchive& Ar) override;
+
+#if WITH_EDITOR
+	/**
+	 * Rasterize all static, pawn-blocking geometry in the world into the heightfield.
+	 * @param InCellSize		Width of each cell, in units
+	 * @param WalkableNormalZ	Smallest normal Z value that is considered walkable
+	 * @param LayerSeparation	How far below the top surface another floor must be before the column is considered layered
+	 **/
+	void Bake(UWorld* World, const float InCellSize, const float WalkableNormalZ, const float LayerSeparation);
+#endif
+
+	bool HasData() const { return Cells.Num() > 0; }
+
+	float GetCellSize() const { return CellSize; }
+
+	/** Returns the cell containing the location, or nullptr if the location is outside of the heightfield **/
+	const FPupFloorCell* FindCell(const FVector& Location) const;
+
+	/**
+	 * Find the floor a capsule would land on if it was swept downwards, without touching the physics scene.
+	 * Only answers when every cell under the capsule is static and the floor beneath it is flat.
+	 **/
+	EPupHeightfieldFloorResult QueryFloor(const FVector& CapsuleLocation, const float Radius, const float HalfHeight,
+		const float SweepUp, const float SweepDown, const TArray<AActor*>& IgnoredActors, float& OutFloorHeight,
+		UPrimitiveComponent*& OutComponent) const;
+
+	/**
+	 * Check whether a floor point is at least SafeRadius away from any edge.
+	 * Returns false if the heightfield doesn't cover that floor, e.g. if it is movable, beneath another floor, or
+	 * isn't the floor component the cell was baked from.
+	 **/
+	bool IsSafeFloorLocation(const FVector& FloorLocation, const UPrimitiveComponent* FloorComponent, const float SafeRadius,
+		bool& bOutSafe) const;
+
+	/**
+	 * Find the closest static floor point that is at least SafeRadius away from any edge.
+	 * Cells are searched in a fixed order, so the same query always gives the same result.
+	 **/
+	bool FindNearestSafeFloorLocation(const FVector& FloorLocation, const float SafeRadius, const float MaxSearchDistance,
+		FVector& OutSafeFloorLocation) const;
+
+	/**
+	 * Is every column in the region static, with no movable component currently inside it?
+	 * Only movable components that existed when the heightfield was baked are considered.
+	 **/
+	bool IsRegionStatic(const FBox& Region, const TArray<AActor*>& IgnoredActors) const;
+
+	bool HasLedges() const { return Ledges.Num() > 0; }
+
+	/** Call the visitor for every ledge whose bounds might overlap the region. A ledge may be visited more than once. **/
+	void ForEachLedge(const FBox& Region, TFunctionRef<void(const FPupLedgeSegment&)> Visitor) const;
+
+	/**
+	 * Cast a ray against the wall faces beneath all ledges, returning the closest ledge whose wall the ray hits.
+	 * Walls are treated as running from each ledge's BottomHeight up to its top.
+	 **/
+	const FPupLedgeSegment* RaycastLedgeWalls(const FVector& Start, const FVector& Direction, const float Distance, float& OutHitDistance) const;
+
+	UPrimitiveComponent* GetCellComponent(const FPupFloorCell& Cell) const;
+	UPrimitiveComponent* GetLedgeComponent(const FPupLedgeSegment& Ledge) const;
+
+private:
+#if WITH_EDITOR
+	/**
+	 * Find every drop in the heightfield that is tall enough to grab, and refine it into ledge segments with traces.
+	 * Marks the cells on either side of each drop that is fully described by the ledges, or too short to be seen.
+	 **/
+	void BakeLedges(UWorld* World, const FCollisionQueryParams& QueryParams, const float BottomHeight, TBitArray<>& OutDescribedCells);
+
+	/** Sort the ledges into buckets for quick spatial queries **/
+	void BuildLedgeBuckets();
+
+	/** Fill in each cell's EdgeDistance with a chamfer distance transform **/
+	void ComputeEdgeDistances();
+#endif
+
+	/** Is the region clear of every movable component that existed when the heightfield was baked? **/
+	bool IsClearOfMovables(const FBox& Region, const TArray<AActor*>& IgnoredActors) const;
+
+	void LoadCellsFromBulkData();
+
+	bool GetCellCoordinates(const FVector& Location, int32& OutX, int32& OutY) const;
+
+	/** Version of the cell layout. Heightfields baked with a different layout are ignored until they are rebaked. **/
+	static constexpr int32 CellLayoutVersion = 3;
+
+	UPROPERTY()
+	int32 BakedLayoutVersion = 0;
+
+	/** World space XY location of the corner of the first cell **/
+	UPROPERTY(VisibleAnywhere, Category = "Heightfield")
+	FVector2D Origin = FVector2D::ZeroVector;
+
+	UPROPERTY(VisibleAnywhere, Category = "Heightfield")
+	float CellSize = 25.0f;
+
+	UPROPERTY(VisibleAnywhere, Category = "Heightfield")
+	int32 SizeX = 0;
+
+	UPROPERTY(VisibleAnywhere, Category = "Heightfield")
+	int32 SizeY = 0;
+
+	/** Floor components referenced by the cells. Soft references, since floors may live in streaming levels. **/
+	UPROPERTY()
+	TArray<TSoftObjectPtr<UPrimitiveComponent>> Components;
+
+	/** Movable, pawn-blocking components that existed when the heightfield was baked **/
+	UPROPERTY()
+	TArray<TSoftObjectPtr<UPrimitiveComponent>> MovableComponents;
+
+	UPROPERTY()
+	TArray<FPupLedgeSegment> Ledges;
+
+	/** Width of each ledge bucket, in cells **/
+	static constexpr int32 LedgeBucketCells = 4;
+
+	UPROPERTY()
+	int32 LedgeBucketsX = 0;
+
+	UPROPERTY()
+	int32 LedgeBucketsY = 0;
+
+	/** Index into LedgeBucketEntries where each bucket starts. Has one extra entry marking the end of the last bucket. **/
+	UPROPERTY()
+	TArray<int32> LedgeBucketStarts;
+
+	/** Ledge indices, grouped by bucket **/
+	UPROPERTY()
+	TArray<int32> LedgeBucketEntries;
+
+	FByteBulkData BulkData;
+
+	TArray<FPupFloorCell> Cells;
+};
@@ -0,0 +1,898 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupMovementComponent.h"
+#include "PupMovementKernel.h"
+#include "PupMovementManager.h"
+
+#include "EngineUtils.h"
+#include "Async/ParallelFor.h"
+#include "Containers/Ticker.h"
+#include "Engine/CollisionProfile.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/MemoryBase.h"
+#include "Serialization/MemoryWriter.h"
+#include "Tether/Tether.h"
+#include "Tether/Gameplay/Obstacles/Conveyor.h"
+
+
+namespace PupMovementBenchmarks
+{
+	static const EPupMovementMode BenchmarkModes[] = {
+		EPupMovementMode::M_Walking,
+		EPupMovementMode::M_Falling,
+		EPupMovementMode::M_Deflected,
+		EPupMovementMode::M_Recover,
+		EPupMovementMode::M_Dragging
+	};
+
+
+	/** Fill a batch of states with repeatable, plausible input for a single movement mode **/
+	static void MakeStates(TArray<FPupMovementKernelState>& OutStates, const int32 NumPups, const EPupMovementMode Mode)
+	{
+		FRandomStream RandomStream(static_cast<int32>(Mode) + 1);
+		OutStates.SetNum(NumPups);
+		for (FPupMovementKernelState& State : OutStates)
+		{
+			State = FPupMovementKernelState();
+			State.MovementMode = Mode;
+			State.Rotation = FRotator(0.0f, RandomStream.FRandRange(-180.0f, 180.0f), 0.0f);
+			State.DesiredRotation = State.Rotation;
+			State.Velocity = RandomStream.GetUnitVector() * RandomStream.FRandRange(0.0f, 1000.0f);
+			State.FloorNormal = FMath::Lerp(FVector::UpVector, RandomStream.GetUnitVector(), 0.2f).GetSafeNormal();
+			State.DirectionVector = FVector(RandomStream.GetUnitVector().GetSafeNormal2D());
+			State.DashDirection = State.DirectionVector;
+			State.WallNormal = FVector(RandomStream.GetUnitVector().GetSafeNormal2D());
+			State.DraggingFaceNormal = State.WallNormal;
+			State.InputFactor = RandomStream.FRand();
+			State.MovementSpeedAlpha = RandomStream.FRand();
+			State.bIsWalking = RandomStream.FRand() > 0.25f;
+			State.bGrounded = Mode != EPupMovementMode::M_Falling;
+			State.bDashing = RandomStream.FRand() > 0.9f;
+			State.bJumping = Mode == EPupMovementMode::M_Falling && RandomStream.FRand() > 0.5f;
+			State.bWallSliding = Mode == EPupMovementMode::M_Falling && RandomStream.FRand() > 0.75f;
+		}
+	}
+
+
+	static UPupMovementComponent* FindMovementComponent(UWorld* World)
+	{
+		for (TObjectIterator<UPupMovementComponent> Iterator; Iterator; ++Iterator)
+		{
+			UPupMovementComponent* MovementComponent = *Iterator;
+			if (MovementComponent->GetWorld() == World && MovementComponent->UpdatedComponent &&
+				!MovementComponent->IsPendingKill())
+			{
+				return MovementComponent;
+			}
+		}
+		return nullptr;
+	}
+
+
+	static void BenchmarkKernel(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 NumPups = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 1024;
+		const int32 NumSteps = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 60;
+		const float DeltaTime = 1.0f / 60.0f;
+
+		UPupMovementComponent* MovementComponent = World ? FindMovementComponent(World) : nullptr;
+		const FPupMovementKernelParams Params = MovementComponent ?
+			MovementComponent->MakeKernelParams() :
+			FPupMovementKernelParams();
+
+		UE_LOG(LogTetherGame, Display, TEXT("PupMovement kernel benchmark: %d pups, %d steps"), NumPups, NumSteps);
+
+		TArray<FPupMovementKernelState> States;
+		for (const EPupMovementMode Mode : BenchmarkModes)
+		{
+			const FString ModeName = StaticEnum<EPupMovementMode>()->GetNameStringByValue(static_cast<int64>(Mode));
+
+			MakeStates(States, NumPups, Mode);
+			const double BatchStart = FPlatformTime::Seconds();
+			for (int32 Step = 0; Step < NumSteps; Step++)
+			{
+				PupMovementKernel::UpdateBatch(States, Params, DeltaTime);
+			}
+			const double BatchTime = FPlatformTime::Seconds() - BatchStart;
+			const double NumUpdates = static_cast<double>(NumPups) * NumSteps;
+			UE_LOG(LogTetherGame, Display, TEXT("  %s batched: %.3f ms total, %.1f ns per update"),
+				*ModeName, BatchTime * 1000.0, BatchTime * 1e9 / NumUpdates);
+
+			if (!MovementComponent)
+			{
+				continue;
+			}
+
+			// Run the same states through a real component, then put it back the way we found it
+			const FPupMovementKernelState SavedState = MovementComponent->MakeKernelState();
+			MakeStates(States, NumPups, Mode);
+			const double ComponentStart = FPlatformTime::Seconds();
+			for (int32 Step = 0; Step < NumSteps; Step++)
+			{
+				for (FPupMovementKernelState& State : States)
+				{
+					MovementComponent->StepKinematics(State, DeltaTime);
+				}
+			}
+			const double ComponentTime = FPlatformTime::Seconds() - ComponentStart;
+			MovementComponent->ApplyKernelState(SavedState);
+			MovementComponent->UpdatedComponent->SetWorldRotation(SavedState.Rotation);
+
+			UE_LOG(LogTetherGame, Display, TEXT("  %s per component: %.3f ms total, %.1f ns per update"),
+				*ModeName, ComponentTime * 1000.0, ComponentTime * 1e9 / NumUpdates);
+		}
+
+		if (!MovementComponent)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("  No pup movement component in this world, skipped the per component path"));
+		}
+	}
+
+
+	static void BenchmarkSnapshots(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 NumIterations = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 1000;
+		const int32 RollbackSteps = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 8;
+
+		UPupMovementComponent* MovementComponent = World ? FindMovementComponent(World) : nullptr;
+		if (!MovementComponent)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("PupMovement snapshot benchmark: no pup movement component in this world"));
+			return;
+		}
+
+		UE_LOG(LogTetherGame, Display, TEXT("PupMovement snapshot benchmark: %d iterations, rolling back %d steps"),
+			NumIterations, RollbackSteps);
+
+		FPupMovementComponentState SavedState;
+		MovementComponent->SaveState(SavedState);
+
+		FPupMovementComponentState State;
+		const double SaveStart = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < NumIterations; Iteration++)
+		{
+			MovementComponent->SaveState(State);
+		}
+		const double SaveTime = FPlatformTime::Seconds() - SaveStart;
+
+		const double RestoreStart = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < NumIterations; Iteration++)
+		{
+			MovementComponent->RestoreState(SavedState);
+		}
+		const double RestoreTime = FPlatformTime::Seconds() - RestoreStart;
+
+		TArray<uint8> Bytes;
+		FMemoryWriter Writer(Bytes);
+		State.Serialize(Writer);
+
+		UE_LOG(LogTetherGame, Display, TEXT("  Save: %.1f ns per pup"), SaveTime * 1e9 / NumIterations);
+		UE_LOG(LogTetherGame, Display, TEXT("  Restore: %.1f ns per pup"), RestoreTime * 1e9 / NumIterations);
+		UE_LOG(LogTetherGame, Display, TEXT("  Serialized size: %d bytes"), Bytes.Num());
+
+		// Rolling back simulates steps again, so only a few iterations are needed
+		const int32 NumRollbacks = FMath::Max(1, NumIterations / 100);
+		int32 NumCompleted = 0;
+		const double RollbackStart = FPlatformTime::Seconds();
+		for (int32 Iteration = 0; Iteration < NumRollbacks; Iteration++)
+		{
+			NumCompleted += MovementComponent->Rollback(RollbackSteps) ? 1 : 0;
+		}
+		const double RollbackTime = FPlatformTime::Seconds() - RollbackStart;
+		MovementComponent->RestoreState(SavedState);
+
+		if (NumCompleted == 0)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("  Rollback: history doesn't go back %d steps, see PupMovement.HistoryLength"), RollbackSteps);
+			return;
+		}
+		UE_LOG(LogTetherGame, Display, TEXT("  Rollback and simulate again: %.3f us per pup, %.3f us per step"),
+			RollbackTime * 1e6 / NumCompleted, RollbackTime * 1e6 / (static_cast<double>(NumCompleted) * RollbackSteps));
+	}
+
+
+	/** A correction check in progress, driven a frame at a time while the session runs **/
+	struct FCorrectionCheck
+	{
+		TWeakObjectPtr<UWorld> World;
+		TWeakObjectPtr<UPupMovementComponent> Pup;
+		float Duration = 0.0f;
+		float Elapsed = 0.0f;
+		float MaxRate = 0.0f;
+		int32 StartCorrections = 0;
+		uint32 StartStep = 0;
+		bool bJumpHeld = false;
+	};
+
+
+	static void SetPacketSimulation(UWorld* World, const int32 PacketLoss, const int32 PacketLag)
+	{
+		if (GEngine && World)
+		{
+			GEngine->Exec(World, *FString::Printf(TEXT("Net PktLoss=%d PktLag=%d"), PacketLoss, PacketLag));
+		}
+	}
+
+
+	/** Move and jump around in a pattern, returning false once the check is over **/
+	static bool TickCorrectionCheck(FCorrectionCheck& Check, const float DeltaTime)
+	{
+		UPupMovementComponent* Pup = Check.Pup.Get();
+		APawn* Pawn = Pup ? Pup->GetPawnOwner() : nullptr;
+		if (!Pawn)
+		{
+			UE_LOG(LogTetherGame, Error, TEXT("PupMovement correction check: the pup went away before the check finished"));
+			SetPacketSimulation(Check.World.Get(), 0, 0);
+			return false;
+		}
+
+		Check.Elapsed += DeltaTime;
+		if (Check.Elapsed < Check.Duration)
+		{
+			// Circle around, hopping every couple of seconds, so the server has turns and landings to disagree about
+			Pawn->AddMovementInput(FRotator(0.0f, Check.Elapsed * 45.0f, 0.0f).Vector());
+			const bool bWantJump = FMath::Fmod(Check.Elapsed, 2.0f) < 0.3f;
+			if (bWantJump != Check.bJumpHeld)
+			{
+				Pup->HandleInputAction(bWantJump ? EPupMovementInputAction::Jump : EPupMovementInputAction::StopJumping);
+				Check.bJumpHeld = bWantJump;
+			}
+			return true;
+		}
+
+		SetPacketSimulation(Check.World.Get(), 0, 0);
+		const int32 Corrections = Pup->GetNumCorrections() - Check.StartCorrections;
+		const uint32 Steps = Pup->GetStepNumber() - Check.StartStep;
+		const float Rate = Corrections * 100.0f / FMath::Max(Steps, 1u);
+		if (Rate <= Check.MaxRate)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("  Passed: %d corrections in %u steps, %.2f per 100 steps"), Corrections, Steps, Rate);
+		}
+		else
+		{
+			UE_LOG(LogTetherGame, Error, TEXT("  Failed: %d corrections in %u steps, %.2f per 100 steps, more than %.2f"),
+				Corrections, Steps, Rate, Check.MaxRate);
+		}
+		return false;
+	}
+
+
+	static void CheckCorrections(const TArray<FString>& Args, UWorld* World)
+	{
+		const float Duration = Args.Num() > 0 ? FMath::Max(1.0f, FCString::Atof(*Args[0])) : 30.0f;
+		const int32 PacketLoss = Args.Num() > 1 ? FMath::Clamp(FCString::Atoi(*Args[1]), 0, 100) : 10;
+		const int32 PacketLag = Args.Num() > 2 ? FMath::Max(0, FCString::Atoi(*Args[2])) : 100;
+		const float MaxRate = Args.Num() > 3 ? FCString::Atof(*Args[3]) : 2.0f;
+
+		UPupMovementComponent* Pup = nullptr;
+		for (TObjectIterator<UPupMovementComponent> Iterator; Iterator; ++Iterator)
+		{
+			if (Iterator->GetWorld() == World && Iterator->IsPredicting() && !Iterator->IsPendingKill())
+			{
+				Pup = *Iterator;
+				break;
+			}
+		}
+		if (!Pup)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("PupMovement correction check: run this on a client that is predicting its own pup"));
+			return;
+		}
+
+		UE_LOG(LogTetherGame, Display, TEXT("PupMovement correction check: %.0f seconds, %d%% packet loss, %d ms lag"),
+			Duration, PacketLoss, PacketLag);
+		SetPacketSimulation(World, PacketLoss, PacketLag);
+
+		const TSharedRef<FCorrectionCheck> Check = MakeShared<FCorrectionCheck>();
+		Check->World = World;
+		Check->Pup = Pup;
+		Check->Duration = Duration;
+		Check->MaxRate = MaxRate;
+		Check->StartCorrections = Pup->GetNumCorrections();
+		Check->StartStep = Pup->GetStepNumber();
+		FTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([Check](const float DeltaTime)
+		{
+			return TickCorrectionCheck(*Check, DeltaTime);
+		}));
+	}
+
+
+	/**
+	 * Time a frame of fixed steps for every pup in the world, either one after another or batched
+	 * @param OutNumSteps	If set, how many rounds of fixed steps the manager ran is added to it
+	 **/
+	static double TimeFrames(APupMovementManager* Manager, const TArray<APawn*>& HeadlessPups, const int32 NumFrames,
+		const bool bParallel, const bool bLOD, int32* OutNumSteps = nullptr)
+	{
+		const float FrameTime = UPupMovementComponent::GetTimestepLength();
+		double TotalTime = 0.0;
+		for (int32 Frame = 0; Frame < NumFrames; Frame++)
+		{
+			// Keep every pup running in slowly turning circles, so nobody comes to rest
+			for (int32 Index = 0; Index < HeadlessPups.Num(); Index++)
+			{
+				const float Yaw = Index * 137.5f + Frame * 3.0f;
+				HeadlessPups[Index]->AddMovementInput(FRotator(0.0f, Yaw, 0.0f).Vector());
+			}
+
+			const double FrameStart = FPlatformTime::Seconds();
+			Manager->UpdateMovementLOD(FrameTime, bLOD);
+			Manager->StepPups(FrameTime, bParallel);
+			TotalTime += FPlatformTime::Seconds() - FrameStart;
+
+			if (OutNumSteps)
+			{
+				*OutNumSteps += Manager->GetLastStepCount();
+			}
+		}
+		return TotalTime;
+	}
+
+
+	/** Spread copies of a pup out in a grid beside it, with no controllers **/
+	static void SpawnHeadlessPups(UWorld* World, const APawn* TemplatePawn, const int32 NumPups, const float Spacing,
+		TArray<APawn*>& OutHeadlessPups)
+	{
+		const FVector Origin = TemplatePawn->GetActorLocation();
+		const int32 GridSize = FMath::CeilToInt(FMath::Sqrt(static_cast<float>(NumPups)));
+
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.SpawnCollisionHandlingOverride = ESpawnActorCollisionHandlingMethod::AdjustIfPossibleButAlwaysSpawn;
+		SpawnParameters.ObjectFlags |= RF_Transient;
+
+		for (int32 Index = 0; Index < NumPups; Index++)
+		{
+			const FVector Offset((Index % GridSize + 1) * Spacing, (Index / GridSize) * Spacing, 0.0f);
+			if (APawn* Pawn = World->SpawnActor<APawn>(TemplatePawn->GetClass(), Origin + Offset, TemplatePawn->GetActorRotation(),
+				SpawnParameters))
+			{
+				OutHeadlessPups.Add(Pawn);
+			}
+		}
+	}
+
+
+	/** Find what the batch and crowd benchmarks need, or explain why they can't run **/
+	static bool GetBenchmarkPups(UWorld* World, const TCHAR* BenchmarkName, const APawn*& OutTemplatePawn,
+		APupMovementManager*& OutManager)
+	{
+		UPupMovementComponent* MovementComponent = World ? FindMovementComponent(World) : nullptr;
+		OutManager = APupMovementManager::Get(World);
+		OutTemplatePawn = MovementComponent ? MovementComponent->GetPawnOwner() : nullptr;
+		if (!OutTemplatePawn || !OutManager)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("PupMovement %s benchmark: no pup movement component in this world to copy"), BenchmarkName);
+			return false;
+		}
+		if (!UPupMovementComponent::UsesFixedTimestep())
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("PupMovement %s benchmark: pups are only batched with PupMovement.FixedTimestep"), BenchmarkName);
+			return false;
+		}
+		return true;
+	}
+
+
+	static void SaveStates(const TArray<TWeakObjectPtr<UPupMovementComponent>>& Pups, TArray<FPupMovementComponentState>& OutStates)
+	{
+		OutStates.SetNum(Pups.Num());
+		for (int32 Index = 0; Index < Pups.Num(); Index++)
+		{
+			Pups[Index]->SaveState(OutStates[Index]);
+		}
+	}
+
+
+	static void RestoreStates(const TArray<TWeakObjectPtr<UPupMovementComponent>>& Pups, const TArray<FPupMovementComponentState>& States)
+	{
+		for (int32 Index = 0; Index < Pups.Num(); Index++)
+		{
+			if (Pups[Index].IsValid())
+			{
+				Pups[Index]->RestoreState(States[Index]);
+			}
+		}
+	}
+
+
+	static void BenchmarkBatch(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 NumPups = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 64;
+		const int32 NumFrames = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 120;
+
+		const APawn* TemplatePawn = nullptr;
+		APupMovementManager* Manager = nullptr;
+		if (!GetBenchmarkPups(World, TEXT("batch"), TemplatePawn, Manager))
+		{
+			return;
+		}
+
+		TArray<APawn*> HeadlessPups;
+		SpawnHeadlessPups(World, TemplatePawn, NumPups, 150.0f, HeadlessPups);
+		UE_LOG(LogTetherGame, Display, TEXT("PupMovement batch benchmark: %d headless pups, %d frames"), HeadlessPups.Num(), NumFrames);
+
+		// Both runs start from the same place, at full detail
+		const TArray<TWeakObjectPtr<UPupMovementComponent>> Pups = Manager->GetPups();
+		TArray<FPupMovementComponentState> SavedStates;
+		SaveStates(Pups, SavedStates);
+
+		const double SerialTime = TimeFrames(Manager, HeadlessPups, NumFrames, false, false);
+		RestoreStates(Pups, SavedStates);
+		const double BatchedTime = TimeFrames(Manager, HeadlessPups, NumFrames, true, false);
+		RestoreStates(Pups, SavedStates);
+
+		for (APawn* Pawn : HeadlessPups)
+		{
+			Pawn->Destroy();
+		}
+
+		UE_LOG(LogTetherGame, Display, TEXT("  Serial: %.3f ms per frame"), SerialTime * 1000.0 / NumFrames);
+		UE_LOG(LogTetherGame, Display, TEXT("  Batched: %.3f ms per frame"), BatchedTime * 1000.0 / NumFrames);
+	}
+
+
+	/**
+	 * Forwards everything to the real allocator, counting the allocations made on the game thread.
+	 * Only installed while a check is running, and everything it allocates is freed by the same allocator.
+	 **/
+	class FCountingMalloc final : public FMalloc
+	{
+	public:
+		explicit FCountingMalloc(FMalloc* InInner) : Inner(InInner) {}
+
+		int32 GetNumAllocations() const { return NumAllocations; }
+
+		virtual void* Malloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return Inner->Malloc(Count, Alignment);
+		}
+
+		virtual void* TryMalloc(SIZE_T Count, uint32 Alignment) override
+		{
+			CountAllocation();
+			return Inner->TryMalloc(Count, Alignment);
+		}
+
+		virtual void* Realloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			if (Count > 0)
+			{
+				CountAllocation();
+			}
+			return Inner->Realloc(Original, Count, Alignment);
+		}
+
+		virtual void* TryRealloc(void* Original, SIZE_T Count, uint32 Alignment) override
+		{
+			if (Count > 0)
+			{
+				CountAllocation();
+			}
+			return Inner->TryRealloc(Original, Count, Alignment);
+		}
+
+		virtual void Free(void* Original) override { Inner->Free(Original); }
+
+		virtual SIZE_T QuantizeSize(SIZE_T Count, uint32 Alignment) override { return Inner->QuantizeSize(Count, Alignment); }
+
+		virtual bool GetAllocationSize(void* Original, SIZE_T& SizeOut) override { return Inner->GetAllocationSize(Original, SizeOut); }
+
+		virtual void Trim(bool bTrimThreadCaches) override { Inner->Trim(bTrimThreadCaches); }
+
+		virtual void SetupTLSCachesOnCurrentThread() override { Inner->SetupTLSCachesOnCurrentThread(); }
+
+		virtual void ClearAndDisableTLSCachesOnCurrentThread() override { Inner->ClearAndDisableTLSCachesOnCurrentThread(); }
+
+		virtual bool IsInternallyThreadSafe() const override { return Inner->IsInternallyThreadSafe(); }
+
+		virtual const TCHAR* GetDescriptiveName() override { return Inner->GetDescriptiveName(); }
+
+	private:
+		void CountAllocation()
+		{
+			// Worker threads and the render thread allocate whenever they like, so only count the step's own thread
+			if (IsInGameThread())
+			{
+				NumAllocations++;
+			}
+		}
+
+		FMalloc* Inner;
+		int32 NumAllocations = 0;
+	};
+
+
+	static void ReportStepAllocations(const TCHAR* PassName, const int32 NumAllocations, const int32 NumPups, const int32 NumFrames)
+	{
+		if (NumAllocations == 0)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("  %s passed: no allocations in %d frames of steps"), PassName, NumFrames);
+		}
+		else
+		{
+			UE_LOG(LogTetherGame, Error, TEXT("  %s failed: %d allocations in %d frames of steps, %.2f per pup per frame"),
+				PassName, NumAllocations, NumFrames, static_cast<float>(NumAllocations) / (FMath::Max(NumPups, 1) * NumFrames));
+		}
+	}
+
+
+	static void CheckStepAllocations(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 NumPups = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 16;
+		const int32 NumFrames = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 60;
+
+		const APawn* TemplatePawn = nullptr;
+		APupMovementManager* Manager = nullptr;
+		if (!GetBenchmarkPups(World, TEXT("allocation"), TemplatePawn, Manager))
+		{
+			return;
+		}
+
+		TArray<APawn*> HeadlessPups;
+		SpawnHeadlessPups(World, TemplatePawn, NumPups, 150.0f, HeadlessPups);
+		UE_LOG(LogTetherGame, Display, TEXT("PupMovement allocation check: %d headless pups, %d frames"), HeadlessPups.Num(), NumFrames);
+
+		const TArray<TWeakObjectPtr<UPupMovementComponent>> Pups = Manager->GetPups();
+		TArray<FPupMovementComponentState> SavedStates;
+		SaveStates(Pups, SavedStates);
+
+		// Let every cache, history, prefetch and scratch array grow to its steady state size first
+		TimeFrames(Manager, HeadlessPups, NumFrames, false, false);
+		TimeFrames(Manager, HeadlessPups, NumFrames, true, false);
+
+		// Serial, so the whole step runs on the game thread where it's counted
+		FMalloc* const PreviousMalloc = GMalloc;
+		FCountingMalloc SerialMalloc(PreviousMalloc);
+		GMalloc = &SerialMalloc;
+		TimeFrames(Manager, HeadlessPups, NumFrames, false, false);
+		GMalloc = PreviousMalloc;
+
+		// ParallelFor allocates its own bookkeeping for every dispatch, which the parallel pass shouldn't be blamed for
+		FCountingMalloc DispatchMalloc(PreviousMalloc);
+		GMalloc = &DispatchMalloc;
+		ParallelFor(Pups.Num(), [](const int32 Index) {});
+		GMalloc = PreviousMalloc;
+
+		// Parallel, where the queries are prefetched on worker threads. Only the game thread's share of it is counted.
+		int32 NumSteps = 0;
+		FCountingMalloc ParallelMalloc(PreviousMalloc);
+		GMalloc = &ParallelMalloc;
+		TimeFrames(Manager, HeadlessPups, NumFrames, true, false, &NumSteps);
+		GMalloc = PreviousMalloc;
+
+		RestoreStates(Pups, SavedStates);
+		for (APawn* Pawn : HeadlessPups)
+		{
+			Pawn->Destroy();
+		}
+
+		const int32 ParallelAllocations = ParallelMalloc.GetNumAllocations() - DispatchMalloc.GetNumAllocations() * NumSteps;
+		ReportStepAllocations(TEXT("Serial"), SerialMalloc.GetNumAllocations(), HeadlessPups.Num(), NumFrames);
+		ReportStepAllocations(TEXT("Parallel"), FMath::Max(ParallelAllocations, 0), HeadlessPups.Num(), NumFrames);
+	}
+
+
+	static void BenchmarkCrowd(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 NumPups = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 256;
+		const int32 NumFrames = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 120;
+
+		const APawn* TemplatePawn = nullptr;
+		APupMovementManager* Manager = nullptr;
+		if (!GetBenchmarkPups(World, TEXT("crowd"), TemplatePawn, Manager))
+		{
+			return;
+		}
+
+		// Spread far enough apart that the crowd reaches past every LOD distance
+		TArray<APawn*> HeadlessPups;
+		SpawnHeadlessPups(World, TemplatePawn, NumPups, 800.0f, HeadlessPups);
+		UE_LOG(LogTetherGame, Display, TEXT("PupMovement crowd benchmark: %d headless pups, %d frames"), HeadlessPups.Num(), NumFrames);
+
+		const TArray<TWeakObjectPtr<UPupMovementComponent>> Pups = Manager->GetPups();
+		TArray<FPupMovementComponentState> SavedStates;
+		SaveStates(Pups, SavedStates);
+
+		const double FullDetailTime = TimeFrames(Manager, HeadlessPups, NumFrames, true, false);
+		RestoreStates(Pups, SavedStates);
+		const double LODTime = TimeFrames(Manager, HeadlessPups, NumFrames, true, true);
+
+		// Count where the crowd ended up before anything is put back
+		TArray<int32> PupsPerLOD;
+		for (const TWeakObjectPtr<UPupMovementComponent>& Pup : Pups)
+		{
+			if (Pup.IsValid())
+			{
+				const int32 LOD = Pup->GetMovementLOD();
+				if (LOD >= PupsPerLOD.Num())
+				{
+					PupsPerLOD.SetNumZeroed(LOD + 1);
+				}
+				PupsPerLOD[LOD]++;
+			}
+		}
+		RestoreStates(Pups, SavedStates);
+
+		for (APawn* Pawn : HeadlessPups)
+		{
+			Pawn->Destroy();
+		}
+
+		UE_LOG(LogTetherGame, Display, TEXT("  Full detail: %.3f ms per frame"), FullDetailTime * 1000.0 / NumFrames);
+		UE_LOG(LogTetherGame, Display, TEXT("  With movement LOD: %.3f ms per frame"), LODTime * 1000.0 / NumFrames);
+		for (int32 LOD = 0; LOD < PupsPerLOD.Num(); LOD++)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("    LOD %d: %d pups"), LOD, PupsPerLOD[LOD]);
+		}
+	}
+
+
+	/**
+	 * Lay a square of conveyor segments under an area, each pushing a different way.
+	 * Every other segment is static, so both moving and static surfaces are measured.
+	 **/
+	static void SpawnConveyors(UWorld* World, const FVector& Corner, const float Width, const int32 NumSegments,
+		TArray<AActor*>& OutSegments)
+	{
+		const int32 GridSize = FMath::CeilToInt(FMath::Sqrt(static_cast<float>(NumSegments)));
+		const float SegmentSize = Width / GridSize;
+		const float Thickness = 10.0f;
+
+		FActorSpawnParameters SpawnParameters;
+		SpawnParameters.ObjectFlags |= RF_Transient;
+
+		for (int32 Index = 0; Index < NumSegments; Index++)
+		{
+			const FVector Location = Corner + FVector(
+				(Index % GridSize + 0.5f) * SegmentSize,
+				(Index / GridSize + 0.5f) * SegmentSize,
+				-Thickness);
+			AActor* Segment = World->SpawnActor<AActor>(AActor::StaticClass(), FTransform::Identity, SpawnParameters);
+			if (!Segment)
+			{
+				continue;
+			}
+
+			UConveyorComponent* Conveyor = NewObject<UConveyorComponent>(Segment);
+			Conveyor->SetMobility(Index % 2 == 0 ? EComponentMobility::Movable : EComponentMobility::Static);
+			Conveyor->SetBoxExtent(FVector(SegmentSize * 0.5f, SegmentSize * 0.5f, Thickness));
+			Conveyor->SetCollisionProfileName(UCollisionProfile::BlockAll_ProfileName);
+			Conveyor->SetBeltVelocity(FVector(100.0f, 0.0f, 0.0f));
+			Conveyor->SetWorldLocationAndRotation(Location, FRotator(0.0f, (Index % 4) * 90.0f, 0.0f));
+			Segment->SetRootComponent(Conveyor);
+			Conveyor->RegisterComponent();
+			OutSegments.Add(Segment);
+		}
+	}
+
+
+	static void BenchmarkConveyors(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 NumSegments = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 400;
+		const int32 NumPups = Args.Num() > 1 ? FMath::Max(1, FCString::Atoi(*Args[1])) : 64;
+		const int32 NumFrames = Args.Num() > 2 ? FMath::Max(1, FCString::Atoi(*Args[2])) : 120;
+
+		const APawn* TemplatePawn = nullptr;
+		APupMovementManager* Manager = nullptr;
+		if (!GetBenchmarkPups(World, TEXT("conveyor"), TemplatePawn, Manager))
+		{
+			return;
+		}
+
+		// Raise the pups and their conveyors off of the level's own floor, so the conveyors are all they can stand on
+		const float Spacing = 150.0f;
+		const float Lift = 100.0f;
+		TArray<APawn*> HeadlessPups;
+		SpawnHeadlessPups(World, TemplatePawn, NumPups, Spacing, HeadlessPups);
+		for (APawn* Pawn : HeadlessPups)
+		{
+			Pawn->SetActorLocation(Pawn->GetActorLocation() + FVector(0.0f, 0.0f, Lift));
+		}
+
+		const int32 PupGridSize = FMath::CeilToInt(FMath::Sqrt(static_cast<float>(NumPups)));
+		const FVector Feet = TemplatePawn->GetActorLocation() - FVector(0.0f, 0.0f, TemplatePawn->GetSimpleCollisionHalfHeight());
+		TArray<AActor*> Segments;
+		SpawnConveyors(World, Feet + FVector(0.0f, -Spacing, Lift), (PupGridSize + 2) * Spacing, NumSegments, Segments);
+		UE_LOG(LogTetherGame, Display, TEXT("PupMovement conveyor benchmark: %d headless pups on %d conveyor segments, %d frames"),
+			HeadlessPups.Num(), Segments.Num(), NumFrames);
+
+		const TArray<TWeakObjectPtr<UPupMovementComponent>> Pups = Manager->GetPups();
+		TArray<FPupMovementComponentState> SavedStates;
+		SaveStates(Pups, SavedStates);
+
+		const double SerialTime = TimeFrames(Manager, HeadlessPups, NumFrames, false, false);
+		RestoreStates(Pups, SavedStates);
+		const double BatchedTime = TimeFrames(Manager, HeadlessPups, NumFrames, true, false);
+		RestoreStates(Pups, SavedStates);
+
+		for (APawn* Pawn : HeadlessPups)
+		{
+			Pawn->Destroy();
+		}
+		for (AActor* Segment : Segments)
+		{
+			Segment->Destroy();
+		}
+
+		UE_LOG(LogTetherGame, Display, TEXT("  Serial: %.3f ms per frame"), SerialTime * 1000.0 / NumFrames);
+		UE_LOG(LogTetherGame, Display, TEXT("  Batched: %.3f ms per frame"), BatchedTime * 1000.0 / NumFrames);
+	}
+
+
+	/**
+	 * Step every pup a frame at a time, reading input before each frame, until a pup's velocity first changes.
+	 * @returns how many frames it took, or INDEX_NONE if the pup never responded
+	 **/
+	static int32 CountFramesToRespond(APupMovementManager* Manager, const UPupMovementComponent* Pup, const float FrameTime,
+		const int32 MaxFrames, TFunctionRef<void(int32 Frame)> ReadInput)
+	{
+		const FVector StartVelocity = Pup->Velocity;
+		for (int32 Frame = 0; Frame < MaxFrames; Frame++)
+		{
+			ReadInput(Frame);
+			Manager->UpdateMovementLOD(FrameTime, false);
+			Manager->StepPups(FrameTime, true);
+			if (!Pup->Velocity.Equals(StartVelocity, 1.0f))
+			{
+				return Frame + 1;
+			}
+		}
+		return INDEX_NONE;
+	}
+
+
+	static void BenchmarkInputLatency(const TArray<FString>& Args, UWorld* World)
+	{
+		const int32 NumTrials = Args.Num() > 0 ? FMath::Max(1, FCString::Atoi(*Args[0])) : 16;
+		const float FrameRates[] = { 30.0f, 60.0f, 144.0f, 240.0f };
+		const int32 MaxFrames = 60;
+
+		const APawn* TemplatePawn = nullptr;
+		APupMovementManager* Manager = nullptr;
+		if (!GetBenchmarkPups(World, TEXT("input latency"), TemplatePawn, Manager))
+		{
+			return;
+		}
+
+		TArray<APawn*> HeadlessPups;
+		SpawnHeadlessPups(World, TemplatePawn, 1, 300.0f, HeadlessPups);
+		UPupMovementComponent* Pup = HeadlessPups.Num() > 0 ?
+			Cast<UPupMovementComponent>(HeadlessPups[0]->GetMovementComponent()) :
+			nullptr;
+		if (!Pup)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("PupMovement input latency benchmark: couldn't spawn a headless pup"));
+			return;
+		}
+		APawn* Pawn = HeadlessPups[0];
+
+		const TArray<TWeakObjectPtr<UPupMovementComponent>> Pups = Manager->GetPups();
+		TArray<FPupMovementComponentState> SavedStates;
+		SaveStates(Pups, SavedStates);
+
+		// Let the new pup land and come to rest, so the only thing that can change its velocity is the input
+		for (int32 Frame = 0; Frame < 60; Frame++)
+		{
+			Manager->StepPups(1.0f / 60.0f, true);
+		}
+		TArray<FPupMovementComponentState> SettledStates;
+		SaveStates(Pups, SettledStates);
+
+		UE_LOG(LogTetherGame, Display, TEXT("PupMovement input latency benchmark: %d trials per frame rate, %.1f ms steps"),
+			NumTrials, UPupMovementComponent::GetTimestepLength() * 1000.0f);
+
+		for (const float FrameRate : FrameRates)
+		{
+			const float FrameTime = 1.0f / FrameRate;
+			int32 JumpFrames = 0;
+			int32 MoveFrames = 0;
+			int32 MaxJumpFrames = 0;
+			int32 MaxMoveFrames = 0;
+			int32 NumResponses = 0;
+			for (int32 Trial = 0; Trial < NumTrials; Trial++)
+			{
+				// Idle for a different number of frames each trial, so input lands at different points between steps
+				const auto RestoreAndIdle = [&]()
+				{
+					RestoreStates(Pups, SettledStates);
+					for (int32 Frame = 0; Frame < Trial % 7; Frame++)
+					{
+						Manager->StepPups(FrameTime, true);
+					}
+				};
+
+				RestoreAndIdle();
+				const int32 Jump = CountFramesToRespond(Manager, Pup, FrameTime, MaxFrames, [Pup](int32 Frame)
+				{
+					if (Frame == 0)
+					{
+						Pup->HandleInputAction(EPupMovementInputAction::Jump);
+					}
+				});
+
+				RestoreAndIdle();
+				const int32 Move = CountFramesToRespond(Manager, Pup, FrameTime, MaxFrames, [Pawn](int32)
+				{
+					Pawn->AddMovementInput(FVector::ForwardVector);
+				});
+
+				if (Jump == INDEX_NONE || Move == INDEX_NONE)
+				{
+					continue;
+				}
+				NumResponses++;
+				JumpFrames += Jump;
+				MoveFrames += Move;
+				MaxJumpFrames = FMath::Max(MaxJumpFrames, Jump);
+				MaxMoveFrames = FMath::Max(MaxMoveFrames, Move);
+			}
+
+			if (NumResponses == 0)
+			{
+				UE_LOG(LogTetherGame, Display, TEXT("  %.0f fps: the pup never responded, is it standing on anything?"), FrameRate);
+				continue;
+			}
+			const float AverageJump = static_cast<float>(JumpFrames) / NumResponses;
+			const float AverageMove = static_cast<float>(MoveFrames) / NumResponses;
+			UE_LOG(LogTetherGame, Display, TEXT("  %.0f fps: jump after %.2f frames (%.1f ms, at most %d), move after %.2f frames (%.1f ms, at most %d)"),
+				FrameRate, AverageJump, AverageJump * FrameTime * 1000.0f, MaxJumpFrames,
+				AverageMove, AverageMove * FrameTime * 1000.0f, MaxMoveFrames);
+		}
+
+		RestoreStates(Pups, SavedStates);
+		for (APawn* HeadlessPawn : HeadlessPups)
+		{
+			HeadlessPawn->Destroy();
+		}
+	}
+
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkInputLatencyCommand(
+		TEXT("PupMovement.BenchmarkInputLatency"),
+		TEXT("Spawn a headless pup and count the frames from a jump or move input to its velocity changing, at several frame rates. Usage: PupMovement.BenchmarkInputLatency [NumTrials]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkInputLatency));
+
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkConveyorsCommand(
+		TEXT("PupMovement.BenchmarkConveyors"),
+		TEXT("Spawn headless pups on a field of conveyor segments and time stepping them. Usage: PupMovement.BenchmarkConveyors [NumSegments] [NumPups] [NumFrames]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkConveyors));
+
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkCrowdCommand(
+		TEXT("PupMovement.BenchmarkCrowd"),
+		TEXT("Spawn a spread out crowd of headless pups and time stepping them at full detail and with movement LOD. Usage: PupMovement.BenchmarkCrowd [NumPups] [NumFrames]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkCrowd));
+
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkBatchCommand(
+		TEXT("PupMovement.BenchmarkBatch"),
+		TEXT("Spawn headless pups and time stepping every pup one after another against batching them. Usage: PupMovement.BenchmarkBatch [NumPups] [NumFrames]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkBatch));
+
+
+	static FAutoConsoleCommandWithWorldAndArgs CheckCorrectionsCommand(
+		TEXT("PupMovement.CheckCorrections"),
+		TEXT("On a client, move the local pup around under simulated packet loss and lag, and fail if the server corrects it too often. ")
+		TEXT("Usage: PupMovement.CheckCorrections [Seconds] [PacketLossPercent] [LagMs] [MaxCorrectionsPer100Steps]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&CheckCorrections));
+
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkSnapshotsCommand(
+		TEXT("PupMovement.BenchmarkSnapshots"),
+		TEXT("Time saving, restoring, and rolling back a pup's movement state. Usage: PupMovement.BenchmarkSnapshots [NumIterations] [RollbackSteps]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkSnapshots));
+
+
+	static FAutoConsoleCommandWithWorldAndArgs BenchmarkKernelCommand(
+		TEXT("PupMovement.BenchmarkKernel"),
+		TEXT("Time the batched movement kernel against stepping a movement component. Usage: PupMovement.BenchmarkKernel [NumPups] [NumSteps]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&BenchmarkKernel));
+
+
+	static FAutoConsoleCommandWithWorldAndArgs CheckStepAllocationsCommand(
+		TEXT("PupMovement.CheckStepAllocations"),
+		TEXT("Spawn headless pups, let them settle, then fail if stepping them serially or in parallel allocates any memory on the game thread. Allocations on worker threads aren't counted. Usage: PupMovement.CheckStepAllocations [NumPups] [NumFrames]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&CheckStepAllocations));
+}
@@ -4,11 +4,14 @@
 #include "PupMovementComponent.h"
 
 #include "DrawDebugHelpers.h"
+#include "PupMovementManager.h"
+#include "PupMovementStats.h"
 #include "../TetherCharacter.h"
 #include "Components/CapsuleComponent.h"
 #include "Kismet/KismetSystemLibrary.h"
 #include "Tether/Tether.h"
-#include "Tether/Gameplay/Obstacles/Conveyor.h"
+#include "Tether/Core/SurfaceVelocity.h"
+#include "Tether/Core/TetherWorldSettings.h"
 
 
 namespace PupMovementCVars
@@ -20,6 +23,21 @@ namespace PupMovementCVars
 		TEXT("Maximum length of a physics timestep before splitting into multiple steps"),
 		ECVF_Default);
 
+	static int32 FixedTimestep = 1;
+	static FAutoConsoleVariableRef CVarFixedTimestep(
+		TEXT("PupMovement.FixedTimestep"),
+		FixedTimestep,
+		TEXT("If non-zero, movement is simulated in fixed steps of TimestepLength, carrying leftover frame time ")
+		TEXT("over to the next frame and interpolating the presented transform between the last two steps"),
+		ECVF_Default);
+
+	static int32 MaxStepsPerFrame = 4;
+	static FAutoConsoleVariableRef CVarMaxStepsPerFrame(
+		TEXT("PupMovement.MaxStepsPerFrame"),
+		MaxStepsPerFrame,
+		TEXT("Maximum number of fixed movement steps simulated in a single frame. Any time beyond this budget is dropped"),
+		ECVF_Default);
+
 	static float MinimumTraceDistance = 0.5f;
 	static FAutoConsoleVariableRef CVarMinimumTraceDistance(
 		TEXT("PupMovement.MinimumTraceDistance"),
@@ -33,7 +51,49 @@ namespace PupMovementCVars
 		MaxSubsteps,
 		TEXT("Maximum number of substeps to perform while resolving movement collision"),
 		ECVF_Default);
+
+	static float SubstepRadiusFraction = 0.5f;
+	static FAutoConsoleVariableRef CVarSubstepRadiusFraction(
+		TEXT("PupMovement.SubstepRadiusFraction"),
+		SubstepRadiusFraction,
+		TEXT("Maximum distance covered by a single velocity substep, as a fraction of the capsule radius"),
+		ECVF_Default);
+
+	static int32 MaxVelocitySubsteps = 8;
+	static FAutoConsoleVariableRef CVarMaxVelocitySubsteps(
+		TEXT("PupMovement.MaxVelocitySubsteps"),
+		MaxVelocitySubsteps,
+		TEXT("Maximum number of slices a single step can be broken into when moving quickly"),
+		ECVF_Default);
 	
+	static int32 AllowResting = 1;
+	static FAutoConsoleVariableRef CVarAllowResting(
+		TEXT("PupMovement.AllowResting"),
+		AllowResting,
+		TEXT("If non-zero, pups standing still on a static floor stop running movement queries until something wakes them"),
+		ECVF_Default);
+
+	static int32 UseContactCache = 1;
+	static FAutoConsoleVariableRef CVarUseContactCache(
+		TEXT("PupMovement.UseContactCache"),
+		UseContactCache,
+		TEXT("If non-zero, nearby blocking primitives are gathered once per step, and queries that can't hit any of them are skipped"),
+		ECVF_Default);
+
+	static float ContactCacheMargin = 50.0f;
+	static FAutoConsoleVariableRef CVarContactCacheMargin(
+		TEXT("PupMovement.ContactCacheMargin"),
+		ContactCacheMargin,
+		TEXT("Extra distance around the capsule, beyond the distance travelled in a step, to gather contacts from"),
+		ECVF_Default);
+
+	static int32 PenetrationSolverIterations = 4;
+	static FAutoConsoleVariableRef CVarPenetrationSolverIterations(
+		TEXT("PupMovement.PenetrationSolverIterations"),
+		PenetrationSolverIterations,
+		TEXT("Number of passes over the queued penetrations when solving for a step's combined adjustment"),
+		ECVF_Default);
+
 	static float KillZ = -100.0f;
 	static FAutoConsoleVariableRef CVarKillZ(
 		TEXT("PupMovement.KillZ"),
@@ -42,12 +102,146 @@ namespace PupMovementCVars
 		ECVF_Default);
 }
 
+DEFINE_STAT(STAT_PupMovementSubsteps);
+DEFINE_STAT(STAT_PupMovementHeightfieldQueries);
+DEFINE_STAT(STAT_PupMovementHeightfieldFallbacks);
+DEFINE_STAT(STAT_PupMovementContactCacheHits);
+DEFINE_STAT(STAT_PupMovementContactCacheMisses);
+DEFINE_STAT(STAT_PupMovementCorrections);
+DEFINE_STAT(STAT_PupMovementAsyncQueryHits);
+DEFINE_STAT(STAT_PupMovementAsyncQueryFallbacks);
+DEFINE_STAT(STAT_PupMovementSweeps);
+DEFINE_STAT(STAT_PupMovementLineTraces);
+DEFINE_STAT(STAT_PupMovementClosestPoints);
+DEFINE_STAT(STAT_PupMovementOverlaps);
+DEFINE_STAT(STAT_PupMovementPupsStepped);
+DEFINE_STAT(STAT_PupMovementSweepsPerPup);
+DEFINE_STAT(STAT_PupMovementLineTracesPerPup);
+DEFINE_STAT(STAT_PupMovementClosestPointsPerPup);
+DEFINE_STAT(STAT_PupMovementMaxPupQueries);
+DEFINE_STAT(STAT_PupMovementSubsteps1);
+DEFINE_STAT(STAT_PupMovementSubsteps2);
+DEFINE_STAT(STAT_PupMovementSubsteps4);
+DEFINE_STAT(STAT_PupMovementSubsteps8);
+DEFINE_STAT(STAT_PupMovementSubstepsMore);
+DEFINE_STAT(STAT_PupMovementRemainingNone);
+DEFINE_STAT(STAT_PupMovementRemainingQuarter);
+DEFINE_STAT(STAT_PupMovementRemainingHalf);
+DEFINE_STAT(STAT_PupMovementRemainingMore);
+DEFINE_STAT(STAT_PupMovementStepWalking);
+DEFINE_STAT(STAT_PupMovementStepFalling);
+DEFINE_STAT(STAT_PupMovementStepAnchored);
+DEFINE_STAT(STAT_PupMovementStepDeflected);
+DEFINE_STAT(STAT_PupMovementStepRecover);
+DEFINE_STAT(STAT_PupMovementStepDragging);
+DEFINE_STAT(STAT_PupMovementPrefetch);
+DEFINE_STAT(STAT_PupMovementStepMovement);
+DEFINE_STAT(STAT_PupMovementSubstepMovement);
+DEFINE_STAT(STAT_PupMovementFindFloor);
+DEFINE_STAT(STAT_PupMovementMantle);
+DEFINE_STAT(STAT_PupMovementEdgeSlide);
+
+CSV_DEFINE_CATEGORY(PupMovement, true);
+
+
+/** What each movement mode needs from a step. Modes without a specialization skip everything. **/
+template <EPupMovementMode Mode>
+struct TPupMovementModeTraits
+{
+	/** Does this mode move through its velocity and rotation updates at all? **/
+	static constexpr bool bUpdatesKinematics = false;
+	/** Can this mode be pushed around by other objects? **/
+	static constexpr bool bAcceptsPushes = false;
+	/** Does this mode probe for the floor and sweep its movement through the world? **/
+	static constexpr bool bSweepsMovement = false;
+	static TStatId GetStatId() { return TStatId(); }
+	/** Name of the mode's step timing in CSV profiles, which don't use the stats system **/
+	static const char* GetCsvStatName() { return "StepOther"; }
+};
+
+template <>
+struct TPupMovementModeTraits<EPupMovementMode::M_None>
+{
+	/** Only stops the player, which the kernel does for any mode without its own velocity **/
+	static constexpr bool bUpdatesKinematics = true;
+	static constexpr bool bAcceptsPushes = false;
+	static constexpr bool bSweepsMovement = false;
+	static TStatId GetStatId() { return TStatId(); }
+	static const char* GetCsvStatName() { return "StepNone"; }
+};
+
+template <>
+struct TPupMovementModeTraits<EPupMovementMode::M_Walking>
+{
+	static constexpr bool bUpdatesKinematics = true;
+	static constexpr bool bAcceptsPushes = true;
+	static constexpr bool bSweepsMovement = true;
+	static TStatId GetStatId() { return GET_STATID(STAT_PupMovementStepWalking); }
+	static const char* GetCsvStatName() { return "StepWalking"; }
+};
+
+template <>
+struct TPupMovementModeTraits<EPupMovementMode::M_Falling>
+{
+	static constexpr bool bUpdatesKinematics = true;
+	static constexpr bool bAcceptsPushes = true;
+	static constexpr bool bSweepsMovement = true;
+	static TStatId GetStatId() { return GET_STATID(STAT_PupMovementStepFalling); }
+	static const char* GetCsvStatName() { return "StepFalling"; }
+};
+
+template <>
+struct TPupMovementModeTraits<EPupMovementMode::M_Anchored>
+{
+	static constexpr bool bUpdatesKinematics = true;
+	static constexpr bool bAcceptsPushes = false;
+	static constexpr bool bSweepsMovement = true;
+	static TStatId GetStatId() { return GET_STATID(STAT_PupMovementStepAnchored); }
+	static const char* GetCsvStatName() { return "StepAnchored"; }
+};
+
+template <>
+struct TPupMovementModeTraits<EPupMovementMode::M_Deflected>
+{
+	static constexpr bool bUpdatesKinematics = true;
+	static constexpr bool bAcceptsPushes = false;
+	static constexpr bool bSweepsMovement = true;
+	static TStatId GetStatId() { return GET_STATID(STAT_PupMovementStepDeflected); }
+	static const char* GetCsvStatName() { return "StepDeflected"; }
+};
+
+template <>
+struct TPupMovementModeTraits<EPupMovementMode::M_Recover>
+{
+	static constexpr bool bUpdatesKinematics = true;
+	static constexpr bool bAcceptsPushes = false;
+	/** Recovering players fall through (or around) everything, and never look for the floor **/
+	static constexpr bool bSweepsMovement = false;
+	static TStatId GetStatId() { return GET_STATID(STAT_PupMovementStepRecover); }
+	static const char* GetCsvStatName() { return "StepRecover"; }
+};
+
+template <>
+struct TPupMovementModeTraits<EPupMovementMode::M_Dragging>
+{
+	static constexpr bool bUpdatesKinematics = true;
+	static constexpr bool bAcceptsPushes = false;
+	static constexpr bool bSweepsMovement = true;
+	static TStatId GetStatId() { return GET_STATID(STAT_PupMovementStepDragging); }
+	static const char* GetCsvStatName() { return "StepDragging"; }
+};
+
 
 UPupMovementComponent::UPupMovementComponent()
-{}
+{
+	SetIsReplicatedByDefault(true);
+	MovementLODTiers_DEPRECATED = UPupMovementSettings::MakeDefaultMovementLODTiers();
+}
 
 UPupMovementComponent::UPupMovementComponent(const FObjectInitializer& ObjectInitializer)
 {
+	SetIsReplicatedByDefault(true);
+	MovementLODTiers_DEPRECATED = UPupMovementSettings::MakeDefaultMovementLODTiers();
 }
 
 
@@ -59,134 +253,753 @@ void UPupMovementComponent::BeginPlay()
 	DesiredRotation = UpdatedComponent->GetComponentRotation();
 	BasisPositionLastTick = UpdatedComponent->GetComponentLocation();
 	LastValidLocation = UpdatedComponent->GetComponentLocation();
+
+	if (ATetherCharacter* Character = Cast<ATetherCharacter>(GetPawnOwner()))
+	{
+		PresentationComponent = Character->GetMeshComponent();
+		if (PresentationComponent)
+		{
+			PresentationRelativeTransform = PresentationComponent->GetRelativeTransform();
+		}
+	}
+	ResetPresentationInterpolation();
+
+	TArray<USceneComponent*> ChildComponents;
+	UpdatedComponent->GetChildrenComponents(false, ChildComponents);
+	for (USceneComponent* Component : ChildComponents)
+	{
+		if (Component->ComponentHasTag(TEXT("MantleHandle")))
+		{
+			MantleHandleOffset = Component->GetRelativeLocation();
+			break;
+		}
+	}
+
+	if (const ATetherWorldSettings* WorldSettings = Cast<ATetherWorldSettings>(GetWorld()->GetWorldSettings()))
+	{
+		FloorHeightfield = WorldSettings->FloorHeightfield;
+	}
+
+	ContactCache.SetFrameStats(&FrameStats);
+
+	if (UpdatedPrimitive)
+	{
+		UpdatedPrimitive->OnComponentBeginOverlap.AddDynamic(this, &UPupMovementComponent::OnUpdatedComponentBeginOverlap);
+		UpdatedPrimitive->OnComponentHit.AddDynamic(this, &UPupMovementComponent::OnUpdatedComponentHit);
+	}
+
+	if (APupMovementManager* Manager = APupMovementManager::Get(GetWorld()))
+	{
+		Manager->AddPup(this);
+		MovementManager = Manager;
+	}
+}
+
+
+void UPupMovementComponent::PostLoad()
+{
+	Super::PostLoad();
+	MigrateDeprecatedTuning();
+}
+
+
+void UPupMovementComponent::MigrateDeprecatedTuning()
+{
+	if (MovementSettings || HasAnyFlags(RF_ClassDefaultObject))
+	{
+		return;
+	}
+
+	// Deprecated properties are never saved again, so they can only differ from the class defaults in old saves
+	const UPupMovementComponent* Defaults = GetDefault<UPupMovementComponent>();
+	bool bHasOldTuning = false;
+	for (TFieldIterator<FProperty> Iterator(StaticClass()); Iterator && !bHasOldTuning; ++Iterator)
+	{
+		bHasOldTuning = Iterator->HasAnyPropertyFlags(CPF_Deprecated) && !Iterator->Identical_InContainer(this, Defaults);
+	}
+	if (!bHasOldTuning)
+	{
+		return;
+	}
+
+	// Copy every old value, not just the saved ones, since some of the settings' defaults are different
+	MovementSettings = NewObject<UPupMovementSettings>(this, TEXT("MigratedMovementSettings"), GetMaskedFlags(RF_PropagateToSubObjects));
+	static const int32 SuffixLength = FCString::Strlen(TEXT("_DEPRECATED"));
+	for (TFieldIterator<FProperty> Iterator(StaticClass()); Iterator; ++Iterator)
+	{
+		if (!Iterator->HasAnyPropertyFlags(CPF_Deprecated))
+		{
+			continue;
+		}
+
+		const FString SettingName = Iterator->GetName().LeftChop(SuffixLength);
+		FProperty* SettingProperty = FindFProperty<FProperty>(UPupMovementSettings::StaticClass(), *SettingName);
+		if (SettingProperty && SettingProperty->SameType(*Iterator))
+		{
+			SettingProperty->CopyCompleteValue(SettingProperty->ContainerPtrToValuePtr<void>(MovementSettings),
+				Iterator->ContainerPtrToValuePtr<void>(this));
+		}
+	}
+	MovementSettings->UpdateDerivedValues();
+
+	UE_LOG(LogTetherGame, Display, TEXT("%s: moved tuning saved on the component into %s. Resave to keep it."),
+		*GetPathName(), *MovementSettings->GetName());
+}
+
+
+void UPupMovementComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if (APupMovementManager* Manager = MovementManager.Get())
+	{
+		Manager->RemovePup(this);
+	}
+	MovementManager.Reset();
+
+	Super::EndPlay(EndPlayReason);
 }
 
 
 void UPupMovementComponent::TickComponent(float DeltaTime, ELevelTick TickType,
                                           FActorComponentTickFunction* TickFunction)
 {
-	// Gather all of the input we've accumulated since the last frame
-	HandleInputVectors();
+	if (IsBatched() || bReplaying)
+	{
+		// The movement manager steps and presents us along with every other pup, or from a replay
+		return;
+	}
+
+	if (GetOwnerRole() == ROLE_SimulatedProxy)
+	{
+		// Other players' pups are moved by replicated movement, so just show them wherever they are
+		DecayCorrectionOffset(DeltaTime);
+		ResetPresentationInterpolation();
+		UpdatePresentation();
+		return;
+	}
+	if (IsDrivenByRemoteClient())
+	{
+		// Steps are simulated as the owning client's input arrives, in ServerMove, as fast as time passes here
+		EarnClientStepBudget(DeltaTime);
+		DecayCorrectionOffset(DeltaTime);
+		UpdatePresentation();
+		return;
+	}
+
+	if (!PupMovementCVars::FixedTimestep)
+	{
+		DecayCorrectionOffset(DeltaTime);
+		BufferInputVector();
+		InputClock += DeltaTime;
+		ConsumeBufferedInput(InputClock);
+		while (DeltaTime > SMALL_NUMBER)
+		{
+			// Break frame time into actual movement steps
+			const float ActualStepLength = FMath::Min(DeltaTime, PupMovementCVars::TimestepLength);
+			DeltaTime -= ActualStepLength;
+
+			StepMovement(ActualStepLength);
+		}
+		IssueAsyncQueries(PupMovementCVars::TimestepLength);
+		ResetPresentationInterpolation();
+		UpdatePresentation();
+		return;
+	}
+
+	const int32 NumSteps = BeginFixedSteps(DeltaTime);
+	const float StepLength = GetFixedStepLength();
+	for (int32 Step = 0; Step < NumSteps; Step++)
+	{
+		SimulateFixedStep(StepLength);
+	}
+	EndFixedSteps(NumSteps);
+}
+
+
+float UPupMovementComponent::GetTimestepLength()
+{
+	return FMath::Max(PupMovementCVars::TimestepLength, KINDA_SMALL_NUMBER);
+}
+
+
+bool UPupMovementComponent::UsesFixedTimestep()
+{
+	return PupMovementCVars::FixedTimestep != 0;
+}
+
+
+bool UPupMovementComponent::IsBatched() const
+{
+	return MovementManager.IsValid() && APupMovementManager::IsBatching() && CanBeBatched();
+}
+
+
+bool UPupMovementComponent::CanBeBatched() const
+{
+	return UpdatedComponent && IsComponentTickEnabled() && GetOwnerRole() != ROLE_SimulatedProxy && !IsDrivenByRemoteClient() &&
+		!bReplaying;
+}
+
+
+int32 UPupMovementComponent::BeginFixedSteps(const float DeltaTime)
+{
+	DecayCorrectionOffset(DeltaTime);
+
+	// Gather all of the input we've accumulated since the last frame. It arrived before any of this frame's time.
+	BufferInputVector();
+	InputClock += DeltaTime;
+
+	const float StepLength = GetTimestepLength();
+	TimeAccumulator += DeltaTime;
+
+	int32 NumSteps = FMath::Clamp(FMath::FloorToInt(TimeAccumulator / StepLength), 0,
+		FMath::Max(PupMovementCVars::MaxStepsPerFrame, 0));
+	TimeAccumulator -= NumSteps * StepLength;
+	if (TimeAccumulator >= StepLength)
+	{
+		// We ran out of our step budget, so drop the extra time instead of trying to catch up next frame
+		TimeAccumulator = FMath::Fmod(TimeAccumulator, StepLength);
+	}
+
+	// At reduced movement LOD, one long step stands in for several fixed ones
+	const int32 StepInterval = FMath::Max(GetMovementLODTier().StepInterval, 1);
+	NumSteps += SkippedSteps;
+	SkippedSteps = NumSteps % StepInterval;
+	NumSteps /= StepInterval;
+
+	// This frame's steps finish wherever the time still waiting to be simulated begins
+	StepClock = InputClock - TimeAccumulator - SkippedSteps * StepLength - NumSteps * GetFixedStepLength();
+	return NumSteps;
+}
+
+
+float UPupMovementComponent::GetFixedStepLength() const
+{
+	return GetTimestepLength() * FMath::Max(GetMovementLODTier().StepInterval, 1);
+}
+
+
+void UPupMovementComponent::SimulateFixedStep(const float DeltaTime)
+{
+	StepClock += DeltaTime;
+	ConsumeBufferedInput(StepClock);
+
+	PreviousSimulatedTransform = UpdatedComponent->GetComponentTransform();
+	if (IsPredicting())
+	{
+		PredictStep(DeltaTime);
+	}
+	else
+	{
+		StepMovement(DeltaTime);
+	}
+	CurrentSimulatedTransform = UpdatedComponent->GetComponentTransform();
+}
+
+
+void UPupMovementComponent::EndFixedSteps(const int32 NumSteps)
+{
+	if (NumSteps > 0)
+	{
+		IssueAsyncQueries(GetTimestepLength());
+		if (IsPredicting())
+		{
+			SendUnacknowledgedFrames();
+		}
+	}
+	UpdatePresentation();
+}
+
+
+void UPupMovementComponent::PrefetchStepQueries(const float DeltaTime)
+{
+	// Indexed by EPupMovementMode
+	static const bool ModeSweeps[] = {
+		TPupMovementModeTraits<EPupMovementMode::M_None>::bSweepsMovement,
+		TPupMovementModeTraits<EPupMovementMode::M_Walking>::bSweepsMovement,
+		TPupMovementModeTraits<EPupMovementMode::M_Falling>::bSweepsMovement,
+		TPupMovementModeTraits<EPupMovementMode::M_Anchored>::bSweepsMovement,
+		TPupMovementModeTraits<EPupMovementMode::M_Deflected>::bSweepsMovement,
+		TPupMovementModeTraits<EPupMovementMode::M_Recover>::bSweepsMovement,
+		TPupMovementModeTraits<EPupMovementMode::M_Dragging>::bSweepsMovement
+	};
+
+	const int32 Index = static_cast<int32>(MovementMode);
+	if (bResting || Index < 0 || Index >= UE_ARRAY_COUNT(ModeSweeps) || !ModeSweeps[Index] || !UpdatedPrimitive)
+	{
+		// Resting steps run no queries at all, and the mode could still change before the step sweeps
+		return;
+	}
+
+	// The cache is gathered before this step's velocity is known, but queries that leave the gathered region are
+	// never ruled out, so a stale region only costs hits
+	GatherContacts(DeltaTime);
+	bContactsPrefetched = ContactCache.IsGathered();
+	PrefetchedBounds = bContactsPrefetched ? ContactCache.GetRegion() : FBox(ForceInit);
+
+	PrefetchFloor(DeltaTime);
+}
+
+
+void UPupMovementComponent::DiscardPrefetchedQueries(const FBox& Bounds)
+{
+	if ((bContactsPrefetched || bFloorPrefetched) && PrefetchedBounds.Intersect(Bounds))
+	{
+		ClearPrefetchedQueries();
+	}
+}
+
+
+void UPupMovementComponent::UpdateMovementLOD(const float DeltaTime, const float ViewerDistance, const bool bOffScreen)
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+	MovementLODPromotionRemaining = FMath::Max(MovementLODPromotionRemaining - DeltaTime, 0.0f);
+	if (IsExemptFromMovementLOD() || MovementLODPromotionRemaining > 0.0f)
+	{
+		MovementLOD = 0;
+		return;
+	}
+
+	int32 NewMovementLOD = 0;
+	for (int32 Index = 1; Index < Settings.MovementLODTiers.Num(); Index++)
+	{
+		const FPupMovementLODTier& Tier = Settings.MovementLODTiers[Index];
+		if (ViewerDistance >= Tier.MinDistance || (bOffScreen && Tier.bWhenOffScreen))
+		{
+			NewMovementLOD = Index;
+		}
+	}
+	MovementLOD = NewMovementLOD;
+}
+
+
+void UPupMovementComponent::PromoteMovementLOD()
+{
+	MovementLODPromotionRemaining = GetMovementSettings().MovementLODPromotionTime;
+	MovementLOD = 0;
+}
+
+
+bool UPupMovementComponent::IsExemptFromMovementLOD() const
+{
+	return !PawnOwner || PawnOwner->IsPlayerControlled() || IsPredicting() || IsDrivenByRemoteClient();
+}
+
+
+bool UPupMovementComponent::WasRecentlyRendered() const
+{
+	const UPrimitiveComponent* RenderedComponent = Cast<UPrimitiveComponent>(PresentationComponent);
+	if (!RenderedComponent)
+	{
+		RenderedComponent = UpdatedPrimitive;
+	}
+	return RenderedComponent && RenderedComponent->WasRecentlyRendered();
+}
+
+
+const FPupMovementLODTier& UPupMovementComponent::GetMovementLODTier() const
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+	static const FPupMovementLODTier FullDetail;
+	return Settings.MovementLODTiers.IsValidIndex(MovementLOD) ? Settings.MovementLODTiers[MovementLOD] : FullDetail;
+}
+
+
+void UPupMovementComponent::ClearPrefetchedQueries()
+{
+	if (bContactsPrefetched)
+	{
+		ContactCache.Reset();
+		bContactsPrefetched = false;
+	}
+	bFloorPrefetched = false;
+	PrefetchedBounds = FBox(ForceInit);
+}
+
+
+FTransform UPupMovementComponent::GetPresentationTransform() const
+{
+	if (!UpdatedComponent)
+	{
+		return FTransform::Identity;
+	}
+	if (!PupMovementCVars::FixedTimestep)
+	{
+		FTransform Result = UpdatedComponent->GetComponentTransform();
+		Result.AddToTranslation(CorrectionOffset);
+		return Result;
+	}
+	const float TimeSinceStep = TimeAccumulator + SkippedSteps * GetTimestepLength();
+	const float Alpha = FMath::Clamp(TimeSinceStep / GetFixedStepLength(), 0.0f, 1.0f);
+	
+	// Anything that moved us outside of a step (pushes, teleports, etc.) should show up immediately
+	const FVector ExternalOffset = UpdatedComponent->GetComponentLocation() - CurrentSimulatedTransform.GetLocation();
+	
+	FTransform Result;
+	Result.SetLocation(FMath::Lerp(PreviousSimulatedTransform.GetLocation(), CurrentSimulatedTransform.GetLocation(), Alpha) +
+		ExternalOffset + CorrectionOffset);
+	Result.SetRotation(FQuat::Slerp(PreviousSimulatedTransform.GetRotation(), CurrentSimulatedTransform.GetRotation(), Alpha));
+	Result.SetScale3D(UpdatedComponent->GetComponentScale());
+	return Result;
+}
+
+
+FVector UPupMovementComponent::GetPresentationLocation() const
+{
+	return GetPresentationTransform().GetLocation();
+}
+
+
+void UPupMovementComponent::ResetPresentationInterpolation()
+{
+	if (UpdatedComponent)
+	{
+		PreviousSimulatedTransform = UpdatedComponent->GetComponentTransform();
+		CurrentSimulatedTransform = PreviousSimulatedTransform;
+	}
+}
+
+
+void UPupMovementComponent::UpdatePresentation()
+{
+	if (PresentationComponent && UpdatedComponent)
+	{
+		PresentationComponent->SetWorldTransform(PresentationRelativeTransform * GetPresentationTransform());
+	}
+}
+
+
+float UPupMovementComponent::GetMaxSpeed() const
+{
+	return GetMovementSettings().MaxSpeed;
+}
+
+
+float UPupMovementComponent::GetGravityZ() const
+{
+	// Gravity scale here?
+	return Super::GetGravityZ();
+}
+
+
+bool UPupMovementComponent::ResolvePenetrationImpl(const FVector& Adjustment, const FHitResult& Hit,
+	const FQuat& NewRotation)
+{
+	WakeUp();
+	NoteDynamicContact();
+	/* if (MatchModes(MovementMode, {EPupMovementMode::M_Walking, EPupMovementMode::M_Falling, EPupMovementMode::M_Deflected}))
+	{
+		if (Hit.GetComponent())
+		{
+			// We shouldn't copy the velocity from slight floor glitches -- this could lead to the player
+			// being counted as being in the air.
+			const FVector AdjustmentWithoutBasis = Adjustment - FVector::DotProduct(Adjustment, FloorNormal) * FloorNormal;
+			if (AdjustmentWithoutBasis.Size() >= KINDA_SMALL_NUMBER)
+			{
+				// The further in the sweep the move had to occur, the faster we had to move out of the way
+				// AddAdjustment(AdjustmentWithoutBasis / (1 - Hit.Time));
+				if (bDrawMovementDebug)
+				{
+					DrawDebugDirectionalArrow(GetWorld(), UpdatedComponent->GetComponentLocation(),
+						UpdatedComponent->GetComponentLocation() + Adjustment * 10.0f, 5.0f, FColor::Green, false, 10.0f);
+				}
+			}
+			RenderHitResult(Hit, FColor::Green);
+			InvalidFloorComponents.Add(Hit.GetComponent());
+		}
+	} */
+	// return Super::ResolvePenetrationImpl(Adjustment, Hit, NewRotation);
+	AddPenetration(Adjustment);
+	return true;
+}
+
+
+void UPupMovementComponent::StepMovement(const float DeltaTime)
+{
+	PUP_MOVEMENT_SCOPE_CYCLE_COUNTER(StepMovement);
+	if (!bResimulating && MovementManager.IsValid())
+	{
+		if (FPupMovementRecorder* Recorder = MovementManager->GetRecorder())
+		{
+			Recorder->RecordStep(this, DeltaTime, PendingInputActions);
+		}
+	}
+	RecordHistory(DeltaTime);
+	StepNumber++;
+	FrameStats.Steps++;
+
+	if (const uint32 ExpiredTimers = Timers.Advance(DeltaTime))
+	{
+		WakeUp();
+		HandleExpiredTimers(ExpiredTimers);
+	}
+	RetryBufferedActions();
+
+	if (bResting)
+	{
+		if (CanRest())
+		{
+			// Nothing can have changed since we came to rest, so there's nothing to query
+			ClearPrefetchedQueries();
+			return;
+		}
+		WakeUp();
+	}
+
+	if (DynamicContactSteps > 0)
+	{
+		DynamicContactSteps--;
+	}
+
+	// Move out of anything that pushed into us since the last step, all at once
+	ResolvePendingPenetrations();
+	
+	MagnetToBasis(1.0f, DeltaTime);
+	// HandleExternalOverlaps(DeltaTime);
+	(this->*GetModeRoutines(MovementMode).Step)(DeltaTime);
+
+	// Snapping to the floor and hitting walls can queue penetrations after the last substep resolved them
+	ResolvePendingPenetrations();
+
+	MovementSpeedAlpha = Velocity.IsNearlyZero() ? 0.0f : Velocity.Size2D() / GetMovementSettings().MaxSpeed;
+	ClearInvalidFloorComponents();
+	ContactCache.Reset();
+	ClearPrefetchedQueries();
+	ClearPenetrations();
+	
+	// Let our primitive component know what its new velocity should be
+	UpdateComponentVelocity();
+
+	// EXPERIMENTAL!!!!
+	HandleRootMotion();
 	
-	while (DeltaTime > SMALL_NUMBER)
+	StoreBasisTransformPostUpdate();
+
+	if (PupMovementCVars::AllowResting && CanRest() && Velocity.IsNearlyZero() && FMath::IsNearlyZero(TurningDirection, 0.01f))
+	{
+		bResting = true;
+	}
+}
+
+
+template <EPupMovementMode Mode>
+void UPupMovementComponent::StepMode(const float DeltaTime)
+{
+	typedef TPupMovementModeTraits<Mode> FTraits;
+	FScopeCycleCounter StepCycleCounter(FTraits::GetStatId());
+#if CSV_PROFILER
+	FScopedCsvStat StepCsvStat(FTraits::GetCsvStatName(), CSV_CATEGORY_INDEX(PupMovement));
+#endif
+
+	if (FTraits::bUpdatesKinematics)
+	{
+		UpdateKinematics<Mode>(DeltaTime);
+	}
+	// Breaking an anchor can hand us to a mode that accepts pushes part way through the step
+	if (FTraits::bAcceptsPushes || MovementMode != Mode)
+	{
+		HandlePushes(DeltaTime);
+	}
+
+	if (FTraits::bSweepsMovement)
+	{
+		if (!bContactsPrefetched)
+		{
+			GatherContacts(DeltaTime);
+		}
+		if (MovementMode == Mode)
+		{
+			UpdateVerticalMovement<Mode>(DeltaTime);
+		}
+		else
+		{
+			(this->*GetModeRoutines(MovementMode).UpdateVerticalMovement)(DeltaTime);
+		}
+		TryRegainControl();
+		SweepMovement(DeltaTime);
+		if (UpdatedComponent->GetComponentLocation().Z <= PupMovementCVars::KillZ)
+		{
+			Recover();
+		}
+	}
+	else if (Mode == EPupMovementMode::M_Recover && GetMovementSettings().bIgnoreObstaclesWhenRecovering)
+	{
+		UpdatedComponent->SetWorldLocation(UpdatedComponent->GetComponentLocation() + Velocity * DeltaTime, false);
+	}
+}
+
+
+#define PUP_MODE_ROUTINES(Mode) { \
+	&UPupMovementComponent::StepMode<Mode>, \
+	&UPupMovementComponent::UpdateKinematics<Mode>, \
+	&UPupMovementComponent::UpdateVerticalMovement<Mode> }
+
+const UPupMovementComponent::FModeRoutines& UPupMovementComponent::GetModeRoutines(const EPupMovementMode Mode)
+{
+	// Indexed by EPupMovementMode
+	static const FModeRoutines ModeRoutines[] = {
+		PUP_MODE_ROUTINES(EPupMovementMode::M_None),
+		PUP_MODE_ROUTINES(EPupMovementMode::M_Walking),
+		PUP_MODE_ROUTINES(EPupMovementMode::M_Falling),
+		PUP_MODE_ROUTINES(EPupMovementMode::M_Anchored),
+		PUP_MODE_ROUTINES(EPupMovementMode::M_Deflected),
+		PUP_MODE_ROUTINES(EPupMovementMode::M_Recover),
+		PUP_MODE_ROUTINES(EPupMovementMode::M_Dragging)
+	};
+
+	const int32 Index = static_cast<int32>(Mode);
+	return ModeRoutines[ensure(Index >= 0 && Index < UE_ARRAY_COUNT(ModeRoutines)) ? Index : 0];
+}
+
+#undef PUP_MODE_ROUTINES
+
+
+void UPupMovementComponent::SweepMovement(const float DeltaTime)
+{
+	// Slice the step based on how far we're moving, then break each slice into substeps based on collisions
+	const int32 NumSlices = PlanSubsteps(DeltaTime);
+	const float SliceLength = DeltaTime / NumSlices;
+	int32 NumSubsteps = 0;
+	for (int32 Slice = 0; Slice < NumSlices; Slice++)
 	{
-		// Break frame time into actual movement steps
-		const float ActualStepLength = FMath::Min(DeltaTime, PupMovementCVars::TimestepLength);
-		DeltaTime -= ActualStepLength;
+		float RemainingTime = SliceLength;
+		int32 NumCollisionSubsteps = 0;
+		while (NumCollisionSubsteps < PupMovementCVars::MaxSubsteps && RemainingTime > SMALL_NUMBER)
+		{
+			NumCollisionSubsteps++;
+			RemainingTime -= SubstepMovement(RemainingTime);
+		}
+		NumSubsteps += NumCollisionSubsteps;
+		FrameStats.AddRemainingTime(FMath::Max(RemainingTime, 0.0f) / SliceLength);
+	}
+	INC_DWORD_STAT_BY(STAT_PupMovementSubsteps, NumSubsteps);
+	FrameStats.AddSubsteps(NumSubsteps);
+}
+
 
-		StepMovement(ActualStepLength);
+void UPupMovementComponent::GatherContacts(const float DeltaTime)
+{
+	if (!PupMovementCVars::UseContactCache)
+	{
+		ContactCache.Reset();
+		return;
 	}
+
+	FCollisionQueryParams QueryParams = FCollisionQueryParams::DefaultQueryParam;
+	QueryParams.AddIgnoredActor(GetOwner());
+
+	// Anything the player can reach this step is within the distance travelled, plus a margin for probes like the mantle trace
+	const float Inflation = Velocity.Size() * DeltaTime + PupMovementCVars::ContactCacheMargin;
+	ContactCache.Gather(GetWorld(), Cast<UPrimitiveComponent>(UpdatedComponent), Inflation, QueryParams);
 }
 
 
-#if WITH_EDITOR
-void UPupMovementComponent::PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent)
+void UPupMovementComponent::HandleExpiredTimers(const uint32 ExpiredTimers)
 {
-	Super::PostEditChangeProperty(PropertyChangedEvent);
+	const auto HasExpired = [ExpiredTimers](const EPupMovementTimer Timer)
+	{
+		return (ExpiredTimers & FPupMovementTimers::GetTimerBit(Timer)) != 0;
+	};
 
-	const FName PropertyName = PropertyChangedEvent.Property ? PropertyChangedEvent.GetPropertyName() : NAME_None;
-	if (PropertyName == GET_MEMBER_NAME_CHECKED(UPupMovementComponent, MaxIncline))
+	if (HasExpired(EPupMovementTimer::Coyote) && !bGrounded)
+	{
+		bCanJump = false;
+	}
+	if (HasExpired(EPupMovementTimer::Jump))
+	{
+		StopJumping();
+	}
+	if (HasExpired(EPupMovementTimer::Deflect))
+	{
+		TryRegainControl();
+	}
+	if (HasExpired(EPupMovementTimer::MantleDebounce))
 	{
-		MaxInclineZComponent = FMath::Cos(FMath::DegreesToRadians(MaxIncline));
+		bCanMantle = true;
 	}
-	else if (PropertyName == GET_MEMBER_NAME_CHECKED(UPupMovementComponent, ApexVelocity) || PropertyName ==
-		GET_MEMBER_NAME_CHECKED(UPupMovementComponent, MaxJumpTime) || PropertyName == GET_MEMBER_NAME_CHECKED(
-			UPupMovementComponent, JumpInitialVelocity))
+	if (HasExpired(EPupMovementTimer::WallJumpControl))
 	{
-		HoldJumpAcceleration = MaxJumpTime <= 0.0f ? 0.0f : (ApexVelocity - JumpInitialVelocity) / MaxJumpTime;
+		bWallJumpDisabledControl = false;
+	}
+	if (HasExpired(EPupMovementTimer::Dash))
+	{
+		EndDash();
+	}
+	if (HasExpired(EPupMovementTimer::EdgeScramble))
+	{
+		bWallScrambling = false;
+	}
+	if (HasExpired(EPupMovementTimer::Recovery))
+	{
+		EndRecovery();
 	}
 }
-#endif
 
 
-float UPupMovementComponent::GetMaxSpeed() const
+bool UPupMovementComponent::CanRest() const
 {
-	return MaxSpeed;
+	if (!(MovementMode == EPupMovementMode::M_Walking && bGrounded && !bIsWalking &&
+		!bDashing && !bJumping && !bWallSliding &&
+		IsValid(BasisComponent) && BasisComponent->Mobility != EComponentMobility::Movable &&
+		PendingImpulses.IsNearlyZero() && PendingPushes.IsNearlyZero() &&
+		PendingRootMotionTransforms.GetTranslation().IsNearlyZero()))
+	{
+		return false;
+	}
+
+	// Static conveyors and treadmills don't move, but still carry us along every step
+	const UObject* Source = GetSurfaceVelocitySource();
+	return !Source || ISurfaceVelocity::Execute_GetSurfaceVelocity(Source).IsNearlyZero();
 }
 
 
-float UPupMovementComponent::GetGravityZ() const
+void UPupMovementComponent::WakeUp()
 {
-	// Gravity scale here?
-	return Super::GetGravityZ();
+	bResting = false;
 }
 
 
-bool UPupMovementComponent::ResolvePenetrationImpl(const FVector& Adjustment, const FHitResult& Hit,
-	const FQuat& NewRotation)
+void UPupMovementComponent::OnUpdatedComponentBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor,
+	UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult)
 {
-	/* if (MatchModes(MovementMode, {EPupMovementMode::M_Walking, EPupMovementMode::M_Falling, EPupMovementMode::M_Deflected}))
+	WakeUp();
+	if (OtherComp && OtherComp->Mobility == EComponentMobility::Movable)
 	{
-		if (Hit.GetComponent())
-		{
-			// We shouldn't copy the velocity from slight floor glitches -- this could lead to the player
-			// being counted as being in the air.
-			const FVector AdjustmentWithoutBasis = Adjustment - FVector::DotProduct(Adjustment, FloorNormal) * FloorNormal;
-			if (AdjustmentWithoutBasis.Size() >= KINDA_SMALL_NUMBER)
-			{
-				// The further in the sweep the move had to occur, the faster we had to move out of the way
-				// AddAdjustment(AdjustmentWithoutBasis / (1 - Hit.Time));
-				if (bDrawMovementDebug)
-				{
-					DrawDebugDirectionalArrow(GetWorld(), UpdatedComponent->GetComponentLocation(),
-						UpdatedComponent->GetComponentLocation() + Adjustment * 10.0f, 5.0f, FColor::Green, false, 10.0f);
-				}
-			}
-			RenderHitResult(Hit, FColor::Green);
-			InvalidFloorComponents.Add(Hit.GetComponent());
-		}
-	} */
-	// return Super::ResolvePenetrationImpl(Adjustment, Hit, NewRotation);
-	return true;
+		NoteDynamicContact();
+		PromoteMovementLOD();
+	}
 }
 
 
-void UPupMovementComponent::StepMovement(const float DeltaTime)
+void UPupMovementComponent::OnUpdatedComponentHit(UPrimitiveComponent* HitComponent, AActor* OtherActor,
+	UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit)
 {
-	MagnetToBasis(1.0f, DeltaTime);
-	// HandleExternalOverlaps(DeltaTime);
-	UpdatedComponent->SetWorldRotation(GetNewRotation(DeltaTime));
-	Velocity = GetNewVelocity(DeltaTime);
-	HandlePushes(DeltaTime);
-	
-	if (MatchModes(MovementMode, {EPupMovementMode::M_Walking, EPupMovementMode::M_Falling, EPupMovementMode::M_Deflected, EPupMovementMode::M_Anchored, EPupMovementMode::M_Dragging}))
-	{
-		UpdateVerticalMovement(DeltaTime);
-		TryRegainControl();
-
-		float NewDeltaTime = DeltaTime;
-		// Break up physics into substeps based on collisions
-		int32 NumSubsteps = 0;
-		while (NumSubsteps < PupMovementCVars::MaxSubsteps && DeltaTime > SMALL_NUMBER)
-		{
-			NumSubsteps++;
-			NewDeltaTime -= SubstepMovement(NewDeltaTime);
-		}
-		if (UpdatedComponent->GetComponentLocation().Z <= PupMovementCVars::KillZ)
-		{
-			Recover();
-		}
-	}
-	else if (MovementMode == EPupMovementMode::M_Recover && bIgnoreObstaclesWhenRecovering)
+	WakeUp();
+	if (OtherComp && OtherComp->Mobility == EComponentMobility::Movable)
 	{
-		UpdatedComponent->SetWorldLocation(UpdatedComponent->GetComponentLocation() + Velocity * DeltaTime, false);
+		NoteDynamicContact();
+		PromoteMovementLOD();
 	}
+}
 
-	MovementSpeedAlpha = Velocity.IsNearlyZero() ? 0.0f : Velocity.Size2D() / MaxSpeed;
-	InvalidFloorComponents.Empty();
-	
-	// Let our primitive component know what its new velocity should be
-	UpdateComponentVelocity();
 
-	// EXPERIMENTAL!!!!
-	HandleRootMotion();
+int32 UPupMovementComponent::PlanSubsteps(const float DeltaTime) const
+{
+	if (!UpdatedPrimitive)
+	{
+		return 1;
+	}
+	// Never move more than a fraction of our radius in one sweep, so thin geometry can't be skipped over
+	const float CapsuleRadius = UpdatedPrimitive->GetCollisionShape().GetCapsuleRadius();
+	const float MaxSliceDistance = FMath::Max(CapsuleRadius * PupMovementCVars::SubstepRadiusFraction, PupMovementCVars::MinimumTraceDistance);
+	const float StepDistance = Velocity.Size() * DeltaTime;
 	
-	StoreBasisTransformPostUpdate();
+	return FMath::Clamp(FMath::CeilToInt(StepDistance / MaxSliceDistance), 1, FMath::Max(PupMovementCVars::MaxVelocitySubsteps, 1));
 }
 
 
 float UPupMovementComponent::SubstepMovement(const float DeltaTime)
 {
+	PUP_MOVEMENT_SCOPE_CYCLE_COUNTER(SubstepMovement);
 	const FVector Movement = Velocity * DeltaTime;
 
 	if (Movement.IsNearlyZero())
@@ -201,9 +1014,9 @@ float UPupMovementComponent::SubstepMovement(const float DeltaTime)
 	SweepCapsule(Movement, HitResult, false);
 	if (HitResult.bStartPenetrating)
 	{
-		// Calculate the necessary adjustment to get out of whatever object we're in
-		const FVector Adjustment = GetPenetrationAdjustment(HitResult);
-		UpdatedComponent->AddWorldOffset(Adjustment, false);
+		// Get out of whatever object we're in, without undoing any adjustment we already made this step
+		AddPenetration(GetPenetrationAdjustment(HitResult));
+		ResolvePendingPenetrations();
 	}
 	else if (!HitResult.bBlockingHit)
 	{
@@ -232,6 +1045,10 @@ float UPupMovementComponent::SubstepMovement(const float DeltaTime)
 		if (HitResult.GetComponent())
 		{
 			RelativeVelocity -= HitResult.GetComponent()->GetComponentVelocity();
+			if (HitResult.GetComponent()->Mobility == EComponentMobility::Movable)
+			{
+				NoteDynamicContact();
+			}
 		}
 		const float ImpactVelocityMagnitude = FMath::Min(FVector::DotProduct(HitResult.Normal, RelativeVelocity), 0.f);
 		
@@ -244,18 +1061,21 @@ float UPupMovementComponent::SubstepMovement(const float DeltaTime)
 }
 
 
+template <EPupMovementMode Mode>
 void UPupMovementComponent::UpdateVerticalMovement(const float DeltaTime)
 {
+	const UPupMovementSettings& Settings = GetMovementSettings();
 	// First check if we're on the floor
 	FHitResult FloorHit;
-	const float EffectiveSnapDistance = FMath::Max(FloorSnapDistance, Velocity.Z * -DeltaTime);
+	const float EffectiveSnapDistance = FMath::Max(Settings.FloorSnapDistance, Velocity.Z * -DeltaTime);
 	if (FindFloor(EffectiveSnapDistance, FloorHit, 2))
 	{
 		const FVector RelativeVelocity = Velocity - FloorHit.GetComponent()->GetComponentVelocity();
 		if (FVector::DotProduct(RelativeVelocity, FloorNormal) <= KINDA_SMALL_NUMBER) // Avoid floating point errors..
 		{
 			const FVector ImpactVelocity = FVector::DotProduct(RelativeVelocity, FloorNormal) * FloorNormal;
-			if (!bGrounded && MovementMode == EPupMovementMode::M_Falling)
+			// Landing and falling change the mode, so only the checks before them can use Mode
+			if (!bGrounded && Mode == EPupMovementMode::M_Falling)
 			{
 				Land(FloorHit.ImpactPoint, ImpactVelocity.Size(), FloorHit.GetComponent());
 			}
@@ -275,13 +1095,13 @@ void UPupMovementComponent::UpdateVerticalMovement(const float DeltaTime)
 	}
 	else
 	{
-		if (bGrounded && MovementMode == EPupMovementMode::M_Walking)
+		if (bGrounded && Mode == EPupMovementMode::M_Walking)
 		{
 			Fall();
 		}
 		bGrounded = false;
 	}
-	if (MovementMode == EPupMovementMode::M_Falling && (Velocity.Z <= -MaximumGrabVelocity || bWallScrambling) )
+	if (MovementMode == EPupMovementMode::M_Falling && (Velocity.Z <= -Settings.MaximumGrabVelocity || bWallScrambling) )
 	{
 		Mantle();
 	}
@@ -295,11 +1115,19 @@ void UPupMovementComponent::UpdateVerticalMovement(const float DeltaTime)
 	{
 		// Verify we are actually adjacent to the wall with a line trace
 		FHitResult LineTrace;
-		if (BasisComponent && BasisComponent->LineTraceComponent(LineTrace, UpdatedComponent->GetComponentLocation(),
-			UpdatedComponent->GetComponentLocation() - WallNormal * 100.0f,
-			FCollisionQueryParams::DefaultQueryParam))
+		const FVector TraceStart = UpdatedComponent->GetComponentLocation();
+		bool bBesideWall = false;
+		if (BasisComponent &&
+			ContactCache.MayHit(FPupContactQuery::Line(TraceStart, TraceStart - WallNormal * 100.0f), IgnoredActors, BasisComponent))
+		{
+			CountQuery(EPupMovementQuery::LineTrace);
+			bBesideWall = BasisComponent->LineTraceComponent(LineTrace, TraceStart, TraceStart - WallNormal * 100.0f,
+				FCollisionQueryParams::DefaultQueryParam);
+		}
+
+		if (bBesideWall)
 		{
-			Velocity = FMath::VInterpConstantTo(Velocity, BasisComponent->ComponentVelocity, DeltaTime, BreakingFriction * 0.25f);
+			Velocity = PupMovementKernel::InterpConstantTo(Velocity, BasisComponent->ComponentVelocity, DeltaTime, Settings.BreakingFriction * 0.25f);
 		}
 		else
 		{
@@ -320,7 +1148,7 @@ bool UPupMovementComponent::SetMovementMode(const EPupMovementMode& NewMovementM
 		}
 	case EPupMovementMode::M_Deflected:
 		{
-			if (!bCanJumpWhileDeflected)
+			if (!GetMovementSettings().bCanJumpWhileDeflected)
 			{
 				bCanJump = false;
 			}
@@ -334,6 +1162,7 @@ bool UPupMovementComponent::SetMovementMode(const EPupMovementMode& NewMovementM
 	default:
 		break;
 	}
+	WakeUp();
 	MovementModeChanged.Broadcast(MovementMode, NewMovementMode);
 	MovementMode = NewMovementMode;
 	return true;
@@ -348,33 +1177,50 @@ EPupMovementMode UPupMovementComponent::GetMovementMode() const
 
 void UPupMovementComponent::AddImpulse(const FVector Impulse)
 {
+	WakeUp();
 	PendingImpulses += Impulse;
 }
 
 
 void UPupMovementComponent::Push(const FHitResult& HitResult, const FVector ImpactVelocity, UPrimitiveComponent* Source)
 {
+	WakeUp();
+	NoteDynamicContact();
+	PromoteMovementLOD();
 	const FVector Normal = -HitResult.ImpactNormal;
-	FVector Adjustment = FVector::ZeroVector;
-	if (HitResult.bStartPenetrating)
-	{
-		Adjustment = HitResult.PenetrationDepth * Velocity.GetSafeNormal();
-		UpdatedComponent->AddWorldOffset(Adjustment);
-	}
 	if (MovementMode == EPupMovementMode::M_Anchored && Source != BasisComponent)
 	{
 		BreakAnchor();
 	}
-	UpdatedComponent->AddWorldOffset(Normal * 0.1f);
+	// Move out of the pusher along its normal, plus a little extra so our next sweep doesn't start inside it
+	const float PenetrationDepth = HitResult.bStartPenetrating ? HitResult.PenetrationDepth : 0.0f;
+	AddPenetration(Normal * (PenetrationDepth + 0.1f));
 	PendingPushes = ImpactVelocity;
 }
 
 
+void UPupMovementComponent::AddPenetration(const FVector& Adjustment)
+{
+	const float Depth = Adjustment.Size();
+	if (Depth < KINDA_SMALL_NUMBER)
+	{
+		return;
+	}
+	WakeUp();
+
+	FPupPenetrationConstraint& Constraint = PendingPenetrations.AddDefaulted_GetRef();
+	Constraint.Normal = Adjustment / Depth;
+	// Depth is measured from where we are now, so count what we've already moved along the normal this step
+	Constraint.Depth = Depth + FVector::DotProduct(AppliedPenetration, Constraint.Normal);
+}
+
+
 void UPupMovementComponent::IgnoreActor(AActor* Actor)
 {
 	if (Actor)
 	{
 		IgnoredActors.Add(Actor);
+		bSweepQueryParamsDirty = true;
 	}
 }
 
@@ -384,6 +1230,7 @@ void UPupMovementComponent::UnignoreActor(AActor* Actor)
 	if (Actor)
 	{
 		IgnoredActors.Remove(Actor);
+		bSweepQueryParamsDirty = true;
 	}
 }
 
@@ -400,22 +1247,36 @@ void UPupMovementComponent::UnsupressInput()
 }
 
 
-void UPupMovementComponent::HandleInputVectors()
+void UPupMovementComponent::BufferInputVector()
 {
-	// Copy the camera yaw
-	if (APawn* Pawn = GetPawnOwner())
+	const FVector InputVector = ConsumeInputVector();
+
+	// The camera only matters for turning input into a direction, so don't ask where it is when there's no input
+	float SampleCameraYaw = CameraYaw;
+	if (!InputVector.IsNearlyZero())
 	{
-		if (AController* Controller = Pawn->GetController())
+		if (APawn* Pawn = GetPawnOwner())
 		{
-			FVector ViewLocation;
-			FRotator ViewRotation;
-			Controller->GetPlayerViewPoint(ViewLocation, ViewRotation);
-			CameraYaw = ViewRotation.Yaw;
+			if (AController* Controller = Pawn->GetController())
+			{
+				FVector ViewLocation;
+				FRotator ViewRotation;
+				Controller->GetPlayerViewPoint(ViewLocation, ViewRotation);
+				SampleCameraYaw = ViewRotation.Yaw;
+			}
 		}
 	}
-	const FVector InputVector = ConsumeInputVector();
+	InputBuffer.AddSample(InputVector, SampleCameraYaw, InputClock);
+}
+
+
+void UPupMovementComponent::ApplyInputSample(const FPupBufferedInputSample& Sample)
+{
+	CameraYaw = Sample.CameraYaw;
+	const FVector& InputVector = Sample.InputVector;
 	if (!InputVector.IsNearlyZero() && !bSupressingInput)
 	{
+		WakeUp();
 		// Clamp input axes
 		InputFactor = FMath::Min(InputVector.Size(), 1.0f);
 		bIsWalking = true;
@@ -437,219 +1298,147 @@ void UPupMovementComponent::HandleInputVectors()
 }
 
 
-// Update method wrappers
-FRotator UPupMovementComponent::GetNewRotation(const float DeltaTime)
+void UPupMovementComponent::ConsumeBufferedInput(const double StepTime)
 {
-	switch (MovementMode)
+	FPupBufferedInputSample Sample;
+	if (InputBuffer.ConsumeSample(StepTime, Sample))
 	{
-	case EPupMovementMode::M_Walking:
-		{
-			DesiredRotation.Yaw = bIsWalking ?
-				FMath::RadiansToDegrees(FMath::Atan2(DirectionVector.Y, DirectionVector.X)) :
-				UpdatedComponent->GetComponentRotation().Yaw;
-			float RotationRate = RotationSpeed;
-			if (bSlip)
-			{
-				RotationRate *= 1 - (1 - SlipFactor) * MovementSpeedAlpha;
-			}
-			const FRotator NewRotation = FMath::RInterpConstantTo(UpdatedComponent->GetComponentRotation(), DesiredRotation, DeltaTime, RotationRate);
-			const float DeltaYaw = FMath::FindDeltaAngleDegrees(DesiredRotation.Yaw, NewRotation.Yaw);
+		ApplyInputSample(Sample);
+	}
 
-			TurningDirection = FMath::Abs(DeltaYaw) > 0.01f ?
-				FMath::Clamp(FMath::Lerp(TurningDirection, DeltaYaw / 45.0f, 5.0f * DeltaTime),
-					-1.0f, 1.0f) :
-				FMath::Lerp(TurningDirection, 0.0f, 5.0f * DeltaTime);
-			return NewRotation;
-		}
-	case EPupMovementMode::M_Falling:
-		{
-			if (bWallSliding)
-			{
-				return FMath::RInterpConstantTo(UpdatedComponent->GetComponentRotation(), DesiredRotation, DeltaTime,
-					SnapRotationVelocity);
-			}
-			if (bIsWalking)
-			{
-				DesiredRotation.Yaw = FMath::RadiansToDegrees(FMath::Atan2(DirectionVector.Y, DirectionVector.X));
-			}
-			const float RotationRate = RotationSpeed * AirControlFactor;
-			return FMath::RInterpConstantTo(UpdatedComponent->GetComponentRotation(), DesiredRotation, DeltaTime,
-			    RotationRate);
-		}
-	case EPupMovementMode::M_Anchored:
-		{
-			return FMath::RInterpConstantTo(UpdatedComponent->GetComponentRotation(), DesiredRotation, DeltaTime,
-			    SnapRotationVelocity);
-		}
-	default:
-		{
-			return UpdatedComponent->GetComponentRotation();
-		}
+	const EPupMovementInputAction Actions = InputBuffer.ConsumeActions(StepTime);
+	if (Actions != EPupMovementInputAction::None)
+	{
+		PendingInputActions |= Actions;
+		ApplyInputActions(Actions);
 	}
 }
 
 
-FVector UPupMovementComponent::GetNewVelocity(const float DeltaTime)
+// Update method wrappers
+template <EPupMovementMode Mode>
+void UPupMovementComponent::UpdateKinematics(const float DeltaTime)
 {
-	switch (MovementMode)
-	{
-	case EPupMovementMode::M_Walking:
-		{
-			FVector AccelerationDirection = UpdatedComponent->GetForwardVector() * InputFactor;
-			if (FVector::DotProduct(FVector::UpVector, FloorNormal) < 0.99f)
-			{
-				// Only bother calculating the accleration along the plane if it isn't directly up
-				AccelerationDirection = FQuat::FindBetweenNormals(FVector::UpVector, FloorNormal).RotateVector(AccelerationDirection);
-			}
-			const FVector Acceleration = bIsWalking ? MaxAcceleration * AccelerationDirection + BreakingFriction * AccelerationDirection.GetSafeNormal() : FVector::ZeroVector;
-			FVector NewVelocity = Velocity + Acceleration * DeltaTime;
-			NewVelocity = ApplyFriction(NewVelocity, DeltaTime);
-			NewVelocity = ClampToPlaneMaxSize(NewVelocity, FloorNormal, MaxSpeed);
-			NewVelocity += ConsumeImpulse();
+	FPupMovementKernelState State = MakeKernelState();
+	const FPupMovementKernelParams Params = MakeKernelParams();
 
-			if (bDashing)
-			{
-				float const DashValue = FVector::DotProduct(DashDirection, NewVelocity);
-				if (DashValue < DashSpeed)
-				{
-					NewVelocity += DashDirection * (DashSpeed - DashValue);
-				}
-			}
+	PupMovementKernel::UpdateRotation<Mode>(State, Params, DeltaTime);
+	UpdatedComponent->SetWorldRotation(State.Rotation);
 
-			Speed = NewVelocity.Size();
-			return NewVelocity;
-		}
-	case EPupMovementMode::M_Falling:
-		{
-			// FVector Acceleration = MaxAcceleration * DirectionVector * DeltaTime * AirControlFactor;
-			FVector DesiredPlanarVelocity = bIsWalking ? DirectionVector * MaxSpeed : FVector::ZeroVector;
-			const float Acceleration = MaxAcceleration * AirControlFactor;
+	if (Mode == EPupMovementMode::M_Anchored)
+	{
+		ApplyKernelState(State);
+		Velocity = GetAnchoredVelocity(DeltaTime);
+		return;
+	}
 
-			if (bWallJumpDisabledControl)
-			{
-				// Limit the player's control when they jump away from the wall
-				DesiredPlanarVelocity = FVector(Velocity.X, Velocity.Y, 0.0f);
-			}
+	PupMovementKernel::UpdateVelocity<Mode>(State, Params, DeltaTime);
+	if (State.bWallScrambling && !bWallScrambling)
+	{
+		Timers.Set(EPupMovementTimer::EdgeScramble, GetMovementSettings().WallScrambleTime);
+	}
+	ApplyKernelState(State);
+}
 
-			FVector NewVelocity = FMath::VInterpConstantTo(Velocity, DesiredPlanarVelocity + FVector(0.0f, 0.0f, Velocity.Z), DeltaTime, Acceleration);
-			if (bWallSliding)
-			{
-				const float VelocityAwayFromWallScalar = FVector::DotProduct(NewVelocity, WallNormal);
-				const FVector VelocityAwayFromWall = VelocityAwayFromWallScalar * WallNormal;
 
-				if (VelocityAwayFromWallScalar > 0.0f)
-				{
-					NewVelocity -= VelocityAwayFromWall;
-				}
-				else if (VelocityAwayFromWallScalar < -1.0f)
-				{
-					if (bCanScramble)
-					{
-						bCanScramble = false;
-						bWallScrambling = true;
-						GetWorld()->GetTimerManager().SetTimer(EdgeScrambleTimerHandle, FTimerDelegate::CreateWeakLambda(this, [this]
-						{
-							bWallScrambling = false;
-						}), WallScrambleTime, false);
-					}
-					if (bWallScrambling)
-					{
-						NewVelocity.Z = FMath::Min(TerminalVelocity, NewVelocity.Z + 2000.0f * DeltaTime);
-					}
-				}
-			}
-			else if (bDashing)
-			{
-				float const DashValue = FVector::DotProduct(DashDirection, NewVelocity);
-				if (DashValue < DashSpeed * AirControlFactor)
-				{
-					NewVelocity += DashDirection * (DashSpeed * AirControlFactor - DashValue);
-				}
-			}
-			
-			if (bJumping)
-			{
-				NewVelocity += HoldJump(DeltaTime);
-			}
-			return NewVelocity + ConsumeImpulse();
-		}
-	case EPupMovementMode::M_Anchored:
-		{
-			if (!IsValid(BasisComponent))
-			{
-				BreakAnchor(false);
-			}
-			FVector NewVelocity = FVector::ZeroVector;
-			const FVector DistanceFromDesiredLocation = DesiredAnchorLocation - UpdatedComponent->GetComponentLocation();
-			const FVector DirectionToDesiredLocation = DistanceFromDesiredLocation.GetSafeNormal();
-			
-			if (DistanceFromDesiredLocation.Size() > SnapVelocity * DeltaTime)
-			{
-				NewVelocity = DirectionToDesiredLocation * SnapVelocity;
-			}
-			else
-			{
-				UpdatedComponent->SetWorldLocation(DesiredAnchorLocation);
-			}
-			if (bMantling)
-			{
-				bIsWalking = EdgeSlide(FVector::DotProduct(BasisComponent->GetComponentRotation().RotateVector(LedgeDirection), DirectionVector), DeltaTime);
-			}
-			return NewVelocity;
-		}
-	case EPupMovementMode::M_Deflected:
-		{
-			FVector NewVelocity = Velocity;
-			if (bGrounded)
-			{
-				NewVelocity = ApplySlidingFriction(Velocity, DeltaTime, DeflectionFriction);
-			}
-			NewVelocity += DirectionVector.IsNearlyZero()
-	               ? FVector::ZeroVector
-	               : DeltaTime * MaxAcceleration * DirectionVector * DeflectionControlInfluence;
-			return NewVelocity + ConsumeImpulse();
-		}
-	case EPupMovementMode::M_Recover:
-		{
-			return Velocity + (GetGravityZ() * DeltaTime) * FVector::UpVector;
-		}
-	case EPupMovementMode::M_Dragging:
-		{
-			const FVector RightVector = FVector::CrossProduct(DraggingFaceNormal, FVector::UpVector);
-			const FVector NonPlanarVelocity = DirectionVector * DragSpeed - (FVector::DotProduct(RightVector, DirectionVector) * RightVector);
-			if (!(FloorNormal - FVector::UpVector).IsNearlyZero())
-			{
-				return FQuat::FindBetweenNormals(FVector::UpVector, FloorNormal).RotateVector(NonPlanarVelocity);
-			}
-			return NonPlanarVelocity;
-		}
-	default:
-		{
-			return FVector::ZeroVector;
-		}
+FVector UPupMovementComponent::GetAnchoredVelocity(const float DeltaTime)
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+	if (!IsValid(BasisComponent))
+	{
+		BreakAnchor(false);
+	}
+	FVector NewVelocity = FVector::ZeroVector;
+	const FVector DistanceFromDesiredLocation = DesiredAnchorLocation - UpdatedComponent->GetComponentLocation();
+	const FVector DirectionToDesiredLocation = DistanceFromDesiredLocation.GetSafeNormal();
+	
+	if (DistanceFromDesiredLocation.Size() > Settings.SnapVelocity * DeltaTime)
+	{
+		NewVelocity = DirectionToDesiredLocation * Settings.SnapVelocity;
+	}
+	else
+	{
+		UpdatedComponent->SetWorldLocation(DesiredAnchorLocation);
+	}
+	if (bMantling)
+	{
+		bIsWalking = EdgeSlide(FVector::DotProduct(BasisComponent->GetComponentRotation().RotateVector(LedgeDirection), DirectionVector), DeltaTime);
 	}
+	return NewVelocity;
 }
 
 
-FVector UPupMovementComponent::HoldJump(const float DeltaTime)
+FPupMovementKernelState UPupMovementComponent::MakeKernelState() const
 {
-	const float JumpAcceleration = FMath::Min(HoldJumpAcceleration * DeltaTime, ApexVelocity - JumpAppliedVelocity);
-	JumpAppliedVelocity += JumpAcceleration;
-	return JumpAcceleration * UpdatedComponent->GetUpVector();
+	FPupMovementKernelState State;
+	State.Rotation = UpdatedComponent->GetComponentRotation();
+	State.DesiredRotation = DesiredRotation;
+	State.Velocity = Velocity;
+	State.FloorNormal = FloorNormal;
+	State.DirectionVector = DirectionVector;
+	State.DashDirection = DashDirection;
+	State.WallNormal = WallNormal;
+	State.DraggingFaceNormal = DraggingFaceNormal;
+	State.PendingImpulses = PendingImpulses;
+	State.InputFactor = InputFactor;
+	State.TurningDirection = TurningDirection;
+	State.MovementSpeedAlpha = MovementSpeedAlpha;
+	State.JumpAppliedVelocity = JumpAppliedVelocity;
+	State.Speed = Speed;
+	State.MovementMode = MovementMode;
+	State.bIsWalking = bIsWalking;
+	State.bGrounded = bGrounded;
+	State.bDashing = bDashing;
+	State.bJumping = bJumping;
+	State.bWallSliding = bWallSliding;
+	State.bWallScrambling = bWallScrambling;
+	State.bCanScramble = bCanScramble;
+	State.bWallJumpDisabledControl = bWallJumpDisabledControl;
+	return State;
 }
 
 
-FVector UPupMovementComponent::ApplyFriction(const FVector& VelocityIn, const float DeltaTime)
+FPupMovementKernelParams UPupMovementComponent::MakeKernelParams() const
 {
-	const FVector Result = FMath::VInterpConstantTo(VelocityIn, FVector::ZeroVector, DeltaTime, BreakingFriction);
-	return Result;
+	FPupMovementKernelParams Params = GetMovementSettings().GetKernelParams();
+	Params.GravityZ = GetGravityZ();
+	return Params;
+}
+
+
+void UPupMovementComponent::ApplyKernelState(const FPupMovementKernelState& State)
+{
+	DesiredRotation = State.DesiredRotation;
+	Velocity = State.Velocity;
+	FloorNormal = State.FloorNormal;
+	DirectionVector = State.DirectionVector;
+	DashDirection = State.DashDirection;
+	WallNormal = State.WallNormal;
+	DraggingFaceNormal = State.DraggingFaceNormal;
+	PendingImpulses = State.PendingImpulses;
+	InputFactor = State.InputFactor;
+	TurningDirection = State.TurningDirection;
+	MovementSpeedAlpha = State.MovementSpeedAlpha;
+	JumpAppliedVelocity = State.JumpAppliedVelocity;
+	Speed = State.Speed;
+	MovementMode = State.MovementMode;
+	bIsWalking = State.bIsWalking;
+	bGrounded = State.bGrounded;
+	bDashing = State.bDashing;
+	bJumping = State.bJumping;
+	bWallSliding = State.bWallSliding;
+	bWallScrambling = State.bWallScrambling;
+	bCanScramble = State.bCanScramble;
+	bWallJumpDisabledControl = State.bWallJumpDisabledControl;
 }
 
 
-FVector UPupMovementComponent::ApplySlidingFriction(const FVector& VelocityIn, const float DeltaTime, const float Friction) const
+void UPupMovementComponent::StepKinematics(FPupMovementKernelState& InOutState, const float DeltaTime)
 {
-	const FVector VelocityVertical = FVector::DotProduct(FloorNormal, VelocityIn) * FloorNormal;
-	return FMath::VInterpConstantTo(VelocityIn, VelocityVertical, DeltaTime, Friction);
+	ApplyKernelState(InOutState);
+	UpdatedComponent->SetWorldRotation(InOutState.Rotation);
+	(this->*GetModeRoutines(MovementMode).UpdateKinematics)(DeltaTime);
+	InOutState = MakeKernelState();
 }
 
 
@@ -663,14 +1452,19 @@ void UPupMovementComponent::MagnetToBasis(const float VelocityFactor, const floa
 	}
 	if (bAttachedToBasis && BasisComponent->Mobility == EComponentMobility::Movable)
 	{
+		const FPupBasisMotion Motion = GetBasisMotion();
+		if (Motion.IsAt(BasisLocationLastTick, BasisRotationLastTick))
+		{
+			// The basis hasn't moved since we last stored where we are on it, so there's nothing to follow
+			BasisRelativeVelocity = FVector::ZeroVector;
+			ApplySurfaceVelocity(Motion, DeltaTime);
+			return;
+		}
+
 		// Where is this local space vector in world space now? How has it moved in world space?
-		const FVector PositionAfterUpdate =
-			LocalBasisPosition.X * BasisComponent->GetForwardVector() +
-			LocalBasisPosition.Y * BasisComponent->GetRightVector() +
-			LocalBasisPosition.Z * BasisComponent->GetUpVector() +
-			BasisComponent->GetComponentLocation();
+		const FVector PositionAfterUpdate = Motion.TransformPosition(LocalBasisPosition);
 
-		float DeltaYaw = FMath::FindDeltaAngleDegrees(BasisRotationLastTick.Yaw, BasisComponent->GetComponentRotation().Yaw);
+		float DeltaYaw = FMath::FindDeltaAngleDegrees(BasisRotationLastTick.Yaw, Motion.Rotation.Yaw);
 		if (MovementMode == EPupMovementMode::M_Anchored)
 		{
 			BasisRelativeVelocity = PositionAfterUpdate - DesiredAnchorLocation;
@@ -701,11 +1495,7 @@ void UPupMovementComponent::MagnetToBasis(const float VelocityFactor, const floa
 			}
 			BasisRelativeVelocity /= DeltaTime;
 		}
-		if (UConveyorComponent* Conveyor = Cast<UConveyorComponent>(BasisComponent))
-		{
-			UpdatedComponent->AddWorldOffset(Conveyor->GetAppliedVelocity() * DeltaTime);
-			BasisRelativeVelocity += Conveyor->GetAppliedVelocity();
-		}
+		ApplySurfaceVelocity(Motion, DeltaTime);
 		DesiredRotation.Yaw = DesiredRotation.Yaw + DeltaYaw;
 		FRotator NewRotation = UpdatedComponent->GetComponentRotation();
 		NewRotation.Yaw += DeltaYaw;
@@ -716,8 +1506,55 @@ void UPupMovementComponent::MagnetToBasis(const float VelocityFactor, const floa
 		BasisRelativeVelocity = FVector::ZeroVector;
 		BasisPositionLastTick = UpdatedComponent->GetComponentLocation();
 		BasisRotationLastTick = DesiredRotation;
+		BasisLocationLastTick = FVector::ZeroVector;
 		LocalBasisPosition = FVector::ZeroVector;
+
+		// Surfaces that never move, like treadmills, can still carry us along
+		if (bAttachedToBasis && GetSurfaceVelocitySource())
+		{
+			ApplySurfaceVelocity(GetBasisMotion(), DeltaTime);
+		}
+	}
+}
+
+
+void UPupMovementComponent::ApplySurfaceVelocity(const FPupBasisMotion& Motion, const float DeltaTime)
+{
+	if (!Motion.SurfaceVelocity.IsZero())
+	{
+		UpdatedComponent->AddWorldOffset(Motion.SurfaceVelocity * DeltaTime);
+		BasisRelativeVelocity += Motion.SurfaceVelocity;
+	}
+}
+
+
+const UObject* UPupMovementComponent::GetSurfaceVelocitySource() const
+{
+	// Only look for the interface again when our floor changes
+	if (SurfaceVelocityBasis.Get() != BasisComponent)
+	{
+		SurfaceVelocityBasis = BasisComponent;
+		SurfaceVelocitySource = ISurfaceVelocity::FindSurfaceVelocitySource(BasisComponent);
+	}
+	return SurfaceVelocitySource.Get();
+}
+
+
+FPupBasisMotion UPupMovementComponent::GetBasisMotion()
+{
+	const UObject* Source = GetSurfaceVelocitySource();
+	if (APupMovementManager* Manager = MovementManager.Get())
+	{
+		return Manager->GetBasisMotion(BasisComponent, Source);
 	}
+	return FPupBasisMotion(BasisComponent, Source);
+}
+
+
+void UPupMovementComponent::RecordBasisTransform(const FPupBasisMotion& Motion)
+{
+	BasisLocationLastTick = Motion.Location;
+	BasisRotationLastTick = Motion.Rotation;
 }
 
 
@@ -746,24 +1583,10 @@ void UPupMovementComponent::StoreBasisTransformPostUpdate()
 	{
 		BasisPositionLastTick = MovementMode == EPupMovementMode::M_Anchored ? DesiredAnchorLocation : UpdatedComponent->GetComponentLocation();
 		// Don't bother storing this information if the object can't move
-		LocalBasisPosition = GetRelativeBasisPosition();
-		BasisRotationLastTick = BasisComponent->GetComponentRotation();
-	}
-}
-
-
-FVector UPupMovementComponent::GetRelativeBasisPosition() const
-{
-	if (bAttachedToBasis)
-	{
-		FVector Location = UpdatedComponent->GetComponentLocation();
-		if (MovementMode == EPupMovementMode::M_Anchored)
-		{
-			Location = DesiredAnchorLocation;
-		}
-		return GetLocationRelativeToComponent(Location, BasisComponent);
+		const FPupBasisMotion Motion = GetBasisMotion();
+		LocalBasisPosition = Motion.InverseTransformPosition(BasisPositionLastTick);
+		RecordBasisTransform(Motion);
 	}
-	return FVector::ZeroVector;
 }
 
 
@@ -793,4 +1616,51 @@ FVector UPupMovementComponent::ConsumeAdjustments()
 	const FVector AdjustmentTotal = PendingAdjustments;
 	PendingAdjustments = FVector::ZeroVector;
 	return AdjustmentTotal;
+}
+
+
+void UPupMovementComponent::ResolvePendingPenetrations()
+{
+	if (PendingPenetrations.Num() == 0)
+	{
+		return;
+	}
+
+	// Projected Gauss-Seidel: push the solution out along each constraint it doesn't satisfy yet.
+	// Constraints that can all be met, like two walls of a corner, are met by one combined move. Directly opposing
+	// pushers can't both be met, and whichever is solved last wins.
+	FVector Solution = AppliedPenetration;
+	const int32 NumIterations = FMath::Max(PupMovementCVars::PenetrationSolverIterations, 1);
+	for (int32 Iteration = 0; Iteration < NumIterations; Iteration++)
+	{
+		bool bSatisfied = true;
+		for (const FPupPenetrationConstraint& Constraint : PendingPenetrations)
+		{
+			const float Error = Constraint.Depth - FVector::DotProduct(Solution, Constraint.Normal);
+			if (Error > KINDA_SMALL_NUMBER)
+			{
+				Solution += Constraint.Normal * Error;
+				bSatisfied = false;
+			}
+		}
+		if (bSatisfied)
+		{
+			break;
+		}
+	}
+
+	const FVector Adjustment = Solution - AppliedPenetration;
+	if (!Adjustment.IsNearlyZero())
+	{
+		UpdatedComponent->AddWorldOffset(Adjustment, false);
+		AddAdjustment(Adjustment);
+		AppliedPenetration = Solution;
+	}
+}
+
+
+void UPupMovementComponent::ClearPenetrations()
+{
+	PendingPenetrations.Reset();
+	AppliedPenetration = FVector::ZeroVector;
 }
\ No newline at end of file
@@ -6,6 +6,17 @@
 
 #include "Camera/CameraComponent.h"
 #include "GameFramework/PawnMovementComponent.h"
+#include "PupBasisMotionCache.h"
+#include "PupMovementInputBuffer.h"
+#include "PupContactCache.h"
+#include "PupMovementHistory.h"
+#include "PupMovementKernel.h"
+#include "PupMovementNetworking.h"
+#include "PupMovementRecording.h"
+#include "PupMovementStats.h"
+#include "PupMovementTimers.h"
+#include "PupMovementTrajectory.h"
+#include "Tether/AssetTypes/PupMovementSettings.h"
 #include "PupMovementComponent.generated.h"
 
 /**
@@ -13,6 +24,8 @@
  */
 
 struct FPupMovementComponentState;
+class APupMovementManager;
+class UPupFloorHeightfield;
 UENUM(BlueprintType)
 enum class EPupMovementMode : uint8
 {
@@ -26,6 +39,161 @@ enum class EPupMovementMode : uint8
 };
 
 
+/** The result of looking for a ledge to grab **/
+enum class EPupLedgeQueryResult : uint8
+{
+	/** The ledge index can't answer, and live traces should be used instead **/
+	Unknown,
+	NoLedge,
+	Ledge
+};
+
+
+/** A ledge the player could grab onto, found either from the level's ledge index or from live traces **/
+struct FPupLedgeGrab
+{
+	UPrimitiveComponent* Component = nullptr;
+
+	/** Hit on the wall beneath the ledge, from the player's eye line **/
+	FHitResult WallHit;
+
+	/** Hit on the surface on top of the ledge **/
+	FHitResult TopHit;
+
+	/** The point on the wall closest to the player, raised by the capsule half height **/
+	FVector MantleLocation = FVector::ZeroVector;
+
+	FVector LedgeDirection = FVector::ZeroVector;
+};
+
+
+/** A request to move out of something, solved together with every other request in the same step **/
+struct FPupPenetrationConstraint
+{
+	/** Direction to move to get out **/
+	FVector Normal = FVector::ZeroVector;
+
+	/** How far along Normal we need to move **/
+	float Depth = 0.0f;
+};
+
+
+/**
+ * Everything that changes while the player moves, so that a movement component can be put back exactly where it was.
+ * Tuning values aren't included, since they don't change during play.
+ **/
+USTRUCT()
+struct TETHER_API FPupMovementComponentState
+{
+	GENERATED_BODY()
+
+	FPupMovementComponentState();
+	FPupMovementComponentState(const UPupMovementComponent* Src);
+
+	bool Serialize(FArchive& Ar);
+
+	/** Like Serialize, but sends the basis component through the package map **/
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	/** Serialize everything except the basis component, which needs different handling on and off the network **/
+	void SerializeMovement(FArchive& Ar);
+
+	/** CRC of everything SerializeMovement writes, so two states can be compared without keeping either **/
+	uint32 GetChecksum() const;
+
+	/** More pending penetrations than this in one step means something has already gone wrong, so the rest aren't serialized **/
+	static constexpr int32 MaxSerializedPenetrations = 64;
+
+	EPupMovementMode MovementMode = EPupMovementMode::M_None;
+	FTransform Transform = FTransform::Identity;
+	FVector Velocity = FVector::ZeroVector;
+	FRotator DesiredRotation = FRotator::ZeroRotator;
+
+	// Input
+	FVector DirectionVector = FVector::ZeroVector;
+	float InputFactor = 0.0f;
+	float CameraYaw = 0.0f;
+	bool bIsWalking = false;
+	bool bSupressingInput = false;
+
+	// Animation
+	float Speed = 0.0f;
+	float MovementSpeedAlpha = 0.0f;
+	float TurningDirection = 0.0f;
+
+	// Basis
+	TWeakObjectPtr<UPrimitiveComponent> BasisComponent;
+	bool bAttachedToBasis = false;
+	FVector LocalBasisPosition = FVector::ZeroVector;
+	FVector BasisRelativeVelocity = FVector::ZeroVector;
+	FRotator BasisRotationLastTick = FRotator::ZeroRotator;
+	FVector BasisPositionLastTick = FVector::ZeroVector;
+	FVector BasisLocationLastTick = FVector::ZeroVector;
+
+	// Floor
+	bool bGrounded = false;
+	bool bResting = false;
+	FVector FloorNormal = FVector::UpVector;
+	FVector LastValidLocation = FVector::ZeroVector;
+	int32 DynamicContactSteps = 0;
+
+	// Pending forces
+	FVector PendingImpulses = FVector::ZeroVector;
+	FVector PendingAdjustments = FVector::ZeroVector;
+	FVector PendingPushes = FVector::ZeroVector;
+	FTransform PendingRootMotionTransforms = FTransform::Identity;
+	TArray<FPupPenetrationConstraint, TInlineAllocator<8>> PendingPenetrations;
+
+	// Jumping and dashing
+	bool bCanJump = false;
+	bool bJumping = false;
+	bool bJumpHeld = false;
+	bool bCanDoubleJump = false;
+	float JumpAppliedVelocity = 0.0f;
+	bool bWallJumpDisabledControl = false;
+	bool bCanDash = true;
+	bool bDashing = false;
+	FVector DashDirection = FVector::ZeroVector;
+	FVector DeflectDirection = FVector::ZeroVector;
+
+	// Anchoring
+	bool bMantling = false;
+	bool bCanMantle = true;
+	FVector LedgeDirection = FVector::ZeroVector;
+	FVector DesiredAnchorLocation = FVector::ZeroVector;
+	bool bWallSliding = false;
+	FVector WallNormal = FVector::ZeroVector;
+	bool bCanScramble = false;
+	bool bWallScrambling = false;
+
+	// Dragging
+	bool bIsDraggingSomething = false;
+	FVector DraggingFaceNormal = FVector::ZeroVector;
+
+	FPupMovementTimers Timers;
+};
+
+template <>
+struct TStructOpsTypeTraits<FPupMovementComponentState> : public TStructOpsTypeTraitsBase2<FPupMovementComponentState>
+{
+	enum
+	{
+		WithSerializer = true,
+		WithNetSerializer = true
+	};
+};
+
+
+/** A snapshot taken at the start of a movement step, along with how long that step was **/
+struct FPupMovementHistoryEntry
+{
+	/** State after the step's input actions were applied, but before the step was simulated **/
+	FPupMovementComponentState State;
+	float DeltaTime = 0.0f;
+	EPupMovementInputAction InputActions = EPupMovementInputAction::None;
+};
+
+
 UCLASS(HideCategories = ("NavMovement", "MovementComponent", "PlanarMovement", "ComponentTick"))
 class TETHER_API UPupMovementComponent : public UPawnMovementComponent
 {
@@ -37,13 +205,13 @@ public:
 	
 	// Overrides
 	virtual  void BeginPlay() override;
+
+	virtual void PostLoad() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
 	
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* TickFunction) override;
 
-#if WITH_EDITOR
-	virtual void PostEditChangeProperty(FPropertyChangedEvent& PropertyChangedEvent) override;
-#endif
-
 	virtual float GetMaxSpeed() const override;
 
 	virtual float GetGravityZ() const override;
@@ -119,6 +287,13 @@ public:
 
 	// Called when being pushed by an object
 	void Push(const FHitResult& HitResult, const FVector ImpactVelocity, UPrimitiveComponent* Source);
+
+	/**
+	 * Queue an adjustment that moves the player out of something.
+	 * Adjustments queued between steps are solved together at the start of the next step. Ones queued during a step
+	 * are solved with everything already applied that step, after the substep that found them or at the end of the step.
+	 **/
+	void AddPenetration(const FVector& Adjustment);
 	
 	void AddRootMotionTransform(const FTransform& RootMotionTransform);
 	
@@ -135,6 +310,54 @@ public:
 	void UnsupressInput();
 
 	void HitWall(const FHitResult& HitResult);
+
+	/** Is the player standing still on a static floor, skipping all movement queries? **/
+	UFUNCTION(BlueprintCallable)
+	bool IsResting() const { return bResting; }
+
+	/** Leave the resting state, so the next step runs a full movement update. **/
+	UFUNCTION(BlueprintCallable)
+	void WakeUp();
+
+
+	// Trajectory Prediction
+	/**
+	 * Predict where the player's current flight takes them if they keep their current input, without simulating it.
+	 * @param LandingHeight		Height of the ground to land on, relative to where the player is now.
+	 * @param bSweep			Check for anything in the way with a single capsule sweep from the apex to the landing.
+	 **/
+	UFUNCTION(BlueprintCallable)
+	FPupTrajectory PredictTrajectory(const float LandingHeight = 0.0f, const bool bSweep = false) const;
+
+	/**
+	 * Predict the flight of a grounded jump from where the player is now, either held for as long as possible or released
+	 * straight away. Includes the velocity the jump takes from the basis, the same as Jump.
+	 **/
+	UFUNCTION(BlueprintCallable)
+	FPupTrajectory PredictJump(const bool bHoldJump = true, const float LandingHeight = 0.0f, const bool bSweep = false) const;
+
+	/** Predict the flight of a held jump off the wall the player is sliding down. **/
+	UFUNCTION(BlueprintCallable)
+	FPupTrajectory PredictWallJump(const float LandingHeight = 0.0f, const bool bSweep = false) const;
+
+	/** Predict the flight of an air dash in the direction the player is facing. **/
+	UFUNCTION(BlueprintCallable)
+	FPupTrajectory PredictDash(const float LandingHeight = 0.0f, const bool bSweep = false) const;
+
+	/** Predict the flight after Deflect launches the player with DeflectionVelocity, ignoring what little control they keep. **/
+	UFUNCTION(BlueprintCallable)
+	FPupTrajectory PredictDeflection(const FVector& DeflectionVelocity, const float LandingHeight = 0.0f, const bool bSweep = false) const;
+
+	/** Where a predicted flight is after Time seconds, ignoring anything in the way **/
+	UFUNCTION(BlueprintPure)
+	static FVector GetTrajectoryLocation(const FPupTrajectory& Trajectory, const float Time) { return Trajectory.GetLocation(Time); }
+
+	/**
+	 * Check a predicted flight for anything in the way with a single capsule sweep from its apex to its landing.
+	 * Anything that blocks the way up is missed, but that's rarely what decides where the player lands.
+	 * @return True if something was hit, in which case the landing and airtime are moved to the hit.
+	 **/
+	bool SweepTrajectory(FPupTrajectory& Trajectory) const;
 	
 	/** Sweeps for a valid floor beneath the character. If true, OutHitResult contains the sweep result */
 	bool FindFloor(float SweepDistance, FHitResult& OutHitResult, const int NumTries);
@@ -142,14 +365,180 @@ public:
 	/** Checks if the hit result was for a valid floor based on component settings and floor slope */
 	bool IsValidFloorHit(const FHitResult& FloorHit) const;
 
+	/** Get the true normal of the floor surface, only tracing again if the sweep hit an edge */
+	FVector GetFloorHitNormal(const FHitResult& FloorHit) const;
+
 	/** Moves the character to the floor, but does not update velocity */
 	void SnapToFloor(const FHitResult& FloorHit);
 
 	void ResetState(FPupMovementComponentState* State);
 
+	/** Copy every piece of changing movement state into OutState **/
+	void SaveState(FPupMovementComponentState& OutState) const;
+
+	/** Put the component back exactly as it was when State was saved, without firing any events **/
+	void RestoreState(const FPupMovementComponentState& State);
+
+	/**
+	 * Restore the snapshot from NumSteps steps ago, and simulate those steps again with the same inputs.
+	 * @returns false if the history doesn't go back that far, in which case nothing changes.
+	 **/
+	bool Rollback(const int32 NumSteps);
+
+	/**
+	 * Simulate every step from FromStep onwards again, starting from the current state and replaying the recorded inputs.
+	 * The current state should be the state at the start of FromStep, e.g. after restoring a corrected snapshot.
+	 * @returns false if the history doesn't have FromStep, in which case nothing changes.
+	 **/
+	bool Resimulate(const uint32 FromStep);
+
+	/** The number of the next movement step to be simulated **/
+	uint32 GetStepNumber() const { return StepNumber; }
+
+	/** Find the snapshot taken at the start of a step, if it is still in the history **/
+	const FPupMovementComponentState* FindHistoryState(const uint32 Step) const;
+
+	bool IsResimulating() const { return bResimulating; }
+
+	/**
+	 * Buffer a jump, stop jumping or dash from player input, to be done by the next step that ends after it was read.
+	 * The step remembers it, so it can be replayed or sent to the server. Returns whether the action was accepted.
+	 **/
+	bool HandleInputAction(const EPupMovementInputAction Action);
+
+	/** Is this the owning client's pup, simulated ahead of the server and corrected when the server disagrees? **/
+	bool IsPredicting() const;
+
+	/** Is this the server's copy of a remote client's pup, simulated only as that client's input arrives? **/
+	bool IsDrivenByRemoteClient() const;
+
+	/** How many times the server has corrected this client's prediction **/
+	UFUNCTION(BlueprintCallable)
+	int32 GetNumCorrections() const { return NumCorrections; }
+
 	void PauseTimers();
 
 	void UnPauseTimers();
+
+	/**
+	 * The transform that should be rendered this frame. When using fixed timesteps, this is
+	 * interpolated between the last two simulated steps using the leftover frame time.
+	 **/
+	FTransform GetPresentationTransform() const;
+
+	UFUNCTION(BlueprintCallable)
+	FVector GetPresentationLocation() const;
+
+	/** Snap the presented transform to the current simulated transform, e.g. after a teleport. **/
+	void ResetPresentationInterpolation();
+
+	/** Copy everything the movement kernel reads and writes out of this component. **/
+	FPupMovementKernelState MakeKernelState() const;
+
+	/** The movement kernel's tuning values, from our settings and the current gravity. **/
+	FPupMovementKernelParams MakeKernelParams() const;
+
+	/** Our settings asset, or the defaults if none is assigned. Never null. **/
+	const UPupMovementSettings& GetMovementSettings() const
+	{
+		return MovementSettings ? *MovementSettings : *GetDefault<UPupMovementSettings>();
+	}
+
+	/** Copy a kernel state back into this component. Doesn't move the UpdatedComponent. **/
+	void ApplyKernelState(const FPupMovementKernelState& State);
+
+	/**
+	 * Run the kinematic part of a step on an arbitrary state, exactly as a real step would through this component.
+	 * Used to compare the per-component path against batched kernel updates.
+	 **/
+	void StepKinematics(FPupMovementKernelState& InOutState, const float DeltaTime);
+
+
+	// Batched updates
+	/** Is this pup stepped by the world's movement manager this frame, instead of by its own tick? **/
+	bool IsBatched() const;
+
+	/** Could a movement manager run this pup's fixed steps? Not for pups stepped by the network, or suspended pups. **/
+	bool CanBeBatched() const;
+
+	/**
+	 * Start a frame of fixed steps, gathering input and consuming frame time.
+	 * Returns how many times SimulateFixedStep should be called before EndFixedSteps.
+	 **/
+	int32 BeginFixedSteps(const float DeltaTime);
+
+	/** Simulate one fixed step, keeping the transforms the presentation interpolates between **/
+	void SimulateFixedStep(const float DeltaTime);
+
+	/** Finish a frame of fixed steps, sending any predicted input and presenting the result **/
+	void EndFixedSteps(const int32 NumSteps);
+
+	/**
+	 * Run the queries the next step starts with (gathering contacts and probing for the floor) ahead of time.
+	 * Only reads the world and writes to this component, so many pups can prefetch at once on worker threads.
+	 **/
+	void PrefetchStepQueries(const float DeltaTime);
+
+	/** Forget any prefetched queries that looked at Bounds, because something has moved there since **/
+	void DiscardPrefetchedQueries(const FBox& Bounds);
+
+	/** Length of the steps SimulateFixedStep should be called with, which depends on the movement LOD **/
+	float GetFixedStepLength() const;
+
+
+	// Movement LOD
+	/** Choose a movement LOD tier from how far the closest viewer is, and whether anybody can see us **/
+	void UpdateMovementLOD(const float DeltaTime, const float ViewerDistance, const bool bOffScreen);
+
+	/** Run at full detail for a while, e.g. because something interacted with us **/
+	void PromoteMovementLOD();
+
+	/** Index into our settings' MovementLODTiers. 0 is full detail. **/
+	UFUNCTION(BlueprintCallable)
+	int32 GetMovementLOD() const { return MovementLOD; }
+
+	/** Are we always simulated at full detail, because a player is controlling us? **/
+	bool IsExemptFromMovementLOD() const;
+
+	/** Has our mesh been rendered by any view recently? **/
+	bool WasRecentlyRendered() const;
+
+	/** Length of a fixed movement step **/
+	static float GetTimestepLength();
+
+	/** Is movement simulated in fixed steps, with the presented transform interpolated between them? **/
+	static bool UsesFixedTimestep();
+
+	/** How many queries the contact cache proved couldn't hit anything, since the movement manager last published the PupMovement stats **/
+	UFUNCTION(BlueprintCallable)
+	int32 GetContactCacheHits() const { return FrameStats.ContactCacheHits; }
+
+	/** How many queries the contact cache couldn't rule out, and so went to the physics scene, since the stats were last published **/
+	UFUNCTION(BlueprintCallable)
+	int32 GetContactCacheMisses() const { return FrameStats.ContactCacheMisses; }
+
+	/** What this pup's movement has cost since the movement manager last published the PupMovement stats **/
+	const FPupMovementFrameStats& GetFrameStats() const { return FrameStats; }
+
+	void ResetFrameStats() { FrameStats.Reset(); }
+
+
+	// Recording
+	/** Tell the movement manager's recorder, if it is recording, about an action the character handled itself **/
+	void RecordCharacterAction(const EPupRecordedAction Action);
+
+	/** Is this pup being driven by a replay, instead of by its own tick and input? **/
+	bool IsReplaying() const { return bReplaying; }
+
+	void SetReplaying(const bool bInReplaying);
+
+	/**
+	 * Simulate a step with exactly the input it was recorded with.
+	 * @param bApplyActions		False when the step's actions are already part of the current state, i.e. when the
+	 *							state was just restored from the start of a recording.
+	 * @returns the checksum of the state the step started from, to compare against the recorded one.
+	 **/
+	uint32 SimulateRecordedStep(const FPupRecordedStep& Step, const bool bApplyActions);
 	
 	DECLARE_DYNAMIC_MULTICAST_DELEGATE_TwoParams(FMovementModeChanged, EPupMovementMode, OldMovementMode, EPupMovementMode, NewMovementMode);
 	FMovementModeChanged& OnMovementModeChanged(EPupMovementMode, EPupMovementMode) { return MovementModeChanged; }
@@ -174,9 +563,139 @@ private:
 	/** Perform one single movement step, with potential substeps */
 	void StepMovement(float DeltaTime);
 
+	/** Save a snapshot of the state at the start of the next step into the history **/
+	void RecordHistory(const float DeltaTime);
+
+	
+	// Networking
+	/** Send the server the input for a batch of steps, which it simulates and acknowledges **/
+	UFUNCTION(Server, Unreliable, WithValidation)
+	void ServerMove(const FPupMovementInputBatch& Batch);
+
+	/** Tell the owning client what the state was at the start of a step, so it can correct its prediction **/
+	UFUNCTION(Client, Unreliable)
+	void ClientAckMove(const int32 Step, const FPupMovementComponentState& ServerState);
+
+	bool ApplyInputActions(const EPupMovementInputAction Actions);
+
+	/** Simulate a step on the owning client, recording the quantized input to send to the server **/
+	void PredictStep(const float DeltaTime);
+
+	/** Simulate a step on the server with input from the owning client **/
+	void SimulateClientFrame(const FPupMovementInputFrame& Frame, const float DeltaTime);
+
+	void SendUnacknowledgedFrames();
+
+	/** Let the owning client's steps use another DeltaTime of server time **/
+	void EarnClientStepBudget(const float DeltaTime);
+
+	/** Use up the server time for NumSteps of the owning client's steps. False, using nothing, if there isn't enough. **/
+	bool SpendClientStepBudget(const uint32 NumSteps);
+
+	/** Does the predicted state differ from the server's enough to be corrected? **/
+	static bool NeedsCorrection(const FPupMovementComponentState& Predicted, const FPupMovementComponentState& Server);
+
+	/** Let the presented transform catch up with the corrected simulation over time, instead of snapping **/
+	void DecayCorrectionOffset(const float DeltaTime);
+
+	/**
+	 * The part of a step that depends on the movement mode, instantiated for each mode at compile time.
+	 * Mode is the movement mode at the start of the step. If the mode changes before the vertical update, the new
+	 * mode's vertical update is looked up instead.
+	 **/
+	template <EPupMovementMode Mode>
+	void StepMode(const float DeltaTime);
+
+	/** Sweep the capsule along the velocity for a whole step, in slices and collision substeps. **/
+	void SweepMovement(const float DeltaTime);
+
+	typedef void (UPupMovementComponent::*FModeStepFunction)(const float DeltaTime);
+
+	/** The routines a step runs for one movement mode, each instantiated for that mode **/
+	struct FModeRoutines
+	{
+		FModeStepFunction Step;
+		FModeStepFunction UpdateKinematics;
+		FModeStepFunction UpdateVerticalMovement;
+	};
+
+	/** Find the routines for a movement mode. Never null. **/
+	static const FModeRoutines& GetModeRoutines(const EPupMovementMode Mode);
+
+	/** Move the presentation component (our mesh) to the interpolated presentation transform. **/
+	void UpdatePresentation();
+
+	/** Run whatever should happen when each of the expired timers runs out **/
+	void HandleExpiredTimers(const uint32 ExpiredTimers);
+
+	/** Can the player stay at rest? Only checks state, never runs any queries. **/
+	bool CanRest() const;
+
+	UFUNCTION()
+	void OnUpdatedComponentBeginOverlap(UPrimitiveComponent* OverlappedComponent, AActor* OtherActor,
+		UPrimitiveComponent* OtherComp, int32 OtherBodyIndex, bool bFromSweep, const FHitResult& SweepResult);
+
+	UFUNCTION()
+	void OnUpdatedComponentHit(UPrimitiveComponent* HitComponent, AActor* OtherActor,
+		UPrimitiveComponent* OtherComp, FVector NormalImpulse, const FHitResult& Hit);
+
+	/**
+	 * Try to answer a floor query from the level's baked floor heightfield instead of sweeping.
+	 * Returns false if the heightfield can't answer, in which case a sweep must be used.
+	 **/
+	bool FindFloorFromHeightfield(const float SweepDistance, FHitResult& OutHitResult, bool& bOutFoundFloor) const;
+
+	/** Could the floor heightfield be asked about the floor right now? Only checks state, never runs any queries. **/
+	bool CanQueryFloorHeightfield() const;
+
+	/** The cheaper floor query used by reduced movement LOD tiers, built to look like the capsule sweep it replaces **/
+	bool FindFloorWithLineTrace(const float SweepDistance, FHitResult& OutHitResult);
+
+	const FPupMovementLODTier& GetMovementLODTier() const;
+
+	/** Sweep for the floor ahead of a step, far enough to answer any distance the step is likely to ask for **/
+	void PrefetchFloor(const float DeltaTime);
+
+	/** Use the prefetched floor sweep in place of a real one, if the capsule hasn't moved since it was run **/
+	bool ConsumePrefetchedFloor(const float SweepDistance, FHitResult& OutHitResult);
+
+	void ClearPrefetchedQueries();
+
+	/**
+	 * Turn a floor sweep run from QueryLocation into the one FindFloor would run from where the capsule is now.
+	 * Returns false if the old sweep doesn't cover the new one.
+	 **/
+	bool ReuseFloorHit(const FHitResult& Hit, const FVector& QueryLocation, const float QueryDistance, const float SweepDistance,
+		FHitResult& OutHitResult) const;
+
+	/** Start the floor and ledge queries the next frame's first step will probably run, so it doesn't have to wait on them **/
+	void IssueAsyncQueries(const float DeltaTime);
+
+	/** Use the asynchronous floor sweep in place of a real one, if it has finished and we haven't moved too far since **/
+	bool ConsumeAsyncFloor(const float SweepDistance, FHitResult& OutHitResult);
+
+	/** Use the asynchronous eye line trace in place of a real one, if it has finished and we haven't moved too far since **/
+	bool ConsumeAsyncWallHit(const FVector& TraceStart, const FVector& TraceEnd, FHitResult& OutHitResult);
+
+	void ClearAsyncQueries();
+
+	/** Remember that something movable touched us, so the baked floor heightfield isn't trusted for a while. **/
+	void NoteDynamicContact();
+
+	/** Fill the contact cache with everything the player could touch during a step of this length **/
+	void GatherContacts(const float DeltaTime);
+
+	/** Decide how many slices a step should be split into, so that fast movement never skips over thin geometry */
+	int32 PlanSubsteps(const float DeltaTime) const;
+
 	/** Perform a single movement substep, returning the amount of time actually simulated in the substep */
 	float SubstepMovement(const float DeltaTime);
 
+	/**
+	 * Find the floor, land or fall, and apply gravity. Must be called while in Mode. Checks made before the first
+	 * transition use Mode, and the ones after it check the movement mode again.
+	 **/
+	template <EPupMovementMode Mode>
 	void UpdateVerticalMovement(const float DeltaTime);
 	
 	/** Explicit transition when landing on a floor while in the 'Falling' state */
@@ -193,6 +712,9 @@ private:
 	 */
 	void Recover();
 
+	/** Find the nearest safe location to LastValidLocation, using the floor heightfield if the level has one. **/
+	FVector FindRecoveryLocation() const;
+
 	void EndDash();
 	
 	/**
@@ -208,39 +730,91 @@ private:
 	/** Slide along the ledge we are currently holding to the right **/
 	bool EdgeSlide(const float Scale, const float DeltaTime);
 
-	/** Transform any accumulated input vectors to be relative to the player's viewpoint, and store them as a property. **/
-	void HandleInputVectors();
+	/** Find the ledge we would slide onto using live traces. **/
+	EPupLedgeQueryResult TraceSlideLedge(const FVector& WallProbe, const FVector& TopProbe,
+		UPrimitiveComponent*& OutLedgeComponent, float& OutTopHeight) const;
+
+	/** Find the ledge we would slide onto from the level's ledge index, if it covers the area around us. **/
+	EPupLedgeQueryResult FindIndexedSlideLedge(const FVector& WallProbe, const FVector& TopProbe,
+		UPrimitiveComponent*& OutLedgeComponent, float& OutTopHeight) const;
 
+	/**
+	 * Look for a ledge in front of the player's eye line using live traces.
+	 * @param KnownWallHit	The result of the eye line trace, if it was already run asynchronously
+	 **/
+	EPupLedgeQueryResult TraceLedge(FPupLedgeGrab& OutLedge, const FHitResult* KnownWallHit = nullptr) const;
 
-	/** Return the new rotation for this tick. **/
-	FRotator GetNewRotation(const float DeltaTime);
-	/** Return the new velocity for this tick. **/
-	FVector GetNewVelocity(const float DeltaTime);
+	/** Look for a ledge in front of the player's eye line using the level's ledge index, if it covers the area around us. **/
+	EPupLedgeQueryResult FindIndexedLedge(FPupLedgeGrab& OutLedge) const;
 
+	/** Anchor the player to a ledge found by TraceLedge or FindIndexedLedge. **/
+	void GrabLedge(const FPupLedgeGrab& Ledge);
 
-	
-	// Update utilities
-	/** Add additional velocity to the player if they hold down 'Jump' **/
-	FVector HoldJump(const float DeltaTime);
+	FVector GetMantleEyePosition() const;
+
+	/** Get the offset of the mantle handle in world space, facing the DesiredRotation. **/
+	FVector GetMantleHandleWorldOffset(const float ForwardOffset) const;
 
-	/** Get the new velocity after stopping the player's movement along whatever plane they are attached to. **/
-	FVector ApplyFriction(const FVector& VelocityIn, const float DeltaTime);
+	/** Buffer the input vectors accumulated since the last frame, with the camera yaw they are relative to. **/
+	void BufferInputVector();
 
-	/** Get the new velocity after Friction has been applied. **/
-	FVector ApplySlidingFriction(const FVector& VelocityIn, const float DeltaTime, const float Friction) const;
+	/** Transform a buffered input sample to be relative to the player's viewpoint, and store it as a property. **/
+	void ApplyInputSample(const FPupBufferedInputSample& Sample);
+
+	/** Take the buffered input due by the end of a step, before simulating it. **/
+	void ConsumeBufferedInput(const double StepTime);
+
+	/** Try again to jump or dash, if it was pressed recently when we couldn't. **/
+	void RetryBufferedActions();
+
+
+	/**
+	 * Update the rotation and velocity for this tick, using the movement kernel for everything but anchoring.
+	 * Must be called while in Mode.
+	 **/
+	template <EPupMovementMode Mode>
+	void UpdateKinematics(const float DeltaTime);
+
+	/** Return the new velocity for this tick while anchored. **/
+	FVector GetAnchoredVelocity(const float DeltaTime);
 
 
 	// Basis/Floor Movement
 	void MagnetToBasis(const float VelocityFactor, const float DeltaTime);
 
+	/** Carry us along with a conveyor belt, or anything else with a surface velocity, that we're standing on. **/
+	void ApplySurfaceVelocity(const FPupBasisMotion& Motion, const float DeltaTime);
+
+	/** What gives our basis its surface velocity, if anything. Only looked up again when our basis changes. **/
+	const UObject* GetSurfaceVelocitySource() const;
+
+	/** Where our basis is this frame, shared with every other pup on it through the movement manager. **/
+	FPupBasisMotion GetBasisMotion();
+
+	/** Remember where our basis was when we last stored our position relative to it. **/
+	void RecordBasisTransform(const FPupBasisMotion& Motion);
+
+
+	// Trajectory Prediction
+	/**
+	 * The velocity a grounded jump adds straight away: the jump itself, plus the basis velocity we leave with.
+	 * Switching to falling adds the basis velocity again, which isn't included.
+	 **/
+	FVector GetJumpImpulse() const;
+
+	/** How a flight launched with LaunchVelocity from where we are now starts, steered by our current input. **/
+	FPupTrajectoryLaunch MakeTrajectoryLaunch(const FVector& LaunchVelocity) const;
+
+	/** How our current flight carries on, including any jump that's still held and any dash that's still going. **/
+	FPupTrajectoryLaunch MakeCurrentTrajectoryLaunch() const;
+
+	FPupTrajectory FinishTrajectory(const FPupTrajectoryLaunch& Launch, const float LandingHeight, const bool bSweep) const;
+
 	void HandlePushes(const float DeltaTime);
 	
 	/** Update our relative basis transform to reflect any movements the player has made themself. **/
 	void StoreBasisTransformPostUpdate();
 
-	/** Calculate the player's position in world space, in case the floor they are standing on has moved. **/
-	FVector GetRelativeBasisPosition() const;
-
 	
 	// Private impulse methods
 	/** Get the total value of pending impulses, and empty their value. **/
@@ -253,18 +827,38 @@ private:
 
 	/** Get the total velocity of adjustments we had to make this step, and empty the value. **/
 	FVector ConsumeAdjustments();
+
+	/**
+	 * Find the smallest translation that satisfies every penetration queued this step,
+	 * and move by whatever part of it hasn't been applied yet.
+	 **/
+	void ResolvePendingPenetrations();
+
+	/** Throw away all queued penetrations, e.g. after a teleport. **/
+	void ClearPenetrations();
 	
 
 	
 	// Utilities
-	/** Scale an FVector to a max size along a plane, similar to ClampToMaxSize2D. **/
-	static FVector ClampToPlaneMaxSize(const FVector& VectorIn, const FVector& Normal, const float MaxSize);
-
 	bool SweepCapsule(const FVector Offset, FHitResult& OutHit, const bool bIgnoreInitialOverlap = false) const;
 	bool SweepCapsule(const FVector InitialOffset, const FVector Offset, FHitResult& OutHit, const bool bIgnoreInitialOverlap = false) const;
 
+	/** Query params for SweepCapsule, only rebuilt when the ignored actors or invalid floor components change. **/
+	FCollisionQueryParams& GetSweepQueryParams() const;
+
+	/** Count a scene query in the PupMovement stats. Call it right before the query it counts. **/
+	void CountQuery(const EPupMovementQuery Query) const
+	{
+		FrameStats.AddQuery(Query);
+	}
+
+	void AddInvalidFloorComponent(UPrimitiveComponent* Component);
+
+	/** Forget all invalid floor components, keeping the array's memory so the next step doesn't allocate. **/
+	void ClearInvalidFloorComponents();
+
 	
-	/** Utility function for rendering HitResults. Will only fire if bDrawMovementDebug is checked. **/
+	/** Utility function for rendering HitResults. Will only fire if PupMovement.DrawQueries is set. **/
 	void RenderHitResult(const FHitResult& HitResult, const FColor Color = FColor::White, const bool bPersistent = false) const;
 
 	void HandleRootMotion();
@@ -291,33 +885,17 @@ public:
 
 
 	
-	/* ========================== SPEED PROPERTIES ========================== */
-	/**
-	 * The maximum running velocity the player can achieve by running.
-	 * External forces can accelerate the player further, but they will be unable
-	 * to maintain that speed.
-	 * To control the absolute maximum velocity, see: 'TerminalVelocity'
-	 **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Speed", meta = (ClampMin = 0.0f))
-	float MaxSpeed;
+	/* ========================== SETTINGS ========================== */
+	/** Tuning shared by every pup that uses this asset. Without one, the defaults of UPupMovementSettings are used. **/
+	UPROPERTY(BlueprintReadOnly, EditAnywhere, Category = "Settings")
+	UPupMovementSettings* MovementSettings = nullptr;
 
+
+	
+	/* ========================== SPEED PROPERTIES ========================== */
 	UPROPERTY(VisibleInstanceOnly, Category = "Speed", AdvancedDisplay)
 	float Speed;
 
-	/** How quickly the player gains speed (in units/s2) when the control stick is pushed all the way. **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Speed", meta = (ClampMin = 0.0f))
-	float MaxAcceleration = 200.f;
-
-	/** How quickly the player stops (in units/s2) when the control stick is released. **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Speed|Friction", meta = (ClampMin = 0.0f))
-	float BreakingFriction = 2000.f;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Speed|Dash")
-	float DashSpeed = 400.0f;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Speed|Dash")
-	float DashTime = 0.5f;
-	
 	UPROPERTY(BlueprintReadWrite, VisibleInstanceOnly, Category = "Speed|Dash")
 	FVector DashDirection;
 
@@ -366,32 +944,10 @@ public:
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, AdvancedDisplay, Category = "Rotation")
 	float MovementSpeedAlpha = 0.0f;
 
-	/** The absolute maximum velocity the player can go in any movement state. **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f))
-	float TerminalVelocity = 4000.f;
-
 	/** Where the player is turning towards. **/
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Transient, Category = "Rotation", meta = (MakeEditWidget))
 	FRotator DesiredRotation = FRotator(0.f,0.f,0.f);
 
-	/** How fast (in degrees/s) the player turns to face the direction of the input. **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Rotation", meta = (ClampMin = 0.0f))
-	float RotationSpeed = 360.f;
-
-	/** Will the player rotate slower as they move faster? Simulates decreased static friction when running. **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Rotation|Slip")
-	bool bSlip = true;
-
-	/**
-	 * How much the player's rotation speed should be multiplied by when moving fast.
-	 * Scales linearly with velocity - if this value is 0 and the player is moving at
-	 * their maximum speed, they will be unable to turn.
-	 * If at 1, the player will turn at the same speed regardless of how fast they
-	 * are moving across the floor.
-	 **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Rotation|Slip", meta = (ClampMin = 0.0f, ClampMax = 1.0f, EditCondition = "bSlip"))
-	float SlipFactor = 0.8f;
-
 	/**
 	 * The yaw of the camera component, so that input is relative to the camera's rotation (yaw only).
 	 * Automatically found from the current camera.
@@ -410,9 +966,6 @@ public:
 	
 
 	/* ========================== JUMPING PROPERTIES ========================== */
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Jumping|Floor", meta = (ClampMin = 0.0f))
-	float FloorSnapDistance = 5.0f;
-
 	/**
 	* Is the player on a valid floor? See: Movement | Planar for
 	* controlling what is considered a valid floor.
@@ -425,56 +978,12 @@ public:
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "Jumping")
 	bool bCanJump = false;
 
-	/** The initial velocity (in units/s) applied as an impulse, when jumping **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f))
-	float JumpInitialVelocity = 300.0f;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f))
-	float ApexVelocity = 500.0f;
-
-	/**
-	 * How much the player accelerates (in units/s2) when the jump is held, after the initial velocity is applied.
-	 * Derived from the ApexVelocity and HoldJumpAcceleration values.
-	 **/
-	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Category = "Jumping")
-	float HoldJumpAcceleration = 400.0f;
-
-	/** The maximum time the Jump can be held for, in seconds. **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f))
-	float MaxJumpTime = 0.5f;
-
-	/**
-	 * How long after falling (in seconds) can the player still jump? Setting this value to 0
-	 * will prevent the player from jumping at all immediately after leaving the floor.
-	 * Recommended to set this value to compensate for player reaction time and other
-	 * sources of latency.
-	 **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f))
-	float CoyoteTime = 0.5f;
-	
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Jumping", meta = (ClampMin = 0.0f, ClampMax = 1.0f))
-	float AirControlFactor = 0.2f;
-
-	/**
-	 * Does the character move forward along the direction is facing?
-	 * If true, the character accelerates only forwards and rotates to accomodate the direction of input.
-	 * If false, the acceleration will be applied regardless of the player's rotation, and they will
-	 * begin to rotate in that direction.
-	 **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Jumping")
-	bool bTurnFirst = true;
-	
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Jumping|Double Jump")
-	bool bDoubleJump = true;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Jumping|Double Jump", meta = (ClampMin = 0.0f, ClampMax = 1.0f, EditCondition = "bDoubleJump"))
-	float DoubleJumpAccelerationFactor = 0.5f;
-	
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Jumping|Double Jump")
 	bool bJumping = false;
 
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Jumping|Wall Jump")
-	float WallJumpDisableTime = 0.2f;
+	/** Is the jump button held? A buffered jump that only happens after it's let go is a hop. **/
+	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Jumping")
+	bool bJumpHeld = false;
 
 	UPROPERTY(BlueprintReadWrite, VisibleAnywhere, Category = "Jumping|Wall Jump")
 	bool bWallJumpDisabledControl = false;
@@ -490,50 +999,11 @@ public:
 	UPROPERTY(BlueprintReadOnly, VisibleInstanceOnly, Transient, Category = "Anchored|Mantling")
 	bool bCanMantle = true;
 
-	/** How close a wall must be to the player before they can grab on to it. **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Anchored|Mantling", meta = (ClampMin = 0.0f))
-	float GrabRangeForward = 20.0f;
-
-	/** How far above the eye location the player can grab onto a ledge. **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Anchored|Mantling", meta = (ClampMin = 0.0f))
-	float GrabRangeTop = 10.0f;
-
-	/** How far below the eye location the player can grab onto a ledge. **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Anchored|Mantling", meta = (ClampMin = 0.0f))
-	float GrabRangeBottom = 10.0f;
-
-	/**
-	 * How fast the player must be falling before they can grab onto the ledge.
-	 * The apex of the height is 0.0 (unit/s).
-	 * A negative value will allow the player to grab onto a ledge, even
-	 * if they are still moving upward.
-	 **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Anchored|Mantling")
-	float MaximumGrabVelocity = -100.0f;
-
-	/**
-	 * How far the ledge can deviate from a perfectly 'level' floor.
-	 * At 1.0f, the ledge must be completely level, and at 0.0f
-	 * the ledge could be vertical.
-	 * This value is recommended to be somewhere between 0.5f and 0.95f
-	 * to account for errors in floating point arithmetic.
-	 **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Anchored|Mantling", meta = (ClampMin = 0.0f, ClampMax = 1.0f))
-	float LedgeDeviation = 0.9f;
-
 	UPROPERTY(BlueprintReadOnly, VisibleInstanceOnly, Transient, Category = "Anchored|Mantling")
 	FVector LedgeDirection;
 
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Anchored")
 	FVector DesiredAnchorLocation;
-	
-	/** How quickly the player should move to their anchor, in units/s **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Anchored", meta = (ClampMin = 0.0f))
-	float SnapVelocity = 1000.0f;
-
-	/** How quickly the player should rotate to face their anchor, in degrees/s **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Anchored", meta = (ClampMin = 0.0f))
-	float SnapRotationVelocity = 360.0f;	
 
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Anchored|Wall Slide")
 	bool bWallSliding = false;
@@ -546,12 +1016,7 @@ public:
 
 	UPROPERTY(BlueprintReadOnly, VisibleInstanceOnly, Transient, Category = "Anchored|Wall Slide|Scramble")
 	bool bWallScrambling = false;
-	
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Anchored|Wall Slide|Scramble")
-	float WallScrambleTime = 10.0f;
-	
 
-	
 	/**
 	 * The normal of whatever floor surface the player is standing on.
 	 * Used for calculating movement along the plane.
@@ -559,74 +1024,16 @@ public:
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Planar", meta = (MakeEditWidget))
 	FVector FloorNormal;
 
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Planar", meta = (ClampMin = 0.0f, ClampMax = 90.0f))
-	float MaxIncline = 60.0f;
-
-	/**
-	 * The smallest value the Z component of our FloorNormal can be,
-	 * before it will no longer be considered a valid floor and the
-	 * player will instead begin to slide down it.
-	 * Calculated whenever MaxIncline is changed; Cached value.
-	 **/
-	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Planar")
-	float MaxInclineZComponent = 0.5f;
-
-
-	UPROPERTY(BlueprintReadWrite, VisibleAnywhere, Category = "Planar", Meta = (ClampMin = 0.0f, ClampMax = 1.0f))
-	float MaxWallDeviation = 0.2f;
-
-	
-	/** The deceleration of the player when being set to the Deflected state by another object **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Deflections", meta = (ClampMin = 0.0f))
-	float DeflectionFriction = 800.0f;
-
-	/** Factor representing how much the player can still be controlled when Deflected **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Deflections", meta = (ClampMin = 0.0f, ClampMax = 1.0f))
-	float DeflectionControlInfluence = 0.2f;
-
-	/** If the player can regain control of the character early, by cancelling the velocity in the direction **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Deflections")
-	bool bCanRegainControl = true;
-
-	/** Can the player jump, even if they are being Deflected? Player must still be on a valid floor. **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Deflections")
-	bool bCanJumpWhileDeflected = true;
-
-
-
-
-	
-	/** How long it takes the player to return to the stage after falling. **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Recovery", meta = (ClampMin = 0.0f))
-	float RecoveryTime = 1.0f;
-
-	/** Should the player be able to pass through any/all objects when recovering? **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Recovery")
-	bool bIgnoreObstaclesWhenRecovering = true;
-	
-	/** The height offset added to our LastValidLocation when recovering. **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Recovery")
-	float RecoveryLevitationHeight = 100.0f;
-
 	/** The last location on a floor that was sufficiently far from the edge. **/
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Recovery")
 	FVector LastValidLocation;
 
-	/** How far away from the edge we should be to consider a location 'safe' **/
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Recovery", meta = (ClampMin = 0.0f))
-	float MinimumSafeRadius = 100.0f;
 
 
 
 
 	
 	/* ========================== DRAGGING PROPERTIES ========================== */
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Dragging")
-	bool bDragOnlyWhenGrounded = true;
-
-	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Dragging")
-	float DragSpeed = 100.0f;
-	
 	UPROPERTY(BlueprintReadOnly, VisibleAnywhere, Transient, Category = "Dragging")
 	bool bIsDraggingSomething = false;
 	
@@ -643,6 +1050,10 @@ private:
 	EPupMovementMode MovementMode = EPupMovementMode::M_Falling;	
 
 	bool bSupressingInput = false;
+
+	/** Are we standing still on a static floor? While resting, movement steps are skipped entirely. **/
+	UPROPERTY(Transient, VisibleInstanceOnly, Category = "Speed")
+	bool bResting = false;
 	
 	/** Pointer to the component that is serving as the floor. **/
 	UPROPERTY(Transient)
@@ -665,6 +1076,14 @@ private:
 	UPROPERTY(Transient, VisibleInstanceOnly, Category = "Basis|History")
 	FVector BasisPositionLastTick;
 
+	/** Where the basis itself was when LocalBasisPosition was last stored. If it's still there, we have nothing to follow. **/
+	UPROPERTY(Transient, VisibleInstanceOnly, Category = "Basis|History")
+	FVector BasisLocationLastTick;
+
+	/** The basis we last looked for a surface velocity on, and what we found **/
+	mutable TWeakObjectPtr<const UPrimitiveComponent> SurfaceVelocityBasis;
+	mutable TWeakObjectPtr<const UObject> SurfaceVelocitySource;
+
 	/**
 	 * Components to ignore when looking for our floor surface,
 	 * that have either overlapped our capsule, or become invalid
@@ -682,6 +1101,10 @@ private:
 	UPROPERTY(Transient, VisibleInstanceOnly)
 	TArray<AActor*> IgnoredActors;
 
+	/** Cached by GetSweepQueryParams, so sweeps don't rebuild their ignore lists every time. **/
+	mutable FCollisionQueryParams SweepQueryParams;
+	mutable bool bSweepQueryParamsDirty = true;
+
 	/** Which direction the player was launched by a deflection. Used to calculate when to regain control. **/
 	FVector DeflectDirection;
 
@@ -696,17 +1119,126 @@ private:
 	FVector PendingImpulses = FVector::ZeroVector;
 	FVector PendingPushes = FVector::ZeroVector;
 	FTransform PendingRootMotionTransforms = FTransform::Identity;
+
+	/** Penetrations queued since the last step started, kept until the step ends so later ones are solved against them. **/
+	TArray<FPupPenetrationConstraint, TInlineAllocator<8>> PendingPenetrations;
+
+	/** How much of the solved penetration adjustment has already been applied this step. **/
+	FVector AppliedPenetration = FVector::ZeroVector;
+
+	// Fixed timestep
+	/** Frame time that has not been simulated yet, always less than one timestep. **/
+	float TimeAccumulator = 0.0f;
+
+	/** Input read since the last step, waiting for the step it arrived before **/
+	FPupMovementInputBuffer InputBuffer;
+
+	/** Total frame time handed to our steps, which buffered input is stamped with **/
+	double InputClock = 0.0;
+
+	/** Where the step being simulated ends on the input clock **/
+	double StepClock = 0.0;
+
+	FTransform PreviousSimulatedTransform = FTransform::Identity;
+	FTransform CurrentSimulatedTransform = FTransform::Identity;
+
+	/** The baked static floor heightfield for this level, if there is one. **/
+	UPROPERTY(Transient)
+	UPupFloorHeightfield* FloorHeightfield;
+
+	/** Steps remaining before the floor heightfield can be trusted again after touching something movable. **/
+	int32 DynamicContactSteps = 0;
+
+	/** Blocking primitives around the player, gathered once at the start of each step and cleared at the end. **/
+	FPupContactCache ContactCache;
+
+	/** Counted from const queries, and from the prefetch on worker threads, which only ever touches its own pup. **/
+	mutable FPupMovementFrameStats FrameStats;
+
+	/** The manager stepping this pup alongside every other one, found or spawned in BeginPlay. **/
+	TWeakObjectPtr<APupMovementManager> MovementManager;
+
+	/** Was the contact cache already filled for the next step, by PrefetchStepQueries? **/
+	bool bContactsPrefetched = false;
+
+	/** A floor sweep run by PrefetchStepQueries, valid while the capsule stays at PrefetchedFloorLocation. **/
+	FHitResult PrefetchedFloorHit;
+	FVector PrefetchedFloorLocation = FVector::ZeroVector;
+	float PrefetchedFloorDistance = 0.0f;
+	bool bFloorPrefetched = false;
+
+	/** Everything the prefetched queries looked at. **/
+	FBox PrefetchedBounds = FBox(ForceInit);
+
+	UPROPERTY(Transient, VisibleInstanceOnly, Category = "LOD")
+	int32 MovementLOD = 0;
+
+	/** Fixed steps that have passed since the last simulated step, while running fewer steps for movement LOD **/
+	int32 SkippedSteps = 0;
+
+	/** Time left before a promoted pup can drop back to a cheaper movement LOD **/
+	float MovementLODPromotionRemaining = 0.0f;
+
+	/** Queries issued after the last frame's steps, for the first step of the next frame. **/
+	FTraceHandle AsyncFloorHandle;
+	FVector AsyncFloorLocation = FVector::ZeroVector;
+	float AsyncFloorDistance = 0.0f;
+
+	FTraceHandle AsyncWallHandle;
+	FVector AsyncWallTraceStart = FVector::ZeroVector;
+	FVector AsyncWallTraceEnd = FVector::ZeroVector;
+
+	/** Location of the owner's MantleHandle component relative to the UpdatedComponent, found in BeginPlay. **/
+	FVector MantleHandleOffset = FVector::ZeroVector;
+
+	/** Component that is moved to the interpolated transform for rendering. **/
+	UPROPERTY(Transient)
+	USceneComponent* PresentationComponent;
+
+	/** The original transform of the PresentationComponent, relative to the UpdatedComponent. **/
+	FTransform PresentationRelativeTransform = FTransform::Identity;
 	
-	// Timer Handles
-	FTimerHandle CoyoteTimerHandle;
-	FTimerHandle JumpTimerHandle;
-	FTimerHandle DeflectTimerHandle;
-	FTimerHandle RecoveryTimerHandle;
-	FTimerHandle MantleTimerHandle;
-	FTimerHandle MantleDebounceTimerHandle;
-	FTimerHandle DashTimerHandle;
+	/** Countdown timers for jumps, dashes, recovery, etc. Advanced at the start of each movement step. **/
+	FPupMovementTimers Timers;
+
+	/** Snapshots taken at the start of recent steps, for rolling back and simulating again **/
+	TPupMovementHistory<FPupMovementHistoryEntry> History;
+
+	/** The number of the next step to be simulated. Keeps counting up through rollbacks. **/
+	uint32 StepNumber = 0;
+
+	/** Are we simulating steps again after a rollback? **/
+	bool bResimulating = false;
+
+	/** Are we being stepped by a replay? **/
+	bool bReplaying = false;
+
+	/** Input actions handled since the last step, recorded with the next step **/
+	EPupMovementInputAction PendingInputActions = EPupMovementInputAction::None;
+
+	/** Input frames the server hasn't acknowledged yet, oldest first. Only used while predicting. **/
+	static constexpr int32 MaxUnacknowledgedFrames = 32;
+	TArray<FPupMovementInputFrame, TInlineAllocator<MaxUnacknowledgedFrames>> UnacknowledgedFrames;
+
+	/** The newest step the server has acknowledged **/
+	uint32 LastAcknowledgedStep = 0;
+	bool bReceivedAcknowledgement = false;
+
+	/** The last input frame received from the owning client, repeated if later frames never arrive **/
+	FPupMovementInputFrame LastClientFrame;
+	bool bReceivedClientFrames = false;
+
+	/** The first step received from the owning client, and when, to tell how far ahead its step numbers can be **/
+	uint32 FirstClientStep = 0;
+	double FirstClientFrameTime = 0.0;
 
-	FTimerHandle EdgeScrambleTimerHandle;
+	/** Server time the owning client's steps can still use. Earned as the server ticks, spent by each step. **/
+	float ClientStepBudget = 0.0f;
+
+	/** Distance between the presented and simulated location left over from corrections, decaying towards zero **/
+	FVector CorrectionOffset = FVector::ZeroVector;
+
+	int32 NumCorrections = 0;
 
 	UPROPERTY(BlueprintAssignable)
 	FMovementModeChanged MovementModeChanged;
@@ -724,22 +1256,136 @@ private:
 
 	UPROPERTY(BlueprintAssignable)
 	FDashEvent DashEvent;
-};
 
-USTRUCT()
-struct FPupMovementComponentState
-{
-	GENERATED_BODY()
 
-	FPupMovementComponentState();
-	FPupMovementComponentState(const UPupMovementComponent* Src);
+	// Deprecated tuning
+	/**
+	 * Move tuning saved on this component, from before it moved to UPupMovementSettings, into a settings object of our
+	 * own, so old overrides keep working. Components that already have settings are left alone.
+	 **/
+	void MigrateDeprecatedTuning();
 
-	EPupMovementMode GetMovementMode() const { return MovementMode; }
-	FTransform GetTransform() const { return Transform; }
-	FVector GetVelocity() const { return Velocity; }
+	/** Tuning that used to live on each component, only kept so anything saved back then still loads **/
+	UPROPERTY()
+	float MaxSpeed_DEPRECATED = 0.0f;
 
-private:
-	EPupMovementMode MovementMode;
-	FTransform Transform;
-	FVector Velocity;
+	UPROPERTY()
+	float MaxAcceleration_DEPRECATED = 200.0f;
+
+	UPROPERTY()
+	float BreakingFriction_DEPRECATED = 2000.0f;
+
+	UPROPERTY()
+	float DashSpeed_DEPRECATED = 400.0f;
+
+	UPROPERTY()
+	float DashTime_DEPRECATED = 0.5f;
+
+	UPROPERTY()
+	float TerminalVelocity_DEPRECATED = 4000.0f;
+
+	UPROPERTY()
+	float RotationSpeed_DEPRECATED = 360.0f;
+
+	UPROPERTY()
+	bool bSlip_DEPRECATED = true;
+
+	UPROPERTY()
+	float SlipFactor_DEPRECATED = 0.8f;
+
+	UPROPERTY()
+	float FloorSnapDistance_DEPRECATED = 5.0f;
+
+	UPROPERTY()
+	float JumpInitialVelocity_DEPRECATED = 300.0f;
+
+	UPROPERTY()
+	float ApexVelocity_DEPRECATED = 500.0f;
+
+	UPROPERTY()
+	float MaxJumpTime_DEPRECATED = 0.5f;
+
+	UPROPERTY()
+	float CoyoteTime_DEPRECATED = 0.5f;
+
+	UPROPERTY()
+	float AirControlFactor_DEPRECATED = 0.2f;
+
+	UPROPERTY()
+	bool bTurnFirst_DEPRECATED = true;
+
+	UPROPERTY()
+	bool bDoubleJump_DEPRECATED = true;
+
+	UPROPERTY()
+	float DoubleJumpAccelerationFactor_DEPRECATED = 0.5f;
+
+	UPROPERTY()
+	float WallJumpDisableTime_DEPRECATED = 0.2f;
+
+	UPROPERTY()
+	float GrabRangeForward_DEPRECATED = 20.0f;
+
+	UPROPERTY()
+	float GrabRangeTop_DEPRECATED = 10.0f;
+
+	UPROPERTY()
+	float GrabRangeBottom_DEPRECATED = 10.0f;
+
+	UPROPERTY()
+	float MaximumGrabVelocity_DEPRECATED = -100.0f;
+
+	UPROPERTY()
+	float LedgeDeviation_DEPRECATED = 0.9f;
+
+	UPROPERTY()
+	float SnapVelocity_DEPRECATED = 1000.0f;
+
+	UPROPERTY()
+	float SnapRotationVelocity_DEPRECATED = 360.0f;
+
+	UPROPERTY()
+	float WallScrambleTime_DEPRECATED = 10.0f;
+
+	UPROPERTY()
+	float MaxIncline_DEPRECATED = 60.0f;
+
+	UPROPERTY()
+	float MaxWallDeviation_DEPRECATED = 0.2f;
+
+	UPROPERTY()
+	float DeflectionFriction_DEPRECATED = 800.0f;
+
+	UPROPERTY()
+	float DeflectionControlInfluence_DEPRECATED = 0.2f;
+
+	UPROPERTY()
+	bool bCanRegainControl_DEPRECATED = true;
+
+	UPROPERTY()
+	bool bCanJumpWhileDeflected_DEPRECATED = true;
+
+	UPROPERTY()
+	float RecoveryTime_DEPRECATED = 1.0f;
+
+	UPROPERTY()
+	bool bIgnoreObstaclesWhenRecovering_DEPRECATED = true;
+
+	UPROPERTY()
+	float RecoveryLevitationHeight_DEPRECATED = 100.0f;
+
+	UPROPERTY()
+	float MinimumSafeRadius_DEPRECATED = 100.0f;
+
+	UPROPERTY()
+	bool bDragOnlyWhenGrounded_DEPRECATED = true;
+
+	UPROPERTY()
+	float DragSpeed_DEPRECATED = 100.0f;
+
+	UPROPERTY()
+	TArray<FPupMovementLODTier> MovementLODTiers_DEPRECATED;
+
+	UPROPERTY()
+	float MovementLODPromotionTime_DEPRECATED = 2.0f;
 };
@@ -0,0 +1,435 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupMovementComponent.h"
+
+#include "PupMovementManager.h"
+#include "PupMovementStats.h"
+#include "GameFramework/PlayerController.h"
+#include "Tether/Tether.h"
+
+
+// Networking
+namespace PupMovementCVars
+{
+	static int32 RedundantInputFrames = 8;
+	static FAutoConsoleVariableRef CVarRedundantInputFrames(
+		TEXT("PupMovement.RedundantInputFrames"),
+		RedundantInputFrames,
+		TEXT("How many of the newest unacknowledged input frames a client sends each frame, so lost packets don't lose input"),
+		ECVF_Default);
+
+	static int32 MaxMissingClientSteps = 8;
+	static FAutoConsoleVariableRef CVarMaxMissingClientSteps(
+		TEXT("PupMovement.MaxMissingClientSteps"),
+		MaxMissingClientSteps,
+		TEXT("Most steps the server fills in with the last known input when a client's frames never arrive. Larger gaps are skipped"),
+		ECVF_Default);
+
+	static float ClientTimeTolerance = 0.25f;
+	static FAutoConsoleVariableRef CVarClientTimeTolerance(
+		TEXT("PupMovement.ClientTimeTolerance"),
+		ClientTimeTolerance,
+		TEXT("Seconds of steps a client can bunch up beyond the time that has passed on the server, to absorb network jitter. ")
+		TEXT("Steps beyond that wait until enough server time has passed"),
+		ECVF_Default);
+
+	static float MaxClientTimeAhead = 2.0f;
+	static FAutoConsoleVariableRef CVarMaxClientTimeAhead(
+		TEXT("PupMovement.MaxClientTimeAhead"),
+		MaxClientTimeAhead,
+		TEXT("How many seconds a client's step numbers can run ahead of the server's clock before its input is rejected as impossible"),
+		ECVF_Default);
+
+	static float CorrectionLocationTolerance = 1.0f;
+	static FAutoConsoleVariableRef CVarCorrectionLocationTolerance(
+		TEXT("PupMovement.CorrectionLocationTolerance"),
+		CorrectionLocationTolerance,
+		TEXT("How far a client's predicted location can be from the server's before it is corrected"),
+		ECVF_Default);
+
+	static float CorrectionVelocityTolerance = 10.0f;
+	static FAutoConsoleVariableRef CVarCorrectionVelocityTolerance(
+		TEXT("PupMovement.CorrectionVelocityTolerance"),
+		CorrectionVelocityTolerance,
+		TEXT("How far a client's predicted velocity can be from the server's before it is corrected"),
+		ECVF_Default);
+
+	static float CorrectionSmoothingTime = 0.1f;
+	static FAutoConsoleVariableRef CVarCorrectionSmoothingTime(
+		TEXT("PupMovement.CorrectionSmoothingTime"),
+		CorrectionSmoothingTime,
+		TEXT("Time constant, in seconds, for the presented location to catch up with a corrected prediction"),
+		ECVF_Default);
+
+	static float CorrectionSnapDistance = 200.0f;
+	static FAutoConsoleVariableRef CVarCorrectionSnapDistance(
+		TEXT("PupMovement.CorrectionSnapDistance"),
+		CorrectionSnapDistance,
+		TEXT("Corrections larger than this snap the presented location instead of smoothing it"),
+		ECVF_Default);
+}
+
+
+bool UPupMovementComponent::HandleInputAction(const EPupMovementInputAction Action)
+{
+	if (GetOwnerRole() == ROLE_SimulatedProxy || IsDrivenByRemoteClient())
+	{
+		// Only the owner of a pup can act for it. The server hears about actions with the owner's input.
+		return false;
+	}
+	InputBuffer.AddAction(Action, InputClock);
+	WakeUp();
+	return true;
+}
+
+
+bool UPupMovementComponent::IsPredicting() const
+{
+	return GetOwnerRole() == ROLE_AutonomousProxy;
+}
+
+
+bool UPupMovementComponent::IsDrivenByRemoteClient() const
+{
+	if (GetOwnerRole() != ROLE_Authority || GetNetMode() == NM_Standalone || !PawnOwner || PawnOwner->IsLocallyControlled())
+	{
+		return false;
+	}
+	return Cast<APlayerController>(PawnOwner->GetController()) != nullptr;
+}
+
+
+bool UPupMovementComponent::ApplyInputActions(const EPupMovementInputAction Actions)
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+	bool bResult = false;
+	if (EnumHasAnyFlags(Actions, EPupMovementInputAction::Jump))
+	{
+		bJumpHeld = true;
+		// Climbing a mantle uses up the press, even though it isn't a jump
+		const bool bWasMantling = bMantling;
+		if (Jump())
+		{
+			bResult = true;
+		}
+		else if (!bWasMantling)
+		{
+			Timers.Set(EPupMovementTimer::JumpBuffer, Settings.JumpBufferTime);
+		}
+	}
+	if (EnumHasAnyFlags(Actions, EPupMovementInputAction::StopJumping))
+	{
+		bJumpHeld = false;
+		StopJumping();
+		bResult = true;
+	}
+	if (EnumHasAnyFlags(Actions, EPupMovementInputAction::Dash))
+	{
+		if (bCanDash)
+		{
+			Dash();
+			bResult = true;
+		}
+		else
+		{
+			Timers.Set(EPupMovementTimer::DashBuffer, Settings.DashBufferTime);
+		}
+	}
+	return bResult;
+}
+
+
+void UPupMovementComponent::RetryBufferedActions()
+{
+	if (Timers.IsActive(EPupMovementTimer::JumpBuffer) && !bMantling && Jump())
+	{
+		Timers.Clear(EPupMovementTimer::JumpBuffer);
+		WakeUp();
+		if (!bJumpHeld)
+		{
+			// The button was let go before we could jump, so it's only a hop
+			StopJumping();
+		}
+	}
+	if (Timers.IsActive(EPupMovementTimer::DashBuffer) && bCanDash)
+	{
+		Timers.Clear(EPupMovementTimer::DashBuffer);
+		Dash();
+	}
+}
+
+
+void UPupMovementComponent::PredictStep(const float DeltaTime)
+{
+	const FPupMovementInputFrame Frame = FPupMovementInputFrame::Make(StepNumber, DirectionVector, InputFactor, bIsWalking,
+		PendingInputActions);
+
+	// Simulate with exactly the input the server will see
+	DirectionVector = Frame.GetDirectionVector();
+	InputFactor = Frame.GetInputFactor();
+	bIsWalking = Frame.IsWalking();
+
+	if (UnacknowledgedFrames.Num() >= MaxUnacknowledgedFrames)
+	{
+		// The server has stopped listening, so only the newest frames are worth keeping
+		UnacknowledgedFrames.RemoveAt(0, 1, false);
+	}
+	UnacknowledgedFrames.Add(Frame);
+
+	StepMovement(DeltaTime);
+}
+
+
+void UPupMovementComponent::SendUnacknowledgedFrames()
+{
+	const int32 MaxFrames = FMath::Clamp(PupMovementCVars::RedundantInputFrames, 1, FPupMovementInputBatch::MaxFrames);
+	const int32 NumFrames = FMath::Min(UnacknowledgedFrames.Num(), MaxFrames);
+	if (NumFrames == 0)
+	{
+		return;
+	}
+
+	FPupMovementInputBatch Batch;
+	Batch.Frames.Append(UnacknowledgedFrames.GetData() + UnacknowledgedFrames.Num() - NumFrames, NumFrames);
+	ServerMove(Batch);
+}
+
+
+bool UPupMovementComponent::ServerMove_Validate(const FPupMovementInputBatch& Batch)
+{
+	if (Batch.Frames.Num() == 0 || Batch.Frames.Num() > FPupMovementInputBatch::MaxFrames)
+	{
+		return false;
+	}
+	if (!bReceivedClientFrames)
+	{
+		return true;
+	}
+
+	// A client can't have simulated more steps than the time that has passed since its first frame arrived, give or take ping
+	const UWorld* World = GetWorld();
+	const double Elapsed = World ? World->GetTimeSeconds() - FirstClientFrameTime : 0.0;
+	const double MaxSteps = (Elapsed + FMath::Max(PupMovementCVars::MaxClientTimeAhead, 0.0f)) / GetTimestepLength();
+	return static_cast<int64>(Batch.Frames.Last().Step) - static_cast<int64>(FirstClientStep) <= MaxSteps;
+}
+
+
+void UPupMovementComponent::EarnClientStepBudget(const float DeltaTime)
+{
+	// Time the client didn't use can't be saved up for a burst later
+	ClientStepBudget = FMath::Min(ClientStepBudget + DeltaTime, FMath::Max(PupMovementCVars::ClientTimeTolerance, 0.0f));
+}
+
+
+bool UPupMovementComponent::SpendClientStepBudget(const uint32 NumSteps)
+{
+	const float Cost = NumSteps * GetTimestepLength();
+	if (Cost > ClientStepBudget + KINDA_SMALL_NUMBER)
+	{
+		return false;
+	}
+	ClientStepBudget -= Cost;
+	return true;
+}
+
+
+void UPupMovementComponent::ServerMove_Implementation(const FPupMovementInputBatch& Batch)
+{
+	if (!IsDrivenByRemoteClient() || Batch.Frames.Num() == 0)
+	{
+		return;
+	}
+
+	if (!bReceivedClientFrames)
+	{
+		// Adopt the client's step numbers, so acknowledgements line up with its history
+		StepNumber = Batch.Frames[0].Step;
+		bReceivedClientFrames = true;
+		FirstClientStep = StepNumber;
+		FirstClientFrameTime = GetWorld()->GetTimeSeconds();
+		ClientStepBudget = FMath::Max(PupMovementCVars::ClientTimeTolerance, 0.0f);
+	}
+
+	const float StepLength = GetTimestepLength();
+	bool bSimulated = false;
+	for (const FPupMovementInputFrame& Frame : Batch.Frames)
+	{
+		if (Frame.Step < StepNumber)
+		{
+			// Already simulated from an earlier batch
+			continue;
+		}
+
+		// Every step we simulate costs server time, including the ones filled in for lost frames. Skipped steps don't
+		// move the pup, so they're free. Frames we can't afford yet are sent again with the client's next batch.
+		const uint32 Gap = Frame.Step - StepNumber;
+		const bool bSkipGap = Gap > static_cast<uint32>(FMath::Max(PupMovementCVars::MaxMissingClientSteps, 0));
+		if (!SpendClientStepBudget(bSkipGap ? 1 : Gap + 1))
+		{
+			break;
+		}
+		if (bSkipGap)
+		{
+			StepNumber = Frame.Step;
+		}
+		while (StepNumber < Frame.Step)
+		{
+			// Every copy of these frames was lost, so keep doing whatever the client did last
+			FPupMovementInputFrame MissingFrame = LastClientFrame;
+			MissingFrame.Step = StepNumber;
+			MissingFrame.Actions = 0;
+			SimulateClientFrame(MissingFrame, StepLength);
+		}
+		SimulateClientFrame(Frame, StepLength);
+		bSimulated = true;
+	}
+
+	if (!bSimulated)
+	{
+		return;
+	}
+	ResetPresentationInterpolation();
+
+	// Acknowledge the newest step with the state it started from, which is what the client recorded for it
+	const uint32 AckStep = StepNumber - 1;
+	if (const FPupMovementComponentState* AckState = FindHistoryState(AckStep))
+	{
+		ClientAckMove(static_cast<int32>(AckStep), *AckState);
+	}
+	else
+	{
+		ClientAckMove(static_cast<int32>(StepNumber), FPupMovementComponentState(this));
+	}
+}
+
+
+void UPupMovementComponent::SimulateClientFrame(const FPupMovementInputFrame& Frame, const float DeltaTime)
+{
+	DirectionVector = Frame.GetDirectionVector();
+	InputFactor = Frame.GetInputFactor();
+	bIsWalking = Frame.IsWalking();
+
+	ApplyInputActions(Frame.GetActions());
+	PendingInputActions = Frame.GetActions();
+	StepMovement(DeltaTime);
+
+	LastClientFrame = Frame;
+}
+
+
+void UPupMovementComponent::RecordCharacterAction(const EPupRecordedAction Action)
+{
+	if (FPupMovementRecorder* Recorder = MovementManager.IsValid() ? MovementManager->GetRecorder() : nullptr)
+	{
+		Recorder->RecordCharacterAction(this, Action);
+	}
+}
+
+
+void UPupMovementComponent::SetReplaying(const bool bInReplaying)
+{
+	bReplaying = bInReplaying;
+
+	// Input read while the replay was driving us doesn't belong to any step, before or after it
+	InputBuffer.Reset();
+	ConsumeInputVector();
+	PendingInputActions = EPupMovementInputAction::None;
+	ResetPresentationInterpolation();
+}
+
+
+uint32 UPupMovementComponent::SimulateRecordedStep(const FPupRecordedStep& Step, const bool bApplyActions)
+{
+	DirectionVector = Step.GetDirectionVector();
+	InputFactor = Step.InputFactor;
+	CameraYaw = Step.CameraYaw;
+	bIsWalking = Step.bIsWalking;
+	MovementLOD = Step.MovementLOD;
+	if (Step.bAwake)
+	{
+		// Whatever woke us when this was recorded, whether input, an overlap, or a push, isn't being replayed
+		WakeUp();
+	}
+
+	if (bApplyActions)
+	{
+		ApplyInputActions(Step.GetInputActions());
+	}
+	PendingInputActions = Step.GetInputActions();
+
+	// Recorded at the same point in StepMovement, once the input has been applied
+	const uint32 Checksum = FPupMovementComponentState(this).GetChecksum();
+
+	PreviousSimulatedTransform = UpdatedComponent->GetComponentTransform();
+	StepMovement(Step.DeltaTime);
+	CurrentSimulatedTransform = UpdatedComponent->GetComponentTransform();
+	return Checksum;
+}
+
+
+void UPupMovementComponent::ClientAckMove_Implementation(const int32 Step, const FPupMovementComponentState& ServerState)
+{
+	const uint32 AckStep = static_cast<uint32>(Step);
+	if (!IsPredicting() || (bReceivedAcknowledgement && AckStep <= LastAcknowledgedStep))
+	{
+		// Acknowledgements are unreliable, so older ones can arrive after newer ones
+		return;
+	}
+	bReceivedAcknowledgement = true;
+	LastAcknowledgedStep = AckStep;
+
+	int32 NumAcknowledged = 0;
+	while (NumAcknowledged < UnacknowledgedFrames.Num() && UnacknowledgedFrames[NumAcknowledged].Step <= AckStep)
+	{
+		NumAcknowledged++;
+	}
+	UnacknowledgedFrames.RemoveAt(0, NumAcknowledged, false);
+
+	const FPupMovementComponentState* Predicted = FindHistoryState(AckStep);
+	if (!Predicted || !NeedsCorrection(*Predicted, ServerState))
+	{
+		return;
+	}
+
+	UE_LOG(LogTetherGame, Verbose, TEXT("%s corrected at step %u, %.2f units off"), *GetNameSafe(GetOwner()), AckStep,
+		FVector::Dist(Predicted->Transform.GetLocation(), ServerState.Transform.GetLocation()));
+
+	// The camera's yaw never leaves the client, so the server's copy is meaningless
+	const float LocalCameraYaw = CameraYaw;
+	const FVector OldSimulatedLocation = CurrentSimulatedTransform.GetLocation();
+
+	RestoreState(ServerState);
+	CameraYaw = LocalCameraYaw;
+	Resimulate(AckStep);
+
+	// Keep showing the old prediction, and let the offset decay so the mesh and camera glide onto the corrected path
+	const FVector Correction = CurrentSimulatedTransform.GetLocation() - OldSimulatedLocation;
+	PreviousSimulatedTransform.AddToTranslation(Correction);
+	CorrectionOffset -= Correction;
+	if (CorrectionOffset.SizeSquared() > FMath::Square(PupMovementCVars::CorrectionSnapDistance))
+	{
+		CorrectionOffset = FVector::ZeroVector;
+	}
+
+	NumCorrections++;
+	INC_DWORD_STAT(STAT_PupMovementCorrections);
+}
+
+
+bool UPupMovementComponent::NeedsCorrection(const FPupMovementComponentState& Predicted, const FPupMovementComponentState& Server)
+{
+	return Predicted.MovementMode != Server.MovementMode ||
+		!Predicted.Transform.GetLocation().Equals(Server.Transform.GetLocation(), PupMovementCVars::CorrectionLocationTolerance) ||
+		!Predicted.Velocity.Equals(Server.Velocity, PupMovementCVars::CorrectionVelocityTolerance);
+}
+
+
+void UPupMovementComponent::DecayCorrectionOffset(const float DeltaTime)
+{
+	if (CorrectionOffset.IsNearlyZero(0.01f))
+	{
+		CorrectionOffset = FVector::ZeroVector;
+		return;
+	}
+	CorrectionOffset *= FMath::Exp(-DeltaTime / FMath::Max(PupMovementCVars::CorrectionSmoothingTime, KINDA_SMALL_NUMBER));
+}
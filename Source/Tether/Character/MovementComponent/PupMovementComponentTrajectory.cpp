@@ -0,0 +1,175 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupMovementComponent.h"
+
+
+// Trajectory Prediction
+namespace PupMovementTrajectory
+{
+	/** How much longer a jump with AppliedVelocity already behind it can be held, given how long the button can be held for **/
+	static float GetHoldTime(const UPupMovementSettings& Settings, const float AppliedVelocity, const float MaxTime)
+	{
+		if (Settings.HoldJumpAcceleration <= 0.0f)
+		{
+			return 0.0f;
+		}
+		return FMath::Clamp((Settings.ApexVelocity - AppliedVelocity) / Settings.HoldJumpAcceleration, 0.0f, MaxTime);
+	}
+}
+
+
+FPupTrajectory UPupMovementComponent::PredictTrajectory(const float LandingHeight, const bool bSweep) const
+{
+	return FinishTrajectory(MakeCurrentTrajectoryLaunch(), LandingHeight, bSweep);
+}
+
+
+FPupTrajectory UPupMovementComponent::PredictJump(const bool bHoldJump, const float LandingHeight, const bool bSweep) const
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+
+	// Jump adds its impulse, and then SetMovementMode(M_Falling) adds the basis velocity a second time
+	const FVector LaunchVelocity = Velocity + GetJumpImpulse() + BasisRelativeVelocity;
+
+	FPupTrajectoryLaunch Launch = MakeTrajectoryLaunch(LaunchVelocity);
+	if (bHoldJump)
+	{
+		Launch.HoldAcceleration = Settings.HoldJumpAcceleration;
+		Launch.HoldTime = PupMovementTrajectory::GetHoldTime(Settings, JumpAppliedVelocity + Settings.JumpInitialVelocity, Settings.MaxJumpTime);
+	}
+	if (bDashing)
+	{
+		Launch.CoastVelocity = FVector(LaunchVelocity.X, LaunchVelocity.Y, 0.0f);
+		Launch.CoastTime = Timers.GetRemaining(EPupMovementTimer::Dash);
+	}
+	return FinishTrajectory(Launch, LandingHeight, bSweep);
+}
+
+
+FPupTrajectory UPupMovementComponent::PredictWallJump(const float LandingHeight, const bool bSweep) const
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+
+	FVector LaunchVelocity = Velocity + Settings.MaxSpeed * WallNormal;
+	LaunchVelocity.Z = Settings.JumpInitialVelocity;
+
+	// Control is taken away for a moment, so the player keeps their velocity away from the wall
+	FPupTrajectoryLaunch Launch = MakeTrajectoryLaunch(LaunchVelocity);
+	Launch.HoldAcceleration = Settings.HoldJumpAcceleration;
+	Launch.HoldTime = PupMovementTrajectory::GetHoldTime(Settings, JumpAppliedVelocity + Settings.JumpInitialVelocity, Settings.MaxJumpTime);
+	Launch.CoastVelocity = FVector(LaunchVelocity.X, LaunchVelocity.Y, 0.0f);
+	Launch.CoastTime = Settings.WallJumpDisableTime;
+	return FinishTrajectory(Launch, LandingHeight, bSweep);
+}
+
+
+FPupTrajectory UPupMovementComponent::PredictDash(const float LandingHeight, const bool bSweep) const
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+	FPupTrajectoryLaunch Launch = MakeCurrentTrajectoryLaunch();
+
+	// The falling mode keeps at least the dash speed along the dash direction until the dash ends
+	const FVector Direction = UpdatedComponent->GetForwardVector();
+	const FVector PlanarVelocity = FVector(Velocity.X, Velocity.Y, 0.0f);
+	const float DashValue = FVector::DotProduct(Direction, PlanarVelocity);
+	Launch.CoastVelocity = PlanarVelocity + Direction * FMath::Max(Settings.DashSpeed * Settings.AirControlFactor - DashValue, 0.0f);
+	Launch.CoastTime = Settings.DashTime;
+	return FinishTrajectory(Launch, LandingHeight, bSweep);
+}
+
+
+FPupTrajectory UPupMovementComponent::PredictDeflection(const FVector& DeflectionVelocity, const float LandingHeight, const bool bSweep) const
+{
+	// Deflections don't steer towards the input or hold jumps, so gravity is all that's left
+	FPupTrajectoryLaunch Launch = MakeTrajectoryLaunch(Velocity + DeflectionVelocity);
+	Launch.AirAcceleration = 0.0f;
+	return FinishTrajectory(Launch, LandingHeight, bSweep);
+}
+
+
+bool UPupMovementComponent::SweepTrajectory(FPupTrajectory& Trajectory) const
+{
+	UWorld* World = GetWorld();
+	if (!World || !UpdatedPrimitive || !Trajectory.bLands)
+	{
+		return false;
+	}
+
+	FCollisionQueryParams& QueryParams = GetSweepQueryParams();
+	QueryParams.bFindInitialOverlaps = false;
+
+	FHitResult HitResult;
+	CountQuery(EPupMovementQuery::Sweep);
+	if (!World->SweepSingleByChannel(HitResult, Trajectory.Apex, Trajectory.Landing, UpdatedComponent->GetComponentQuat(),
+		ECC_Pawn, UpdatedPrimitive->GetCollisionShape(), QueryParams, FCollisionResponseParams::DefaultResponseParam))
+	{
+		return false;
+	}
+
+	Trajectory.bBlocked = true;
+	Trajectory.Landing = HitResult.Location;
+
+	// The sweep is a straight line, so find when the curve really reaches the hit height, falling back to the sweep's fraction
+	const float HitTime = Trajectory.FindDescentTime(HitResult.Location.Z);
+	Trajectory.Airtime = HitTime >= 0.0f ? HitTime : FMath::Lerp(Trajectory.ApexTime, Trajectory.Airtime, HitResult.Time);
+	return true;
+}
+
+
+FPupTrajectoryLaunch UPupMovementComponent::MakeTrajectoryLaunch(const FVector& LaunchVelocity) const
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+
+	FPupTrajectoryLaunch Launch;
+	Launch.Location = UpdatedComponent->GetComponentLocation();
+	Launch.Velocity = LaunchVelocity;
+	Launch.GravityZ = GetGravityZ();
+	Launch.TargetVelocity = bIsWalking ? DirectionVector * Settings.MaxSpeed : FVector::ZeroVector;
+	Launch.AirAcceleration = Settings.MaxAcceleration * Settings.AirControlFactor;
+	return Launch;
+}
+
+
+FPupTrajectoryLaunch UPupMovementComponent::MakeCurrentTrajectoryLaunch() const
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+	FPupTrajectoryLaunch Launch = MakeTrajectoryLaunch(Velocity);
+
+	if (MovementMode == EPupMovementMode::M_Deflected)
+	{
+		Launch.AirAcceleration = 0.0f;
+		return Launch;
+	}
+
+	if (bJumping)
+	{
+		Launch.HoldAcceleration = Settings.HoldJumpAcceleration;
+		Launch.HoldTime = PupMovementTrajectory::GetHoldTime(Settings, JumpAppliedVelocity, Timers.GetRemaining(EPupMovementTimer::Jump));
+	}
+
+	const FVector PlanarVelocity = FVector(Velocity.X, Velocity.Y, 0.0f);
+	if (bDashing)
+	{
+		const float DashValue = FVector::DotProduct(DashDirection, PlanarVelocity);
+		Launch.CoastVelocity = PlanarVelocity + DashDirection * FMath::Max(Settings.DashSpeed * Settings.AirControlFactor - DashValue, 0.0f);
+		Launch.CoastTime = Timers.GetRemaining(EPupMovementTimer::Dash);
+	}
+	else if (bWallJumpDisabledControl)
+	{
+		Launch.CoastVelocity = PlanarVelocity;
+		Launch.CoastTime = Timers.GetRemaining(EPupMovementTimer::WallJumpControl);
+	}
+	return Launch;
+}
+
+
+FPupTrajectory UPupMovementComponent::FinishTrajectory(const FPupTrajectoryLaunch& Launch, const float LandingHeight,
+	const bool bSweep) const
+{
+	FPupTrajectory Trajectory = FPupTrajectory::Predict(Launch, Launch.Location.Z + LandingHeight);
+	if (bSweep)
+	{
+		SweepTrajectory(Trajectory);
+	}
+	return Trajectory;
+}
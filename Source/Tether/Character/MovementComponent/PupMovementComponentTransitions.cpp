@@ -1,14 +1,48 @@
 #include "PupMovementComponent.h"
 
 #include "DrawDebugHelpers.h"
+#include "PupFloorHeightfield.h"
 #include "../TetherCharacter.h"
 #include "Components/CapsuleComponent.h"
 
+
+// Transitions
+namespace PupMovementCVars
+{
+	static int32 UseLedgeIndex = 1;
+	static FAutoConsoleVariableRef CVarUseLedgeIndex(
+		TEXT("PupMovement.UseLedgeIndex"),
+		UseLedgeIndex,
+		TEXT("If non-zero, ledges on static geometry are found from the level's baked ledge index instead of live traces"),
+		ECVF_Default);
+}
+
+
+/** Build a hit result that matches what a line trace against an indexed ledge would have returned. **/
+static FHitResult MakeIndexedLedgeHit(UPrimitiveComponent* Component, const FVector& TraceStart, const FVector& TraceEnd,
+	const FVector& ImpactPoint, const FVector& Normal)
+{
+	FHitResult Hit(1.0f);
+	Hit.bBlockingHit = true;
+	Hit.TraceStart = TraceStart;
+	Hit.TraceEnd = TraceEnd;
+	Hit.Location = ImpactPoint;
+	Hit.ImpactPoint = ImpactPoint;
+	Hit.Normal = Normal;
+	Hit.ImpactNormal = Normal;
+	Hit.Distance = FVector::Dist(TraceStart, ImpactPoint);
+	Hit.Time = Hit.Distance / FMath::Max(FVector::Dist(TraceStart, TraceEnd), KINDA_SMALL_NUMBER);
+	Hit.Component = Component;
+	Hit.Actor = Component->GetOwner();
+	return Hit;
+}
+
+
 void UPupMovementComponent::SetDefaultMovementMode()
 {
 	ConsumeImpulse();
 	FHitResult FloorResult;
-	const float EffectiveSnapDistance = FMath::Max(FloorSnapDistance, Velocity.Z);
+	const float EffectiveSnapDistance = FMath::Max(GetMovementSettings().FloorSnapDistance, Velocity.Z);
 	if ( (FindFloor(EffectiveSnapDistance, FloorResult, 1) && Velocity.Z <= 0.0f) || bGrounded)
 	{
 		SetMovementMode(EPupMovementMode::M_Walking);
@@ -36,11 +70,19 @@ void UPupMovementComponent::SetWorldLocation(const FVector Location)
 	{
 		StoreBasisTransformPostUpdate();
 	}
+	ResetPresentationInterpolation();
+}
+
+
+FVector UPupMovementComponent::GetJumpImpulse() const
+{
+	return UpdatedComponent->GetUpVector() * (GetMovementSettings().JumpInitialVelocity - Velocity.Z) + BasisRelativeVelocity;
 }
 
 
 bool UPupMovementComponent::Jump()
 {
+	const UPupMovementSettings& Settings = GetMovementSettings();
 	if (bSupressingInput || MatchModes(MovementMode, {EPupMovementMode::M_Dragging, EPupMovementMode::M_Recover, EPupMovementMode::M_None}))
 	{
 		return false;
@@ -65,28 +107,22 @@ bool UPupMovementComponent::Jump()
 		JumpEvent.Broadcast(BasisPositionLastTick - PlayerHeight * UpdatedComponent->GetUpVector(), true);
 
 		
-		if (UWorld* World = GetWorld())
+		if (Settings.MaxJumpTime > 0.0f)
 		{
-			if (MaxJumpTime > 0.0f)
-			{
-				World->GetTimerManager().SetTimer(JumpTimerHandle, FTimerDelegate::CreateWeakLambda(this, [this]
-				{
-					StopJumping();
-				}), MaxJumpTime, false);
-			}
-			else
-			{
-				StopJumping();
-			}
+			Timers.Set(EPupMovementTimer::Jump, Settings.MaxJumpTime);
+		}
+		else
+		{
+			StopJumping();
 		}
 		return true;
 	}
 	if (bCanJump)
 	{
 		bAttachedToBasis = false;
-		AddImpulse(UpdatedComponent->GetUpVector() * (JumpInitialVelocity - Velocity.Z) + BasisRelativeVelocity);
+		AddImpulse(GetJumpImpulse());
 		
-		JumpAppliedVelocity += JumpInitialVelocity;
+		JumpAppliedVelocity += Settings.JumpInitialVelocity;
 		bCanJump = false;
 		bJumping = true;
 
@@ -102,35 +138,29 @@ bool UPupMovementComponent::Jump()
 		
 		SetMovementMode(EPupMovementMode::M_Falling);
 		
-		if (UWorld* World = GetWorld())
+		if (Settings.MaxJumpTime > 0.0f)
 		{
-			if (MaxJumpTime > 0.0f)
-			{
-				World->GetTimerManager().SetTimer(JumpTimerHandle, FTimerDelegate::CreateWeakLambda(this, [this]
-				{
-					StopJumping();
-				}), MaxJumpTime, false);
-			}
-			else
-			{
-				StopJumping();
-			}
+			Timers.Set(EPupMovementTimer::Jump, Settings.MaxJumpTime);
+		}
+		else
+		{
+			StopJumping();
 		}
 		return true;
 	}
 	if (bCanDoubleJump)
 	{
-		Velocity.Z = JumpInitialVelocity;
+		Velocity.Z = Settings.JumpInitialVelocity;
 		UpdatedComponent->SetWorldRotation(DesiredRotation);
 
 		if (bIsWalking && !bDashing)
 		{
-			const float ImpulseStrength = MaxSpeed - Speed;
+			const float ImpulseStrength = Settings.MaxSpeed - Speed;
 			// Apply extra directional velocity
-			AddImpulse(FMath::Min(MaxAcceleration * InputFactor * DoubleJumpAccelerationFactor, ImpulseStrength) * UpdatedComponent->GetForwardVector());
+			AddImpulse(FMath::Min(Settings.MaxAcceleration * InputFactor * Settings.DoubleJumpAccelerationFactor, ImpulseStrength) * UpdatedComponent->GetForwardVector());
 		}
 		
-		JumpAppliedVelocity += JumpInitialVelocity;
+		JumpAppliedVelocity += Settings.JumpInitialVelocity;
 		bCanDoubleJump = false;
 		bJumping = true;
 
@@ -150,19 +180,13 @@ bool UPupMovementComponent::Jump()
 		
 		SetMovementMode(EPupMovementMode::M_Falling);
 		
-		if (UWorld* World = GetWorld())
+		if (Settings.MaxJumpTime > 0.0f)
 		{
-			if (MaxJumpTime > 0.0f)
-			{
-				World->GetTimerManager().SetTimer(JumpTimerHandle, FTimerDelegate::CreateWeakLambda(this, [this]
-				{
-					StopJumping();
-				}), MaxJumpTime, false);
-			}
-			else
-			{
-				StopJumping();
-			}
+			Timers.Set(EPupMovementTimer::Jump, Settings.MaxJumpTime);
+		}
+		else
+		{
+			StopJumping();
 		}
 		return true;
 	}
@@ -172,22 +196,19 @@ bool UPupMovementComponent::Jump()
 
 void UPupMovementComponent::WallJump()
 {
+	const UPupMovementSettings& Settings = GetMovementSettings();
 	bWallSliding = false;
-	JumpAppliedVelocity += JumpInitialVelocity;
+	JumpAppliedVelocity += Settings.JumpInitialVelocity;
 	bCanJump = false;
 	bJumping = true;
 	bCanScramble = false;
 		
-	AddImpulse(MaxSpeed * WallNormal + (JumpInitialVelocity - Velocity.Z) * UpdatedComponent->GetUpVector() );
+	AddImpulse(Settings.MaxSpeed * WallNormal + (Settings.JumpInitialVelocity - Velocity.Z) * UpdatedComponent->GetUpVector() );
 	DesiredRotation.Yaw += 180.0f;
 	UpdatedComponent->AddWorldRotation(FRotator(0.0f, 180.0f, 0.0f));
 	
 	bWallJumpDisabledControl = true;
-	GetWorld()->GetTimerManager().SetTimer(MantleDebounceTimerHandle,
-		FTimerDelegate::CreateWeakLambda(this, [this]
-		{
-			bWallJumpDisabledControl = false;
-		}),	WallJumpDisableTime, false);
+	Timers.Set(EPupMovementTimer::WallJumpControl, Settings.WallJumpDisableTime);
 }
 
 
@@ -201,7 +222,7 @@ void UPupMovementComponent::StopJumping()
 
 void UPupMovementComponent::TryRegainControl()
 {
-	if (bCanRegainControl)
+	if (GetMovementSettings().bCanRegainControl)
 	{
 		if (FVector::DotProduct(DeflectDirection, Velocity) <= KINDA_SMALL_NUMBER)
 		{
@@ -222,7 +243,8 @@ void UPupMovementComponent::Deflect(const FVector& DeflectionVelocity, const flo
 	{
 		return;
 	}
-	if (UWorld* World = GetWorld())
+	PromoteMovementLOD();
+	if (GetWorld())
 	{
 		if (MovementMode == EPupMovementMode::M_Anchored)
 		{
@@ -240,13 +262,9 @@ void UPupMovementComponent::Deflect(const FVector& DeflectionVelocity, const flo
 		DesiredRotation.Yaw = DesiredYaw;
 		UpdatedComponent->SetWorldRotation(NewRotation);
 
-		const float DeflectTimeRemaining = DeflectTimerHandle.IsValid() ? World->GetTimerManager().GetTimerRemaining(DeflectTimerHandle) : 0.f;
-		if (DeflectTimeRemaining < DeflectTime)
+		if (Timers.GetRemaining(EPupMovementTimer::Deflect) < DeflectTime)
 		{
-			World->GetTimerManager().SetTimer(DeflectTimerHandle, FTimerDelegate::CreateWeakLambda(this, [this]
-			{
-				TryRegainControl();
-			}), DeflectTime, false);
+			Timers.Set(EPupMovementTimer::Deflect, DeflectTime);
 		}
 	}
 	AddImpulse(DeflectionVelocity);
@@ -269,7 +287,9 @@ void UPupMovementComponent::AnchorToComponent(UPrimitiveComponent* AnchorTargetC
 	{
 		FHitResult AnchorTestHit;
 		UPrimitiveComponent* PrimitiveComponent = Cast<UPrimitiveComponent>(UpdatedComponent);
+		CountQuery(EPupMovementQuery::ClosestPoint);
 		AnchorTargetComponent->GetClosestPointOnCollision(UpdatedComponent->GetComponentLocation(), AttachmentLocation);
+		CountQuery(EPupMovementQuery::Sweep);
 		AnchorTargetComponent->SweepComponent(AnchorTestHit, ComponentLocation,
 			AttachmentLocation,
 			UpdatedComponent->GetComponentQuat(),
@@ -280,6 +300,7 @@ void UPupMovementComponent::AnchorToComponent(UPrimitiveComponent* AnchorTargetC
 			FVector::DotProduct(Distance, BasisComponent->GetForwardVector()),
 			FVector::DotProduct(Distance, BasisComponent->GetRightVector()),
 			FVector::DotProduct(Distance, BasisComponent->GetUpVector()));
+		BasisLocationLastTick = BasisComponent->GetComponentLocation();
 	}
 	bIsWalking = false;
 	SetMovementMode(EPupMovementMode::M_Anchored);
@@ -300,10 +321,7 @@ void UPupMovementComponent::BreakAnchor(const bool bForceBreak)
 	{
 		SetDefaultMovementMode();
 	}
-	GetWorld()->GetTimerManager().SetTimer(MantleDebounceTimerHandle, FTimerDelegate::CreateWeakLambda(this, [this]
-	{;
-		bCanMantle = true;
-	}), 0.2f, false);
+	Timers.Set(EPupMovementTimer::MantleDebounce, 0.2f);
 }
 
 
@@ -318,7 +336,7 @@ void UPupMovementComponent::Land(const FVector& FloorLocation, const float Impac
 	bCanScramble = true;
 	bCanDash = true;
 	
-	if (bDoubleJump)
+	if (GetMovementSettings().bDoubleJump)
 	{
 		bCanDoubleJump = true;
 	}
@@ -331,16 +349,7 @@ void UPupMovementComponent::Fall()
 	bAttachedToBasis = false;
 	BasisComponent = nullptr;
 	SetMovementMode(EPupMovementMode::M_Falling);
-	if (UWorld* World = GetWorld())
-	{
-		World->GetTimerManager().SetTimer(CoyoteTimerHandle, FTimerDelegate::CreateWeakLambda(this, [this]
-		{
-			if (!bGrounded)
-			{
-				bCanJump = false;
-			}
-		}), CoyoteTime, false);
-	}
+	Timers.Set(EPupMovementTimer::Coyote, GetMovementSettings().CoyoteTime);
 }
 
 
@@ -362,18 +371,13 @@ void UPupMovementComponent::Recover()
 	bGrounded = false;
 	bAttachedToBasis = false;
 	BasisComponent = nullptr;
+	LastValidLocation = FindRecoveryLocation();
 	
 	// const FVector RecoveryLocation = LastValidLocation + (RecoveryLevitationHeight * UpdatedComponent->GetUpVector());
 	// const float GravityDelta = GetGravityZ() * RecoveryTime;
 	// FVector RecoveryVelocity = (RecoveryLocation - UpdatedComponent->GetComponentLocation()) / RecoveryTime;
 	// Velocity = RecoveryVelocity;
-	if (UWorld* World = GetWorld())
-	{
-		World->GetTimerManager().SetTimer(RecoveryTimerHandle, FTimerDelegate::CreateWeakLambda(this, [this]
-		{
-			EndRecovery();
-		}), RecoveryTime, false);
-	}
+	Timers.Set(EPupMovementTimer::Recovery, GetMovementSettings().RecoveryTime);
 }
 
 void UPupMovementComponent::Dash()
@@ -382,14 +386,12 @@ void UPupMovementComponent::Dash()
 	{
 		return;
 	}
+	WakeUp();
 	bCanDash = false;
 	DashDirection = UpdatedComponent->GetForwardVector();
 	bDashing = true;
 	DashEvent.Broadcast(DashDirection);
-	GetWorld()->GetTimerManager().SetTimer(DashTimerHandle, FTimerDelegate::CreateWeakLambda(this, [this]
-		{
-			EndDash();
-		}), DashTime, false);
+	Timers.Set(EPupMovementTimer::Dash, GetMovementSettings().DashTime);
 }
 
 void UPupMovementComponent::EndDash()
@@ -408,10 +410,11 @@ void UPupMovementComponent::EndRecovery()
 		}
 
 		Velocity = FVector::ZeroVector;
-		UpdatedComponent->SetWorldLocation(LastValidLocation + RecoveryLevitationHeight * UpdatedComponent->GetUpVector());
+		UpdatedComponent->SetWorldLocation(LastValidLocation + GetMovementSettings().RecoveryLevitationHeight * UpdatedComponent->GetUpVector());
 		BasisPositionLastTick = UpdatedComponent->GetComponentLocation();
 		ClearImpulse();
 		SetDefaultMovementMode();
+		ResetPresentationInterpolation();
 	}
 	if (ATetherCharacter* TetherCharacter = Cast<ATetherCharacter>(GetOwner()))
 	{
@@ -458,7 +461,8 @@ void UPupMovementComponent::EndDraggingObject()
 
 bool UPupMovementComponent::EdgeSlide(const float Scale, const float DeltaTime)
 {
-	if (FMath::Abs(Scale) < 0.5f)
+	PUP_MOVEMENT_SCOPE_CYCLE_COUNTER(EdgeSlide);
+	if (FMath::Abs(Scale) < 0.5f || !GetMovementLODTier().bProbeLedges)
 	{
 		return false;
 	}
@@ -470,207 +474,438 @@ bool UPupMovementComponent::EdgeSlide(const float Scale, const float DeltaTime)
 	if (UPrimitiveComponent* CapsuleComponent = Cast<UPrimitiveComponent>(UpdatedComponent))
 	{
 		const float CapsuleRadius = CapsuleComponent->GetCollisionShape().GetCapsuleRadius();
-		const float CapsuleHalfHeight = CapsuleComponent->GetCollisionShape().GetCapsuleHalfHeight();
 
 		const FVector RotatedLedgeDirection = BasisComponent->GetComponentRotation().RotateVector(LedgeDirection);
 		
 		const FVector SlideOffset = RotatedLedgeDirection * SlideRate * CurvedScale * DeltaTime;
 		const FVector NewAnchorWorldLocation = UpdatedComponent->GetComponentLocation() + SlideOffset;
 		const FVector RadiusCheckOffset = Scale > 0.0f ? RotatedLedgeDirection * CapsuleRadius : RotatedLedgeDirection * -CapsuleRadius;
+
+		const FVector MantleOffsetWorldSpace = GetMantleHandleWorldOffset(5.0f);
+		const FVector WallProbe = NewAnchorWorldLocation + RadiusCheckOffset;
+		const FVector TopProbe = UpdatedComponent->GetComponentLocation() + MantleOffsetWorldSpace + SlideOffset + RadiusCheckOffset;
+
+		UPrimitiveComponent* LedgeComponent = nullptr;
+		float TopHeight = 0.0f;
+		EPupLedgeQueryResult Result = FindIndexedSlideLedge(WallProbe, TopProbe, LedgeComponent, TopHeight);
+		if (Result == EPupLedgeQueryResult::Unknown)
+		{
+			Result = TraceSlideLedge(WallProbe, TopProbe, LedgeComponent, TopHeight);
+		}
 		
-		FHitResult LineTraceResult;
-		if (BasisComponent && GetWorld()->LineTraceSingleByChannel(LineTraceResult,
-			NewAnchorWorldLocation + RadiusCheckOffset,
-			NewAnchorWorldLocation + RadiusCheckOffset + UpdatedComponent->GetForwardVector() * GrabRangeForward,
-			ECC_Pawn))
+		if (Result == EPupLedgeQueryResult::Ledge)
 		{
-			FHitResult TopLineTraceResult;
-			FVector MantleOffset = FVector::ZeroVector;
-			TArray<USceneComponent*> ChildComponents;
-			UpdatedComponent->GetChildrenComponents(false, ChildComponents);
-			for (USceneComponent* Component : ChildComponents)
+			if (LedgeComponent != BasisComponent)
 			{
-				if (Component->ComponentHasTag(TEXT("MantleHandle")))
-				{
-					// TODO: Don't search for components this way
-					MantleOffset = Component->GetRelativeLocation();
-					break;
-				}
+				BasisComponent = LedgeComponent;
+				FVector NewBasisWorldLocation = UpdatedComponent->GetComponentLocation();
+				NewBasisWorldLocation.Z = TopHeight - MantleOffsetWorldSpace.Z;
+				UpdatedComponent->SetWorldLocation(NewBasisWorldLocation);
 			}
-			MantleOffset.X += 5.0f;
-			const float SinYaw = FMath::Sin(FMath::DegreesToRadians(DesiredRotation.Yaw));
-			const float CosYaw = FMath::Cos(FMath::DegreesToRadians(DesiredRotation.Yaw));
-			const FVector MantleOffsetWorldSpace = FVector(MantleOffset.X * CosYaw - MantleOffset.Y * SinYaw, MantleOffset.X * SinYaw + MantleOffset.Y * CosYaw, MantleOffset.Z);
-
-			const FVector MantleLocation = UpdatedComponent->GetComponentLocation() + MantleOffsetWorldSpace;
-			const FVector TraceStart = MantleLocation + SlideOffset + RadiusCheckOffset + FVector::UpVector * GrabRangeTop;
-			const FVector TraceEnd = MantleLocation + SlideOffset + RadiusCheckOffset + FVector::DownVector * GrabRangeBottom;
-
-			FCollisionQueryParams CollisionQueryParams = FCollisionQueryParams::DefaultQueryParam;
-			CollisionQueryParams.AddIgnoredActors(IgnoredActors);
-			CollisionQueryParams.bFindInitialOverlaps = true;
-			CollisionQueryParams.bIgnoreTouches = false;
-			CollisionQueryParams.bTraceComplex = false;
-
-			GetWorld()->LineTraceSingleByChannel(TopLineTraceResult, TraceStart, TraceEnd, ECC_Pawn, CollisionQueryParams);
-			if (TopLineTraceResult.bBlockingHit && !TopLineTraceResult.bStartPenetrating)
-			{
-				if (LineTraceResult.GetComponent() != BasisComponent)
-				{
-					BasisComponent = LineTraceResult.GetComponent();
-					FVector NewBasisWorldLocation = UpdatedComponent->GetComponentLocation();
-					NewBasisWorldLocation.Z = TopLineTraceResult.Location.Z - MantleOffsetWorldSpace.Z;
-					UpdatedComponent->SetWorldLocation(NewBasisWorldLocation);
-				}
-				// UpdatedComponent->AddWorldOffset(SlideOffset);
-				DesiredAnchorLocation += SlideOffset;
-				TurningDirection = CurvedScale;
-				// LedgeDirection = FVector::CrossProduct(WallNormal, TopLineTraceResult.Normal);
-				return true;
-			}
-			RenderHitResult(TopLineTraceResult, FColor::Red);
+			// UpdatedComponent->AddWorldOffset(SlideOffset);
+			DesiredAnchorLocation += SlideOffset;
+			TurningDirection = CurvedScale;
+			// LedgeDirection = FVector::CrossProduct(WallNormal, TopLineTraceResult.Normal);
+			return true;
 		}
 	}
 	return false;
 }
 
 
+EPupLedgeQueryResult UPupMovementComponent::TraceSlideLedge(const FVector& WallProbe, const FVector& TopProbe,
+	UPrimitiveComponent*& OutLedgeComponent, float& OutTopHeight) const
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+	if (!BasisComponent)
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+
+	FHitResult LineTraceResult;
+	CountQuery(EPupMovementQuery::LineTrace);
+	if (!GetWorld()->LineTraceSingleByChannel(LineTraceResult,
+		WallProbe, WallProbe + UpdatedComponent->GetForwardVector() * Settings.GrabRangeForward, ECC_Pawn))
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+
+	FCollisionQueryParams CollisionQueryParams = FCollisionQueryParams::DefaultQueryParam;
+	CollisionQueryParams.AddIgnoredActors(IgnoredActors);
+	CollisionQueryParams.bFindInitialOverlaps = true;
+	CollisionQueryParams.bIgnoreTouches = false;
+	CollisionQueryParams.bTraceComplex = false;
+
+	FHitResult TopLineTraceResult;
+	CountQuery(EPupMovementQuery::LineTrace);
+	GetWorld()->LineTraceSingleByChannel(TopLineTraceResult,
+		TopProbe + FVector::UpVector * Settings.GrabRangeTop,
+		TopProbe + FVector::DownVector * Settings.GrabRangeBottom,
+		ECC_Pawn, CollisionQueryParams);
+	if (!TopLineTraceResult.bBlockingHit || TopLineTraceResult.bStartPenetrating)
+	{
+		RenderHitResult(TopLineTraceResult, FColor::Red);
+		return EPupLedgeQueryResult::NoLedge;
+	}
+
+	OutLedgeComponent = LineTraceResult.GetComponent();
+	OutTopHeight = TopLineTraceResult.Location.Z;
+	return EPupLedgeQueryResult::Ledge;
+}
+
+
+EPupLedgeQueryResult UPupMovementComponent::FindIndexedSlideLedge(const FVector& WallProbe, const FVector& TopProbe,
+	UPrimitiveComponent*& OutLedgeComponent, float& OutTopHeight) const
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+	if (!PupMovementCVars::UseLedgeIndex || !FloorHeightfield || !FloorHeightfield->HasLedges() || DynamicContactSteps > 0 ||
+		!BasisComponent || BasisComponent->Mobility == EComponentMobility::Movable)
+	{
+		return EPupLedgeQueryResult::Unknown;
+	}
+
+	// Everything the live traces could touch has to be described by the index
+	const FVector Forward = UpdatedComponent->GetForwardVector();
+	FBox ProbeBounds(ForceInit);
+	ProbeBounds += WallProbe;
+	ProbeBounds += WallProbe + Forward * Settings.GrabRangeForward;
+	ProbeBounds += TopProbe + FVector::UpVector * Settings.GrabRangeTop;
+	ProbeBounds += TopProbe + FVector::DownVector * Settings.GrabRangeBottom;
+	if (!FloorHeightfield->IsRegionStatic(ProbeBounds.ExpandBy(1.0f), IgnoredActors))
+	{
+		return EPupLedgeQueryResult::Unknown;
+	}
+
+	float WallDistance = 0.0f;
+	const FPupLedgeSegment* Ledge = FloorHeightfield->RaycastLedgeWalls(WallProbe, Forward, Settings.GrabRangeForward, WallDistance);
+	if (!Ledge)
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+
+	UPrimitiveComponent* LedgeComponent = FloorHeightfield->GetLedgeComponent(*Ledge);
+	if (!LedgeComponent)
+	{
+		return EPupLedgeQueryResult::Unknown;
+	}
+
+	// The top probe has to come down on top of this ledge, just behind its wall face
+	const float Length = Ledge->GetLength();
+	const float Along = FVector::DotProduct(TopProbe - Ledge->Start, Ledge->GetDirection());
+	const float BehindWall = -FVector::DotProduct(TopProbe - Ledge->Start, Ledge->WallNormal.GetSafeNormal2D());
+	if (Along < 0.0f || Along > Length)
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+	if (BehindWall < 0.0f || BehindWall > FloorHeightfield->GetCellSize())
+	{
+		// Either in front of the wall or past the top we know about, so something else decides what the probe lands on
+		return EPupLedgeQueryResult::Unknown;
+	}
+
+	const float TopHeight = FMath::Lerp(Ledge->Start.Z, Ledge->End.Z, Along / Length);
+	if (TopHeight > TopProbe.Z + Settings.GrabRangeTop || TopHeight < TopProbe.Z - Settings.GrabRangeBottom)
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+
+	OutLedgeComponent = LedgeComponent;
+	OutTopHeight = TopHeight;
+	return EPupLedgeQueryResult::Ledge;
+}
+
+
 void UPupMovementComponent::Mantle()
 {
-	if (UpdatedComponent->GetClass() != UCapsuleComponent::StaticClass() || !bCanMantle)
+	PUP_MOVEMENT_SCOPE_CYCLE_COUNTER(Mantle);
+	if (UpdatedComponent->GetClass() != UCapsuleComponent::StaticClass() || !bCanMantle || !GetMovementLODTier().bProbeLedges)
 	{
 		return;
 	}
+
+	FPupLedgeGrab Ledge;
+	EPupLedgeQueryResult Result = FindIndexedLedge(Ledge);
+	if (Result == EPupLedgeQueryResult::Unknown)
+	{
+		const FVector EyePosition = GetMantleEyePosition();
+		const FVector EyeTraceEnd = EyePosition + UpdatedComponent->GetForwardVector() * GetMovementSettings().GrabRangeForward;
+		FHitResult AsyncWallHit;
+		const bool bHasAsyncWallHit = ConsumeAsyncWallHit(EyePosition, EyeTraceEnd, AsyncWallHit);
+		Result = TraceLedge(Ledge, bHasAsyncWallHit ? &AsyncWallHit : nullptr);
+	}
+
+	if (Result == EPupLedgeQueryResult::Ledge)
+	{
+		GrabLedge(Ledge);
+	}
+
+	// The line trace originated at the eye, so we can look there, plus 1.0f in case the player is
+	// very close to the wall
+	const float CapsuleRadius = Cast<UCapsuleComponent>(UpdatedComponent)->GetScaledCapsuleRadius();
+	if (Ledge.WallHit.bBlockingHit && Ledge.WallHit.Distance <= CapsuleRadius + 1.0f)
+	{
+		HitWall(Ledge.WallHit);
+	}
+}
+
+
+EPupLedgeQueryResult UPupMovementComponent::TraceLedge(FPupLedgeGrab& OutLedge, const FHitResult* KnownWallHit) const
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
 	UCapsuleComponent* CapsuleComponent = Cast<UCapsuleComponent>(UpdatedComponent);
-	const float CapsuleRadius = CapsuleComponent->GetScaledCapsuleRadius();
-	
-	const FVector EyePosition = CapsuleComponent->GetComponentLocation() +
-		(CapsuleComponent->GetUnscaledCapsuleHalfHeight() - CapsuleRadius - 8.0f) * FVector::UpVector +
-		CapsuleRadius * CapsuleComponent->GetForwardVector();
+	const FVector EyePosition = GetMantleEyePosition();
 	
 	FCollisionQueryParams CollisionQueryParams = FCollisionQueryParams::DefaultQueryParam;
 	CollisionQueryParams.AddIgnoredActor(this->GetOwner());
 
-	FHitResult LineTraceResult;
-	if(GetWorld()->LineTraceSingleByChannel(LineTraceResult,
-		EyePosition, EyePosition + CapsuleComponent->GetForwardVector() * GrabRangeForward,
-		ECollisionChannel::ECC_Pawn, CollisionQueryParams,
-		CapsuleComponent->GetCollisionResponseToChannels()))
+	FHitResult& LineTraceResult = OutLedge.WallHit;
+	const FVector EyeTraceEnd = EyePosition + CapsuleComponent->GetForwardVector() * Settings.GrabRangeForward;
+	if (KnownWallHit)
 	{
-		if (LineTraceResult.GetComponent() && LineTraceResult.GetComponent()->CanCharacterStepUp(this->GetPawnOwner()))
+		LineTraceResult = *KnownWallHit;
+		if (!LineTraceResult.bBlockingHit)
 		{
-			RenderHitResult(LineTraceResult, FColor::Blue);
-			
-			UPrimitiveComponent* Target = LineTraceResult.GetComponent();
-			const FVector EdgeWallNormal = LineTraceResult.Normal;
-
-			// Where the ledge is in world space, as far as we know...
-			// We look slightly into the wall to avoid missing the next sweep
-			FVector MantleLocation = FVector::ZeroVector;
-			Target->GetClosestPointOnCollision(UpdatedComponent->GetComponentLocation(), MantleLocation);
-			MantleLocation -= EdgeWallNormal;
-			MantleLocation.Z += CapsuleComponent->GetScaledCapsuleHalfHeight();
-
-			CollisionQueryParams = FCollisionQueryParams::DefaultQueryParam;
-			CollisionQueryParams.AddIgnoredActors(IgnoredActors);
-			CollisionQueryParams.bFindInitialOverlaps = true;
-			CollisionQueryParams.bIgnoreTouches = false;
-			CollisionQueryParams.bTraceComplex = false;
-
-			FHitResult TopLineTraceResult;
-			GetWorld()->LineTraceSingleByChannel(TopLineTraceResult,
-				MantleLocation + FVector::UpVector * GrabRangeTop,
-				MantleLocation + FVector::DownVector * GrabRangeBottom,
-				ECollisionChannel::ECC_Pawn, CollisionQueryParams);
-			RenderHitResult(TopLineTraceResult, FColor::Red);
-
-			if (!TopLineTraceResult.bStartPenetrating && TopLineTraceResult.bBlockingHit)
-			{
-				const FVector TopWallNormal = TopLineTraceResult.Normal;
-				LedgeDirection = FVector::CrossProduct(TopWallNormal, EdgeWallNormal).GetUnsafeNormal();
-
-				// Check how close our ledge direction vector is to the 'right vector',
-				// assuming that the 'forward vector' is the direction the player will rotate towards --
-				// the opposite of the WallNormal 
-				if (FMath::Abs(FVector::DotProduct(LedgeDirection, EdgeWallNormal.RotateAngleAxis(90.0f, FVector::UpVector))) >= LedgeDeviation)
-				{
-					// Verify that we can actually 'fit' along the ledge
-					const FVector LeftSide = UpdatedComponent->GetComponentLocation() - LedgeDirection * CapsuleComponent->GetCollisionShape().GetCapsuleRadius() - FVector::DownVector;
-					const FVector RightSide = UpdatedComponent->GetComponentLocation() + LedgeDirection * CapsuleComponent->GetCollisionShape().GetCapsuleRadius() - FVector::DownVector;
-					const FVector Offset =  (MantleLocation - UpdatedComponent->GetComponentLocation()).GetSafeNormal2D() * (GrabRangeForward + CapsuleRadius);
-
-					FHitResult SizeTraceLeft;
-					FHitResult SizeTraceRight;
-					
-					if (Target->LineTraceComponent(SizeTraceLeft, LeftSide, LeftSide + Offset, CollisionQueryParams) &&
-					Target->LineTraceComponent(SizeTraceRight, RightSide, RightSide + Offset, CollisionQueryParams))
-					{
-						FVector AnchorWorldLocation = FVector(MantleLocation.X, MantleLocation.Y, TopLineTraceResult.Location.Z);
-
-						FVector MantleOffset = FVector::ZeroVector;
-						TArray<USceneComponent*> ChildComponents;
-						UpdatedComponent->GetChildrenComponents(false, ChildComponents);
-						for (USceneComponent* Component : ChildComponents)
-						{
-							if (Component->ComponentHasTag(TEXT("MantleHandle")))
-							{
-								// TODO: Don't search for components this way
-								MantleOffset = Component->GetRelativeLocation();
-								break;
-							}
-						}
-						
-						const float SinYaw = FMath::Sin(FMath::DegreesToRadians(DesiredRotation.Yaw));
-						const float CosYaw = FMath::Cos(FMath::DegreesToRadians(DesiredRotation.Yaw));
-						const FVector MantleOffsetWorldSpace = FVector(MantleOffset.X * CosYaw - MantleOffset.Y * SinYaw, MantleOffset.X * SinYaw + MantleOffset.Y * CosYaw, MantleOffset.Z);
-
-						AnchorWorldLocation -= MantleOffsetWorldSpace;
-						const FVector Difference = AnchorWorldLocation - Target->GetComponentLocation();
-						
-						if (Target->Mobility == EComponentMobility::Movable)
-						{
-							LedgeDirection = Target->GetComponentRotation().GetInverse().RotateVector(LedgeDirection);
-						}				
-						LocalBasisPosition = FVector(
-							FVector::DotProduct(Difference, Target->GetForwardVector()),
-							FVector::DotProduct(Difference, Target->GetRightVector()),
-							FVector::DotProduct(Difference, Target->GetUpVector()));
-
-						BasisRotationLastTick = Target->GetComponentRotation();
-						
-						bMantling = true;
-						bCanMantle = false;
-						bIsWalking = false;
-						bWallSliding = false;
-						bAttachedToBasis = true;
-						bWallJumpDisabledControl = false;
-
-						BasisComponent = Target;
-						SetMovementMode(EPupMovementMode::M_Anchored);
-
-						FHitResult DispatchHitResult = TopLineTraceResult;
-						DispatchHitResult.Component = Cast<UPrimitiveComponent>(UpdatedComponent);
-						DispatchHitResult.Actor = GetPawnOwner();
-						DispatchHitResult.Normal *= -1.0f;
-						TopLineTraceResult.GetComponent()->DispatchBlockingHit(*TopLineTraceResult.GetActor(), DispatchHitResult);
-
-
-						const float Yaw = FMath::RadiansToDegrees(FMath::Atan2(-LineTraceResult.ImpactNormal.Y, -LineTraceResult.ImpactNormal.X));
-						// UpdatedComponent->SetWorldLocation(AnchorWorldLocation);
-						DesiredAnchorLocation = AnchorWorldLocation;
-						UpdatedComponent->SetWorldRotation(FRotator(0.0f, Yaw, 0.0f));
-						DesiredRotation = FRotator(0.0f, Yaw, 0.0f);
-					}
-				}
-			}
+			return EPupLedgeQueryResult::NoLedge;
 		}
 	}
-	// The line trace originated at the eye, so we can look there, plus 1.0f in case the player is
-	// very close to the wall
-	if (LineTraceResult.bBlockingHit && LineTraceResult.Distance <= CapsuleRadius + 1.0f)
+	else
+	{
+		if (!ContactCache.MayHit(FPupContactQuery::Line(EyePosition, EyeTraceEnd), TArray<AActor*>()))
+		{
+			LineTraceResult = FHitResult(EyePosition, EyeTraceEnd);
+			return EPupLedgeQueryResult::NoLedge;
+		}
+		
+		CountQuery(EPupMovementQuery::LineTrace);
+		if (!GetWorld()->LineTraceSingleByChannel(LineTraceResult, EyePosition, EyeTraceEnd,
+			ECollisionChannel::ECC_Pawn, CollisionQueryParams,
+			CapsuleComponent->GetCollisionResponseToChannels()))
+		{
+			return EPupLedgeQueryResult::NoLedge;
+		}
+	}
+	
+	if (!LineTraceResult.GetComponent() || !LineTraceResult.GetComponent()->CanCharacterStepUp(this->GetPawnOwner()))
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+	RenderHitResult(LineTraceResult, FColor::Blue);
+	
+	UPrimitiveComponent* Target = LineTraceResult.GetComponent();
+	const FVector EdgeWallNormal = LineTraceResult.Normal;
+
+	// Where the ledge is in world space, as far as we know...
+	// We look slightly into the wall to avoid missing the next sweep
+	FVector& MantleLocation = OutLedge.MantleLocation;
+	if (!ContactCache.FindClosestPoint(Target, UpdatedComponent->GetComponentLocation(), MantleLocation))
+	{
+		CountQuery(EPupMovementQuery::ClosestPoint);
+		Target->GetClosestPointOnCollision(UpdatedComponent->GetComponentLocation(), MantleLocation);
+	}
+	MantleLocation -= EdgeWallNormal;
+	MantleLocation.Z += CapsuleComponent->GetScaledCapsuleHalfHeight();
+
+	CollisionQueryParams = FCollisionQueryParams::DefaultQueryParam;
+	CollisionQueryParams.AddIgnoredActors(IgnoredActors);
+	CollisionQueryParams.bFindInitialOverlaps = true;
+	CollisionQueryParams.bIgnoreTouches = false;
+	CollisionQueryParams.bTraceComplex = false;
+
+	FHitResult& TopLineTraceResult = OutLedge.TopHit;
+	CountQuery(EPupMovementQuery::LineTrace);
+	GetWorld()->LineTraceSingleByChannel(TopLineTraceResult,
+		MantleLocation + FVector::UpVector * Settings.GrabRangeTop,
+		MantleLocation + FVector::DownVector * Settings.GrabRangeBottom,
+		ECollisionChannel::ECC_Pawn, CollisionQueryParams);
+	RenderHitResult(TopLineTraceResult, FColor::Red);
+
+	if (TopLineTraceResult.bStartPenetrating || !TopLineTraceResult.bBlockingHit)
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+	
+	const FVector TopWallNormal = TopLineTraceResult.Normal;
+	OutLedge.LedgeDirection = FVector::CrossProduct(TopWallNormal, EdgeWallNormal).GetUnsafeNormal();
+
+	// Check how close our ledge direction vector is to the 'right vector',
+	// assuming that the 'forward vector' is the direction the player will rotate towards --
+	// the opposite of the WallNormal 
+	if (FMath::Abs(FVector::DotProduct(OutLedge.LedgeDirection, EdgeWallNormal.RotateAngleAxis(90.0f, FVector::UpVector))) < Settings.LedgeDeviation)
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+	
+	// Verify that we can actually 'fit' along the ledge
+	const FVector LeftSide = UpdatedComponent->GetComponentLocation() - OutLedge.LedgeDirection * CapsuleComponent->GetCollisionShape().GetCapsuleRadius() - FVector::DownVector;
+	const FVector RightSide = UpdatedComponent->GetComponentLocation() + OutLedge.LedgeDirection * CapsuleComponent->GetCollisionShape().GetCapsuleRadius() - FVector::DownVector;
+	const FVector Offset =  (MantleLocation - UpdatedComponent->GetComponentLocation()).GetSafeNormal2D() * (Settings.GrabRangeForward + CapsuleComponent->GetScaledCapsuleRadius());
+
+	FHitResult SizeTraceLeft;
+	FHitResult SizeTraceRight;
+	
+	CountQuery(EPupMovementQuery::LineTrace);
+	if (!Target->LineTraceComponent(SizeTraceLeft, LeftSide, LeftSide + Offset, CollisionQueryParams))
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+
+	CountQuery(EPupMovementQuery::LineTrace);
+	if (!Target->LineTraceComponent(SizeTraceRight, RightSide, RightSide + Offset, CollisionQueryParams))
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+
+	OutLedge.Component = Target;
+	return EPupLedgeQueryResult::Ledge;
+}
+
+
+EPupLedgeQueryResult UPupMovementComponent::FindIndexedLedge(FPupLedgeGrab& OutLedge) const
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+	if (!PupMovementCVars::UseLedgeIndex || !FloorHeightfield || !FloorHeightfield->HasLedges() || DynamicContactSteps > 0)
+	{
+		return EPupLedgeQueryResult::Unknown;
+	}
+
+	const UCapsuleComponent* CapsuleComponent = Cast<UCapsuleComponent>(UpdatedComponent);
+	const float CapsuleRadius = CapsuleComponent->GetScaledCapsuleRadius();
+	const float CapsuleHalfHeight = CapsuleComponent->GetScaledCapsuleHalfHeight();
+	const FVector Location = CapsuleComponent->GetComponentLocation();
+	const FVector Forward = CapsuleComponent->GetForwardVector();
+	const FVector EyePosition = GetMantleEyePosition();
+
+	// Everything the live traces could touch has to be described by the index
+	const float Reach = CapsuleRadius + Settings.GrabRangeForward;
+	const FBox TraceBounds(Location - FVector(Reach, Reach, CapsuleHalfHeight + Settings.GrabRangeBottom),
+		Location + FVector(Reach, Reach, CapsuleHalfHeight + Settings.GrabRangeTop));
+	if (!FloorHeightfield->IsRegionStatic(TraceBounds, IgnoredActors))
+	{
+		return EPupLedgeQueryResult::Unknown;
+	}
+
+	float WallDistance = 0.0f;
+	const FPupLedgeSegment* Ledge = FloorHeightfield->RaycastLedgeWalls(EyePosition, Forward, Settings.GrabRangeForward, WallDistance);
+	if (!Ledge)
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+
+	UPrimitiveComponent* Target = FloorHeightfield->GetLedgeComponent(*Ledge);
+	if (!Target)
+	{
+		return EPupLedgeQueryResult::Unknown;
+	}
+
+	// Stand in for the eye trace, so walls can still be slid down
+	const FVector WallNormal = Ledge->WallNormal;
+	OutLedge.WallHit = MakeIndexedLedgeHit(Target, EyePosition, EyePosition + Forward * Settings.GrabRangeForward,
+		EyePosition + Forward * WallDistance, WallNormal);
+	if (!Ledge->bGrabbable || !Target->CanCharacterStepUp(GetPawnOwner()))
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+
+	// Find the same point on the wall that GetClosestPointOnCollision would
+	const FVector LedgeAxis = Ledge->GetDirection();
+	const float Length = Ledge->GetLength();
+	const float CapsuleAlong = FVector::DotProduct(Location - Ledge->Start, LedgeAxis);
+	FVector WallPoint = Ledge->Start + LedgeAxis * FMath::Clamp(CapsuleAlong, 0.0f, Length);
+	const float TopHeight = WallPoint.Z;
+	WallPoint.Z = FMath::Clamp(Location.Z, Ledge->BottomHeight, TopHeight);
+	OutLedge.MantleLocation = WallPoint - WallNormal + FVector::UpVector * CapsuleHalfHeight;
+
+	const FVector& MantleLocation = OutLedge.MantleLocation;
+	if (TopHeight > MantleLocation.Z + Settings.GrabRangeTop || TopHeight < MantleLocation.Z - Settings.GrabRangeBottom)
 	{
-		HitWall(LineTraceResult);
+		return EPupLedgeQueryResult::NoLedge;
 	}
+	OutLedge.TopHit = MakeIndexedLedgeHit(Target, MantleLocation + FVector::UpVector * Settings.GrabRangeTop,
+		MantleLocation + FVector::DownVector * Settings.GrabRangeBottom, FVector(MantleLocation.X, MantleLocation.Y, TopHeight), Ledge->TopNormal);
+
+	OutLedge.LedgeDirection = FVector::CrossProduct(Ledge->TopNormal, WallNormal).GetUnsafeNormal();
+	if (FMath::Abs(FVector::DotProduct(OutLedge.LedgeDirection, WallNormal.RotateAngleAxis(90.0f, FVector::UpVector))) < Settings.LedgeDeviation)
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+
+	// Verify that we can actually 'fit' along the ledge, just above the middle of the capsule
+	const float SideHeight = Location.Z + 1.0f;
+	if (CapsuleAlong - CapsuleRadius < 0.0f || CapsuleAlong + CapsuleRadius > Length ||
+		SideHeight <= Ledge->BottomHeight || SideHeight >= TopHeight)
+	{
+		return EPupLedgeQueryResult::NoLedge;
+	}
+
+	OutLedge.Component = Target;
+	return EPupLedgeQueryResult::Ledge;
+}
+
+
+void UPupMovementComponent::GrabLedge(const FPupLedgeGrab& Ledge)
+{
+	UPrimitiveComponent* Target = Ledge.Component;
+	const FHitResult& TopLineTraceResult = Ledge.TopHit;
+	LedgeDirection = Ledge.LedgeDirection;
+
+	FVector AnchorWorldLocation = FVector(Ledge.MantleLocation.X, Ledge.MantleLocation.Y, TopLineTraceResult.Location.Z);
+	AnchorWorldLocation -= GetMantleHandleWorldOffset(0.0f);
+	const FVector Difference = AnchorWorldLocation - Target->GetComponentLocation();
+	
+	if (Target->Mobility == EComponentMobility::Movable)
+	{
+		LedgeDirection = Target->GetComponentRotation().GetInverse().RotateVector(LedgeDirection);
+	}				
+	LocalBasisPosition = FVector(
+		FVector::DotProduct(Difference, Target->GetForwardVector()),
+		FVector::DotProduct(Difference, Target->GetRightVector()),
+		FVector::DotProduct(Difference, Target->GetUpVector()));
+
+	BasisRotationLastTick = Target->GetComponentRotation();
+	BasisLocationLastTick = Target->GetComponentLocation();
+	
+	bMantling = true;
+	bCanMantle = false;
+	bIsWalking = false;
+	bWallSliding = false;
+	bAttachedToBasis = true;
+	bWallJumpDisabledControl = false;
+
+	BasisComponent = Target;
+	SetMovementMode(EPupMovementMode::M_Anchored);
+
+	FHitResult DispatchHitResult = TopLineTraceResult;
+	DispatchHitResult.Component = Cast<UPrimitiveComponent>(UpdatedComponent);
+	DispatchHitResult.Actor = GetPawnOwner();
+	DispatchHitResult.Normal *= -1.0f;
+	TopLineTraceResult.GetComponent()->DispatchBlockingHit(*TopLineTraceResult.GetActor(), DispatchHitResult);
+
+
+	const float Yaw = FMath::RadiansToDegrees(FMath::Atan2(-Ledge.WallHit.ImpactNormal.Y, -Ledge.WallHit.ImpactNormal.X));
+	// UpdatedComponent->SetWorldLocation(AnchorWorldLocation);
+	DesiredAnchorLocation = AnchorWorldLocation;
+	UpdatedComponent->SetWorldRotation(FRotator(0.0f, Yaw, 0.0f));
+	DesiredRotation = FRotator(0.0f, Yaw, 0.0f);
+}
+
+
+FVector UPupMovementComponent::GetMantleEyePosition() const
+{
+	const UCapsuleComponent* CapsuleComponent = Cast<UCapsuleComponent>(UpdatedComponent);
+	const float CapsuleRadius = CapsuleComponent->GetScaledCapsuleRadius();
+	
+	return CapsuleComponent->GetComponentLocation() +
+		(CapsuleComponent->GetUnscaledCapsuleHalfHeight() - CapsuleRadius - 8.0f) * FVector::UpVector +
+		CapsuleRadius * CapsuleComponent->GetForwardVector();
+}
+
+
+FVector UPupMovementComponent::GetMantleHandleWorldOffset(const float ForwardOffset) const
+{
+	const FVector MantleOffset = MantleHandleOffset + FVector(ForwardOffset, 0.0f, 0.0f);
+	const float SinYaw = FMath::Sin(FMath::DegreesToRadians(DesiredRotation.Yaw));
+	const float CosYaw = FMath::Cos(FMath::DegreesToRadians(DesiredRotation.Yaw));
+	return FVector(MantleOffset.X * CosYaw - MantleOffset.Y * SinYaw, MantleOffset.X * SinYaw + MantleOffset.Y * CosYaw, MantleOffset.Z);
 }
 
 
@@ -686,15 +921,19 @@ void UPupMovementComponent::HitWall(const FHitResult& HitResult)
 			BasisComponent = PrimitiveComponent;
 			bWallSliding = true;
 			
-			if (PrimitiveComponent->LineTraceComponent(LineTrace, UpdatedComponent->GetComponentLocation(),
-				UpdatedComponent->GetComponentLocation() + DirectionVector * 100.0f,
-				FCollisionQueryParams::DefaultQueryParam))
+			const FVector TraceStart = UpdatedComponent->GetComponentLocation();
+			const FVector TraceEnd = TraceStart + DirectionVector * 100.0f;
+			if (ContactCache.MayHit(FPupContactQuery::Line(TraceStart, TraceEnd), IgnoredActors, PrimitiveComponent))
 			{
-				const FVector PlanarNormal = LineTrace.Normal.GetSafeNormal2D();
-				const float WallYaw = FMath::RadiansToDegrees( FMath::Atan2(-PlanarNormal.Y, -PlanarNormal.X) );
-				DesiredRotation.Yaw = WallYaw;
-				// UpdatedComponent->SetWorldRotation(DesiredRotation);
-				WallNormal = PlanarNormal;
+				CountQuery(EPupMovementQuery::LineTrace);
+				if (PrimitiveComponent->LineTraceComponent(LineTrace, TraceStart, TraceEnd, FCollisionQueryParams::DefaultQueryParam))
+				{
+					const FVector PlanarNormal = LineTrace.Normal.GetSafeNormal2D();
+					const float WallYaw = FMath::RadiansToDegrees( FMath::Atan2(-PlanarNormal.Y, -PlanarNormal.X) );
+					DesiredRotation.Yaw = WallYaw;
+					// UpdatedComponent->SetWorldRotation(DesiredRotation);
+					WallNormal = PlanarNormal;
+				}
 			}
 		}
 	}
@@ -1,10 +1,14 @@
 #include "PupMovementComponent.h"
 
 #include "DrawDebugHelpers.h"
+#include "PupFloorHeightfield.h"
+#include "PupMovementStats.h"
 #include "../TetherCharacter.h"
 #include "Components/CapsuleComponent.h"
 #include "Kismet/KismetSystemLibrary.h"
+#include "Serialization/MemoryWriter.h"
 #include "Tether/Tether.h"
+#include "UObject/CoreNet.h"
 
 
 // Utilities
@@ -16,24 +20,122 @@ namespace  PupMovementCVars
 		FloorPadding,
 		TEXT("The minimum distance when snapping to the floor."),
 		ECVF_Default);
+
+	static int32 FloorProbeMode = 1;
+	static FAutoConsoleVariableRef CVarFloorProbeMode(
+		TEXT("PupMovement.FloorProbeMode"),
+		FloorProbeMode,
+		TEXT("0: always confirm floor normals with a long line trace (legacy). ")
+		TEXT("1: trust the sweep's face normal, and only use a short line trace when the hit is on an edge."),
+		ECVF_Default);
+
+	static float FloorNormalAgreement = 0.999f;
+	static FAutoConsoleVariableRef CVarFloorNormalAgreement(
+		TEXT("PupMovement.FloorNormalAgreement"),
+		FloorNormalAgreement,
+		TEXT("Minimum dot product between a floor sweep's Normal and ImpactNormal for the hit to be considered a face, not an edge"),
+		ECVF_Default);
+
+	static float FloorNormalTraceDistance = 25.0f;
+	static FAutoConsoleVariableRef CVarFloorNormalTraceDistance(
+		TEXT("PupMovement.FloorNormalTraceDistance"),
+		FloorNormalTraceDistance,
+		TEXT("Half length of the line trace used to find the floor normal of an edge hit, when FloorProbeMode is 1"),
+		ECVF_Default);
+
+	static int32 UseFloorHeightfield = 1;
+	static FAutoConsoleVariableRef CVarUseFloorHeightfield(
+		TEXT("PupMovement.UseFloorHeightfield"),
+		UseFloorHeightfield,
+		TEXT("If non-zero, floor queries over static geometry are answered from the level's baked floor heightfield"),
+		ECVF_Default);
+
+	static int32 HeightfieldDynamicContactSteps = 30;
+	static FAutoConsoleVariableRef CVarHeightfieldDynamicContactSteps(
+		TEXT("PupMovement.HeightfieldDynamicContactSteps"),
+		HeightfieldDynamicContactSteps,
+		TEXT("Number of steps after touching something movable before the floor heightfield is trusted again"),
+		ECVF_Default);
+
+	static float RecoverySearchDistance = 1000.0f;
+	static FAutoConsoleVariableRef CVarRecoverySearchDistance(
+		TEXT("PupMovement.RecoverySearchDistance"),
+		RecoverySearchDistance,
+		TEXT("How far from the last valid location to search the floor heightfield for a safe recovery location"),
+		ECVF_Default);
+
+	static float FloorPrefetchMargin = 10.0f;
+	static FAutoConsoleVariableRef CVarFloorPrefetchMargin(
+		TEXT("PupMovement.FloorPrefetchMargin"),
+		FloorPrefetchMargin,
+		TEXT("Extra distance a prefetched floor sweep reaches, so it still answers the step if the velocity changes before the floor is probed"),
+		ECVF_Default);
+
+	static int32 AsyncQueries = 0;
+	static FAutoConsoleVariableRef CVarAsyncQueries(
+		TEXT("PupMovement.AsyncQueries"),
+		AsyncQueries,
+		TEXT("If non-zero, the floor sweep and mantle eye trace for the next frame are issued asynchronously after each frame's steps, ")
+		TEXT("instead of being run and waited on during the step"),
+		ECVF_Default);
+
+	static float AsyncQueryTolerance = 1.0f;
+	static FAutoConsoleVariableRef CVarAsyncQueryTolerance(
+		TEXT("PupMovement.AsyncQueryTolerance"),
+		AsyncQueryTolerance,
+		TEXT("How far the player can move after an asynchronous query was issued before it is thrown away and run again"),
+		ECVF_Default);
+
+	static int32 HistoryLength = 32;
+	static FAutoConsoleVariableRef CVarHistoryLength(
+		TEXT("PupMovement.HistoryLength"),
+		HistoryLength,
+		TEXT("Number of movement steps to keep snapshots of, for rolling back and simulating again. 0 disables the history"),
+		ECVF_Default);
+
+	static int32 DrawQueries = 0;
+	static FAutoConsoleVariableRef CVarDrawQueries(
+		TEXT("PupMovement.DrawQueries"),
+		DrawQueries,
+		TEXT("If non-zero, draw the floor, ledge and mantle queries pups run as they move"),
+		ECVF_Cheat);
 }
 
 
 bool UPupMovementComponent::FindFloor(const float SweepDistance, FHitResult& OutHitResult, const int NumTries)
 {
+	PUP_MOVEMENT_SCOPE_CYCLE_COUNTER(FindFloor);
 	const FVector SweepOffset = FVector::DownVector * SweepDistance;
 
+	bool bFoundFloor = false;
+	if (FindFloorFromHeightfield(SweepDistance, OutHitResult, bFoundFloor))
+	{
+		if (bFoundFloor)
+		{
+			FloorNormal = OutHitResult.ImpactNormal;
+		}
+		return bFoundFloor;
+	}
+	if (GetMovementLODTier().bLineTraceFloor && MovementMode != EPupMovementMode::M_Anchored)
+	{
+		return FindFloorWithLineTrace(SweepDistance, OutHitResult);
+	}
+
 	if (MovementMode == EPupMovementMode::M_Anchored)
 	{
-		InvalidFloorComponents.Add(BasisComponent);
+		AddInvalidFloorComponent(BasisComponent);
 	}
 	for (int i = 0; i < NumTries; i++)
 	{
 		FHitResult IterativeHitResult;
-		if (SweepCapsule(FVector(0.0f, 0.0f, 10.0f),SweepOffset, IterativeHitResult, false))
+		const bool bHit = i == 0 && (ConsumePrefetchedFloor(SweepDistance, IterativeHitResult) ||
+			ConsumeAsyncFloor(SweepDistance, IterativeHitResult)) ?
+			IterativeHitResult.bBlockingHit :
+			SweepCapsule(FVector(0.0f, 0.0f, 10.0f),SweepOffset, IterativeHitResult, false);
+		if (bHit)
 		{
 			OutHitResult = IterativeHitResult;
-			// RenderHitResult(IterativeHitResult, FColor::White, true);
+			RenderHitResult(IterativeHitResult, FColor::White, true);
 			if (IsValidFloorHit(IterativeHitResult))
 			{
 				FloorNormal = IterativeHitResult.ImpactNormal;
@@ -42,45 +144,420 @@ bool UPupMovementComponent::FindFloor(const float SweepDistance, FHitResult& Out
 			if (OutHitResult.bStartPenetrating)
 			{
 				// ResolvePenetration(GetPenetrationAdjustment(OutHitResult), OutHitResult, UpdatedComponent->GetComponentQuat());
-				InvalidFloorComponents.Add(OutHitResult.GetComponent());
+				AddInvalidFloorComponent(OutHitResult.GetComponent());
 			}
 		}
 	}
-	InvalidFloorComponents.Empty();
+	ClearInvalidFloorComponents();
 	// If this wasn't a valid floor hit, clear the hit result but keep the trace data
 	OutHitResult.Reset(1.f, true);
 	return false;
 }
 
 
-bool UPupMovementComponent::IsValidFloorHit(const FHitResult& FloorHit) const
+bool UPupMovementComponent::FindFloorWithLineTrace(const float SweepDistance, FHitResult& OutHitResult)
 {
-	// Check if we actually hit a floor component
-	UPrimitiveComponent* FloorComponent = FloorHit.GetComponent();
-	if (FloorComponent && FloorComponent->CanCharacterStepUp(GetPawnOwner()))
-	{
-		// Capsule traces will give us ImpactNormals that are sometimes 'glancing' edges
-		// so, the most realiable way of getting the floor's normal is with a line trace.
-		FHitResult NormalLineTrace;
-		FloorComponent->LineTraceComponent(
-			NormalLineTrace,
-			FloorHit.ImpactPoint + FVector(0.0f, 0.0f, 250.0f),
-			FloorHit.ImpactPoint + FVector(0.0f, 0.0f, -250.0f),
-			FCollisionQueryParams::DefaultQueryParam);
-		// RenderHitResult(NormalLineTrace, FColor::Red);
-		if (NormalLineTrace.ImpactNormal.Z >= MaxInclineZComponent && !FloorHit.bStartPenetrating)
+	UWorld* World = GetWorld();
+	if (!World || !UpdatedPrimitive)
+	{
+		OutHitResult.Reset(1.f, false);
+		return false;
+	}
+
+	// Match the sweep in FindFloor, which starts slightly above the capsule
+	const float SweepUp = 10.0f;
+	const float HalfHeight = UpdatedPrimitive->GetCollisionShape().GetCapsuleHalfHeight();
+	const FVector CapsuleLocation = UpdatedComponent->GetComponentLocation();
+	const FVector TraceStart = CapsuleLocation + FVector(0.0f, 0.0f, SweepUp);
+	const FVector TraceEnd = CapsuleLocation - FVector(0.0f, 0.0f, SweepDistance);
+
+	// Only the ground under the center of the capsule counts, which is close enough for pups nobody is watching
+	const FVector LineEnd = CapsuleLocation - FVector(0.0f, 0.0f, HalfHeight + SweepDistance);
+	FHitResult LineHit;
+	bool bHit = false;
+	if (ContactCache.MayHit(FPupContactQuery::Line(CapsuleLocation, LineEnd), IgnoredActors))
+	{
+		CountQuery(EPupMovementQuery::LineTrace);
+		bHit = World->LineTraceSingleByChannel(LineHit, CapsuleLocation, LineEnd, ECC_Pawn, GetSweepQueryParams());
+	}
+
+	// Build the same hit result a downwards capsule sweep would have produced
+	OutHitResult = FHitResult(TraceStart, TraceEnd);
+	if (bHit)
+	{
+		const FVector HitLocation = LineHit.ImpactPoint + FVector(0.0f, 0.0f, HalfHeight);
+		OutHitResult.bBlockingHit = true;
+		OutHitResult.Location = HitLocation;
+		OutHitResult.ImpactPoint = LineHit.ImpactPoint;
+		OutHitResult.Normal = LineHit.ImpactNormal;
+		OutHitResult.ImpactNormal = LineHit.ImpactNormal;
+		OutHitResult.Distance = TraceStart.Z - HitLocation.Z;
+		OutHitResult.Time = OutHitResult.Distance / (SweepUp + SweepDistance);
+		OutHitResult.Component = LineHit.Component;
+		OutHitResult.Actor = LineHit.Actor;
+		OutHitResult.PhysMaterial = LineHit.PhysMaterial;
+		if (IsValidFloorHit(OutHitResult))
 		{
+			FloorNormal = OutHitResult.ImpactNormal;
 			return true;
 		}
 	}
+	OutHitResult.Reset(1.f, true);
+	return false;
+}
+
+
+bool UPupMovementComponent::CanQueryFloorHeightfield() const
+{
+	// Anything involving movable geometry, or floors we've been told to ignore, needs a real sweep
+	return MatchModes(MovementMode, {EPupMovementMode::M_Walking, EPupMovementMode::M_Falling, EPupMovementMode::M_Deflected}) &&
+		DynamicContactSteps == 0 && InvalidFloorComponents.Num() == 0 &&
+		!(BasisComponent && BasisComponent->Mobility == EComponentMobility::Movable);
+}
+
+
+bool UPupMovementComponent::FindFloorFromHeightfield(const float SweepDistance, FHitResult& OutHitResult, bool& bOutFoundFloor) const
+{
+	if (!PupMovementCVars::UseFloorHeightfield || !FloorHeightfield || !FloorHeightfield->HasData() || !UpdatedPrimitive)
+	{
+		return false;
+	}
+
+	if (!CanQueryFloorHeightfield())
+	{
+		INC_DWORD_STAT(STAT_PupMovementHeightfieldFallbacks);
+		return false;
+	}
+
+	// Match the sweep in FindFloor, which starts slightly above the capsule
+	const float SweepUp = 10.0f;
+	const FCollisionShape CapsuleShape = UpdatedPrimitive->GetCollisionShape();
+	const FVector CapsuleLocation = UpdatedComponent->GetComponentLocation();
+
+	float FloorHeight = 0.0f;
+	UPrimitiveComponent* FloorComponent = nullptr;
+	const EPupHeightfieldFloorResult Result = FloorHeightfield->QueryFloor(CapsuleLocation, CapsuleShape.GetCapsuleRadius(),
+		CapsuleShape.GetCapsuleHalfHeight(), SweepUp, SweepDistance, IgnoredActors, FloorHeight, FloorComponent);
+
+	if (Result == EPupHeightfieldFloorResult::Unknown ||
+		(Result == EPupHeightfieldFloorResult::Floor && !FloorComponent->CanCharacterStepUp(GetPawnOwner())))
+	{
+		INC_DWORD_STAT(STAT_PupMovementHeightfieldFallbacks);
+		return false;
+	}
+	INC_DWORD_STAT(STAT_PupMovementHeightfieldQueries);
+
+	// Build the same hit result a downwards capsule sweep would have produced
+	const FVector TraceStart = CapsuleLocation + FVector(0.0f, 0.0f, SweepUp);
+	const FVector TraceEnd = CapsuleLocation - FVector(0.0f, 0.0f, SweepDistance);
+	OutHitResult = FHitResult(1.0f);
+	OutHitResult.TraceStart = TraceStart;
+	OutHitResult.TraceEnd = TraceEnd;
+
+	bOutFoundFloor = Result == EPupHeightfieldFloorResult::Floor;
+	if (bOutFoundFloor)
+	{
+		const FVector HitLocation(CapsuleLocation.X, CapsuleLocation.Y, FloorHeight + CapsuleShape.GetCapsuleHalfHeight());
+		OutHitResult.bBlockingHit = true;
+		OutHitResult.Location = HitLocation;
+		OutHitResult.ImpactPoint = FVector(CapsuleLocation.X, CapsuleLocation.Y, FloorHeight);
+		OutHitResult.Normal = FVector::UpVector;
+		OutHitResult.ImpactNormal = FVector::UpVector;
+		OutHitResult.Distance = TraceStart.Z - HitLocation.Z;
+		OutHitResult.Time = OutHitResult.Distance / (SweepUp + SweepDistance);
+		OutHitResult.Component = FloorComponent;
+		OutHitResult.Actor = FloorComponent->GetOwner();
+	}
+	return true;
+}
+
+
+void UPupMovementComponent::PrefetchFloor(const float DeltaTime)
+{
+	bFloorPrefetched = false;
+	if (MovementMode == EPupMovementMode::M_Anchored || InvalidFloorComponents.Num() > 0)
+	{
+		// These floor queries ignore components that are only known once the step runs
+		return;
+	}
+	if (PupMovementCVars::UseFloorHeightfield && FloorHeightfield && FloorHeightfield->HasData() && CanQueryFloorHeightfield())
+	{
+		// The heightfield is cheaper than any sweep, and is asked first
+		return;
+	}
+	if (GetMovementLODTier().bLineTraceFloor)
+	{
+		// A single line trace isn't worth prefetching
+		return;
+	}
+	if (AsyncFloorHandle.IsValid())
+	{
+		// Already on its way
+		return;
+	}
+
+	// Reach as far as UpdateVerticalMovement will ask, with some room for the step changing our velocity first
+	PrefetchedFloorDistance = FMath::Max(GetMovementSettings().FloorSnapDistance, Velocity.Z * -DeltaTime) + FMath::Max(PupMovementCVars::FloorPrefetchMargin, 0.0f);
+	PrefetchedFloorLocation = UpdatedComponent->GetComponentLocation();
+	SweepCapsule(FVector(0.0f, 0.0f, 10.0f), FVector::DownVector * PrefetchedFloorDistance, PrefetchedFloorHit, false);
+	bFloorPrefetched = true;
+
+	const FCollisionShape CapsuleShape = UpdatedPrimitive->GetCollisionShape();
+	PrefetchedBounds += FPupContactQuery::Capsule(PrefetchedFloorHit.TraceStart, PrefetchedFloorHit.TraceEnd, CapsuleShape).GetBounds();
+}
+
+
+bool UPupMovementComponent::ConsumePrefetchedFloor(const float SweepDistance, FHitResult& OutHitResult)
+{
+	if (!bFloorPrefetched)
+	{
+		return false;
+	}
+	bFloorPrefetched = false;
+
+	if (UpdatedComponent->GetComponentLocation() != PrefetchedFloorLocation || InvalidFloorComponents.Num() > 0 ||
+		bSweepQueryParamsDirty)
+	{
+		// We moved, or the sweep would now ignore something different
+		return false;
+	}
+	return ReuseFloorHit(PrefetchedFloorHit, PrefetchedFloorLocation, PrefetchedFloorDistance, SweepDistance, OutHitResult);
+}
+
+
+bool UPupMovementComponent::ReuseFloorHit(const FHitResult& Hit, const FVector& QueryLocation, const float QueryDistance,
+	const float SweepDistance, FHitResult& OutHitResult) const
+{
+	// Match the sweep in FindFloor, which starts slightly above the capsule
+	const float SweepUp = 10.0f;
+	const FVector CapsuleLocation = UpdatedComponent->GetComponentLocation();
+	const FVector Offset = CapsuleLocation - QueryLocation;
+	const FVector TraceStart = CapsuleLocation + FVector(0.0f, 0.0f, SweepUp);
+	const FVector TraceEnd = CapsuleLocation + FVector::DownVector * SweepDistance;
+	if (TraceEnd.Z < QueryLocation.Z - QueryDistance)
+	{
+		// The old sweep didn't reach as far down as this one would
+		return false;
+	}
+
+	if (!Hit.bBlockingHit)
+	{
+		OutHitResult = FHitResult(TraceStart, TraceEnd);
+		return true;
+	}
+	if (Hit.bStartPenetrating)
+	{
+		// Whatever we were stuck in may not be there any more
+		if (!Offset.IsZero())
+		{
+			return false;
+		}
+		OutHitResult = Hit;
+		return true;
+	}
+
+	// Anything the old sweep hit has slid along with the capsule, as it would on a flat floor
+	const FVector PlanarOffset(Offset.X, Offset.Y, 0.0f);
+	const float TraceLength = SweepUp + SweepDistance;
+	const float Distance = TraceStart.Z - Hit.Location.Z;
+	if (Distance < 0.0f)
+	{
+		// This sweep would have started below what the old one hit
+		return false;
+	}
+	if (Distance > TraceLength)
+	{
+		OutHitResult = FHitResult(TraceStart, TraceEnd);
+		return true;
+	}
+
+	OutHitResult = Hit;
+	OutHitResult.TraceStart = TraceStart;
+	OutHitResult.TraceEnd = TraceEnd;
+	OutHitResult.Location += PlanarOffset;
+	OutHitResult.ImpactPoint += PlanarOffset;
+	OutHitResult.Distance = Distance;
+	OutHitResult.Time = Distance / FMath::Max(TraceLength, KINDA_SMALL_NUMBER);
+	return true;
+}
+
+
+void UPupMovementComponent::IssueAsyncQueries(const float DeltaTime)
+{
+	const UPupMovementSettings& Settings = GetMovementSettings();
+	ClearAsyncQueries();
+
+	UWorld* World = GetWorld();
+	if (!PupMovementCVars::AsyncQueries || !World || !UpdatedPrimitive || bResting || bResimulating ||
+		!MatchModes(MovementMode, {EPupMovementMode::M_Walking, EPupMovementMode::M_Falling, EPupMovementMode::M_Deflected,
+			EPupMovementMode::M_Dragging}))
+	{
+		return;
+	}
+
+	const FCollisionShape CapsuleShape = UpdatedPrimitive->GetCollisionShape();
+	const FVector CapsuleLocation = UpdatedComponent->GetComponentLocation();
+
+	// The floor sweep FindFloor will run, unless the heightfield can answer it for free or our LOD only wants a line trace
+	if (!(PupMovementCVars::UseFloorHeightfield && FloorHeightfield && FloorHeightfield->HasData() && CanQueryFloorHeightfield()) &&
+		!GetMovementLODTier().bLineTraceFloor)
+	{
+		FCollisionQueryParams QueryParams = GetSweepQueryParams();
+		QueryParams.bFindInitialOverlaps = true;
+
+		AsyncFloorLocation = CapsuleLocation;
+		AsyncFloorDistance = FMath::Max(Settings.FloorSnapDistance, Velocity.Z * -DeltaTime) + FMath::Max(PupMovementCVars::FloorPrefetchMargin, 0.0f);
+		CountQuery(EPupMovementQuery::Sweep);
+		AsyncFloorHandle = World->AsyncSweepByChannel(EAsyncTraceType::Single, CapsuleLocation + FVector(0.0f, 0.0f, 10.0f),
+			CapsuleLocation + FVector::DownVector * AsyncFloorDistance, UpdatedComponent->GetComponentQuat(), ECC_Pawn, CapsuleShape,
+			QueryParams);
+	}
+
+	// The eye line trace Mantle starts with, which only falling players ever run
+	if (MovementMode == EPupMovementMode::M_Falling && bCanMantle && GetMovementLODTier().bProbeLedges &&
+		UpdatedComponent->GetClass() == UCapsuleComponent::StaticClass())
+	{
+		FCollisionQueryParams QueryParams = FCollisionQueryParams::DefaultQueryParam;
+		QueryParams.AddIgnoredActor(GetOwner());
+
+		AsyncWallTraceStart = GetMantleEyePosition();
+		AsyncWallTraceEnd = AsyncWallTraceStart + UpdatedComponent->GetForwardVector() * Settings.GrabRangeForward;
+		CountQuery(EPupMovementQuery::LineTrace);
+		AsyncWallHandle = World->AsyncLineTraceByChannel(EAsyncTraceType::Single, AsyncWallTraceStart, AsyncWallTraceEnd, ECC_Pawn,
+			QueryParams, UpdatedPrimitive->GetCollisionResponseToChannels());
+	}
+}
+
+
+bool UPupMovementComponent::ConsumeAsyncFloor(const float SweepDistance, FHitResult& OutHitResult)
+{
+	if (!AsyncFloorHandle.IsValid())
+	{
+		return false;
+	}
+	FTraceDatum TraceDatum;
+	const bool bFinished = GetWorld()->QueryTraceData(AsyncFloorHandle, TraceDatum);
+	AsyncFloorHandle = FTraceHandle();
+
+	const float Tolerance = PupMovementCVars::AsyncQueryTolerance;
+	if (!bFinished || InvalidFloorComponents.Num() > 0 || bSweepQueryParamsDirty ||
+		FVector::DistSquared(UpdatedComponent->GetComponentLocation(), AsyncFloorLocation) > Tolerance * Tolerance)
+	{
+		INC_DWORD_STAT(STAT_PupMovementAsyncQueryFallbacks);
+		return false;
+	}
+
+	// Single traces only report their blocking hit, if there was one
+	const FHitResult Hit = TraceDatum.OutHits.Num() > 0 ?
+		TraceDatum.OutHits[0] :
+		FHitResult(TraceDatum.Start, TraceDatum.End);
+	if (!ReuseFloorHit(Hit, AsyncFloorLocation, AsyncFloorDistance, SweepDistance, OutHitResult))
+	{
+		INC_DWORD_STAT(STAT_PupMovementAsyncQueryFallbacks);
+		return false;
+	}
+	INC_DWORD_STAT(STAT_PupMovementAsyncQueryHits);
+	return true;
+}
+
+
+bool UPupMovementComponent::ConsumeAsyncWallHit(const FVector& TraceStart, const FVector& TraceEnd, FHitResult& OutHitResult)
+{
+	if (!AsyncWallHandle.IsValid())
+	{
+		return false;
+	}
+	FTraceDatum TraceDatum;
+	const bool bFinished = GetWorld()->QueryTraceData(AsyncWallHandle, TraceDatum);
+	AsyncWallHandle = FTraceHandle();
+
+	const float ToleranceSquared = FMath::Square(PupMovementCVars::AsyncQueryTolerance);
+	if (!bFinished || FVector::DistSquared(TraceStart, AsyncWallTraceStart) > ToleranceSquared ||
+		FVector::DistSquared(TraceEnd, AsyncWallTraceEnd) > ToleranceSquared)
+	{
+		INC_DWORD_STAT(STAT_PupMovementAsyncQueryFallbacks);
+		return false;
+	}
+	INC_DWORD_STAT(STAT_PupMovementAsyncQueryHits);
+
+	if (TraceDatum.OutHits.Num() == 0 || !TraceDatum.OutHits[0].bBlockingHit)
+	{
+		OutHitResult = FHitResult(TraceStart, TraceEnd);
+		return true;
+	}
+
+	// Keep what was hit, measured from where the trace would start now
+	OutHitResult = TraceDatum.OutHits[0];
+	OutHitResult.TraceStart = TraceStart;
+	OutHitResult.TraceEnd = TraceEnd;
+	OutHitResult.Distance = FVector::Dist(TraceStart, OutHitResult.ImpactPoint);
+	OutHitResult.Time = OutHitResult.Distance / FMath::Max(FVector::Dist(TraceStart, TraceEnd), KINDA_SMALL_NUMBER);
+	return true;
+}
+
+
+void UPupMovementComponent::ClearAsyncQueries()
+{
+	AsyncFloorHandle = FTraceHandle();
+	AsyncWallHandle = FTraceHandle();
+}
+
+
+void UPupMovementComponent::NoteDynamicContact()
+{
+	DynamicContactSteps = PupMovementCVars::HeightfieldDynamicContactSteps;
+}
+
+
+bool UPupMovementComponent::IsValidFloorHit(const FHitResult& FloorHit) const
+{
+	// Check if we actually hit a floor component
+	UPrimitiveComponent* FloorComponent = FloorHit.GetComponent();
+	if (FloorComponent && !FloorHit.bStartPenetrating && FloorComponent->CanCharacterStepUp(GetPawnOwner()))
+	{
+		return GetFloorHitNormal(FloorHit).Z >= GetMovementSettings().MaxInclineZComponent;
+	}
 	return false;
 }
 
 
+FVector UPupMovementComponent::GetFloorHitNormal(const FHitResult& FloorHit) const
+{
+	// The sweep's Normal points from the contact to the center of the capsule, while the ImpactNormal is the
+	// normal of the face we hit. If they agree, we're resting on a face and can trust the sweep result.
+	const bool bSingleQuery = PupMovementCVars::FloorProbeMode != 0;
+	if (bSingleQuery && FVector::DotProduct(FloorHit.Normal, FloorHit.ImpactNormal) >= PupMovementCVars::FloorNormalAgreement)
+	{
+		return FloorHit.ImpactNormal;
+	}
+
+	// Capsule traces will give us ImpactNormals that are sometimes 'glancing' edges
+	// so, the most realiable way of getting the floor's normal is with a line trace.
+	const float TraceDistance = bSingleQuery ? PupMovementCVars::FloorNormalTraceDistance : 250.0f;
+	FHitResult NormalLineTrace;
+	CountQuery(EPupMovementQuery::LineTrace);
+	FloorHit.GetComponent()->LineTraceComponent(
+		NormalLineTrace,
+		FloorHit.ImpactPoint + FVector(0.0f, 0.0f, TraceDistance),
+		FloorHit.ImpactPoint + FVector(0.0f, 0.0f, -TraceDistance),
+		FCollisionQueryParams::DefaultQueryParam);
+	RenderHitResult(NormalLineTrace, FColor::Red);
+	return NormalLineTrace.ImpactNormal;
+}
+
+
 void UPupMovementComponent::SnapToFloor(const FHitResult& FloorHit)
 {
+	const UPupMovementSettings& Settings = GetMovementSettings();
 	FHitResult DiscardHit;
-	if (CheckFloorValidWithinRange(MinimumSafeRadius, FloorHit))
+	bool bSafeFloor = false;
+	if (!PupMovementCVars::UseFloorHeightfield || !FloorHeightfield ||
+		!FloorHeightfield->IsSafeFloorLocation(FloorHit.ImpactPoint, FloorHit.GetComponent(), Settings.MinimumSafeRadius,
+		bSafeFloor))
+	{
+		bSafeFloor = CheckFloorValidWithinRange(Settings.MinimumSafeRadius, FloorHit);
+	}
+	if (bSafeFloor)
 	{
 		LastValidLocation = FloorHit.Location;
 	}
@@ -93,23 +570,29 @@ void UPupMovementComponent::SnapToFloor(const FHitResult& FloorHit)
 		FloorHit.GetComponent()->DispatchBlockingHit(*FloorHit.GetActor(), DispatchHitResult);
 	}
 	
+	CountQuery(EPupMovementQuery::Sweep);
 	SafeMoveUpdatedComponent(
 		FloorHit.Location - UpdatedComponent->GetComponentLocation() + FloorHit.Normal * PupMovementCVars::FloorPadding,
 		UpdatedComponent->GetComponentQuat(), true, DiscardHit, ETeleportType::None);
 }
 
 
-FVector UPupMovementComponent::ClampToPlaneMaxSize(const FVector& VectorIn, const FVector& Normal, const float MaxSize)
+FVector UPupMovementComponent::FindRecoveryLocation() const
 {
-	FVector Planar = VectorIn;
-	const FVector VectorAlongNormal = FVector::DotProduct(Planar, Normal) * Normal;
-	Planar -= VectorAlongNormal;
+	if (!PupMovementCVars::UseFloorHeightfield || !FloorHeightfield || !UpdatedPrimitive)
+	{
+		return LastValidLocation;
+	}
 
-	if (Planar.Size() > MaxSize)
+	// LastValidLocation is where the capsule was, but the heightfield works with floor points
+	const FVector CapsuleOffset = FVector::UpVector * UpdatedPrimitive->GetCollisionShape().GetCapsuleHalfHeight();
+	FVector SafeFloorLocation;
+	if (FloorHeightfield->FindNearestSafeFloorLocation(LastValidLocation - CapsuleOffset, GetMovementSettings().MinimumSafeRadius,
+		PupMovementCVars::RecoverySearchDistance, SafeFloorLocation))
 	{
-		Planar = Planar.GetSafeNormal() * MaxSize;
+		return SafeFloorLocation + CapsuleOffset;
 	}
-	return Planar + VectorAlongNormal;
+	return LastValidLocation;
 }
 
 
@@ -130,16 +613,19 @@ bool UPupMovementComponent::SweepCapsule(const FVector InitialOffset, const FVec
 		const FVector Start = Capsule->GetComponentLocation() + InitialOffset;
 		const FVector End = Capsule->GetComponentLocation() + Offset;
 
-		FCollisionQueryParams QueryParams = FCollisionQueryParams::DefaultQueryParam;
-		QueryParams.bIgnoreTouches = true;
-		QueryParams.bFindInitialOverlaps = !bIgnoreInitialOverlap;
+		if (!ContactCache.MayHit(FPupContactQuery::Capsule(Start, End, Capsule->GetCollisionShape()), IgnoredActors))
+		{
+			// Nothing nearby can be in the way, so fill in the result a missed sweep would give
+			OutHit = FHitResult(Start, End);
+			return false;
+		}
 
-		QueryParams.AddIgnoredActor(Character);
-		QueryParams.AddIgnoredActors(IgnoredActors);
-		QueryParams.AddIgnoredComponents(InvalidFloorComponents);
+		FCollisionQueryParams& QueryParams = GetSweepQueryParams();
+		QueryParams.bFindInitialOverlaps = !bIgnoreInitialOverlap;
 
 		const FCollisionResponseParams ResponseParams = FCollisionResponseParams::DefaultResponseParam;
 
+		CountQuery(EPupMovementQuery::Sweep);
 		return World->SweepSingleByChannel(OutHit, Start, End, Capsule->GetComponentQuat(), ECC_Pawn,
 			Capsule->GetCollisionShape(), QueryParams, ResponseParams);
 	}
@@ -147,9 +633,52 @@ bool UPupMovementComponent::SweepCapsule(const FVector InitialOffset, const FVec
 }
 
 
+FCollisionQueryParams& UPupMovementComponent::GetSweepQueryParams() const
+{
+	if (bSweepQueryParamsDirty)
+	{
+		// Reset rather than reassign, so the ignore lists keep their memory
+		SweepQueryParams.ClearIgnoredActors();
+		SweepQueryParams.ClearIgnoredComponents();
+		SweepQueryParams.bIgnoreTouches = true;
+
+		SweepQueryParams.AddIgnoredActor(GetOwner());
+		SweepQueryParams.AddIgnoredActors(IgnoredActors);
+		SweepQueryParams.AddIgnoredComponents(InvalidFloorComponents);
+		bSweepQueryParamsDirty = false;
+	}
+	return SweepQueryParams;
+}
+
+
+void UPupMovementComponent::AddInvalidFloorComponent(UPrimitiveComponent* Component)
+{
+	if (Component && !InvalidFloorComponents.Contains(Component))
+	{
+		InvalidFloorComponents.Add(Component);
+		bSweepQueryParamsDirty = true;
+	}
+}
+
+
+void UPupMovementComponent::ClearInvalidFloorComponents()
+{
+	if (InvalidFloorComponents.Num() > 0)
+	{
+		InvalidFloorComponents.Reset();
+		bSweepQueryParamsDirty = true;
+	}
+}
+
+
 void UPupMovementComponent::RenderHitResult(const FHitResult& HitResult, const FColor Color, const bool bPersistent) const
 {
-	/*
+#if ENABLE_DRAW_DEBUG
+	if (!PupMovementCVars::DrawQueries)
+	{
+		return;
+	}
+
 	if (HitResult.GetComponent())
 	{
 		DrawDebugDirectionalArrow(GetWorld(), HitResult.ImpactPoint + HitResult.ImpactNormal * 10.0f, HitResult.ImpactPoint, 5.0f, FColor::Black, false, bPersistent ? 0.015f : 2.0f, -1, 0.5f);
@@ -170,11 +699,13 @@ void UPupMovementComponent::RenderHitResult(const FHitResult& HitResult, const F
 			bPersistent ? 0.015f : 2.0f, -1, 0.5f);
 		DrawDebugString(GetWorld(), HitResult.ImpactPoint + HitResult.ImpactNormal * 100.0f,
 		TEXT("X"), nullptr, Color, bPersistent ? 0.015f : 2.0f, false, 1.0f);
-	}*/
+	}
+#endif
 }
 
 void UPupMovementComponent::AddRootMotionTransform(const FTransform& RootMotionTransform)
 {
+	WakeUp();
 	PendingRootMotionTransforms += RootMotionTransform;
 }
 
@@ -190,6 +721,7 @@ void UPupMovementComponent::HandleRootMotion()
 	else
 	{
 		FHitResult EmptyResult;
+		CountQuery(EPupMovementQuery::Sweep);
 		SafeMoveUpdatedComponent(PendingRootMotionTransforms.GetTranslation(),
 			UpdatedComponent->GetComponentQuat(),
 			true, EmptyResult);
@@ -209,6 +741,7 @@ bool UPupMovementComponent::CheckFloorValidWithinRange(const float Range, const
 		
 		FHitResult NewHitResult;
 		FCollisionQueryParams QueryParams = FCollisionQueryParams::DefaultQueryParam;
+		CountQuery(EPupMovementQuery::LineTrace);
 		bResult = HitResult.GetComponent()->LineTraceComponent(NewHitResult, NewSweepLocation, NewSweepLocation + FVector::UpVector * -10.0f, QueryParams);
 	}
 	return bResult;
@@ -277,51 +810,268 @@ void UPupMovementComponent::ResetState(FPupMovementComponentState* State)
 	BasisRelativeVelocity = FVector::ZeroVector;
 	BasisPositionLastTick = FVector::ZeroVector;
 	BasisRotationLastTick = FRotator::ZeroRotator;
+	BasisLocationLastTick = FVector::ZeroVector;
 
 	ConsumeAdjustments();
 	ConsumeImpulse();
+	ClearPenetrations();
 	
 	if (State)
 	{
-		SetMovementMode(State->GetMovementMode());
-		UpdatedComponent->SetWorldTransform(State->GetTransform());
-		Velocity = State->GetVelocity();
+		SetMovementMode(State->MovementMode);
+		UpdatedComponent->SetWorldTransform(State->Transform);
+		Velocity = State->Velocity;
 	}
-	GetWorld()->GetTimerManager().ClearTimer(RecoveryTimerHandle);
-
-	const float TimerRemaining = GetWorld()->GetTimerManager().GetTimerRemaining(RecoveryTimerHandle);
-	const bool bIsPaused = GetWorld()->GetTimerManager().IsTimerPaused(RecoveryTimerHandle);
-	UE_LOG(LogTetherGame, Display, TEXT("Time left until recovery: %f. Timer paused? %s"), &TimerRemaining, bIsPaused ? TEXT("true") : TEXT("false"));
+	Timers.Clear(EPupMovementTimer::Recovery);
+	Timers.Clear(EPupMovementTimer::JumpBuffer);
+	Timers.Clear(EPupMovementTimer::DashBuffer);
+	InputBuffer.Reset();
+	bJumpHeld = false;
 	bAttachedToBasis = false;
 	BasisComponent = nullptr;
 	
 	DesiredRotation = UpdatedComponent->GetComponentRotation();
+	History.Reset();
+	CorrectionOffset = FVector::ZeroVector;
+	ResetPresentationInterpolation();
 }
 
 
-void UPupMovementComponent::PauseTimers()
+void UPupMovementComponent::SaveState(FPupMovementComponentState& OutState) const
+{
+	OutState.MovementMode = MovementMode;
+	OutState.Transform = UpdatedComponent->GetComponentTransform();
+	OutState.Velocity = Velocity;
+	OutState.DesiredRotation = DesiredRotation;
+
+	OutState.DirectionVector = DirectionVector;
+	OutState.InputFactor = InputFactor;
+	OutState.CameraYaw = CameraYaw;
+	OutState.bIsWalking = bIsWalking;
+	OutState.bSupressingInput = bSupressingInput;
+
+	OutState.Speed = Speed;
+	OutState.MovementSpeedAlpha = MovementSpeedAlpha;
+	OutState.TurningDirection = TurningDirection;
+
+	OutState.BasisComponent = BasisComponent;
+	OutState.bAttachedToBasis = bAttachedToBasis;
+	OutState.LocalBasisPosition = LocalBasisPosition;
+	OutState.BasisRelativeVelocity = BasisRelativeVelocity;
+	OutState.BasisRotationLastTick = BasisRotationLastTick;
+	OutState.BasisPositionLastTick = BasisPositionLastTick;
+	OutState.BasisLocationLastTick = BasisLocationLastTick;
+
+	OutState.bGrounded = bGrounded;
+	OutState.bResting = bResting;
+	OutState.FloorNormal = FloorNormal;
+	OutState.LastValidLocation = LastValidLocation;
+	OutState.DynamicContactSteps = DynamicContactSteps;
+
+	OutState.PendingImpulses = PendingImpulses;
+	OutState.PendingAdjustments = PendingAdjustments;
+	OutState.PendingPushes = PendingPushes;
+	OutState.PendingRootMotionTransforms = PendingRootMotionTransforms;
+	OutState.PendingPenetrations = PendingPenetrations;
+
+	OutState.bCanJump = bCanJump;
+	OutState.bJumping = bJumping;
+	OutState.bJumpHeld = bJumpHeld;
+	OutState.bCanDoubleJump = bCanDoubleJump;
+	OutState.JumpAppliedVelocity = JumpAppliedVelocity;
+	OutState.bWallJumpDisabledControl = bWallJumpDisabledControl;
+	OutState.bCanDash = bCanDash;
+	OutState.bDashing = bDashing;
+	OutState.DashDirection = DashDirection;
+	OutState.DeflectDirection = DeflectDirection;
+
+	OutState.bMantling = bMantling;
+	OutState.bCanMantle = bCanMantle;
+	OutState.LedgeDirection = LedgeDirection;
+	OutState.DesiredAnchorLocation = DesiredAnchorLocation;
+	OutState.bWallSliding = bWallSliding;
+	OutState.WallNormal = WallNormal;
+	OutState.bCanScramble = bCanScramble;
+	OutState.bWallScrambling = bWallScrambling;
+
+	OutState.bIsDraggingSomething = bIsDraggingSomething;
+	OutState.DraggingFaceNormal = DraggingFaceNormal;
+
+	OutState.Timers = Timers;
+}
+
+
+void UPupMovementComponent::RestoreState(const FPupMovementComponentState& State)
+{
+	// Set directly instead of through SetMovementMode, since the transition already happened when the state was saved
+	MovementMode = State.MovementMode;
+	UpdatedComponent->SetWorldTransform(State.Transform, false, nullptr, ETeleportType::TeleportPhysics);
+	Velocity = State.Velocity;
+	DesiredRotation = State.DesiredRotation;
+
+	DirectionVector = State.DirectionVector;
+	InputFactor = State.InputFactor;
+	CameraYaw = State.CameraYaw;
+	bIsWalking = State.bIsWalking;
+	bSupressingInput = State.bSupressingInput;
+
+	Speed = State.Speed;
+	MovementSpeedAlpha = State.MovementSpeedAlpha;
+	TurningDirection = State.TurningDirection;
+
+	BasisComponent = State.BasisComponent.Get();
+	bAttachedToBasis = State.bAttachedToBasis && BasisComponent;
+	LocalBasisPosition = State.LocalBasisPosition;
+	BasisRelativeVelocity = State.BasisRelativeVelocity;
+	BasisRotationLastTick = State.BasisRotationLastTick;
+	BasisPositionLastTick = State.BasisPositionLastTick;
+	BasisLocationLastTick = State.BasisLocationLastTick;
+
+	bGrounded = State.bGrounded;
+	bResting = State.bResting;
+	FloorNormal = State.FloorNormal;
+	LastValidLocation = State.LastValidLocation;
+	DynamicContactSteps = State.DynamicContactSteps;
+
+	PendingImpulses = State.PendingImpulses;
+	PendingAdjustments = State.PendingAdjustments;
+	PendingPushes = State.PendingPushes;
+	PendingRootMotionTransforms = State.PendingRootMotionTransforms;
+	PendingPenetrations = State.PendingPenetrations;
+	AppliedPenetration = FVector::ZeroVector;
+
+	bCanJump = State.bCanJump;
+	bJumping = State.bJumping;
+	bJumpHeld = State.bJumpHeld;
+	bCanDoubleJump = State.bCanDoubleJump;
+	JumpAppliedVelocity = State.JumpAppliedVelocity;
+	bWallJumpDisabledControl = State.bWallJumpDisabledControl;
+	bCanDash = State.bCanDash;
+	bDashing = State.bDashing;
+	DashDirection = State.DashDirection;
+	DeflectDirection = State.DeflectDirection;
+
+	bMantling = State.bMantling;
+	bCanMantle = State.bCanMantle;
+	LedgeDirection = State.LedgeDirection;
+	DesiredAnchorLocation = State.DesiredAnchorLocation;
+	bWallSliding = State.bWallSliding;
+	WallNormal = State.WallNormal;
+	bCanScramble = State.bCanScramble;
+	bWallScrambling = State.bWallScrambling;
+
+	bIsDraggingSomething = State.bIsDraggingSomething;
+	DraggingFaceNormal = State.DraggingFaceNormal;
+
+	Timers = State.Timers;
+
+	ContactCache.Reset();
+	ClearPrefetchedQueries();
+	ClearAsyncQueries();
+	ClearInvalidFloorComponents();
+}
+
+
+void UPupMovementComponent::RecordHistory(const float DeltaTime)
 {
-	if (UWorld* World = GetWorld())
+	const EPupMovementInputAction InputActions = PendingInputActions;
+	PendingInputActions = EPupMovementInputAction::None;
+
+	History.SetCapacity(PupMovementCVars::HistoryLength);
+	if (History.GetCapacity() == 0)
 	{
-		FTimerManager& TimerManager = World->GetTimerManager();
-		if (TimerManager.TimerExists(RecoveryTimerHandle) && TimerManager.IsTimerActive(RecoveryTimerHandle))
-		{
-			TimerManager.PauseTimer(RecoveryTimerHandle);
-		}
+		return;
+	}
+
+	// Steps simulated again after a rollback overwrite their old entries
+	FPupMovementHistoryEntry* Entry = History.Find(StepNumber);
+	if (!Entry)
+	{
+		Entry = &History.Add(StepNumber);
 	}
+	SaveState(Entry->State);
+	Entry->DeltaTime = DeltaTime;
+	Entry->InputActions = InputActions;
 }
 
 
-void UPupMovementComponent::UnPauseTimers()
+bool UPupMovementComponent::Rollback(const int32 NumSteps)
+{
+	if (NumSteps <= 0 || static_cast<uint32>(NumSteps) > StepNumber)
+	{
+		return false;
+	}
+
+	const uint32 FromStep = StepNumber - NumSteps;
+	const FPupMovementHistoryEntry* Entry = History.Find(FromStep);
+	if (!Entry)
+	{
+		return false;
+	}
+	RestoreState(Entry->State);
+	return Resimulate(FromStep);
+}
+
+
+bool UPupMovementComponent::Resimulate(const uint32 FromStep)
 {
-	if (UWorld* World = GetWorld())
+	if (FromStep > StepNumber || (FromStep < StepNumber && !History.Find(FromStep)))
+	{
+		return false;
+	}
+
+	TGuardValue<bool> ResimulatingGuard(bResimulating, true);
+	const FVector CurrentDirectionVector = DirectionVector;
+	const float CurrentInputFactor = InputFactor;
+	const bool bCurrentIsWalking = bIsWalking;
+	const EPupMovementInputAction CurrentInputActions = PendingInputActions;
+
+	const uint32 ToStep = StepNumber;
+	StepNumber = FromStep;
+	while (StepNumber < ToStep)
 	{
-		FTimerManager& TimerManager = World->GetTimerManager();
-		if (TimerManager.TimerExists(RecoveryTimerHandle))
+		// Replay the input the step was originally simulated with. Simulating the step records over its entry.
+		const FPupMovementHistoryEntry& Entry = *History.Find(StepNumber);
+		DirectionVector = Entry.State.DirectionVector;
+		InputFactor = Entry.State.InputFactor;
+		bIsWalking = Entry.State.bIsWalking;
+		const EPupMovementInputAction InputActions = Entry.InputActions;
+		const float StepDeltaTime = Entry.DeltaTime;
+
+		// The first step's actions are already part of the state we started from
+		if (StepNumber != FromStep)
 		{
-			TimerManager.UnPauseTimer(RecoveryTimerHandle);
+			ApplyInputActions(InputActions);
 		}
+		PendingInputActions = InputActions;
+		StepMovement(StepDeltaTime);
 	}
+
+	DirectionVector = CurrentDirectionVector;
+	InputFactor = CurrentInputFactor;
+	bIsWalking = bCurrentIsWalking;
+	PendingInputActions = CurrentInputActions;
+	CurrentSimulatedTransform = UpdatedComponent->GetComponentTransform();
+	return true;
+}
+
+
+const FPupMovementComponentState* UPupMovementComponent::FindHistoryState(const uint32 Step) const
+{
+	const FPupMovementHistoryEntry* Entry = History.Find(Step);
+	return Entry ? &Entry->State : nullptr;
+}
+
+
+void UPupMovementComponent::PauseTimers()
+{
+	Timers.SetPaused(true);
+}
+
+
+void UPupMovementComponent::UnPauseTimers()
+{
+	Timers.SetPaused(false);
 }
 
 
@@ -357,10 +1107,123 @@ FVector UPupMovementComponent::GetLocationRelativeToComponent(const FVector& Wor
 
 
 FPupMovementComponentState::FPupMovementComponentState()
-	:MovementMode(EPupMovementMode::M_None), Transform(FTransform::Identity), Velocity(FVector::ZeroVector)
 {}
 
 
 FPupMovementComponentState::FPupMovementComponentState(const UPupMovementComponent* Src)
-	:MovementMode(Src->GetMovementMode()), Transform(Src->UpdatedComponent->GetComponentTransform()), Velocity(Src->Velocity)
-{}
+{
+	Src->SaveState(*this);
+}
+
+
+bool FPupMovementComponentState::Serialize(FArchive& Ar)
+{
+	Ar << BasisComponent;
+	SerializeMovement(Ar);
+	return true;
+}
+
+
+bool FPupMovementComponentState::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	UObject* Basis = BasisComponent.Get();
+	bOutSuccess = Map->SerializeObject(Ar, UPrimitiveComponent::StaticClass(), Basis);
+	if (Ar.IsLoading())
+	{
+		BasisComponent = Cast<UPrimitiveComponent>(Basis);
+	}
+	SerializeMovement(Ar);
+	bOutSuccess &= !Ar.IsError();
+	return true;
+}
+
+
+void FPupMovementComponentState::SerializeMovement(FArchive& Ar)
+{
+	Ar << MovementMode;
+	Ar << Transform;
+	Ar << Velocity;
+	Ar << DesiredRotation;
+
+	Ar << DirectionVector;
+	Ar << InputFactor;
+	Ar << CameraYaw;
+	Ar << bIsWalking;
+	Ar << bSupressingInput;
+
+	Ar << Speed;
+	Ar << MovementSpeedAlpha;
+	Ar << TurningDirection;
+
+	Ar << bAttachedToBasis;
+	Ar << LocalBasisPosition;
+	Ar << BasisRelativeVelocity;
+	Ar << BasisRotationLastTick;
+	Ar << BasisPositionLastTick;
+	Ar << BasisLocationLastTick;
+
+	Ar << bGrounded;
+	Ar << bResting;
+	Ar << FloorNormal;
+	Ar << LastValidLocation;
+	Ar << DynamicContactSteps;
+
+	Ar << PendingImpulses;
+	Ar << PendingAdjustments;
+	Ar << PendingPushes;
+	Ar << PendingRootMotionTransforms;
+
+	int32 NumPenetrations = FMath::Min(PendingPenetrations.Num(), MaxSerializedPenetrations);
+	Ar << NumPenetrations;
+	if (Ar.IsLoading())
+	{
+		if (NumPenetrations < 0 || NumPenetrations > MaxSerializedPenetrations)
+		{
+			// Reading any further would be misaligned with what was written
+			Ar.SetError();
+			return;
+		}
+		PendingPenetrations.SetNum(NumPenetrations);
+	}
+	for (int32 Index = 0; Index < NumPenetrations; Index++)
+	{
+		Ar << PendingPenetrations[Index].Normal;
+		Ar << PendingPenetrations[Index].Depth;
+	}
+
+	Ar << bCanJump;
+	Ar << bJumping;
+	Ar << bJumpHeld;
+	Ar << bCanDoubleJump;
+	Ar << JumpAppliedVelocity;
+	Ar << bWallJumpDisabledControl;
+	Ar << bCanDash;
+	Ar << bDashing;
+	Ar << DashDirection;
+	Ar << DeflectDirection;
+
+	Ar << bMantling;
+	Ar << bCanMantle;
+	Ar << LedgeDirection;
+	Ar << DesiredAnchorLocation;
+	Ar << bWallSliding;
+	Ar << WallNormal;
+	Ar << bCanScramble;
+	Ar << bWallScrambling;
+
+	Ar << bIsDraggingSomething;
+	Ar << DraggingFaceNormal;
+
+	Ar << Timers;
+}
+
+
+uint32 FPupMovementComponentState::GetChecksum() const
+{
+	// Serializing needs a mutable state, even though writing doesn't change anything
+	FPupMovementComponentState Copy = *this;
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	Copy.SerializeMovement(Writer);
+	return FCrc::MemCrc32(Bytes.GetData(), Bytes.Num());
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/**
+ * A ring buffer holding one entry per consecutive movement step, overwriting the oldest step once full.
+ * Storage is only allocated when the capacity changes, never when adding entries.
+ **/
+template <typename T>
+class TPupMovementHistory
+{
+public:
+	/** Resize the buffer, forgetting every entry if the capacity changed **/
+	void SetCapacity(const int32 NewCapacity)
+	{
+		const int32 ClampedCapacity = FMath::Max(NewCapacity, 0);
+		if (ClampedCapacity != Entries.Num())
+		{
+			Entries.SetNum(ClampedCapacity);
+			Reset();
+		}
+	}
+
+	int32 GetCapacity() const { return Entries.Num(); }
+
+	int32 Num() const { return Count; }
+
+	void Reset()
+	{
+		Count = 0;
+		NewestStep = 0;
+	}
+
+	/**
+	 * Claim the entry for a step, overwriting the oldest entry if the buffer is full.
+	 * Steps that don't directly follow the newest step start the history over.
+	 * Must not be called with no capacity.
+	 **/
+	T& Add(const uint32 Step)
+	{
+		check(Entries.Num() > 0);
+		if (Count > 0 && Step != NewestStep + 1)
+		{
+			Reset();
+		}
+		NewestStep = Step;
+		Count = FMath::Min(Count + 1, Entries.Num());
+		return Entries[Step % Entries.Num()];
+	}
+
+	/** Find the entry for a step, or null if it was never added or has been overwritten **/
+	T* Find(const uint32 Step)
+	{
+		if (Count == 0 || Step > NewestStep || NewestStep - Step >= static_cast<uint32>(Count))
+		{
+			return nullptr;
+		}
+		return &Entries[Step % Entries.Num()];
+	}
+
+	const T* Find(const uint32 Step) const
+	{
+		return const_cast<TPupMovementHistory*>(this)->Find(Step);
+	}
+
+	/** Forget the entries for Step and every step after it **/
+	void DiscardFrom(const uint32 Step)
+	{
+		if (Count == 0 || Step > NewestStep)
+		{
+			return;
+		}
+		const uint32 NumDiscarded = NewestStep - Step + 1;
+		if (NumDiscarded >= static_cast<uint32>(Count))
+		{
+			Reset();
+			return;
+		}
+		Count -= NumDiscarded;
+		NewestStep = Step - 1;
+	}
+
+	/** The newest step with an entry. Only meaningful if there are any entries. **/
+	uint32 GetNewestStep() const { return NewestStep; }
+
+	/** The oldest step with an entry. Only meaningful if there are any entries. **/
+	uint32 GetOldestStep() const { return NewestStep - (Count - 1); }
+
+private:
+	TArray<T> Entries;
+	int32 Count = 0;
+	uint32 NewestStep = 0;
+};
@@ -0,0 +1,67 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupMovementInputBuffer.h"
+
+
+void FPupMovementInputBuffer::AddAction(const EPupMovementInputAction Action, const double Time)
+{
+	if (Actions.Num() >= MaxActions)
+	{
+		Actions.RemoveAt(0, 1, false);
+	}
+	FPupBufferedInputAction& Entry = Actions.AddDefaulted_GetRef();
+	Entry.Action = Action;
+	Entry.Time = Time;
+}
+
+
+void FPupMovementInputBuffer::AddSample(const FVector& InputVector, const float CameraYaw, const double Time)
+{
+	if (Samples.Num() >= MaxSamples)
+	{
+		Samples.RemoveAt(0, 1, false);
+	}
+	FPupBufferedInputSample& Entry = Samples.AddDefaulted_GetRef();
+	Entry.InputVector = InputVector;
+	Entry.CameraYaw = CameraYaw;
+	Entry.Time = Time;
+}
+
+
+EPupMovementInputAction FPupMovementInputBuffer::ConsumeActions(const double Time)
+{
+	// Input is buffered in the order it's read, so everything due is at the front
+	EPupMovementInputAction Result = EPupMovementInputAction::None;
+	int32 NumDue = 0;
+	while (NumDue < Actions.Num() && Actions[NumDue].Time <= Time)
+	{
+		Result |= Actions[NumDue].Action;
+		NumDue++;
+	}
+	Actions.RemoveAt(0, NumDue, false);
+	return Result;
+}
+
+
+bool FPupMovementInputBuffer::ConsumeSample(const double Time, FPupBufferedInputSample& OutSample)
+{
+	int32 NumDue = 0;
+	while (NumDue < Samples.Num() && Samples[NumDue].Time <= Time)
+	{
+		NumDue++;
+	}
+	if (NumDue == 0)
+	{
+		return false;
+	}
+	OutSample = Samples[NumDue - 1];
+	Samples.RemoveAt(0, NumDue, false);
+	return true;
+}
+
+
+void FPupMovementInputBuffer::Reset()
+{
+	Actions.Reset();
+	Samples.Reset();
+}
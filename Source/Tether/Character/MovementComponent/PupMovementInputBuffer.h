@@ -0,0 +1,57 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PupMovementNetworking.h"
+
+
+/** A press or release, stamped with the input clock of the frame it was read in **/
+struct FPupBufferedInputAction
+{
+	EPupMovementInputAction Action = EPupMovementInputAction::None;
+	double Time = 0.0;
+};
+
+
+/** The movement axes read in one frame, and the camera yaw they are relative to **/
+struct FPupBufferedInputSample
+{
+	FVector InputVector = FVector::ZeroVector;
+	float CameraYaw = 0.0f;
+	double Time = 0.0;
+};
+
+
+/**
+ * Input read between movement steps, stamped with when it was read, so that each fixed step takes only the input that
+ * arrived before the step ends. A frame can run several steps, or none at all.
+ * Times are on the owning pup's input clock, which counts up by the frame time handed to its fixed steps.
+ **/
+class TETHER_API FPupMovementInputBuffer
+{
+public:
+	static constexpr int32 MaxActions = 16;
+	static constexpr int32 MaxSamples = 8;
+
+	/** Buffer a press. If the buffer is full, the oldest press is dropped. **/
+	void AddAction(const EPupMovementInputAction Action, const double Time);
+
+	/** Buffer a frame's axes. If the buffer is full, the oldest sample is dropped. **/
+	void AddSample(const FVector& InputVector, const float CameraYaw, const double Time);
+
+	/** Take every action read at or before Time, oldest first, merged into one set of flags **/
+	EPupMovementInputAction ConsumeActions(const double Time);
+
+	/** Take the newest sample read at or before Time, dropping any older ones. False if there are none yet. **/
+	bool ConsumeSample(const double Time, FPupBufferedInputSample& OutSample);
+
+	void Reset();
+
+	bool IsEmpty() const { return Actions.Num() == 0 && Samples.Num() == 0; }
+
+private:
+	TArray<FPupBufferedInputAction, TInlineAllocator<MaxActions>> Actions;
+	TArray<FPupBufferedInputSample, TInlineAllocator<MaxSamples>> Samples;
+};
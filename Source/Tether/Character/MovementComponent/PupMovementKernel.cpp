@@ -0,0 +1,333 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupMovementKernel.h"
+
+#include "PupMovementComponent.h"
+
+
+namespace PupMovementKernel
+{
+	static FVector ConsumeImpulses(FPupMovementKernelState& State)
+	{
+		const FVector Impulses = State.PendingImpulses;
+		State.PendingImpulses = FVector::ZeroVector;
+		return Impulses;
+	}
+
+
+	/** Add additional velocity to the player if they hold down 'Jump' **/
+	static FVector HoldJump(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const FVector& UpVector,
+		const float DeltaTime)
+	{
+		const float JumpAcceleration = FMath::Min(Params.HoldJumpAcceleration * DeltaTime, Params.ApexVelocity - State.JumpAppliedVelocity);
+		State.JumpAppliedVelocity += JumpAcceleration;
+		return JumpAcceleration * UpVector;
+	}
+
+
+	static FVector GetWalkingVelocity(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime)
+	{
+		FVector AccelerationDirection = State.Rotation.Vector() * State.InputFactor;
+		if (FVector::DotProduct(FVector::UpVector, State.FloorNormal) < 0.99f)
+		{
+			// Only bother calculating the accleration along the plane if it isn't directly up
+			AccelerationDirection = FQuat::FindBetweenNormals(FVector::UpVector, State.FloorNormal).RotateVector(AccelerationDirection);
+		}
+		const FVector Acceleration = State.bIsWalking ?
+			Params.MaxAcceleration * AccelerationDirection + Params.BreakingFriction * AccelerationDirection.GetSafeNormal() :
+			FVector::ZeroVector;
+		FVector NewVelocity = State.Velocity + Acceleration * DeltaTime;
+		NewVelocity = InterpConstantTo(NewVelocity, FVector::ZeroVector, DeltaTime, Params.BreakingFriction);
+		NewVelocity = ClampToPlaneMaxSize(NewVelocity, State.FloorNormal, Params.MaxSpeed);
+		NewVelocity += ConsumeImpulses(State);
+
+		if (State.bDashing)
+		{
+			const float DashValue = FVector::DotProduct(State.DashDirection, NewVelocity);
+			if (DashValue < Params.DashSpeed)
+			{
+				NewVelocity += State.DashDirection * (Params.DashSpeed - DashValue);
+			}
+		}
+
+		State.Speed = NewVelocity.Size();
+		return NewVelocity;
+	}
+
+
+	static FVector GetFallingVelocity(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime)
+	{
+		FVector DesiredPlanarVelocity = State.bIsWalking ? State.DirectionVector * Params.MaxSpeed : FVector::ZeroVector;
+		const float Acceleration = Params.MaxAcceleration * Params.AirControlFactor;
+
+		if (State.bWallJumpDisabledControl)
+		{
+			// Limit the player's control when they jump away from the wall
+			DesiredPlanarVelocity = FVector(State.Velocity.X, State.Velocity.Y, 0.0f);
+		}
+
+		FVector NewVelocity = InterpConstantTo(State.Velocity, DesiredPlanarVelocity + FVector(0.0f, 0.0f, State.Velocity.Z),
+			DeltaTime, Acceleration);
+		if (State.bWallSliding)
+		{
+			const float VelocityAwayFromWallScalar = FVector::DotProduct(NewVelocity, State.WallNormal);
+			if (VelocityAwayFromWallScalar > 0.0f)
+			{
+				NewVelocity -= VelocityAwayFromWallScalar * State.WallNormal;
+			}
+			else if (VelocityAwayFromWallScalar < -1.0f)
+			{
+				if (State.bCanScramble)
+				{
+					// The movement component starts the scramble timer when it sees this change
+					State.bCanScramble = false;
+					State.bWallScrambling = true;
+				}
+				if (State.bWallScrambling)
+				{
+					NewVelocity.Z = FMath::Min(Params.TerminalVelocity, NewVelocity.Z + 2000.0f * DeltaTime);
+				}
+			}
+		}
+		else if (State.bDashing)
+		{
+			const float DashValue = FVector::DotProduct(State.DashDirection, NewVelocity);
+			if (DashValue < Params.DashSpeed * Params.AirControlFactor)
+			{
+				NewVelocity += State.DashDirection * (Params.DashSpeed * Params.AirControlFactor - DashValue);
+			}
+		}
+
+		if (State.bJumping)
+		{
+			NewVelocity += HoldJump(State, Params, State.Rotation.Quaternion().GetUpVector(), DeltaTime);
+		}
+		return NewVelocity + ConsumeImpulses(State);
+	}
+
+
+	static FVector GetDeflectedVelocity(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime)
+	{
+		FVector NewVelocity = State.Velocity;
+		if (State.bGrounded)
+		{
+			NewVelocity = ApplySlidingFriction(State.Velocity, State.FloorNormal, DeltaTime, Params.DeflectionFriction);
+		}
+		if (!State.DirectionVector.IsNearlyZero())
+		{
+			NewVelocity += DeltaTime * Params.MaxAcceleration * State.DirectionVector * Params.DeflectionControlInfluence;
+		}
+		return NewVelocity + ConsumeImpulses(State);
+	}
+
+
+	static FVector GetDraggingVelocity(const FPupMovementKernelState& State, const FPupMovementKernelParams& Params)
+	{
+		const FVector RightVector = FVector::CrossProduct(State.DraggingFaceNormal, FVector::UpVector);
+		const FVector NonPlanarVelocity = State.DirectionVector * Params.DragSpeed -
+			FVector::DotProduct(RightVector, State.DirectionVector) * RightVector;
+		if (!(State.FloorNormal - FVector::UpVector).IsNearlyZero())
+		{
+			return FQuat::FindBetweenNormals(FVector::UpVector, State.FloorNormal).RotateVector(NonPlanarVelocity);
+		}
+		return NonPlanarVelocity;
+	}
+
+
+	static void RotateWalking(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime)
+	{
+		State.DesiredRotation.Yaw = State.bIsWalking ?
+			FMath::RadiansToDegrees(FMath::Atan2(State.DirectionVector.Y, State.DirectionVector.X)) :
+			State.Rotation.Yaw;
+		float RotationRate = Params.RotationSpeed;
+		if (Params.bSlip)
+		{
+			RotationRate *= 1 - (1 - Params.SlipFactor) * State.MovementSpeedAlpha;
+		}
+		State.Rotation = FMath::RInterpConstantTo(State.Rotation, State.DesiredRotation, DeltaTime, RotationRate);
+		const float DeltaYaw = FMath::FindDeltaAngleDegrees(State.DesiredRotation.Yaw, State.Rotation.Yaw);
+
+		State.TurningDirection = FMath::Abs(DeltaYaw) > 0.01f ?
+			FMath::Clamp(FMath::Lerp(State.TurningDirection, DeltaYaw / 45.0f, 5.0f * DeltaTime), -1.0f, 1.0f) :
+			FMath::Lerp(State.TurningDirection, 0.0f, 5.0f * DeltaTime);
+	}
+
+
+	static void RotateFalling(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime)
+	{
+		if (State.bWallSliding)
+		{
+			State.Rotation = FMath::RInterpConstantTo(State.Rotation, State.DesiredRotation, DeltaTime, Params.SnapRotationVelocity);
+			return;
+		}
+		if (State.bIsWalking)
+		{
+			State.DesiredRotation.Yaw = FMath::RadiansToDegrees(FMath::Atan2(State.DirectionVector.Y, State.DirectionVector.X));
+		}
+		State.Rotation = FMath::RInterpConstantTo(State.Rotation, State.DesiredRotation, DeltaTime,
+			Params.RotationSpeed * Params.AirControlFactor);
+	}
+}
+
+
+template <EPupMovementMode Mode>
+void PupMovementKernel::UpdateRotation(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime)
+{
+	// Mode is a constant, so each instantiation keeps only its own branch
+	if (Mode == EPupMovementMode::M_Walking)
+	{
+		RotateWalking(State, Params, DeltaTime);
+	}
+	else if (Mode == EPupMovementMode::M_Falling)
+	{
+		RotateFalling(State, Params, DeltaTime);
+	}
+	else if (Mode == EPupMovementMode::M_Anchored)
+	{
+		State.Rotation = FMath::RInterpConstantTo(State.Rotation, State.DesiredRotation, DeltaTime, Params.SnapRotationVelocity);
+	}
+}
+
+
+template <EPupMovementMode Mode>
+void PupMovementKernel::UpdateVelocity(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime)
+{
+	if (Mode == EPupMovementMode::M_Walking)
+	{
+		State.Velocity = GetWalkingVelocity(State, Params, DeltaTime);
+	}
+	else if (Mode == EPupMovementMode::M_Falling)
+	{
+		State.Velocity = GetFallingVelocity(State, Params, DeltaTime);
+	}
+	else if (Mode == EPupMovementMode::M_Anchored)
+	{
+		// Depends on the anchor component, so the movement component handles this itself
+	}
+	else if (Mode == EPupMovementMode::M_Deflected)
+	{
+		State.Velocity = GetDeflectedVelocity(State, Params, DeltaTime);
+	}
+	else if (Mode == EPupMovementMode::M_Recover)
+	{
+		State.Velocity += (Params.GravityZ * DeltaTime) * FVector::UpVector;
+	}
+	else if (Mode == EPupMovementMode::M_Dragging)
+	{
+		State.Velocity = GetDraggingVelocity(State, Params);
+	}
+	else
+	{
+		State.Velocity = FVector::ZeroVector;
+	}
+}
+
+
+#define PUP_KERNEL_INSTANTIATE_MODE(Mode) \
+	template void PupMovementKernel::UpdateRotation<Mode>(FPupMovementKernelState&, const FPupMovementKernelParams&, const float); \
+	template void PupMovementKernel::UpdateVelocity<Mode>(FPupMovementKernelState&, const FPupMovementKernelParams&, const float);
+
+PUP_KERNEL_INSTANTIATE_MODE(EPupMovementMode::M_None)
+PUP_KERNEL_INSTANTIATE_MODE(EPupMovementMode::M_Walking)
+PUP_KERNEL_INSTANTIATE_MODE(EPupMovementMode::M_Falling)
+PUP_KERNEL_INSTANTIATE_MODE(EPupMovementMode::M_Anchored)
+PUP_KERNEL_INSTANTIATE_MODE(EPupMovementMode::M_Deflected)
+PUP_KERNEL_INSTANTIATE_MODE(EPupMovementMode::M_Recover)
+PUP_KERNEL_INSTANTIATE_MODE(EPupMovementMode::M_Dragging)
+
+#undef PUP_KERNEL_INSTANTIATE_MODE
+
+
+void PupMovementKernel::UpdateRotation(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime)
+{
+	switch (State.MovementMode)
+	{
+	case EPupMovementMode::M_Walking:
+		UpdateRotation<EPupMovementMode::M_Walking>(State, Params, DeltaTime);
+		break;
+	case EPupMovementMode::M_Falling:
+		UpdateRotation<EPupMovementMode::M_Falling>(State, Params, DeltaTime);
+		break;
+	case EPupMovementMode::M_Anchored:
+		UpdateRotation<EPupMovementMode::M_Anchored>(State, Params, DeltaTime);
+		break;
+	default:
+		break;
+	}
+}
+
+
+void PupMovementKernel::UpdateVelocity(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime)
+{
+	switch (State.MovementMode)
+	{
+	case EPupMovementMode::M_Walking:
+		UpdateVelocity<EPupMovementMode::M_Walking>(State, Params, DeltaTime);
+		break;
+	case EPupMovementMode::M_Falling:
+		UpdateVelocity<EPupMovementMode::M_Falling>(State, Params, DeltaTime);
+		break;
+	case EPupMovementMode::M_Anchored:
+		break;
+	case EPupMovementMode::M_Deflected:
+		UpdateVelocity<EPupMovementMode::M_Deflected>(State, Params, DeltaTime);
+		break;
+	case EPupMovementMode::M_Recover:
+		UpdateVelocity<EPupMovementMode::M_Recover>(State, Params, DeltaTime);
+		break;
+	case EPupMovementMode::M_Dragging:
+		UpdateVelocity<EPupMovementMode::M_Dragging>(State, Params, DeltaTime);
+		break;
+	default:
+		UpdateVelocity<EPupMovementMode::M_None>(State, Params, DeltaTime);
+		break;
+	}
+}
+
+
+void PupMovementKernel::UpdateBatch(TArrayView<FPupMovementKernelState> States, const FPupMovementKernelParams& Params, const float DeltaTime)
+{
+	for (FPupMovementKernelState& State : States)
+	{
+		UpdateRotation(State, Params, DeltaTime);
+		UpdateVelocity(State, Params, DeltaTime);
+	}
+}
+
+
+FVector PupMovementKernel::InterpConstantTo(const FVector& Current, const FVector& Target, const float DeltaTime, const float Speed)
+{
+	// Replays compare checksums, so this does exactly what FMath::VInterpConstantTo does, in the same order.
+	// VectorDot3 adds its terms in a different order than FVector::Size, so it can't be used here.
+	const FVector Delta = Target - Current;
+	const float DeltaSize = Delta.Size();
+	const float MaxStep = Speed * DeltaTime;
+	if (DeltaSize <= MaxStep)
+	{
+		return Target;
+	}
+	if (MaxStep <= 0.0f)
+	{
+		return Current;
+	}
+	return Current + (Delta / DeltaSize) * MaxStep;
+}
+
+
+FVector PupMovementKernel::ClampToPlaneMaxSize(const FVector& VectorIn, const FVector& Normal, const float MaxSize)
+{
+	const FVector AlongNormal = FVector::DotProduct(VectorIn, Normal) * Normal;
+	FVector Planar = VectorIn - AlongNormal;
+	if (Planar.Size() > MaxSize)
+	{
+		Planar = Planar.GetSafeNormal() * MaxSize;
+	}
+	return Planar + AlongNormal;
+}
+
+
+FVector PupMovementKernel::ApplySlidingFriction(const FVector& VelocityIn, const FVector& FloorNormal, const float DeltaTime, const float Friction)
+{
+	const FVector VelocityVertical = FVector::DotProduct(FloorNormal, VelocityIn) * FloorNormal;
+	return InterpConstantTo(VelocityIn, VelocityVertical, DeltaTime, Friction);
+}
@@ -0,0 +1,101 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+enum class EPupMovementMode : uint8;
+
+
+/** Tuning values read by the movement kernel. Precomputed by each settings asset, with gravity filled in once per step. **/
+struct FPupMovementKernelParams
+{
+	float MaxSpeed = 0.0f;
+	float MaxAcceleration = 0.0f;
+	float BreakingFriction = 0.0f;
+	float DashSpeed = 0.0f;
+	float AirControlFactor = 0.0f;
+	float TerminalVelocity = 0.0f;
+	float HoldJumpAcceleration = 0.0f;
+	float ApexVelocity = 0.0f;
+	float DeflectionFriction = 0.0f;
+	float DeflectionControlInfluence = 0.0f;
+	float DragSpeed = 0.0f;
+	float RotationSpeed = 0.0f;
+	float SnapRotationVelocity = 0.0f;
+	float SlipFactor = 0.0f;
+	float GravityZ = 0.0f;
+	bool bSlip = false;
+};
+
+
+/**
+ * Everything the movement kernel reads and writes for a single pup.
+ * Plain old data, so batches of pups can be stepped without touching their components.
+ **/
+struct FPupMovementKernelState
+{
+	FRotator Rotation = FRotator::ZeroRotator;
+	FRotator DesiredRotation = FRotator::ZeroRotator;
+
+	FVector Velocity = FVector::ZeroVector;
+	FVector FloorNormal = FVector::UpVector;
+	FVector DirectionVector = FVector::ZeroVector;
+	FVector DashDirection = FVector::ZeroVector;
+	FVector WallNormal = FVector::ZeroVector;
+	FVector DraggingFaceNormal = FVector::ZeroVector;
+
+	/** Impulses waiting to be added to the velocity. Consumed by the modes that accept impulses. **/
+	FVector PendingImpulses = FVector::ZeroVector;
+
+	float InputFactor = 0.0f;
+	float TurningDirection = 0.0f;
+	float MovementSpeedAlpha = 0.0f;
+	float JumpAppliedVelocity = 0.0f;
+	float Speed = 0.0f;
+
+	EPupMovementMode MovementMode{};
+
+	bool bIsWalking = false;
+	bool bGrounded = false;
+	bool bDashing = false;
+	bool bJumping = false;
+	bool bWallSliding = false;
+	bool bWallScrambling = false;
+	bool bCanScramble = false;
+	bool bWallJumpDisabledControl = false;
+};
+
+
+/**
+ * The movement math that doesn't need the world: rotation, velocity, friction and gravity.
+ * Anchored velocity is left to the movement component, since it depends on the anchor's component.
+ **/
+namespace PupMovementKernel
+{
+	/** Turn towards the desired rotation, updating DesiredRotation and TurningDirection along the way **/
+	TETHER_API void UpdateRotation(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime);
+
+	/** Find the new velocity for the current movement mode. Should be called after UpdateRotation. **/
+	TETHER_API void UpdateVelocity(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime);
+
+	/** UpdateRotation for a state known to be in Mode, without checking its mode. Instantiated for every mode. **/
+	template <EPupMovementMode Mode>
+	void UpdateRotation(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime);
+
+	/** UpdateVelocity for a state known to be in Mode, without checking its mode. Instantiated for every mode. **/
+	template <EPupMovementMode Mode>
+	void UpdateVelocity(FPupMovementKernelState& State, const FPupMovementKernelParams& Params, const float DeltaTime);
+
+	/** Update the rotation and velocity of every pup in a batch. Anchored pups keep their velocity. **/
+	TETHER_API void UpdateBatch(TArrayView<FPupMovementKernelState> States, const FPupMovementKernelParams& Params, const float DeltaTime);
+
+	/** Move Current towards Target by at most Speed * DeltaTime, matching FMath::VInterpConstantTo **/
+	TETHER_API FVector InterpConstantTo(const FVector& Current, const FVector& Target, const float DeltaTime, const float Speed);
+
+	/** Scale an FVector to a max size along a plane, similar to ClampToMaxSize2D **/
+	TETHER_API FVector ClampToPlaneMaxSize(const FVector& VectorIn, const FVector& Normal, const float MaxSize);
+
+	/** Slow down along the plane of the floor, keeping any velocity along its normal **/
+	TETHER_API FVector ApplySlidingFriction(const FVector& VelocityIn, const FVector& FloorNormal, const float DeltaTime, const float Friction);
+}
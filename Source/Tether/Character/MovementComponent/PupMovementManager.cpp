@@ -0,0 +1,353 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupMovementManager.h"
+
+#include "EngineUtils.h"
+#include "GameFramework/PlayerController.h"
+#include "PupMovementComponent.h"
+#include "PupMovementStats.h"
+#include "Async/ParallelFor.h"
+
+
+namespace PupMovementCVars
+{
+	static int32 BatchedUpdate = 1;
+	static FAutoConsoleVariableRef CVarBatchedUpdate(
+		TEXT("PupMovement.BatchedUpdate"),
+		BatchedUpdate,
+		TEXT("If non-zero, every pup is stepped together by the world's movement manager, with each step's queries run in parallel. ")
+		TEXT("Only used with fixed timesteps"),
+		ECVF_Default);
+
+	static int32 EnableLOD = 1;
+	static FAutoConsoleVariableRef CVarEnableLOD(
+		TEXT("PupMovement.EnableLOD"),
+		EnableLOD,
+		TEXT("If non-zero, pups far from every viewer or out of sight step less often and skip their most expensive queries"),
+		ECVF_Default);
+}
+
+
+APupMovementManager::APupMovementManager()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.TickGroup = TG_PrePhysics;
+}
+
+
+void APupMovementManager::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+	UpdateMovementLOD(DeltaTime, PupMovementCVars::EnableLOD != 0);
+
+	// Bases nobody has stood on for a few seconds are dropped, so the cache doesn't grow with the level
+	BasisMotionCache.Prune(300);
+	if (Replayer)
+	{
+		// Replayed pups aren't batched, so every other pup is still stepped as usual
+		StepReplay();
+	}
+	if (IsBatching())
+	{
+		StepPups(DeltaTime, true);
+	}
+
+	// Pups that tick on their own have already stepped, since the manager waits for them
+	if (Recorder)
+	{
+		Recorder->EndFrame(DeltaTime);
+	}
+	PublishFrameStats();
+}
+
+
+APupMovementManager* APupMovementManager::Get(UWorld* World)
+{
+	if (!World || !World->IsGameWorld())
+	{
+		return nullptr;
+	}
+	for (TActorIterator<APupMovementManager> Iterator(World); Iterator; ++Iterator)
+	{
+		if (!Iterator->IsPendingKill())
+		{
+			return *Iterator;
+		}
+	}
+	return World->SpawnActor<APupMovementManager>();
+}
+
+
+bool APupMovementManager::IsBatching()
+{
+	return PupMovementCVars::BatchedUpdate && UPupMovementComponent::UsesFixedTimestep();
+}
+
+
+void APupMovementManager::AddPup(UPupMovementComponent* Pup)
+{
+	if (!Pup || Pups.Contains(Pup))
+	{
+		return;
+	}
+	Pups.Add(Pup);
+
+	// Step after the pup's owner has ticked, so this frame's input and root motion are already in.
+	// Player controllers read input before the pup's own tick, not its owner's, so wait for that too.
+	if (AActor* Owner = Pup->GetOwner())
+	{
+		AddTickPrerequisiteActor(Owner);
+	}
+	AddTickPrerequisiteComponent(Pup);
+}
+
+
+void APupMovementManager::RemovePup(UPupMovementComponent* Pup)
+{
+	if (!Pup)
+	{
+		return;
+	}
+	Pups.Remove(Pup);
+	RemoveTickPrerequisiteComponent(Pup);
+	if (AActor* Owner = Pup->GetOwner())
+	{
+		RemoveTickPrerequisiteActor(Owner);
+	}
+}
+
+
+void APupMovementManager::UpdateMovementLOD(const float DeltaTime, const bool bEnabled)
+{
+	Cleanup();
+
+	// Local players see from their cameras. A dedicated server has no cameras, so only distance to players counts.
+	Viewers.Reset();
+	bool bHasLocalViewers = false;
+	if (bEnabled)
+	{
+		for (FConstPlayerControllerIterator Iterator = GetWorld()->GetPlayerControllerIterator(); Iterator; ++Iterator)
+		{
+			const APlayerController* Controller = Iterator->Get();
+			if (!Controller)
+			{
+				continue;
+			}
+			if (Controller->IsLocalController())
+			{
+				FVector ViewLocation;
+				FRotator ViewRotation;
+				Controller->GetPlayerViewPoint(ViewLocation, ViewRotation);
+				Viewers.Add(ViewLocation);
+				bHasLocalViewers = true;
+			}
+			else if (const APawn* Pawn = Controller->GetPawn())
+			{
+				Viewers.Add(Pawn->GetActorLocation());
+			}
+		}
+	}
+
+	for (const TWeakObjectPtr<UPupMovementComponent>& Pup : Pups)
+	{
+		if (!bEnabled || Viewers.Num() == 0 || !Pup->UpdatedComponent)
+		{
+			Pup->UpdateMovementLOD(DeltaTime, 0.0f, false);
+			continue;
+		}
+
+		const FVector Location = Pup->UpdatedComponent->GetComponentLocation();
+		float ViewerDistanceSquared = MAX_flt;
+		for (const FVector& Viewer : Viewers)
+		{
+			ViewerDistanceSquared = FMath::Min(ViewerDistanceSquared, FVector::DistSquared(Viewer, Location));
+		}
+		Pup->UpdateMovementLOD(DeltaTime, FMath::Sqrt(ViewerDistanceSquared), bHasLocalViewers && !Pup->WasRecentlyRendered());
+	}
+}
+
+
+void APupMovementManager::StepPups(const float DeltaTime, const bool bParallel)
+{
+	Cleanup();
+
+	Batch.Reset();
+	BatchSteps.Reset();
+	int32 MaxSteps = 0;
+	for (const TWeakObjectPtr<UPupMovementComponent>& Pup : Pups)
+	{
+		if (Pup->CanBeBatched())
+		{
+			Batch.Add(Pup.Get());
+			BatchSteps.Add(Pup->BeginFixedSteps(DeltaTime));
+			MaxSteps = FMath::Max(MaxSteps, BatchSteps.Last());
+		}
+	}
+	LastStepCount = MaxSteps;
+
+	for (int32 Step = 0; Step < MaxSteps; Step++)
+	{
+		if (bParallel)
+		{
+			SCOPE_CYCLE_COUNTER(STAT_PupMovementPrefetch);
+			ParallelFor(Batch.Num(), [this, Step](const int32 Index)
+			{
+				if (BatchSteps[Index] > Step)
+				{
+					Batch[Index]->PrefetchStepQueries(Batch[Index]->GetFixedStepLength());
+				}
+			});
+		}
+
+		// Anything that moves a pup has to happen on the game thread, one pup at a time
+		for (int32 Index = 0; Index < Batch.Num(); Index++)
+		{
+			UPupMovementComponent* Pup = Batch[Index];
+			if (BatchSteps[Index] <= Step || !IsValid(Pup) || !Pup->UpdatedComponent)
+			{
+				continue;
+			}
+
+			FBox MovedBounds = Pup->UpdatedComponent->Bounds.GetBox();
+			Pup->SimulateFixedStep(Pup->GetFixedStepLength());
+			if (!bParallel || !IsValid(Pup) || !Pup->UpdatedComponent)
+			{
+				continue;
+			}
+
+			// Pups that haven't stepped yet may have prefetched queries from before this pup moved in or out of the way
+			MovedBounds += Pup->UpdatedComponent->Bounds.GetBox();
+			for (int32 OtherIndex = Index + 1; OtherIndex < Batch.Num(); OtherIndex++)
+			{
+				if (BatchSteps[OtherIndex] > Step && IsValid(Batch[OtherIndex]))
+				{
+					Batch[OtherIndex]->DiscardPrefetchedQueries(MovedBounds);
+				}
+			}
+		}
+	}
+
+	for (int32 Index = 0; Index < Batch.Num(); Index++)
+	{
+		if (IsValid(Batch[Index]))
+		{
+			Batch[Index]->EndFixedSteps(BatchSteps[Index]);
+		}
+	}
+	Batch.Reset();
+}
+
+
+bool APupMovementManager::StartRecording()
+{
+	if (Replayer)
+	{
+		return false;
+	}
+	Recorder = MakeUnique<FPupMovementRecorder>(GetWorld());
+	return true;
+}
+
+
+TUniquePtr<FPupMovementRecorder> APupMovementManager::StopRecording()
+{
+	return MoveTemp(Recorder);
+}
+
+
+void APupMovementManager::StartReplay(FPupMovementRecording&& Recording, const bool bExitWhenDone)
+{
+	// Recording a replay would only record the same steps again
+	Recorder.Reset();
+	Replayer.Reset();
+	Cleanup();
+	Replayer = MakeUnique<FPupMovementReplayer>(Pups, MoveTemp(Recording));
+	bExitAfterReplay = bExitWhenDone;
+}
+
+
+void APupMovementManager::StepReplay()
+{
+	Replayer->StepFrame();
+	if (!Replayer->IsFinished())
+	{
+		return;
+	}
+
+	Replayer->LogSummary();
+	const bool bDiverged = Replayer->GetNumDivergences() > 0;
+	Replayer.Reset();
+	if (bExitAfterReplay)
+	{
+		// So a headless replay can fail whatever ran it
+		FPlatformMisc::RequestExitWithStatus(false, bDiverged ? 1 : 0);
+	}
+}
+
+
+void APupMovementManager::PublishFrameStats()
+{
+#if PUP_MOVEMENT_STATS
+	FPupMovementFrameStats Total;
+	int32 PupsStepped = 0;
+	int32 MaxPupQueries = 0;
+	for (const TWeakObjectPtr<UPupMovementComponent>& Pup : Pups)
+	{
+		if (!Pup.IsValid())
+		{
+			continue;
+		}
+		const FPupMovementFrameStats& PupStats = Pup->GetFrameStats();
+		if (PupStats.Steps > 0)
+		{
+			PupsStepped++;
+		}
+		MaxPupQueries = FMath::Max(MaxPupQueries, PupStats.GetTotalQueries());
+		Total.Accumulate(PupStats);
+		Pup->ResetFrameStats();
+	}
+
+	// Totals are already counted as the queries happen, so only the per pup numbers are left
+	const float PerPup = 1.0f / FMath::Max(PupsStepped, 1);
+	const float SweepsPerPup = Total.GetQueries(EPupMovementQuery::Sweep) * PerPup;
+	const float LineTracesPerPup = Total.GetQueries(EPupMovementQuery::LineTrace) * PerPup;
+	const float ClosestPointsPerPup = Total.GetQueries(EPupMovementQuery::ClosestPoint) * PerPup;
+	SET_DWORD_STAT(STAT_PupMovementPupsStepped, PupsStepped);
+	SET_FLOAT_STAT(STAT_PupMovementSweepsPerPup, SweepsPerPup);
+	SET_FLOAT_STAT(STAT_PupMovementLineTracesPerPup, LineTracesPerPup);
+	SET_FLOAT_STAT(STAT_PupMovementClosestPointsPerPup, ClosestPointsPerPup);
+	SET_DWORD_STAT(STAT_PupMovementMaxPupQueries, MaxPupQueries);
+
+	// CSV profiles don't see the stats system, so everything goes into them here
+	CSV_CUSTOM_STAT(PupMovement, PupsStepped, PupsStepped, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, Steps, Total.Steps, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, Sweeps, Total.GetQueries(EPupMovementQuery::Sweep), ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, LineTraces, Total.GetQueries(EPupMovementQuery::LineTrace), ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, ClosestPoints, Total.GetQueries(EPupMovementQuery::ClosestPoint), ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, Overlaps, Total.GetQueries(EPupMovementQuery::Overlap), ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, SweepsPerPup, SweepsPerPup, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, LineTracesPerPup, LineTracesPerPup, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, ClosestPointsPerPup, ClosestPointsPerPup, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, MaxPupQueries, MaxPupQueries, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, ContactCacheHits, Total.ContactCacheHits, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, ContactCacheMisses, Total.ContactCacheMisses, ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, StepsWith1Substep, Total.SubstepHistogram[0], ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, StepsWith2Substeps, Total.SubstepHistogram[1], ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, StepsWith4Substeps, Total.SubstepHistogram[2], ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, StepsWith8Substeps, Total.SubstepHistogram[3], ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, StepsWithMoreSubsteps, Total.SubstepHistogram[4], ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, SlicesResolved, Total.RemainingTimeHistogram[0], ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, SlicesLeftQuarter, Total.RemainingTimeHistogram[1], ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, SlicesLeftHalf, Total.RemainingTimeHistogram[2], ECsvCustomStatOp::Set);
+	CSV_CUSTOM_STAT(PupMovement, SlicesLeftMore, Total.RemainingTimeHistogram[3], ECsvCustomStatOp::Set);
+#endif
+}
+
+
+void APupMovementManager::Cleanup()
+{
+	Pups.RemoveAll([](const TWeakObjectPtr<UPupMovementComponent>& Pup)
+	{
+		return !Pup.IsValid();
+	});
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "GameFramework/Info.h"
+
+#include "PupBasisMotionCache.h"
+#include "PupMovementRecording.h"
+
+#include "PupMovementManager.generated.h"
+
+class UPupMovementComponent;
+
+/**
+ * Steps every pup in the world together, instead of each pup ticking on its own.
+ * The queries each step starts with are run for all pups at once on worker threads, and everything that moves a pup
+ * is still run one pup at a time on the game thread.
+ **/
+UCLASS(NotPlaceable, Transient)
+class TETHER_API APupMovementManager : public AInfo
+{
+	GENERATED_BODY()
+
+public:
+	APupMovementManager();
+
+	virtual void Tick(float DeltaTime) override;
+
+	/** Find the world's movement manager, spawning one if there isn't one yet. Null outside of game worlds. **/
+	static APupMovementManager* Get(UWorld* World);
+
+	/** Are pups stepped by their manager, instead of by their own ticks? **/
+	static bool IsBatching();
+
+	void AddPup(UPupMovementComponent* Pup);
+
+	void RemovePup(UPupMovementComponent* Pup);
+
+	const TArray<TWeakObjectPtr<UPupMovementComponent>>& GetPups() const { return Pups; }
+
+	/**
+	 * Pick every pup's movement LOD from how far it is from the nearest viewer, and whether any of them can see it.
+	 * @param bEnabled		If false, every pup is put back at full detail.
+	 **/
+	void UpdateMovementLOD(const float DeltaTime, const bool bEnabled);
+
+	/**
+	 * Run a frame of fixed steps for every pup that can be batched.
+	 * @param bParallel		Prefetch each step's queries for all pups on worker threads first. Otherwise, every
+	 *						pup runs its own queries as it steps, exactly as its own tick would.
+	 **/
+	void StepPups(const float DeltaTime, const bool bParallel);
+
+	/** How many rounds of fixed steps the last StepPups ran, i.e. the most steps any one pup took **/
+	int32 GetLastStepCount() const { return LastStepCount; }
+
+	/** Where a basis is this frame, read from the component only the first time any pup on it asks **/
+	const FPupBasisMotion& GetBasisMotion(const UPrimitiveComponent* Basis, const UObject* SurfaceVelocitySource)
+	{
+		return BasisMotionCache.Get(Basis, SurfaceVelocitySource);
+	}
+
+
+	// Recording
+	/** Start recording every step every pup takes, until StopRecording. False while replaying. **/
+	bool StartRecording();
+
+	/** Stop recording, handing over everything that was recorded. Null if nothing was being recorded. **/
+	TUniquePtr<FPupMovementRecorder> StopRecording();
+
+	/** The recorder every pup's steps go to, or null if nothing is being recorded **/
+	FPupMovementRecorder* GetRecorder() const { return Recorder.Get(); }
+
+	/**
+	 * Replay a recording one recorded frame per frame, taking over the pups it was recorded from until it's done.
+	 * @param bExitWhenDone		Quit once the replay is done, with a non-zero exit code if it diverged.
+	 **/
+	void StartReplay(FPupMovementRecording&& Recording, const bool bExitWhenDone);
+
+	bool IsReplaying() const { return Replayer.IsValid(); }
+
+private:
+	/** Replay the next recorded frame, finishing the replay after the last one **/
+	void StepReplay();
+
+	void Cleanup();
+
+	/**
+	 * Publish what every pup's movement cost this frame to the PupMovement stats and CSV profile, then start counting again.
+	 * Pups that tick on their own have already ticked by now, since the manager waits for them.
+	 **/
+	void PublishFrameStats();
+
+	UPROPERTY(VisibleInstanceOnly)
+	TArray<TWeakObjectPtr<UPupMovementComponent>> Pups;
+
+	/** The pups being stepped this frame, and how many steps each of them needs. Kept to avoid allocating every frame. **/
+	TArray<UPupMovementComponent*> Batch;
+	TArray<int32> BatchSteps;
+	int32 LastStepCount = 0;
+
+	/** Where the world is being watched from this frame **/
+	TArray<FVector> Viewers;
+
+	FPupBasisMotionCache BasisMotionCache;
+
+	TUniquePtr<FPupMovementRecorder> Recorder;
+
+	TUniquePtr<FPupMovementReplayer> Replayer;
+	bool bExitAfterReplay = false;
+};
@@ -0,0 +1,62 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupMovementNetworking.h"
+
+
+FPupMovementInputFrame FPupMovementInputFrame::Make(const uint32 Step, const FVector& DirectionVector, const float InputFactor,
+	const bool bIsWalking, const EPupMovementInputAction Actions)
+{
+	FPupMovementInputFrame Frame;
+	Frame.Step = Step;
+	Frame.DirectionX = static_cast<int8>(FMath::Clamp(FMath::RoundToInt(DirectionVector.X * 127.0f), -127, 127));
+	Frame.DirectionY = static_cast<int8>(FMath::Clamp(FMath::RoundToInt(DirectionVector.Y * 127.0f), -127, 127));
+	Frame.InputFactor = static_cast<uint8>(FMath::Clamp(FMath::RoundToInt(InputFactor * 255.0f), 0, 255));
+	Frame.Actions = static_cast<uint8>(Actions);
+	Frame.bIsWalking = bIsWalking;
+	return Frame;
+}
+
+
+FVector FPupMovementInputFrame::GetDirectionVector() const
+{
+	// Rounding can push diagonals just past unit length
+	return FVector(DirectionX / 127.0f, DirectionY / 127.0f, 0.0f).GetClampedToMaxSize(1.0f);
+}
+
+
+bool FPupMovementInputBatch::NetSerialize(FArchive& Ar, UPackageMap* Map, bool& bOutSuccess)
+{
+	uint32 NumFrames = Frames.Num();
+	Ar.SerializeInt(NumFrames, MaxFrames + 1);
+
+	uint32 FirstStep = NumFrames > 0 ? Frames[0].Step : 0;
+	Ar << FirstStep;
+
+	if (Ar.IsLoading())
+	{
+		Frames.SetNum(FMath::Min(NumFrames, static_cast<uint32>(MaxFrames)));
+	}
+
+	for (int32 Index = 0; Index < Frames.Num(); Index++)
+	{
+		FPupMovementInputFrame& Frame = Frames[Index];
+		Ar << Frame.DirectionX;
+		Ar << Frame.DirectionY;
+		Ar << Frame.InputFactor;
+
+		uint8 Actions = Frame.Actions;
+		uint8 WalkingBit = Frame.bIsWalking ? 1 : 0;
+		Ar.SerializeBits(&Actions, 3);
+		Ar.SerializeBits(&WalkingBit, 1);
+
+		if (Ar.IsLoading())
+		{
+			Frame.Step = FirstStep + Index;
+			Frame.Actions = Actions & 0x7;
+			Frame.bIsWalking = (WalkingBit & 1) != 0;
+		}
+	}
+
+	bOutSuccess = !Ar.IsError();
+	return true;
+}
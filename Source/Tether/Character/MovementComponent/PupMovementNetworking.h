@@ -0,0 +1,77 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PupMovementNetworking.generated.h"
+
+
+/** Discrete inputs that change movement immediately, instead of through the direction vector **/
+enum class EPupMovementInputAction : uint8
+{
+	None		= 0,
+	Jump		= 1 << 0,
+	StopJumping	= 1 << 1,
+	Dash		= 1 << 2
+};
+ENUM_CLASS_FLAGS(EPupMovementInputAction);
+
+
+/**
+ * The input used for a single movement step, quantized so the client and server simulate with exactly the same values.
+ * Actions are applied at the start of the step, before the step is simulated.
+ **/
+struct TETHER_API FPupMovementInputFrame
+{
+	static FPupMovementInputFrame Make(const uint32 Step, const FVector& DirectionVector, const float InputFactor,
+		const bool bIsWalking, const EPupMovementInputAction Actions);
+
+	FVector GetDirectionVector() const;
+
+	float GetInputFactor() const { return InputFactor / 255.0f; }
+
+	bool IsWalking() const { return bIsWalking; }
+
+	EPupMovementInputAction GetActions() const { return static_cast<EPupMovementInputAction>(Actions); }
+
+	uint32 Step = 0;
+
+	/** Planar direction, with each axis quantized to a byte **/
+	int8 DirectionX = 0;
+	int8 DirectionY = 0;
+
+	uint8 InputFactor = 0;
+
+	/** EPupMovementInputAction flags **/
+	uint8 Actions = 0;
+
+	bool bIsWalking = false;
+};
+
+
+/**
+ * The most recent unacknowledged input frames from a client, oldest first.
+ * Frames are always for consecutive steps, so only the first step number is sent. Older frames are sent again
+ * with every batch until they are acknowledged, so a lost packet doesn't lose any input.
+ **/
+USTRUCT()
+struct TETHER_API FPupMovementInputBatch
+{
+	GENERATED_BODY()
+
+	static constexpr int32 MaxFrames = 16;
+
+	bool NetSerialize(FArchive& Ar, class UPackageMap* Map, bool& bOutSuccess);
+
+	TArray<FPupMovementInputFrame, TInlineAllocator<MaxFrames>> Frames;
+};
+
+template <>
+struct TStructOpsTypeTraits<FPupMovementInputBatch> : public TStructOpsTypeTraitsBase2<FPupMovementInputBatch>
+{
+	enum
+	{
+		WithNetSerializer = true
+	};
+};
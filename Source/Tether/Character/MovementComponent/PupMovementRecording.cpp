@@ -0,0 +1,476 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupMovementRecording.h"
+
+#include "PupMovementComponent.h"
+#include "PupMovementManager.h"
+#include "../TetherCharacter.h"
+
+#include "HAL/IConsoleManager.h"
+#include "Misc/App.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+#include "Tether/Tether.h"
+
+
+namespace PupMovementRecording
+{
+	static constexpr uint32 FileMagic = 0x52505550; // PUPR
+
+	// Bit layout of a step's flags byte
+	static constexpr uint8 InputActionBits = 0x07;
+	static constexpr uint8 CharacterActionShift = 3;
+	static constexpr uint8 CharacterActionBits = 0x03;
+	static constexpr uint8 WalkingFlag = 1 << 5;
+	static constexpr uint8 AwakeFlag = 1 << 6;
+}
+
+
+FArchive& operator<<(FArchive& Ar, FPupRecordedStep& Step)
+{
+	using namespace PupMovementRecording;
+
+	Ar << Step.Track;
+	Ar << Step.DeltaTime;
+	Ar << Step.DirectionX;
+	Ar << Step.DirectionY;
+	Ar << Step.InputFactor;
+	Ar << Step.CameraYaw;
+	Ar << Step.MovementLOD;
+
+	uint8 Flags = (Step.InputActions & InputActionBits) |
+		((Step.CharacterActions & CharacterActionBits) << CharacterActionShift) |
+		(Step.bIsWalking ? WalkingFlag : 0) |
+		(Step.bAwake ? AwakeFlag : 0);
+	Ar << Flags;
+	if (Ar.IsLoading())
+	{
+		Step.InputActions = Flags & InputActionBits;
+		Step.CharacterActions = (Flags >> CharacterActionShift) & CharacterActionBits;
+		Step.bIsWalking = (Flags & WalkingFlag) != 0;
+		Step.bAwake = (Flags & AwakeFlag) != 0;
+	}
+
+	Ar << Step.Checksum;
+	return Ar;
+}
+
+
+FArchive& operator<<(FArchive& Ar, FPupRecordedTrack& Track)
+{
+	Ar << Track.OwnerName;
+	Ar << Track.BasisPath;
+	Ar << Track.InitialState;
+	return Ar;
+}
+
+
+FArchive& operator<<(FArchive& Ar, FPupRecordedFrame& Frame)
+{
+	Ar << Frame.DeltaTime;
+	Ar << Frame.NumSteps;
+	return Ar;
+}
+
+
+
+// Recording files
+FString FPupMovementRecording::GetRecordingPath(const FString& NameOrPath)
+{
+	const FString Filename = FPaths::GetExtension(NameOrPath).IsEmpty() ? NameOrPath + TEXT(".pupreplay") : NameOrPath;
+	if (FPaths::GetPath(Filename).IsEmpty())
+	{
+		return FPaths::ProjectSavedDir() / TEXT("PupRecordings") / Filename;
+	}
+	return Filename;
+}
+
+
+bool FPupMovementRecording::SaveToFile(const FString& Filename)
+{
+	TArray<uint8> Bytes;
+	FMemoryWriter Writer(Bytes);
+	Serialize(Writer);
+	return FFileHelper::SaveArrayToFile(Bytes, *Filename);
+}
+
+
+bool FPupMovementRecording::LoadFromFile(const FString& Filename)
+{
+	TArray<uint8> Bytes;
+	if (!FFileHelper::LoadFileToArray(Bytes, *Filename))
+	{
+		return false;
+	}
+	FMemoryReader Reader(Bytes);
+	Serialize(Reader);
+	return !Reader.IsError();
+}
+
+
+void FPupMovementRecording::Serialize(FArchive& Ar)
+{
+	uint32 Magic = PupMovementRecording::FileMagic;
+	int32 FileVersion = Version;
+	Ar << Magic;
+	Ar << FileVersion;
+	if (Ar.IsLoading() && (Magic != PupMovementRecording::FileMagic || FileVersion != Version))
+	{
+		// Steps from another version would never match their checksums, so don't even try
+		Ar.SetError();
+		return;
+	}
+
+	Ar << MapName;
+	Ar << TimestepLength;
+	Ar << Tracks;
+	Ar << Frames;
+	Ar << Steps;
+}
+
+
+
+// Recorder
+FPupMovementRecorder::FPupMovementRecorder(const UWorld* World)
+{
+	Recording.MapName = World ? UWorld::RemovePIEPrefix(World->GetMapName()) : FString();
+	Recording.TimestepLength = UPupMovementComponent::GetTimestepLength();
+}
+
+
+void FPupMovementRecorder::RecordStep(const UPupMovementComponent* Pup, const float DeltaTime,
+	const EPupMovementInputAction InputActions)
+{
+	// The input is all in the state already, after being turned into a direction, so record exactly that
+	const FPupMovementComponentState State(Pup);
+	const int32 TrackIndex = FindOrAddTrack(Pup, State);
+	if (TrackIndex == INDEX_NONE)
+	{
+		return;
+	}
+
+	FPupRecordedStep& Step = Recording.Steps.AddDefaulted_GetRef();
+	Step.Track = static_cast<uint16>(TrackIndex);
+	Step.DeltaTime = DeltaTime;
+	Step.DirectionX = State.DirectionVector.X;
+	Step.DirectionY = State.DirectionVector.Y;
+	Step.InputFactor = State.InputFactor;
+	Step.CameraYaw = State.CameraYaw;
+	Step.bIsWalking = State.bIsWalking;
+	Step.bAwake = !State.bResting;
+	Step.MovementLOD = static_cast<uint8>(Pup->GetMovementLOD());
+	Step.InputActions = static_cast<uint8>(InputActions);
+	Step.CharacterActions = static_cast<uint8>(PendingCharacterActions[TrackIndex]);
+	Step.Checksum = State.GetChecksum();
+	PendingCharacterActions[TrackIndex] = EPupRecordedAction::None;
+}
+
+
+void FPupMovementRecorder::RecordCharacterAction(const UPupMovementComponent* Pup, const EPupRecordedAction Action)
+{
+	// A pup that hasn't stepped yet starts its track from a state the action has already changed
+	if (const int32* TrackIndex = TrackIndices.Find(Pup))
+	{
+		PendingCharacterActions[*TrackIndex] |= Action;
+	}
+}
+
+
+void FPupMovementRecorder::EndFrame(const float DeltaTime)
+{
+	FPupRecordedFrame& Frame = Recording.Frames.AddDefaulted_GetRef();
+	Frame.DeltaTime = DeltaTime;
+	Frame.NumSteps = Recording.Steps.Num() - FrameStart;
+	FrameStart = Recording.Steps.Num();
+}
+
+
+int32 FPupMovementRecorder::FindOrAddTrack(const UPupMovementComponent* Pup, const FPupMovementComponentState& State)
+{
+	if (const int32* TrackIndex = TrackIndices.Find(Pup))
+	{
+		return *TrackIndex;
+	}
+	if (Recording.Tracks.Num() > MAX_uint16)
+	{
+		return INDEX_NONE;
+	}
+
+	FPupRecordedTrack& Track = Recording.Tracks.AddDefaulted_GetRef();
+	const AActor* Owner = Pup->GetOwner();
+	Track.OwnerName = Owner ? Owner->GetName() : Pup->GetName();
+	if (const UPrimitiveComponent* Basis = State.BasisComponent.Get())
+	{
+		Track.BasisPath = Basis->GetPathName();
+	}
+
+	FPupMovementComponentState InitialState = State;
+	FMemoryWriter Writer(Track.InitialState);
+	InitialState.SerializeMovement(Writer);
+
+	PendingCharacterActions.Add(EPupRecordedAction::None);
+	return TrackIndices.Add(Pup, Recording.Tracks.Num() - 1);
+}
+
+
+
+// Replayer
+FPupMovementReplayer::FPupMovementReplayer(const TArray<TWeakObjectPtr<UPupMovementComponent>>& WorldPups,
+	FPupMovementRecording&& InRecording) :
+	Recording(MoveTemp(InRecording))
+{
+	const int32 NumTracks = Recording.Tracks.Num();
+	Pups.SetNum(NumTracks);
+	StartedTracks.Init(false, NumTracks);
+	DivergedTracks.Init(false, NumTracks);
+	TrackSteps.SetNumZeroed(NumTracks);
+
+	for (int32 TrackIndex = 0; TrackIndex < NumTracks; TrackIndex++)
+	{
+		const FString& OwnerName = Recording.Tracks[TrackIndex].OwnerName;
+		const TWeakObjectPtr<UPupMovementComponent>* Pup = WorldPups.FindByPredicate(
+			[&OwnerName](const TWeakObjectPtr<UPupMovementComponent>& WorldPup)
+		{
+			return WorldPup.IsValid() && WorldPup->GetOwner() && WorldPup->GetOwner()->GetName() == OwnerName;
+		});
+		if (!Pup)
+		{
+			UE_LOG(LogTetherGame, Warning, TEXT("PupMovement replay: no pup owned by %s in this world, skipping its steps"), *OwnerName);
+			continue;
+		}
+		Pups[TrackIndex] = *Pup;
+		(*Pup)->SetReplaying(true);
+	}
+
+	bWasUsingFixedTimeStep = FApp::UseFixedTimeStep();
+	PreviousFixedDeltaTime = FApp::GetFixedDeltaTime();
+}
+
+
+FPupMovementReplayer::~FPupMovementReplayer()
+{
+	for (const TWeakObjectPtr<UPupMovementComponent>& Pup : Pups)
+	{
+		if (Pup.IsValid())
+		{
+			Pup->SetReplaying(false);
+		}
+	}
+	FApp::SetUseFixedTimeStep(bWasUsingFixedTimeStep);
+	FApp::SetFixedDeltaTime(PreviousFixedDeltaTime);
+}
+
+
+bool FPupMovementReplayer::StepFrame()
+{
+	if (IsFinished())
+	{
+		return false;
+	}
+
+	const double StartTime = FPlatformTime::Seconds();
+	for (int32& NumSteps : TrackSteps)
+	{
+		NumSteps = 0;
+	}
+	const int32 EndStep = FMath::Min(NextStep + Recording.Frames[Frame].NumSteps, Recording.Steps.Num());
+	for (; NextStep < EndStep; NextStep++)
+	{
+		ReplayStep(NextStep);
+	}
+	for (int32 TrackIndex = 0; TrackIndex < Pups.Num(); TrackIndex++)
+	{
+		if (TrackSteps[TrackIndex] > 0 && Pups[TrackIndex].IsValid())
+		{
+			Pups[TrackIndex]->EndFixedSteps(TrackSteps[TrackIndex]);
+		}
+	}
+	SimulationSeconds += FPlatformTime::Seconds() - StartTime;
+	Frame++;
+
+	// Run the next frame exactly as long as the recorded one, so everything else that ticks lines up with the steps
+	if (!IsFinished())
+	{
+		FApp::SetUseFixedTimeStep(true);
+		FApp::SetFixedDeltaTime(Recording.Frames[Frame].DeltaTime);
+	}
+	return true;
+}
+
+
+void FPupMovementReplayer::LogSummary() const
+{
+	UE_LOG(LogTetherGame, Display, TEXT("PupMovement replay of %s: %d steps for %d pups over %d frames, %.3f ms of movement per frame"),
+		*Recording.MapName, NumSimulatedSteps, Recording.Tracks.Num(), Frame,
+		SimulationSeconds * 1000.0 / FMath::Max(Frame, 1));
+	if (NumDivergences == 0)
+	{
+		UE_LOG(LogTetherGame, Display, TEXT("  Every step started from exactly its recorded state"));
+	}
+	else
+	{
+		UE_LOG(LogTetherGame, Warning, TEXT("  %d steps diverged from the recording, the first at step %d"),
+			NumDivergences, FirstDivergentStep);
+	}
+}
+
+
+void FPupMovementReplayer::ReplayStep(const int32 StepIndex)
+{
+	const FPupRecordedStep& Step = Recording.Steps[StepIndex];
+	UPupMovementComponent* Pup = Pups.IsValidIndex(Step.Track) ? Pups[Step.Track].Get() : nullptr;
+	if (!Pup || !Pup->UpdatedComponent)
+	{
+		return;
+	}
+
+	const bool bStarted = StartedTracks[Step.Track];
+	if (!bStarted)
+	{
+		// The first step's input, and any character action before it, are already part of the state it started from
+		StartedTracks[Step.Track] = true;
+		const FPupRecordedTrack& Track = Recording.Tracks[Step.Track];
+		FPupMovementComponentState State;
+		FMemoryReader Reader(Track.InitialState);
+		State.SerializeMovement(Reader);
+		State.BasisComponent = Track.BasisPath.IsEmpty() ? nullptr : FindObject<UPrimitiveComponent>(nullptr, *Track.BasisPath);
+		Pup->RestoreState(State);
+	}
+	else if (ATetherCharacter* Character = Cast<ATetherCharacter>(Pup->GetOwner()))
+	{
+		if (EnumHasAnyFlags(Step.GetCharacterActions(), EPupRecordedAction::Interact))
+		{
+			Character->Interact();
+		}
+		if (EnumHasAnyFlags(Step.GetCharacterActions(), EPupRecordedAction::Release))
+		{
+			Character->Release();
+		}
+	}
+
+	const uint32 Checksum = Pup->SimulateRecordedStep(Step, bStarted);
+	TrackSteps[Step.Track]++;
+	NumSimulatedSteps++;
+
+	UE_LOG(LogTetherGame, VeryVerbose, TEXT("PupMovement replay step %d, %s: %08x (recorded %08x)"),
+		StepIndex, *Recording.Tracks[Step.Track].OwnerName, Checksum, Step.Checksum);
+	if (Checksum == Step.Checksum)
+	{
+		return;
+	}
+
+	NumDivergences++;
+	if (FirstDivergentStep == INDEX_NONE)
+	{
+		FirstDivergentStep = StepIndex;
+	}
+	if (!DivergedTracks[Step.Track])
+	{
+		DivergedTracks[Step.Track] = true;
+		UE_LOG(LogTetherGame, Warning, TEXT("PupMovement replay: %s diverged at step %d, in frame %d (%08x, recorded %08x)"),
+			*Recording.Tracks[Step.Track].OwnerName, StepIndex, Frame, Checksum, Step.Checksum);
+	}
+}
+
+
+
+// Console commands
+namespace PupMovementRecording
+{
+	static void Record(const TArray<FString>& Args, UWorld* World)
+	{
+		APupMovementManager* Manager = APupMovementManager::Get(World);
+		if (!Manager)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("PupMovement recording: only game worlds can be recorded"));
+			return;
+		}
+		if (!Manager->StartRecording())
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("PupMovement recording: can't record while replaying"));
+			return;
+		}
+		UE_LOG(LogTetherGame, Display, TEXT("PupMovement recording started, stop with PupMovement.StopRecording [Name]"));
+	}
+
+
+	static void StopRecording(const TArray<FString>& Args, UWorld* World)
+	{
+		APupMovementManager* Manager = APupMovementManager::Get(World);
+		TUniquePtr<FPupMovementRecorder> Recorder;
+		if (Manager)
+		{
+			Recorder = Manager->StopRecording();
+		}
+		if (!Recorder)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("PupMovement recording: nothing is being recorded"));
+			return;
+		}
+
+		FPupMovementRecording& Recording = Recorder->GetRecording();
+		const FString Name = Args.Num() > 0 ? Args[0] : Recording.MapName + TEXT("-") + FDateTime::Now().ToString();
+		const FString Filename = FPupMovementRecording::GetRecordingPath(Name);
+		if (!Recording.SaveToFile(Filename))
+		{
+			UE_LOG(LogTetherGame, Warning, TEXT("PupMovement recording: couldn't write %s"), *Filename);
+			return;
+		}
+		UE_LOG(LogTetherGame, Display, TEXT("PupMovement recording: saved %d steps for %d pups over %d frames to %s"),
+			Recording.Steps.Num(), Recording.Tracks.Num(), Recording.Frames.Num(), *Filename);
+	}
+
+
+	static void Replay(const TArray<FString>& Args, UWorld* World)
+	{
+		if (Args.Num() == 0)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("Usage: PupMovement.Replay <Name or path> [Exit]"));
+			return;
+		}
+		APupMovementManager* Manager = APupMovementManager::Get(World);
+		if (!Manager)
+		{
+			UE_LOG(LogTetherGame, Display, TEXT("PupMovement replay: recordings can only be replayed in game worlds"));
+			return;
+		}
+
+		const FString Filename = FPupMovementRecording::GetRecordingPath(Args[0]);
+		FPupMovementRecording Recording;
+		if (!Recording.LoadFromFile(Filename))
+		{
+			UE_LOG(LogTetherGame, Warning, TEXT("PupMovement replay: couldn't read %s, or it was recorded by a different version"), *Filename);
+			return;
+		}
+		const FString MapName = UWorld::RemovePIEPrefix(World->GetMapName());
+		if (Recording.MapName != MapName)
+		{
+			UE_LOG(LogTetherGame, Warning, TEXT("PupMovement replay: %s was recorded in %s, not %s"), *Filename, *Recording.MapName, *MapName);
+		}
+
+		const bool bExitWhenDone = Args.Num() > 1 && Args[1].Equals(TEXT("Exit"), ESearchCase::IgnoreCase);
+		UE_LOG(LogTetherGame, Display, TEXT("PupMovement replay: %s, %d frames"), *Filename, Recording.Frames.Num());
+		Manager->StartReplay(MoveTemp(Recording), bExitWhenDone);
+	}
+
+
+	static FAutoConsoleCommandWithWorldAndArgs RecordCommand(
+		TEXT("PupMovement.Record"),
+		TEXT("Start recording every pup's steps, with a checksum of the state each one started from. Usage: PupMovement.Record"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&Record));
+
+
+	static FAutoConsoleCommandWithWorldAndArgs StopRecordingCommand(
+		TEXT("PupMovement.StopRecording"),
+		TEXT("Stop recording and save it, to Saved/PupRecordings unless a path is given. Usage: PupMovement.StopRecording [Name]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&StopRecording));
+
+
+	static FAutoConsoleCommandWithWorldAndArgs ReplayCommand(
+		TEXT("PupMovement.Replay"),
+		TEXT("Replay a recording into the pups it was recorded from, logging the first step each one diverges at and the cost per frame. ")
+		TEXT("With Exit, quits afterwards with a non-zero exit code if anything diverged. Usage: PupMovement.Replay <Name> [Exit]"),
+		FConsoleCommandWithWorldAndArgsDelegate::CreateStatic(&Replay));
+}
@@ -0,0 +1,205 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PupMovementNetworking.h"
+
+class UPupMovementComponent;
+struct FPupMovementComponentState;
+
+
+/** Inputs handled by the character instead of the movement component, which still change how a pup moves **/
+enum class EPupRecordedAction : uint8
+{
+	None		= 0,
+	Interact	= 1 << 0,
+	Release		= 1 << 1
+};
+ENUM_CLASS_FLAGS(EPupRecordedAction);
+
+
+/** The input one pup stepped with, and a checksum of the state the step started from **/
+struct FPupRecordedStep
+{
+	/** Index of the pup's track in the recording **/
+	uint16 Track = 0;
+
+	float DeltaTime = 0.0f;
+
+	/** Exactly what the step was simulated with, since quantizing it would change the result **/
+	float DirectionX = 0.0f;
+	float DirectionY = 0.0f;
+	float InputFactor = 0.0f;
+	float CameraYaw = 0.0f;
+	bool bIsWalking = false;
+
+	/** Pups are woken by overlaps and pushes from things that aren't recorded, so whether the step started awake is part of its input **/
+	bool bAwake = false;
+
+	/** Which queries a step skips depends on its movement LOD, which depends on viewers that aren't recorded **/
+	uint8 MovementLOD = 0;
+
+	/** EPupMovementInputAction flags **/
+	uint8 InputActions = 0;
+
+	/** EPupRecordedAction flags **/
+	uint8 CharacterActions = 0;
+
+	uint32 Checksum = 0;
+
+	FVector GetDirectionVector() const { return FVector(DirectionX, DirectionY, 0.0f); }
+
+	EPupMovementInputAction GetInputActions() const { return static_cast<EPupMovementInputAction>(InputActions); }
+
+	EPupRecordedAction GetCharacterActions() const { return static_cast<EPupRecordedAction>(CharacterActions); }
+
+	friend FArchive& operator<<(FArchive& Ar, FPupRecordedStep& Step);
+};
+
+
+/** A pup that was recorded, and the state it was in when its first step was recorded **/
+struct FPupRecordedTrack
+{
+	/** Name of the pup's owner, which is the same from one run of a level to the next for pups placed in it **/
+	FString OwnerName;
+
+	/** Full path of the pup's basis, which isn't part of the serialized state **/
+	FString BasisPath;
+
+	/** FPupMovementComponentState::SerializeMovement output **/
+	TArray<uint8> InitialState;
+
+	friend FArchive& operator<<(FArchive& Ar, FPupRecordedTrack& Track);
+};
+
+
+/** How long a recorded frame was, and how many steps were taken in it **/
+struct FPupRecordedFrame
+{
+	float DeltaTime = 0.0f;
+	int32 NumSteps = 0;
+
+	friend FArchive& operator<<(FArchive& Ar, FPupRecordedFrame& Frame);
+};
+
+
+/** Every step every pup in a world took over a stretch of frames, in the order they were taken **/
+class TETHER_API FPupMovementRecording
+{
+public:
+	/** Bumped whenever the file layout or the serialized movement state changes, since old checksums would never match **/
+	static constexpr int32 Version = 1;
+
+	/** Where a recording is saved to or loaded from. Plain names go in Saved/PupRecordings. **/
+	static FString GetRecordingPath(const FString& NameOrPath);
+
+	bool SaveToFile(const FString& Filename);
+
+	bool LoadFromFile(const FString& Filename);
+
+	void Serialize(FArchive& Ar);
+
+	FString MapName;
+	float TimestepLength = 0.0f;
+
+	TArray<FPupRecordedTrack> Tracks;
+	TArray<FPupRecordedStep> Steps;
+
+	/** Replayed with the same frame times, so moving platforms and everything else that ticks is where it was each step **/
+	TArray<FPupRecordedFrame> Frames;
+};
+
+
+/** Records the steps of every pup in a world, as they are taken **/
+class TETHER_API FPupMovementRecorder
+{
+public:
+	explicit FPupMovementRecorder(const UWorld* World);
+
+	/**
+	 * Record a step that's about to be simulated. Called once the step's input has been applied, before anything else.
+	 * @param InputActions		The actions applied before the step, which are already part of its state.
+	 **/
+	void RecordStep(const UPupMovementComponent* Pup, const float DeltaTime, const EPupMovementInputAction InputActions);
+
+	/** Record a character action, which goes with the pup's next step **/
+	void RecordCharacterAction(const UPupMovementComponent* Pup, const EPupRecordedAction Action);
+
+	/** Mark the end of a frame's steps **/
+	void EndFrame(const float DeltaTime);
+
+	const FPupMovementRecording& GetRecording() const { return Recording; }
+
+	FPupMovementRecording& GetRecording() { return Recording; }
+
+private:
+	/** Returns INDEX_NONE if there's no room for another track **/
+	int32 FindOrAddTrack(const UPupMovementComponent* Pup, const FPupMovementComponentState& State);
+
+	FPupMovementRecording Recording;
+
+	TMap<TWeakObjectPtr<const UPupMovementComponent>, int32> TrackIndices;
+
+	/** Character actions waiting for their pup's next step, indexed by track **/
+	TArray<EPupRecordedAction> PendingCharacterActions;
+
+	int32 FrameStart = 0;
+};
+
+
+/**
+ * Feeds a recording back into the pups it was recorded from, one recorded frame per frame, and checks each step
+ * started from exactly the state it did when it was recorded.
+ **/
+class TETHER_API FPupMovementReplayer
+{
+public:
+	/**
+	 * Take control of every recorded pup that can be found in the world. Each one is put back where it started
+	 * when its first step is replayed.
+	 **/
+	FPupMovementReplayer(const TArray<TWeakObjectPtr<UPupMovementComponent>>& WorldPups, FPupMovementRecording&& InRecording);
+
+	/** Hands every pup back to its own input, and the engine back to its own frame times **/
+	~FPupMovementReplayer();
+
+	/** Simulate the next recorded frame's steps. False once there are no frames left. **/
+	bool StepFrame();
+
+	bool IsFinished() const { return Frame >= Recording.Frames.Num(); }
+
+	/** Log how long the replay took, and whether it diverged **/
+	void LogSummary() const;
+
+	int32 GetNumDivergences() const { return NumDivergences; }
+
+private:
+	void ReplayStep(const int32 StepIndex);
+
+	FPupMovementRecording Recording;
+
+	/** The pup each track was recorded from, or null if it couldn't be found **/
+	TArray<TWeakObjectPtr<UPupMovementComponent>> Pups;
+
+	/** Has each track simulated a step yet? Its first step starts from its recorded state instead. **/
+	TBitArray<> StartedTracks;
+
+	/** Has each track diverged yet? Only the first divergence is worth logging, since the rest follow from it. **/
+	TBitArray<> DivergedTracks;
+
+	/** How many steps each track took this frame. Kept to avoid allocating every frame. **/
+	TArray<int32> TrackSteps;
+
+	/** The engine's own frame time settings, put back once the replay is done **/
+	bool bWasUsingFixedTimeStep = false;
+	double PreviousFixedDeltaTime = 0.0;
+
+	int32 Frame = 0;
+	int32 NextStep = 0;
+	int32 NumSimulatedSteps = 0;
+	int32 NumDivergences = 0;
+	int32 FirstDivergentStep = INDEX_NONE;
+	double SimulationSeconds = 0.0;
+};
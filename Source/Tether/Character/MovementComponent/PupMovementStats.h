@@ -0,0 +1,223 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "ProfilingDebugging/CsvProfiler.h"
+#include "Stats/Stats.h"
+
+/** Query accounting costs a few increments per query, so it's only compiled in where the stats or a CSV profile can read it **/
+#define PUP_MOVEMENT_STATS (STATS || CSV_PROFILER)
+
+DECLARE_STATS_GROUP(TEXT("PupMovement"), STATGROUP_PupMovement, STATCAT_Advanced);
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Substeps"), STAT_PupMovementSubsteps, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Heightfield Floor Queries"), STAT_PupMovementHeightfieldQueries, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Heightfield Floor Fallbacks"), STAT_PupMovementHeightfieldFallbacks, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Contact Cache Hits"), STAT_PupMovementContactCacheHits, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Contact Cache Misses"), STAT_PupMovementContactCacheMisses, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Prediction Corrections"), STAT_PupMovementCorrections, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Async Query Hits"), STAT_PupMovementAsyncQueryHits, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Async Query Fallbacks"), STAT_PupMovementAsyncQueryFallbacks, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Sweeps"), STAT_PupMovementSweeps, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Line Traces"), STAT_PupMovementLineTraces, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Closest Point Queries"), STAT_PupMovementClosestPoints, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Overlaps"), STAT_PupMovementOverlaps, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Pups Stepped"), STAT_PupMovementPupsStepped, STATGROUP_PupMovement, TETHER_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Sweeps Per Pup"), STAT_PupMovementSweepsPerPup, STATGROUP_PupMovement, TETHER_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Line Traces Per Pup"), STAT_PupMovementLineTracesPerPup, STATGROUP_PupMovement, TETHER_API);
+DECLARE_FLOAT_COUNTER_STAT_EXTERN(TEXT("Closest Point Queries Per Pup"), STAT_PupMovementClosestPointsPerPup, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Most Queries By One Pup"), STAT_PupMovementMaxPupQueries, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Steps With 1 Substep"), STAT_PupMovementSubsteps1, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Steps With 2 Substeps"), STAT_PupMovementSubsteps2, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Steps With 3-4 Substeps"), STAT_PupMovementSubsteps4, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Steps With 5-8 Substeps"), STAT_PupMovementSubsteps8, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Steps With 9+ Substeps"), STAT_PupMovementSubstepsMore, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Slices Fully Resolved"), STAT_PupMovementRemainingNone, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Slices With Under 25% Left"), STAT_PupMovementRemainingQuarter, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Slices With Under 50% Left"), STAT_PupMovementRemainingHalf, STATGROUP_PupMovement, TETHER_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Slices With 50%+ Left"), STAT_PupMovementRemainingMore, STATGROUP_PupMovement, TETHER_API);
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Step Walking"), STAT_PupMovementStepWalking, STATGROUP_PupMovement, TETHER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Step Falling"), STAT_PupMovementStepFalling, STATGROUP_PupMovement, TETHER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Step Anchored"), STAT_PupMovementStepAnchored, STATGROUP_PupMovement, TETHER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Step Deflected"), STAT_PupMovementStepDeflected, STATGROUP_PupMovement, TETHER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Step Recover"), STAT_PupMovementStepRecover, STATGROUP_PupMovement, TETHER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Step Dragging"), STAT_PupMovementStepDragging, STATGROUP_PupMovement, TETHER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Prefetch Step Queries"), STAT_PupMovementPrefetch, STATGROUP_PupMovement, TETHER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Step Movement"), STAT_PupMovementStepMovement, STATGROUP_PupMovement, TETHER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Substep Movement"), STAT_PupMovementSubstepMovement, STATGROUP_PupMovement, TETHER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Find Floor"), STAT_PupMovementFindFloor, STATGROUP_PupMovement, TETHER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Mantle"), STAT_PupMovementMantle, STATGROUP_PupMovement, TETHER_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Edge Slide"), STAT_PupMovementEdgeSlide, STATGROUP_PupMovement, TETHER_API);
+
+CSV_DECLARE_CATEGORY_EXTERN(PupMovement);
+
+/** Time a scope in both the stats system and CSV profiles, which are also captured in test builds **/
+#define PUP_MOVEMENT_SCOPE_CYCLE_COUNTER(Stat) \
+	SCOPE_CYCLE_COUNTER(STAT_PupMovement##Stat); \
+	CSV_SCOPED_TIMING_STAT(PupMovement, Stat)
+
+
+enum class EPupMovementQuery : uint8
+{
+	Sweep,
+	LineTrace,
+	ClosestPoint,
+	Overlap,
+	Num
+};
+
+
+/**
+ * What a pup's movement cost it since the movement manager last published the frame's stats.
+ * Counts are also added to the frame's stats as they happen, so pups without a manager still show up in them.
+ **/
+struct FPupMovementFrameStats
+{
+	int32 Steps = 0;
+
+	/** Scene queries run, indexed by EPupMovementQuery **/
+	int32 Queries[static_cast<int32>(EPupMovementQuery::Num)] = {};
+
+	/** Steps, by how many substeps their sweeps took: 1, 2, 3-4, 5-8, and more **/
+	int32 SubstepHistogram[5] = {};
+
+	/** Collision slices, by how much of their time was left when they ran out of substeps: none, under 25%, under 50%, and more **/
+	int32 RemainingTimeHistogram[4] = {};
+
+	/** Queries the contact cache ruled out, and queries it couldn't and so went to the physics scene **/
+	int32 ContactCacheHits = 0;
+	int32 ContactCacheMisses = 0;
+
+	void AddQuery(const EPupMovementQuery Query, const int32 Count = 1)
+	{
+#if PUP_MOVEMENT_STATS
+		Queries[static_cast<int32>(Query)] += Count;
+		switch (Query)
+		{
+		case EPupMovementQuery::Sweep:
+			INC_DWORD_STAT_BY(STAT_PupMovementSweeps, Count);
+			break;
+		case EPupMovementQuery::LineTrace:
+			INC_DWORD_STAT_BY(STAT_PupMovementLineTraces, Count);
+			break;
+		case EPupMovementQuery::ClosestPoint:
+			INC_DWORD_STAT_BY(STAT_PupMovementClosestPoints, Count);
+			break;
+		case EPupMovementQuery::Overlap:
+			INC_DWORD_STAT_BY(STAT_PupMovementOverlaps, Count);
+			break;
+		default:
+			break;
+		}
+#endif
+	}
+
+	void AddSubsteps(const int32 NumSubsteps)
+	{
+#if PUP_MOVEMENT_STATS
+		if (NumSubsteps <= 1)
+		{
+			SubstepHistogram[0]++;
+			INC_DWORD_STAT(STAT_PupMovementSubsteps1);
+		}
+		else if (NumSubsteps == 2)
+		{
+			SubstepHistogram[1]++;
+			INC_DWORD_STAT(STAT_PupMovementSubsteps2);
+		}
+		else if (NumSubsteps <= 4)
+		{
+			SubstepHistogram[2]++;
+			INC_DWORD_STAT(STAT_PupMovementSubsteps4);
+		}
+		else if (NumSubsteps <= 8)
+		{
+			SubstepHistogram[3]++;
+			INC_DWORD_STAT(STAT_PupMovementSubsteps8);
+		}
+		else
+		{
+			SubstepHistogram[4]++;
+			INC_DWORD_STAT(STAT_PupMovementSubstepsMore);
+		}
+#endif
+	}
+
+	/** @param RemainingFraction	How much of a slice's time was left unresolved, from 0 to 1 **/
+	void AddRemainingTime(const float RemainingFraction)
+	{
+#if PUP_MOVEMENT_STATS
+		if (RemainingFraction <= KINDA_SMALL_NUMBER)
+		{
+			RemainingTimeHistogram[0]++;
+			INC_DWORD_STAT(STAT_PupMovementRemainingNone);
+		}
+		else if (RemainingFraction < 0.25f)
+		{
+			RemainingTimeHistogram[1]++;
+			INC_DWORD_STAT(STAT_PupMovementRemainingQuarter);
+		}
+		else if (RemainingFraction < 0.5f)
+		{
+			RemainingTimeHistogram[2]++;
+			INC_DWORD_STAT(STAT_PupMovementRemainingHalf);
+		}
+		else
+		{
+			RemainingTimeHistogram[3]++;
+			INC_DWORD_STAT(STAT_PupMovementRemainingMore);
+		}
+#endif
+	}
+
+	void AddContactCacheResult(const bool bMayHit)
+	{
+#if PUP_MOVEMENT_STATS
+		if (bMayHit)
+		{
+			ContactCacheMisses++;
+			INC_DWORD_STAT(STAT_PupMovementContactCacheMisses);
+		}
+		else
+		{
+			ContactCacheHits++;
+			INC_DWORD_STAT(STAT_PupMovementContactCacheHits);
+		}
+#endif
+	}
+
+	void Accumulate(const FPupMovementFrameStats& Other)
+	{
+		Steps += Other.Steps;
+		ContactCacheHits += Other.ContactCacheHits;
+		ContactCacheMisses += Other.ContactCacheMisses;
+		for (int32 Index = 0; Index < UE_ARRAY_COUNT(Queries); Index++)
+		{
+			Queries[Index] += Other.Queries[Index];
+		}
+		for (int32 Index = 0; Index < UE_ARRAY_COUNT(SubstepHistogram); Index++)
+		{
+			SubstepHistogram[Index] += Other.SubstepHistogram[Index];
+		}
+		for (int32 Index = 0; Index < UE_ARRAY_COUNT(RemainingTimeHistogram); Index++)
+		{
+			RemainingTimeHistogram[Index] += Other.RemainingTimeHistogram[Index];
+		}
+	}
+
+	int32 GetQueries(const EPupMovementQuery Query) const { return Queries[static_cast<int32>(Query)]; }
+
+	int32 GetTotalQueries() const
+	{
+		int32 Total = 0;
+		for (const int32 Count : Queries)
+		{
+			Total += Count;
+		}
+		return Total;
+	}
+
+	void Reset() { *this = FPupMovementFrameStats(); }
+};
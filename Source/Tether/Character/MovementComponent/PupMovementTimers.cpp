@@ -0,0 +1,85 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupMovementTimers.h"
+
+
+void FPupMovementTimers::Set(const EPupMovementTimer Timer, const float Duration)
+{
+	if (Duration <= 0.0f)
+	{
+		Clear(Timer);
+		return;
+	}
+
+	Remaining[static_cast<int32>(Timer)] = Duration;
+	ActiveTimers |= GetTimerBit(Timer);
+}
+
+
+void FPupMovementTimers::Clear(const EPupMovementTimer Timer)
+{
+	Remaining[static_cast<int32>(Timer)] = 0.0f;
+	ActiveTimers &= ~GetTimerBit(Timer);
+}
+
+
+void FPupMovementTimers::ClearAll()
+{
+	for (float& Time : Remaining)
+	{
+		Time = 0.0f;
+	}
+	ActiveTimers = 0;
+}
+
+
+bool FPupMovementTimers::IsActive(const EPupMovementTimer Timer) const
+{
+	return (ActiveTimers & GetTimerBit(Timer)) != 0;
+}
+
+
+float FPupMovementTimers::GetRemaining(const EPupMovementTimer Timer) const
+{
+	return IsActive(Timer) ? Remaining[static_cast<int32>(Timer)] : 0.0f;
+}
+
+
+uint32 FPupMovementTimers::Advance(const float DeltaTime)
+{
+	if (bPaused || ActiveTimers == 0)
+	{
+		return 0;
+	}
+
+	uint32 ExpiredTimers = 0;
+	for (int32 Index = 0; Index < NumTimers; Index++)
+	{
+		const uint32 TimerBit = 1u << Index;
+		if ((ActiveTimers & TimerBit) == 0)
+		{
+			continue;
+		}
+
+		Remaining[Index] -= DeltaTime;
+		if (Remaining[Index] <= 0.0f)
+		{
+			Remaining[Index] = 0.0f;
+			ActiveTimers &= ~TimerBit;
+			ExpiredTimers |= TimerBit;
+		}
+	}
+	return ExpiredTimers;
+}
+
+
+FArchive& operator<<(FArchive& Ar, FPupMovementTimers& Timers)
+{
+	for (float& Time : Timers.Remaining)
+	{
+		Ar << Time;
+	}
+	Ar << Timers.ActiveTimers;
+	Ar << Timers.bPaused;
+	return Ar;
+}
@@ -0,0 +1,75 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/** Every timer the pup movement component can run **/
+enum class EPupMovementTimer : uint8
+{
+	/** Stop allowing jumps if we walked off a ledge and haven't landed **/
+	Coyote,
+	/** Stop applying the held jump velocity **/
+	Jump,
+	/** Try to regain control after a deflection **/
+	Deflect,
+	/** Teleport back to the last valid location after falling off the stage **/
+	Recovery,
+	/** Allow mantling again after letting go of an anchor **/
+	MantleDebounce,
+	/** Give back air control after a wall jump **/
+	WallJumpControl,
+	Dash,
+	EdgeScramble,
+	/** Keep trying a jump that was pressed when we couldn't jump, in case we can soon **/
+	JumpBuffer,
+	/** Keep trying a dash that was pressed when we couldn't dash **/
+	DashBuffer,
+
+	Count
+};
+
+
+/**
+ * A fixed table of countdown timers, advanced by the movement simulation itself.
+ * Timers only run while movement steps run, so they stay in sync with the simulation and can be copied for snapshots.
+ **/
+struct TETHER_API FPupMovementTimers
+{
+	/** Start a timer, replacing any time left on it. Timers with no duration are cleared instead. **/
+	void Set(const EPupMovementTimer Timer, const float Duration);
+
+	void Clear(const EPupMovementTimer Timer);
+
+	void ClearAll();
+
+	bool IsActive(const EPupMovementTimer Timer) const;
+
+	/** Time left on a timer, or 0 if it isn't running **/
+	float GetRemaining(const EPupMovementTimer Timer) const;
+
+	/**
+	 * Count down every running timer.
+	 * @returns a bit mask of the timers that expired, indexed by EPupMovementTimer
+	 **/
+	uint32 Advance(const float DeltaTime);
+
+	void SetPaused(const bool bInPaused) { bPaused = bInPaused; }
+
+	bool IsPaused() const { return bPaused; }
+
+	static uint32 GetTimerBit(const EPupMovementTimer Timer) { return 1u << static_cast<uint32>(Timer); }
+
+	friend TETHER_API FArchive& operator<<(FArchive& Ar, FPupMovementTimers& Timers);
+
+private:
+	static constexpr int32 NumTimers = static_cast<int32>(EPupMovementTimer::Count);
+
+	float Remaining[NumTimers] = {};
+
+	/** Bit mask of running timers, indexed by EPupMovementTimer **/
+	uint32 ActiveTimers = 0;
+
+	bool bPaused = false;
+};
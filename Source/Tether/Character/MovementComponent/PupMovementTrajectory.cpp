@@ -0,0 +1,193 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "PupMovementTrajectory.h"
+
+
+namespace PupMovementTrajectory
+{
+	/**
+	 * The first time from now that a height, moving with constant acceleration, comes down through TargetZ.
+	 * @returns a negative number if it never does
+	 **/
+	static float FindDescent(const float Z, const float VelocityZ, const float AccelerationZ, const float TargetZ)
+	{
+		if (FMath::IsNearlyZero(AccelerationZ))
+		{
+			return VelocityZ < 0.0f && Z >= TargetZ ? (TargetZ - Z) / VelocityZ : -1.0f;
+		}
+		const float Discriminant = VelocityZ * VelocityZ - 2.0f * AccelerationZ * (Z - TargetZ);
+		if (Discriminant < 0.0f)
+		{
+			return -1.0f;
+		}
+		const float Root = FMath::Sqrt(Discriminant);
+		const float Times[] = {
+			FMath::Min((-VelocityZ - Root) / AccelerationZ, (-VelocityZ + Root) / AccelerationZ),
+			FMath::Max((-VelocityZ - Root) / AccelerationZ, (-VelocityZ + Root) / AccelerationZ)
+		};
+		for (const float Time : Times)
+		{
+			if (Time >= 0.0f && VelocityZ + AccelerationZ * Time <= 0.0f)
+			{
+				return Time;
+			}
+		}
+		return -1.0f;
+	}
+
+
+	/** How far planar velocity moves in Time while being steered from Velocity towards Target at Acceleration **/
+	static FVector SteerOffset(const FVector& Velocity, const FVector& Target, const float Acceleration, const float Time)
+	{
+		const FVector Difference = Target - Velocity;
+		const float Distance = Difference.Size();
+		if (Acceleration <= 0.0f || Distance <= KINDA_SMALL_NUMBER)
+		{
+			return (Acceleration <= 0.0f ? Velocity : Target) * Time;
+		}
+		const FVector Direction = Difference / Distance;
+		const float SteerTime = FMath::Min(Time, Distance / Acceleration);
+		return Velocity * SteerTime + Direction * (0.5f * Acceleration * SteerTime * SteerTime) + Target * (Time - SteerTime);
+	}
+
+
+	static FVector SteerVelocity(const FVector& Velocity, const FVector& Target, const float Acceleration, const float Time)
+	{
+		if (Acceleration <= 0.0f)
+		{
+			return Velocity;
+		}
+		return Velocity + (Target - Velocity).GetClampedToMaxSize(Acceleration * Time);
+	}
+
+
+	static FVector Planar(const FVector& Vector)
+	{
+		return FVector(Vector.X, Vector.Y, 0.0f);
+	}
+}
+
+
+FPupTrajectory FPupTrajectory::Predict(const FPupTrajectoryLaunch& InLaunch, const float LandingZ)
+{
+	FPupTrajectory Trajectory;
+	Trajectory.Launch = InLaunch;
+	const FPupTrajectoryLaunch& Launch = Trajectory.Launch;
+
+	// Rising while the jump is held, then under gravity alone
+	const float HoldTime = FMath::Max(Launch.HoldTime, 0.0f);
+	const float HoldAccelerationZ = Launch.GravityZ + Launch.HoldAcceleration;
+	const float HeldVelocityZ = Launch.Velocity.Z + HoldAccelerationZ * HoldTime;
+	if (Launch.Velocity.Z > 0.0f && HoldAccelerationZ < 0.0f && -Launch.Velocity.Z / HoldAccelerationZ <= HoldTime)
+	{
+		Trajectory.ApexTime = -Launch.Velocity.Z / HoldAccelerationZ;
+	}
+	else if (HeldVelocityZ > 0.0f && Launch.GravityZ < 0.0f)
+	{
+		Trajectory.ApexTime = HoldTime - HeldVelocityZ / Launch.GravityZ;
+	}
+	else
+	{
+		Trajectory.ApexTime = HeldVelocityZ > 0.0f ? HoldTime : 0.0f;
+	}
+	Trajectory.Apex = Trajectory.GetLocation(Trajectory.ApexTime);
+
+	Trajectory.Airtime = Trajectory.FindDescentTime(LandingZ);
+	Trajectory.bLands = Trajectory.Airtime >= 0.0f;
+	if (Trajectory.bLands)
+	{
+		Trajectory.Landing = Trajectory.GetLocation(Trajectory.Airtime);
+	}
+	else
+	{
+		Trajectory.Airtime = 0.0f;
+	}
+	return Trajectory;
+}
+
+
+FVector FPupTrajectory::GetLocation(const float Time) const
+{
+	using namespace PupMovementTrajectory;
+
+	const float HoldTime = FMath::Max(Launch.HoldTime, 0.0f);
+	const float HoldAccelerationZ = Launch.GravityZ + Launch.HoldAcceleration;
+	float Z;
+	if (Time <= HoldTime)
+	{
+		Z = Launch.Velocity.Z * Time + 0.5f * HoldAccelerationZ * Time * Time;
+	}
+	else
+	{
+		const float FallTime = Time - HoldTime;
+		Z = Launch.Velocity.Z * HoldTime + 0.5f * HoldAccelerationZ * HoldTime * HoldTime +
+			(Launch.Velocity.Z + HoldAccelerationZ * HoldTime) * FallTime + 0.5f * Launch.GravityZ * FallTime * FallTime;
+	}
+
+	FVector Offset;
+	const float CoastTime = FMath::Max(Launch.CoastTime, 0.0f);
+	if (CoastTime > 0.0f)
+	{
+		const FVector CoastVelocity = Planar(Launch.CoastVelocity);
+		Offset = CoastVelocity * FMath::Min(Time, CoastTime);
+		if (Time > CoastTime)
+		{
+			Offset += SteerOffset(CoastVelocity, Planar(Launch.TargetVelocity), Launch.AirAcceleration, Time - CoastTime);
+		}
+	}
+	else
+	{
+		Offset = SteerOffset(Planar(Launch.Velocity), Planar(Launch.TargetVelocity), Launch.AirAcceleration, Time);
+	}
+	Offset.Z = Z;
+	return Launch.Location + Offset;
+}
+
+
+FVector FPupTrajectory::GetVelocity(const float Time) const
+{
+	using namespace PupMovementTrajectory;
+
+	const float HoldTime = FMath::Max(Launch.HoldTime, 0.0f);
+	const float HoldAccelerationZ = Launch.GravityZ + Launch.HoldAcceleration;
+	const float VelocityZ = Time <= HoldTime ?
+		Launch.Velocity.Z + HoldAccelerationZ * Time :
+		Launch.Velocity.Z + HoldAccelerationZ * HoldTime + Launch.GravityZ * (Time - HoldTime);
+
+	const float CoastTime = FMath::Max(Launch.CoastTime, 0.0f);
+	FVector Velocity;
+	if (CoastTime > 0.0f)
+	{
+		Velocity = Time <= CoastTime ?
+			Planar(Launch.CoastVelocity) :
+			SteerVelocity(Planar(Launch.CoastVelocity), Planar(Launch.TargetVelocity), Launch.AirAcceleration, Time - CoastTime);
+	}
+	else
+	{
+		Velocity = SteerVelocity(Planar(Launch.Velocity), Planar(Launch.TargetVelocity), Launch.AirAcceleration, Time);
+	}
+	Velocity.Z = VelocityZ;
+	return Velocity;
+}
+
+
+float FPupTrajectory::FindDescentTime(const float Z) const
+{
+	using namespace PupMovementTrajectory;
+
+	const float HoldTime = FMath::Max(Launch.HoldTime, 0.0f);
+	const float HoldAccelerationZ = Launch.GravityZ + Launch.HoldAcceleration;
+	if (HoldTime > 0.0f)
+	{
+		const float HeldTime = FindDescent(Launch.Location.Z, Launch.Velocity.Z, HoldAccelerationZ, Z);
+		if (HeldTime >= 0.0f && HeldTime <= HoldTime)
+		{
+			return HeldTime;
+		}
+	}
+
+	const float HeldZ = Launch.Location.Z + Launch.Velocity.Z * HoldTime + 0.5f * HoldAccelerationZ * HoldTime * HoldTime;
+	const float HeldVelocityZ = Launch.Velocity.Z + HoldAccelerationZ * HoldTime;
+	const float FallTime = FindDescent(HeldZ, HeldVelocityZ, Launch.GravityZ, Z);
+	return FallTime >= 0.0f ? HoldTime + FallTime : -1.0f;
+}
@@ -0,0 +1,74 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PupMovementTrajectory.generated.h"
+
+
+/**
+ * How a flight through the air starts, and what shapes it. Built by UPupMovementComponent from its settings and state.
+ * Follows the falling movement mode: a single gravity, extra upward acceleration while a jump is held, and planar
+ * velocity steered towards a target at a constant rate.
+ **/
+struct FPupTrajectoryLaunch
+{
+	FVector Location = FVector::ZeroVector;
+	FVector Velocity = FVector::ZeroVector;
+	float GravityZ = 0.0f;
+
+	/** Extra upward acceleration while the jump is held, and for how long it's held **/
+	float HoldAcceleration = 0.0f;
+	float HoldTime = 0.0f;
+
+	/** Planar velocity kept no matter what, e.g. while dashing or after a wall jump, and for how long **/
+	FVector CoastVelocity = FVector::ZeroVector;
+	float CoastTime = 0.0f;
+
+	/** Planar velocity steered towards once coasting is over, and how quickly **/
+	FVector TargetVelocity = FVector::ZeroVector;
+	float AirAcceleration = 0.0f;
+};
+
+
+/** A predicted flight, worked out in closed form instead of by simulating it step by step **/
+USTRUCT(BlueprintType)
+struct TETHER_API FPupTrajectory
+{
+	GENERATED_BODY()
+
+	/** Predict a flight until it comes back down to LandingZ, ignoring anything in the way **/
+	static FPupTrajectory Predict(const FPupTrajectoryLaunch& InLaunch, const float LandingZ);
+
+	/** Where the flight is after Time seconds, ignoring anything in the way **/
+	FVector GetLocation(const float Time) const;
+
+	FVector GetVelocity(const float Time) const;
+
+	/** The first time after the apex that the flight comes down to Z, or a negative number if it never does **/
+	float FindDescentTime(const float Z) const;
+
+	UPROPERTY(BlueprintReadOnly)
+	FVector Apex = FVector::ZeroVector;
+
+	UPROPERTY(BlueprintReadOnly)
+	float ApexTime = 0.0f;
+
+	/** Where the flight comes back down. Only meaningful if bLands is set. **/
+	UPROPERTY(BlueprintReadOnly)
+	FVector Landing = FVector::ZeroVector;
+
+	UPROPERTY(BlueprintReadOnly)
+	float Airtime = 0.0f;
+
+	/** Does the flight ever come back down to the landing height? **/
+	UPROPERTY(BlueprintReadOnly)
+	bool bLands = false;
+
+	/** Did a collision check find something in the way before the landing height? Landing is then where it hit. **/
+	UPROPERTY(BlueprintReadOnly)
+	bool bBlocked = false;
+
+	FPupTrajectoryLaunch Launch;
+};
@@ -60,6 +60,10 @@ ATetherCharacter::ATetherCharacter(const FObjectInitializer& ObjectInitializer)
 	
 	PrimaryActorTick.bCanEverTick = true;
 	PrimaryActorTick.bStartWithTickEnabled = true;
+
+	// The owning client predicts its own movement, and everyone else sees the server's replicated movement
+	SetReplicates(true);
+	SetReplicatingMovement(true);
 }
 
 
@@ -91,6 +95,7 @@ void ATetherCharacter::BeginPlay()
 {
 	Super::BeginPlay();
 
+	MovementComponent->OnJumpEvent(FVector::ZeroVector, false).AddDynamic(this, &ATetherCharacter::HandleJumpEvent);
 	MovementComponent->OnForceDragReleaseEvent().AddWeakLambda(this, [this]
 	{
 		// The Movement component has initiated the break, so we *must not* instruct it to do anything else
@@ -192,7 +197,15 @@ void ATetherCharacter::Reload()
 
 void ATetherCharacter::Jump()
 {
-	if (MovementComponent->Jump())
+	// Jumps happen in the movement step, which might not be until the press has been held on to for a while
+	MovementComponent->HandleInputAction(EPupMovementInputAction::Jump);
+}
+
+
+void ATetherCharacter::HandleJumpEvent(const FVector FloorLocation, const bool bInitialJump)
+{
+	// Jumps simulated again after a network correction have already been shown
+	if (IsLocallyControlled() && !MovementComponent->IsResimulating())
 	{
 		OnJump();
 	}
@@ -204,7 +217,7 @@ void ATetherCharacter::Jump()
 // ReSharper disable CppMemberFunctionMayBeConst
 void ATetherCharacter::StopJumping()
 {
-	MovementComponent->StopJumping();
+	MovementComponent->HandleInputAction(EPupMovementInputAction::StopJumping);
 }
 
 
@@ -241,6 +254,7 @@ void ATetherCharacter::RotateY(const float Scale)
 
 void ATetherCharacter::Interact()
 {
+	MovementComponent->RecordCharacterAction(EPupRecordedAction::Interact);
 	{
 		if (bCarryingObject)
 		{
@@ -308,12 +322,13 @@ void ATetherCharacter::Interact()
 
 void ATetherCharacter::Dash()
 {
-	MovementComponent->Dash();
+	MovementComponent->HandleInputAction(EPupMovementInputAction::Dash);
 }
 
 
 void ATetherCharacter::Release()
 {
+	MovementComponent->RecordCharacterAction(EPupRecordedAction::Release);
 	if (MovementComponent->GetMovementMode() == EPupMovementMode::M_Anchored)
 	{
 		MovementComponent->BreakAnchor();
@@ -455,8 +470,7 @@ void ATetherCharacter::EndRecovery()
 
 void ATetherCharacter::HandlePenetration(const FHitResult& HitResult)
 {
-	// Todo: accumulate worst penetration and resolve during physics update
-		
+	// Penetrations are accumulated and resolved together during the next movement step
 	if (GetLocalRole() >= ROLE_AutonomousProxy && CapsuleComponent && MovementComponent)
 	{
 		const FVector RequestedAdjustment = MovementComponent->GetPenetrationAdjustment(HitResult);
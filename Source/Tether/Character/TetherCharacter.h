@@ -79,6 +79,9 @@ public:
 	
 	void Interact();
 
+	/** Let go of whatever we're anchored to or dragging **/
+	void Release();
+
 	void Dash();
 
 	/**
@@ -189,6 +192,9 @@ private:
 
 	UFUNCTION()
 	void OnTetherExpired();
+
+	UFUNCTION()
+	void HandleJumpEvent(const FVector FloorLocation, const bool bInitialJump);
 	
 	
 	// Animation tracking
@@ -207,7 +213,6 @@ private:
 
 	void AnchorToObject(AActor* Object) const;
 	void AnchorToComponent(UPrimitiveComponent* Component, const FVector& Location = FVector::ZeroVector) const;
-	void Release();
 
 	bool bCompletedPickupAnimation = false;
 	float SnapFactor = 0.0f;
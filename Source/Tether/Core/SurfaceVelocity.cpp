@@ -0,0 +1,22 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#include "SurfaceVelocity.h"
+
+
+const UObject* ISurfaceVelocity::FindSurfaceVelocitySource(const UPrimitiveComponent* Component)
+{
+	if (!Component)
+	{
+		return nullptr;
+	}
+	if (Component->Implements<USurfaceVelocity>())
+	{
+		return Component;
+	}
+	const AActor* Owner = Component->GetOwner();
+	if (Owner && Owner->Implements<USurfaceVelocity>())
+	{
+		return Owner;
+	}
+	return nullptr;
+}
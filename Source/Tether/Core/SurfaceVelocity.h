@@ -0,0 +1,32 @@
+// Copyright (c) 2021 Spencer Melnick, Stephen Melnick
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "SurfaceVelocity.generated.h"
+
+UINTERFACE(Blueprintable)
+class USurfaceVelocity : public UInterface
+{
+	GENERATED_BODY()
+};
+
+/**
+ * Interface for surfaces that carry anything standing on them along without moving themselves, like conveyor belts
+ * and treadmills. Can be implemented by a primitive component, or by the actor that owns it.
+ **/
+class TETHER_API ISurfaceVelocity
+{
+	GENERATED_BODY()
+
+public:
+
+	/** The velocity given to anything standing on this surface, in world space **/
+	UFUNCTION(BlueprintCallable, BlueprintNativeEvent)
+	FVector GetSurfaceVelocity() const;
+
+	virtual FVector GetSurfaceVelocity_Implementation() const { return FVector::ZeroVector; }
+
+	/** Find whatever gives a component its surface velocity: the component itself, or failing that, its owner **/
+	static const UObject* FindSurfaceVelocitySource(const UPrimitiveComponent* Component);
+};
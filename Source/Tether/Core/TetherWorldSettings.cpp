@@ -3,6 +3,8 @@
 
 #include "TetherWorldSettings.h"
 #include "Tether/Tether.h"
+#include "Tether/Character/MovementComponent/PupFloorHeightfield.h"
+#include "Tether/Character/MovementComponent/PupMovementComponent.h"
 
 APlayerStart* ATetherWorldSettings::GetPlayerStart(const int Index)
 {
@@ -16,3 +18,22 @@ APlayerStart* ATetherWorldSettings::GetPlayerStart(const int Index)
 		return nullptr;
 	}
 }
+
+
+#if WITH_EDITOR
+void ATetherWorldSettings::BakeFloorHeightfield()
+{
+	Modify();
+
+	if (!FloorHeightfield)
+	{
+		FloorHeightfield = NewObject<UPupFloorHeightfield>(this, TEXT("FloorHeightfield"), RF_Transactional);
+	}
+
+	FloorHeightfield->Modify();
+	FloorHeightfield->Bake(GetWorld(), FloorHeightfieldCellSize,
+		GetDefault<UPupMovementComponent>()->GetMovementSettings().MaxInclineZComponent, FloorHeightfieldLayerSeparation);
+
+	MarkPackageDirty();
+}
+#endif
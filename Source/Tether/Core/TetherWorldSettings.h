@@ -7,6 +7,7 @@
 #include "TetherWorldSettings.generated.h"
 
 class APlayerStart;
+class UPupFloorHeightfield;
 /**
  * 
  */
@@ -22,4 +23,21 @@ public:
 	
 	UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Spawning")
 	TArray<APlayerStart*> DefaultPlayerStarts;
+
+#if WITH_EDITOR
+	/** Rebuild the floor heightfield pups use to find static floors without sweeping **/
+	UFUNCTION(CallInEditor, Category = "Movement")
+	void BakeFloorHeightfield();
+#endif
+
+	/** Width of each floor heightfield cell. Smaller cells fit edges more tightly at the cost of memory. **/
+	UPROPERTY(EditAnywhere, Category = "Movement", meta = (ClampMin = 1.0f))
+	float FloorHeightfieldCellSize = 25.0f;
+
+	/** How far below a floor another floor must be before the column is considered layered and left to sweeps **/
+	UPROPERTY(EditAnywhere, Category = "Movement", meta = (ClampMin = 0.0f))
+	float FloorHeightfieldLayerSeparation = 100.0f;
+
+	UPROPERTY(VisibleAnywhere, Category = "Movement")
+	UPupFloorHeightfield* FloorHeightfield;
 };
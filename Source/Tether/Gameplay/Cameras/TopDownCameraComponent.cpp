@@ -85,7 +85,8 @@ void UTopDownCameraComponent::AddCameraRotation(const FRotator Rotator)
 
 FVector UTopDownCameraComponent::CalcDeltaLocation(const float DeltaTime)
 {
-	SubjectLocation = Subject->GetActorLocation() + Subject->EyeHeight * FVector::UpVector;
+	// Track the interpolated location, so the camera doesn't stutter along with fixed movement steps
+	SubjectLocation = Subject->MovementComponent->GetPresentationLocation() + Subject->EyeHeight * FVector::UpVector;
 	const FVector Velocity = Subject->IsSuspended() ? FVector::ZeroVector : Subject->GetVelocity();
 	DesiredFocalPoint =  SubjectLocation + (Velocity * TrackAnticipationTime).GetClampedToMaxSize(MaxAnticipation);
 	FocalPoint = FMath::VInterpTo(FocalPoint, DesiredFocalPoint, DeltaTime, TrackingSpeed);
@@ -6,10 +6,11 @@
 
 #include "Components/ArrowComponent.h"
 #include "Components/BoxComponent.h"
+#include "Tether/Core/SurfaceVelocity.h"
 #include "Conveyor.generated.h"
 
 UCLASS( ClassGroup=(Custom), meta=(BlueprintSpawnableComponent) )
-class TETHER_API UConveyorComponent : public UBoxComponent
+class TETHER_API UConveyorComponent : public UBoxComponent, public ISurfaceVelocity
 {
 	GENERATED_BODY()
 	
@@ -26,6 +27,12 @@ public:
 
 	FVector GetAppliedVelocity() const;
 
+	void SetBeltVelocity(const FVector& NewBeltVelocity) { BeltVelocity = NewBeltVelocity; }
+
+	// Surface velocity interface
+
+	virtual FVector GetSurfaceVelocity_Implementation() const override { return GetAppliedVelocity(); }
+
 
 private:
 	UPROPERTY(EditAnywhere)